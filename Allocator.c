@@ -0,0 +1,90 @@
+/** vim: set noet ci pi sts=0 sw=4 ts=4
+ * @file Allocator.c
+ * @brief The allocator all of SAL's memory comes from.
+ *
+ * Until SAL_Allocator_Set is called blocks come from the Utilities Allocate
+ * and Free macros, as they always have. Once hooks are installed every
+ * structure, buffer and digest SAL allocates goes through them instead, which
+ * lets an application place SAL's memory in its own pools, or count and trace
+ * it. The hooks are process-wide: they cannot scope SAL's memory to a request
+ * and release it in one shot.
+ */
+
+#include "Allocator.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <Utilities/Memory.h>
+
+static SAL_Allocator hooks = { NULL, NULL, NULL };
+
+/**
+ * Route SAL's allocations through @a allocator.
+ *
+ * @param allocator Hooks to use, copied, or NULL to go back to the Utilities
+ * allocator. Allocate must return blocks aligned for any type; it need not
+ * clear them. It must not fail: SAL has no way to report running out of
+ * memory, so a NULL from Allocate aborts the process.
+ *
+ * @warning Call this before any other SAL function, and do not change it while
+ * SAL holds memory from the previous allocator: a block is always handed back
+ * to whichever allocator is installed when it is freed. SAL draws blocks it
+ * keeps for the life of the process from the hooks too, such as the reactors,
+ * their receive buffer slabs and each thread's statistics, so the hooks must
+ * stay valid until the process exits. An arena reset after each request
+ * cannot be installed here.
+ */
+void SAL_Allocator_Set(const SAL_Allocator* allocator) {
+	if (allocator == NULL) {
+		hooks.Allocate = NULL;
+		hooks.Free = NULL;
+		hooks.State = NULL;
+
+		return;
+	}
+
+	assert(allocator->Allocate != NULL);
+	assert(allocator->Free != NULL);
+
+	hooks = *allocator;
+}
+
+/**
+ * Allocate @a size bytes from the installed allocator.
+ *
+ * @param size Bytes to allocate
+ * @returns the zero-filled block.
+ *
+ * @warning Free the block with @ref SAL_Allocator_Free.
+ */
+void* SAL_Allocator_Allocate(uint64 size) {
+	void* block;
+
+	if (hooks.Allocate == NULL)
+		return AllocateArray(uint8, size);
+
+	block = (*hooks.Allocate)(hooks.State, size);
+
+	/* no caller checks for NULL, writing through it would be worse than stopping here */
+	if (block == NULL)
+		abort();
+
+	memset(block, 0, size);
+
+	return block;
+}
+
+/**
+ * Free @a block, from @ref SAL_Allocator_Allocate or returned by a SAL function.
+ *
+ * @param block Block to free, NULL is ignored
+ */
+void SAL_Allocator_Free(void* block) {
+	if (block == NULL)
+		return;
+
+	if (hooks.Free == NULL)
+		Free(block);
+	else
+		(*hooks.Free)(hooks.State, block);
+}
@@ -0,0 +1,23 @@
+#ifndef INCLUDE_SAL_ALLOCATOR
+#define INCLUDE_SAL_ALLOCATOR
+
+#include "Common.h"
+
+typedef void* (*SAL_Allocator_AllocateCallback)(void* state, uint64 size);
+typedef void (*SAL_Allocator_FreeCallback)(void* state, void* block);
+
+/* hooks every allocation SAL makes goes through, see SAL_Allocator_Set */
+typedef struct {
+	SAL_Allocator_AllocateCallback Allocate;
+	SAL_Allocator_FreeCallback Free;
+	void* State; /* passed to both callbacks */
+} SAL_Allocator;
+
+#define SAL_Allocator_New(type) ((type*)SAL_Allocator_Allocate(sizeof(type)))
+#define SAL_Allocator_NewArray(type, count) ((type*)SAL_Allocator_Allocate((uint64)sizeof(type) * (count)))
+
+public void SAL_Allocator_Set(const SAL_Allocator* allocator);
+public void* SAL_Allocator_Allocate(uint64 size);
+public void SAL_Allocator_Free(void* block);
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef INCLUDE_SAL_ATOMIC
+#define INCLUDE_SAL_ATOMIC
+
+#include "Common.h"
+
+/*
+ * Atomic operations on naturally aligned 32-bit, 64-bit and pointer-sized
+ * values. Read-modify-write operations are sequentially consistent, loads
+ * acquire and stores release.
+ */
+#ifdef _MSC_VER
+	#include <intrin.h>
+
+	#define SAL_Atomic_Load32(target) (*(volatile uint32*)(target))
+	#define SAL_Atomic_Store32(target, value) (*(volatile uint32*)(target) = (value))
+	#define SAL_Atomic_Increment32(target) ((uint32)_InterlockedIncrement((volatile long*)(target)))
+	#define SAL_Atomic_Decrement32(target) ((uint32)_InterlockedDecrement((volatile long*)(target)))
+	#define SAL_Atomic_Add32(target, value) ((uint32)_InterlockedExchangeAdd((volatile long*)(target), (long)(value)) + (uint32)(value))
+	#define SAL_Atomic_Exchange32(target, value) ((uint32)_InterlockedExchange((volatile long*)(target), (long)(value)))
+	#define SAL_Atomic_CompareExchange32(target, expected, desired) ((uint32)_InterlockedCompareExchange((volatile long*)(target), (long)(desired), (long)(expected)) == (uint32)(expected))
+
+	#if defined _M_ARM64
+		#define SAL_Atomic_Pause() __yield()
+	#else
+		#define SAL_Atomic_Pause() _mm_pause()
+	#endif
+
+	/* a full barrier: interlocked operations are one on every target MSVC supports */
+	static __inline void SAL_Atomic_Fence(void) {
+		volatile long barrier = 0;
+
+		_InterlockedExchange(&barrier, 0);
+	}
+
+	#define SAL_Atomic_Load64(target) ((uint64)_InterlockedCompareExchange64((volatile __int64*)(target), 0, 0))
+	#define SAL_Atomic_Add64(target, value) ((uint64)_InterlockedExchangeAdd64((volatile __int64*)(target), (__int64)(value)) + (uint64)(value))
+	#ifdef _WIN64
+		#define SAL_Atomic_Store64(target, value) (*(volatile uint64*)(target) = (value))
+	#else
+		/* 32-bit x86 has no single 64-bit store outside cmpxchg8b */
+		static __inline void SAL_Atomic_Store64(volatile uint64* target, uint64 value) {
+			__int64 seen;
+
+			do {
+				seen = *(volatile __int64*)target;
+			} while (_InterlockedCompareExchange64((volatile __int64*)target, (__int64)value, seen) != seen);
+		}
+	#endif
+
+	#define SAL_Atomic_LoadPointer(target) (*(void* volatile*)(target))
+	#define SAL_Atomic_StorePointer(target, value) (*(void* volatile*)(target) = (void*)(value))
+	#define SAL_Atomic_ExchangePointer(target, value) _InterlockedExchangePointer((void* volatile*)(target), (void*)(value))
+	#define SAL_Atomic_CompareExchangePointer(target, expected, desired) (_InterlockedCompareExchangePointer((void* volatile*)(target), (void*)(desired), (void*)(expected)) == (void*)(expected))
+#else
+	#define SAL_Atomic_Load32(target) __atomic_load_n((uint32*)(target), __ATOMIC_ACQUIRE)
+	#define SAL_Atomic_Store32(target, value) __atomic_store_n((uint32*)(target), (value), __ATOMIC_RELEASE)
+	#define SAL_Atomic_Increment32(target) __atomic_add_fetch((uint32*)(target), 1, __ATOMIC_SEQ_CST)
+	#define SAL_Atomic_Decrement32(target) __atomic_sub_fetch((uint32*)(target), 1, __ATOMIC_SEQ_CST)
+	#define SAL_Atomic_Add32(target, value) __atomic_add_fetch((uint32*)(target), (uint32)(value), __ATOMIC_SEQ_CST)
+	#define SAL_Atomic_Exchange32(target, value) __atomic_exchange_n((uint32*)(target), (uint32)(value), __ATOMIC_SEQ_CST)
+	#define SAL_Atomic_CompareExchange32(target, expected, desired) __sync_bool_compare_and_swap((uint32*)(target), (uint32)(expected), (uint32)(desired))
+
+	#define SAL_Atomic_Fence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+	/* tells the processor this is a spin-wait loop */
+	#if defined __x86_64__ || defined __i386__
+		#define SAL_Atomic_Pause() __builtin_ia32_pause()
+	#elif defined __aarch64__ || defined __arm__
+		#define SAL_Atomic_Pause() __asm__ __volatile__("yield")
+	#else
+		#define SAL_Atomic_Pause() ((void)0)
+	#endif
+
+	#define SAL_Atomic_Load64(target) __atomic_load_n((uint64*)(target), __ATOMIC_ACQUIRE)
+	#define SAL_Atomic_Store64(target, value) __atomic_store_n((uint64*)(target), (value), __ATOMIC_RELEASE)
+	#define SAL_Atomic_Add64(target, value) __atomic_add_fetch((uint64*)(target), (uint64)(value), __ATOMIC_SEQ_CST)
+
+	#define SAL_Atomic_LoadPointer(target) __atomic_load_n((void**)(target), __ATOMIC_ACQUIRE)
+	#define SAL_Atomic_StorePointer(target, value) __atomic_store_n((void**)(target), (void*)(value), __ATOMIC_RELEASE)
+	#define SAL_Atomic_ExchangePointer(target, value) __atomic_exchange_n((void**)(target), (void*)(value), __ATOMIC_SEQ_CST)
+	#define SAL_Atomic_CompareExchangePointer(target, expected, desired) __sync_bool_compare_and_swap((void**)(target), (void*)(expected), (void*)(desired))
+#endif
+
+#endif
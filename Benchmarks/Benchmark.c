@@ -0,0 +1,809 @@
+/** vim: set noet ci pi sts=0 sw=4 ts=4
+ * @file Benchmark.c
+ * @brief sal_bench, micro-benchmarks of the reactor, locks, hashing, random
+ * numbers and clocks.
+ *
+ * Every result is printed as one JSON object per line so runs can be
+ * collected and compared over time. Each object names its benchmark and the
+ * parameters it ran with, followed by what was measured. Pass benchmark names
+ * (tcp, accept, locks, hash, random, time) to run only those.
+ */
+
+#include "Atomic.h"
+#include "Cryptography.h"
+#include "Socket.h"
+#include "Thread.h"
+#include "Time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef POSIX
+	#include <signal.h>
+	#include <unistd.h>
+	#include <sys/resource.h>
+#endif
+
+/* how long each measurement runs for, in ns */
+#define SAL_Bench_Duration 500000000
+
+/* the TCP benchmarks open this many connections at each step */
+#define SAL_Bench_ConnectionSteps 3
+static const uint32 connectionSteps[SAL_Bench_ConnectionSteps] = { 1, 100, 10000 };
+
+/* bytes each round trip of the latency benchmark sends, and each write of the throughput benchmark */
+#define SAL_Bench_MessageSize 64
+#define SAL_Bench_ChunkSize 16384
+
+/* most round trips timed per latency run */
+#define SAL_Bench_MaxSamples 100000
+
+/* the lock benchmarks run at each of these thread counts */
+#define SAL_Bench_ThreadSteps 5
+static const uint32 threadSteps[SAL_Bench_ThreadSteps] = { 1, 2, 4, 8, 16 };
+
+/* lock round trips made by all threads of one contention run together */
+#define SAL_Bench_LockOperations 2000000
+
+#define SAL_Bench_HashSizes 8
+static const uint32 hashSizes[SAL_Bench_HashSizes] = { 16, 64, 256, 1024, 4096, 16384, 65536, 1048576 };
+
+/* messages hashed per SAL_Cryptography_SHA1Batch call */
+#define SAL_Bench_BatchCount 16
+
+/* runs its benchmark @a iterations times */
+typedef void (*SAL_Bench_Body)(void* const state, uint64 iterations);
+
+static int8** selected = NULL;
+static uint32 selectedCount = 0;
+static uint16 nextPort = 0;
+
+/* results go out as they are made, so a run cut short still leaves every finished line */
+static void SAL_Bench_Begin(const int8* name) {
+	printf("{\"benchmark\":\"%s\"", name);
+}
+
+static void SAL_Bench_Integer(const int8* key, uint64 value) {
+	printf(",\"%s\":%llu", key, (unsigned long long)value);
+}
+
+static void SAL_Bench_Real(const int8* key, double value) {
+	printf(",\"%s\":%.6g", key, value);
+}
+
+static void SAL_Bench_String(const int8* key, const int8* value) {
+	printf(",\"%s\":\"%s\"", key, value);
+}
+
+static void SAL_Bench_End(void) {
+	printf("}\n");
+	fflush(stdout);
+}
+
+/* whether @a name was asked for, every benchmark is when none were named */
+static boolean SAL_Bench_IsSelected(const int8* name) {
+	uint32 i;
+
+	if (selectedCount == 0)
+		return true;
+
+	for (i = 0; i < selectedCount; i++)
+		if (strcmp(selected[i], name) == 0)
+			return true;
+
+	return false;
+}
+
+/* runs @a body in growing batches until SAL_Bench_Duration has passed, returning the seconds taken and the iterations run */
+static double SAL_Bench_Measure(SAL_Bench_Body body, void* const state, uint64* iterations) {
+	uint64 batch;
+	int64 started;
+	int64 elapsed;
+
+	*iterations = 0;
+	batch = 1;
+	started = SAL_Time_MonotonicNanoseconds();
+
+	do {
+		body(state, batch);
+		*iterations += batch;
+		batch *= 2;
+		elapsed = SAL_Time_MonotonicNanoseconds() - started;
+	} while (elapsed < SAL_Bench_Duration);
+
+	return (double)elapsed / 1e9;
+}
+
+/* ascending order for qsort */
+static int SAL_Bench_CompareSamples(const void* left, const void* right) {
+	int64 a = *(const int64*)left;
+	int64 b = *(const int64*)right;
+
+	return a < b ? -1 : a > b;
+}
+
+/* lets the process hold @a connections connections at both ends, false where the limit cannot be raised that far */
+static boolean SAL_Bench_RaiseDescriptorLimit(uint32 connections) {
+#ifdef POSIX
+	struct rlimit limit;
+	rlim_t needed = (rlim_t)connections * 2 + 64;
+
+	if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+		return false;
+
+	if (limit.rlim_cur >= needed)
+		return true;
+
+	if (limit.rlim_max != RLIM_INFINITY && limit.rlim_max < needed)
+		return false;
+
+	limit.rlim_cur = needed;
+
+	return setrlimit(RLIMIT_NOFILE, &limit) == 0;
+#else
+	return true;
+#endif
+}
+
+/* raises the descriptor limit for @a connections, or reports benchmark @a name as skipped */
+static boolean SAL_Bench_CanConnect(const int8* name, uint32 connections) {
+	if (SAL_Bench_RaiseDescriptorLimit(connections))
+		return true;
+
+	SAL_Bench_Begin(name);
+	SAL_Bench_Integer("connections", connections);
+	SAL_Bench_String("skipped", "descriptor limit too low");
+	SAL_Bench_End();
+
+	return false;
+}
+
+/* the server side of the TCP benchmarks, run by the reactors */
+typedef struct {
+	SAL_Socket* Listener;
+	int8 Port[8];
+	boolean Echo; /* send every message back, otherwise just drain */
+	uint32 Accepted;
+} SAL_Bench_Server;
+
+static void SAL_Bench_Server_Receive(SAL_Socket* socket, SAL_Socket_Buffer* buffer, uint32 length, void* const state) {
+	SAL_Bench_Server* server = (SAL_Bench_Server*)state;
+
+	if (buffer == NULL) {
+		SAL_Socket_Close(socket);
+		return;
+	}
+
+	if (server->Echo)
+		SAL_Socket_Write(socket, buffer->Data, length);
+}
+
+static void SAL_Bench_Server_Accept(SAL_Socket* listener, SAL_Socket** sockets, uint32 count, void* const state) {
+	SAL_Bench_Server* server = (SAL_Bench_Server*)state;
+	uint32 i;
+
+	(void)listener;
+
+	for (i = 0; i < count; i++) {
+		SAL_Socket_SetNoDelay(sockets[i], true);
+		SAL_Socket_SetReceiveCallback(sockets[i], SAL_Bench_Server_Receive, server);
+	}
+
+	SAL_Atomic_Add32(&server->Accepted, count);
+}
+
+/* closes each accepted connection straight away */
+static void SAL_Bench_Server_AcceptAndClose(SAL_Socket* listener, SAL_Socket** sockets, uint32 count, void* const state) {
+	SAL_Bench_Server* server = (SAL_Bench_Server*)state;
+	uint32 i;
+
+	(void)listener;
+
+	for (i = 0; i < count; i++)
+		SAL_Socket_Close(sockets[i]);
+
+	SAL_Atomic_Add32(&server->Accepted, count);
+}
+
+/* listens on the next free loopback port with @a callback taking the connections */
+static boolean SAL_Bench_Server_Start(SAL_Bench_Server* server, boolean echo, SAL_Socket_AcceptCallback callback) {
+	uint32 attempt;
+
+	server->Echo = echo;
+	server->Accepted = 0;
+
+	for (attempt = 0; attempt < 100; attempt++) {
+		snprintf(server->Port, sizeof(server->Port), "%u", (uint32)nextPort++);
+
+		server->Listener = SAL_Socket_Listen(server->Port, SAL_Socket_Families_IPV4, SAL_Socket_Types_TCP);
+		if (server->Listener == NULL)
+			continue;
+
+		SAL_Socket_SetNonBlocking(server->Listener, true);
+		SAL_Socket_SetAcceptCallback(server->Listener, callback, server);
+
+		return true;
+	}
+
+	return false;
+}
+
+/* opens @a count blocking client connections, returning how many succeeded */
+static uint32 SAL_Bench_Connect(SAL_Bench_Server* server, SAL_Socket** clients, uint32 count) {
+	int64 started;
+	uint32 i;
+
+	for (i = 0; i < count; i++) {
+		clients[i] = SAL_Socket_Connect("127.0.0.1", server->Port, SAL_Socket_Families_IPV4, SAL_Socket_Types_TCP);
+		if (clients[i] == NULL)
+			break;
+
+		SAL_Socket_SetNoDelay(clients[i], true);
+	}
+
+	/* the server registers them from its accept callback, reads sent before that would still arrive */
+	started = SAL_Time_MonotonicNanoseconds();
+
+	while (SAL_Atomic_Load32(&server->Accepted) < i && SAL_Time_MonotonicNanoseconds() - started < 10 * (int64)SAL_Bench_Duration)
+		SAL_Thread_Sleep(1);
+
+	return i;
+}
+
+static void SAL_Bench_Disconnect(SAL_Bench_Server* server, SAL_Socket** clients, uint32 count) {
+	uint32 i;
+
+	for (i = 0; i < count; i++)
+		SAL_Socket_Close(clients[i]);
+
+	SAL_Socket_Close(server->Listener);
+}
+
+/* a latency run: every connection keeps one message in flight, the reactors time each round trip and send the next */
+typedef struct {
+	uint8 Message[SAL_Bench_MessageSize];
+	int64* Samples;
+	uint32 Count; /* round trips completed, the first SAL_Bench_MaxSamples of them timed */
+	uint32 Stopping;
+	uint32 Finished; /* connections whose last reply came back after Stopping was set, or that failed */
+} SAL_Bench_Latency;
+
+typedef struct {
+	SAL_Bench_Latency* Run;
+	SAL_Socket* Socket;
+	int64 Sent;
+	uint32 Received; /* bytes of the current reply so far */
+	boolean Done;
+} SAL_Bench_Client;
+
+/* takes a connection out of the run, once */
+static void SAL_Bench_Client_Finish(SAL_Bench_Client* client) {
+	if (client->Done)
+		return;
+
+	client->Done = true;
+	SAL_Atomic_Increment32(&client->Run->Finished);
+}
+
+static void SAL_Bench_Client_Send(SAL_Bench_Client* client) {
+	client->Received = 0;
+	client->Sent = SAL_Time_MonotonicNanoseconds();
+
+	if (SAL_Socket_Write(client->Socket, client->Run->Message, SAL_Bench_MessageSize) != SAL_Bench_MessageSize)
+		SAL_Bench_Client_Finish(client);
+}
+
+static void SAL_Bench_Client_Receive(SAL_Socket* socket, SAL_Socket_Buffer* buffer, uint32 length, void* const state) {
+	SAL_Bench_Client* client = (SAL_Bench_Client*)state;
+	SAL_Bench_Latency* run = client->Run;
+	int64 elapsed;
+	uint32 index;
+
+	(void)socket;
+
+	if (buffer == NULL) {
+		SAL_Bench_Client_Finish(client);
+		return;
+	}
+
+	client->Received += length;
+	if (client->Received < SAL_Bench_MessageSize)
+		return;
+
+	elapsed = SAL_Time_MonotonicNanoseconds() - client->Sent;
+
+	index = SAL_Atomic_Increment32(&run->Count) - 1;
+	if (index < SAL_Bench_MaxSamples)
+		run->Samples[index] = elapsed;
+
+	if (SAL_Atomic_Load32(&run->Stopping))
+		SAL_Bench_Client_Finish(client);
+	else
+		SAL_Bench_Client_Send(client);
+}
+
+/* round trips of one small message, with one in flight on each of @a connections open connections so they all load the reactors */
+static void SAL_Bench_TCPLatency(uint32 connections) {
+	SAL_Bench_Server server;
+	SAL_Bench_Latency run;
+	SAL_Bench_Client* clientStates;
+	SAL_Socket** clients;
+	uint32 opened;
+	uint32 count;
+	uint32 i;
+	int64 started;
+	int64 elapsed;
+
+	if (!SAL_Bench_CanConnect("tcp_latency", connections) || !SAL_Bench_Server_Start(&server, true, SAL_Bench_Server_Accept))
+		return;
+
+	clients = (SAL_Socket**)calloc(connections, sizeof(SAL_Socket*));
+	clientStates = (SAL_Bench_Client*)calloc(connections, sizeof(SAL_Bench_Client));
+	run.Samples = (int64*)calloc(SAL_Bench_MaxSamples, sizeof(int64));
+	run.Count = 0;
+	run.Stopping = 0;
+	run.Finished = 0;
+	memset(run.Message, 'x', sizeof(run.Message));
+
+	opened = SAL_Bench_Connect(&server, clients, connections);
+
+	started = SAL_Time_MonotonicNanoseconds();
+
+	for (i = 0; i < opened; i++) {
+		clientStates[i].Run = &run;
+		clientStates[i].Socket = clients[i];
+
+		SAL_Socket_SetNonBlocking(clients[i], true);
+		SAL_Socket_SetReceiveCallback(clients[i], SAL_Bench_Client_Receive, &clientStates[i]);
+	}
+
+	/* the receive callbacks keep every connection busy from its first message on */
+	for (i = 0; i < opened; i++)
+		SAL_Bench_Client_Send(&clientStates[i]);
+
+	do {
+		SAL_Thread_Sleep(1);
+		elapsed = SAL_Time_MonotonicNanoseconds() - started;
+	} while (elapsed < SAL_Bench_Duration && SAL_Atomic_Load32(&run.Count) < SAL_Bench_MaxSamples && SAL_Atomic_Load32(&run.Finished) < opened);
+
+	/* the last replies are waited for, so no callback is running on a client when it is closed */
+	SAL_Atomic_Store32(&run.Stopping, 1);
+
+	while (SAL_Atomic_Load32(&run.Finished) < opened && SAL_Time_MonotonicNanoseconds() - started < 10 * (int64)SAL_Bench_Duration)
+		SAL_Thread_Sleep(1);
+
+	count = SAL_Atomic_Load32(&run.Count);
+	if (count > SAL_Bench_MaxSamples)
+		count = SAL_Bench_MaxSamples;
+
+	qsort(run.Samples, count, sizeof(int64), SAL_Bench_CompareSamples);
+
+	SAL_Bench_Begin("tcp_latency");
+	SAL_Bench_Integer("connections", opened);
+	SAL_Bench_Integer("in_flight", opened);
+	SAL_Bench_Integer("message_bytes", SAL_Bench_MessageSize);
+	SAL_Bench_Integer("round_trips", SAL_Atomic_Load32(&run.Count));
+	SAL_Bench_Real("round_trips_per_second", (double)SAL_Atomic_Load32(&run.Count) * 1e9 / (double)elapsed);
+	if (count > 0) {
+		SAL_Bench_Integer("p50_ns", (uint64)run.Samples[count / 2]);
+		SAL_Bench_Integer("p99_ns", (uint64)run.Samples[(uint64)count * 99 / 100]);
+		SAL_Bench_Integer("max_ns", (uint64)run.Samples[count - 1]);
+	}
+	SAL_Bench_End();
+
+	SAL_Bench_Disconnect(&server, clients, opened);
+	free(run.Samples);
+	free(clientStates);
+	free(clients);
+}
+
+/* streams chunks round-robin over @a connections connections into servers that drain them */
+static void SAL_Bench_TCPThroughput(uint32 connections) {
+	SAL_Bench_Server server;
+	SAL_Socket_Statistics statistics;
+	SAL_Socket** clients;
+	uint8* chunk;
+	uint64 startRead;
+	uint64 written;
+	uint32 opened;
+	uint32 i;
+	int64 started;
+	int64 elapsed;
+
+	if (!SAL_Bench_CanConnect("tcp_throughput", connections) || !SAL_Bench_Server_Start(&server, false, SAL_Bench_Server_Accept))
+		return;
+
+	clients = (SAL_Socket**)calloc(connections, sizeof(SAL_Socket*));
+	chunk = (uint8*)calloc(SAL_Bench_ChunkSize, 1);
+
+	opened = SAL_Bench_Connect(&server, clients, connections);
+
+	/* the clients only write, so every byte read in the process is one the servers took */
+	SAL_Socket_GetStatistics(&statistics);
+	startRead = statistics.IO.BytesRead;
+
+	written = 0;
+	started = SAL_Time_MonotonicNanoseconds();
+
+	for (i = 0; opened > 0 && SAL_Time_MonotonicNanoseconds() - started < SAL_Bench_Duration; i++) {
+		if (SAL_Socket_EnsureWrite(clients[i % opened], chunk, SAL_Bench_ChunkSize, 100) != SAL_Bench_ChunkSize)
+			break;
+
+		written += SAL_Bench_ChunkSize;
+	}
+
+	do {
+		SAL_Socket_GetStatistics(&statistics);
+		elapsed = SAL_Time_MonotonicNanoseconds() - started;
+	} while (statistics.IO.BytesRead - startRead < written && elapsed < 10 * (int64)SAL_Bench_Duration);
+
+	SAL_Bench_Begin("tcp_throughput");
+	SAL_Bench_Integer("connections", opened);
+	SAL_Bench_Integer("chunk_bytes", SAL_Bench_ChunkSize);
+	SAL_Bench_Integer("bytes", statistics.IO.BytesRead - startRead);
+	SAL_Bench_Real("seconds", (double)elapsed / 1e9);
+	SAL_Bench_Real("bytes_per_second", (double)(statistics.IO.BytesRead - startRead) * 1e9 / (double)elapsed);
+	SAL_Bench_End();
+
+	SAL_Bench_Disconnect(&server, clients, opened);
+	free(chunk);
+	free(clients);
+}
+
+/* connects and closes as fast as one client can, the server closing each connection as it accepts it */
+static void SAL_Bench_AcceptRate(void) {
+	SAL_Bench_Server server;
+	SAL_Socket* client;
+	uint32 connected;
+	int64 started;
+	int64 elapsed;
+
+	if (!SAL_Bench_Server_Start(&server, false, SAL_Bench_Server_AcceptAndClose))
+		return;
+
+	connected = 0;
+	started = SAL_Time_MonotonicNanoseconds();
+
+	while (SAL_Time_MonotonicNanoseconds() - started < SAL_Bench_Duration) {
+		client = SAL_Socket_Connect("127.0.0.1", server.Port, SAL_Socket_Families_IPV4, SAL_Socket_Types_TCP);
+		if (client == NULL)
+			break;
+
+		SAL_Socket_Close(client);
+		connected++;
+	}
+
+	do {
+		elapsed = SAL_Time_MonotonicNanoseconds() - started;
+	} while (SAL_Atomic_Load32(&server.Accepted) < connected && elapsed < 10 * (int64)SAL_Bench_Duration);
+
+	SAL_Bench_Begin("accept");
+	SAL_Bench_Integer("connections", SAL_Atomic_Load32(&server.Accepted));
+	SAL_Bench_Real("seconds", (double)elapsed / 1e9);
+	SAL_Bench_Real("accepts_per_second", (double)SAL_Atomic_Load32(&server.Accepted) * 1e9 / (double)elapsed);
+	SAL_Bench_End();
+
+	SAL_Socket_Close(server.Listener);
+}
+
+/* what the threads of one contention run share */
+typedef struct {
+	uint32 Kind;
+	uint32 Operations; /* per thread */
+	uint32 Go;
+	SAL_Mutex Mutex;
+	SAL_Lock Lock;
+	SAL_RWLock RWLock;
+	SAL_Semaphore Semaphore;
+	SAL_FastSemaphore FastSemaphore;
+	uint64 Counter; /* touched under the lock so the critical section is not empty */
+} SAL_Bench_Contention;
+
+#define SAL_Bench_Kinds 5
+static const int8* const kindNames[SAL_Bench_Kinds] = { "mutex", "lock", "rwlock_write", "semaphore", "fast_semaphore" };
+
+static SAL_Thread_Start(SAL_Bench_Contend) {
+	SAL_Bench_Contention* contention = (SAL_Bench_Contention*)startupArgument;
+	uint32 i;
+
+	while (!SAL_Atomic_Load32(&contention->Go))
+		SAL_Atomic_Pause();
+
+	for (i = 0; i < contention->Operations; i++) {
+		switch (contention->Kind) {
+			case 0:
+				SAL_Mutex_Acquire(contention->Mutex);
+				contention->Counter++;
+				SAL_Mutex_Release(contention->Mutex);
+				break;
+
+			case 1:
+				SAL_Lock_Acquire(&contention->Lock);
+				contention->Counter++;
+				SAL_Lock_Release(&contention->Lock);
+				break;
+
+			case 2:
+				SAL_RWLock_AcquireWrite(&contention->RWLock);
+				contention->Counter++;
+				SAL_RWLock_ReleaseWrite(&contention->RWLock);
+				break;
+
+			case 3:
+				/* the count starts at one, so it works as a binary semaphore guarding the counter */
+				SAL_Semaphore_Decrement(contention->Semaphore);
+				contention->Counter++;
+				SAL_Semaphore_Increment(contention->Semaphore);
+				break;
+
+			case 4:
+				SAL_FastSemaphore_Decrement(&contention->FastSemaphore);
+				contention->Counter++;
+				SAL_FastSemaphore_Increment(&contention->FastSemaphore, 1);
+				break;
+		}
+	}
+
+	return 0;
+}
+
+/* every lock kind at every thread count, the same total work split between the threads */
+static void SAL_Bench_Locks(void) {
+	SAL_Bench_Contention contention;
+	SAL_Thread threads[16];
+	uint32 kind;
+	uint32 step;
+	uint32 count;
+	uint32 i;
+	int64 started;
+	int64 elapsed;
+
+	for (kind = 0; kind < SAL_Bench_Kinds; kind++) {
+		for (step = 0; step < SAL_Bench_ThreadSteps; step++) {
+			count = threadSteps[step];
+
+			memset(&contention, 0, sizeof(SAL_Bench_Contention));
+			contention.Kind = kind;
+			contention.Operations = SAL_Bench_LockOperations / count;
+			contention.Mutex = SAL_Mutex_Create();
+			contention.Semaphore = SAL_Semaphore_Create();
+			SAL_Semaphore_Increment(contention.Semaphore);
+			SAL_FastSemaphore_Initialize(&contention.FastSemaphore, 1);
+
+			for (i = 0; i < count; i++)
+				threads[i] = SAL_Thread_Create(SAL_Bench_Contend, &contention);
+
+			started = SAL_Time_MonotonicNanoseconds();
+			SAL_Atomic_Store32(&contention.Go, 1);
+
+			for (i = 0; i < count; i++)
+				SAL_Thread_Join(threads[i]);
+
+			elapsed = SAL_Time_MonotonicNanoseconds() - started;
+
+			SAL_Bench_Begin(kindNames[kind]);
+			SAL_Bench_Integer("threads", count);
+			SAL_Bench_Integer("operations", contention.Counter);
+			SAL_Bench_Real("seconds", (double)elapsed / 1e9);
+			SAL_Bench_Real("operations_per_second", (double)contention.Counter * 1e9 / (double)elapsed);
+			SAL_Bench_End();
+
+			SAL_Mutex_Free(contention.Mutex);
+			SAL_Semaphore_Free(contention.Semaphore);
+		}
+	}
+}
+
+typedef struct {
+	uint8* Data;
+	uint32 Length;
+	const uint8* Sources[SAL_Bench_BatchCount];
+	uint32 Lengths[SAL_Bench_BatchCount];
+	uint8 Digests[SAL_Bench_BatchCount * SAL_Cryptography_SHA512Length];
+} SAL_Bench_Hashing;
+
+static void SAL_Bench_SHA1(void* const state, uint64 iterations) {
+	SAL_Bench_Hashing* hashing = (SAL_Bench_Hashing*)state;
+
+	while (iterations--)
+		SAL_Cryptography_SHA1Into(hashing->Data, hashing->Length, hashing->Digests);
+}
+
+static void SAL_Bench_SHA512(void* const state, uint64 iterations) {
+	SAL_Bench_Hashing* hashing = (SAL_Bench_Hashing*)state;
+
+	while (iterations--)
+		SAL_Cryptography_SHA512Into(hashing->Data, hashing->Length, hashing->Digests);
+}
+
+static void SAL_Bench_SHA1Batch(void* const state, uint64 iterations) {
+	SAL_Bench_Hashing* hashing = (SAL_Bench_Hashing*)state;
+
+	while (iterations--)
+		SAL_Cryptography_SHA1Batch(hashing->Sources, hashing->Lengths, SAL_Bench_BatchCount, hashing->Digests);
+}
+
+static void SAL_Bench_SHA512Batch(void* const state, uint64 iterations) {
+	SAL_Bench_Hashing* hashing = (SAL_Bench_Hashing*)state;
+
+	while (iterations--)
+		SAL_Cryptography_SHA512Batch(hashing->Sources, hashing->Lengths, SAL_Bench_BatchCount, hashing->Digests);
+}
+
+/* reports one hashing run, @a messages being hashed per iteration */
+static void SAL_Bench_ReportHash(const int8* name, SAL_Bench_Body body, SAL_Bench_Hashing* hashing, uint32 messages) {
+	uint64 iterations;
+	double seconds;
+
+	seconds = SAL_Bench_Measure(body, hashing, &iterations);
+
+	SAL_Bench_Begin(name);
+	SAL_Bench_Integer("size", hashing->Length);
+	SAL_Bench_Integer("messages", iterations * messages);
+	SAL_Bench_Real("seconds", seconds);
+	SAL_Bench_Real("bytes_per_second", (double)iterations * messages * hashing->Length / seconds);
+	SAL_Bench_Real("ns_per_message", seconds * 1e9 / (double)(iterations * messages));
+	SAL_Bench_End();
+}
+
+static void SAL_Bench_Hash(void) {
+	SAL_Bench_Hashing hashing;
+	uint32 size;
+	uint32 i;
+
+	hashing.Data = (uint8*)malloc(hashSizes[SAL_Bench_HashSizes - 1] * SAL_Bench_BatchCount);
+	memset(hashing.Data, 0x5A, hashSizes[SAL_Bench_HashSizes - 1] * SAL_Bench_BatchCount);
+
+	for (size = 0; size < SAL_Bench_HashSizes; size++) {
+		hashing.Length = hashSizes[size];
+
+		for (i = 0; i < SAL_Bench_BatchCount; i++) {
+			hashing.Sources[i] = hashing.Data + i * hashing.Length;
+			hashing.Lengths[i] = hashing.Length;
+		}
+
+		SAL_Bench_ReportHash("sha1", SAL_Bench_SHA1, &hashing, 1);
+		SAL_Bench_ReportHash("sha512", SAL_Bench_SHA512, &hashing, 1);
+
+		/* batching is for many small messages, large ones gain nothing */
+		if (hashing.Length <= 4096) {
+			SAL_Bench_ReportHash("sha1_batch", SAL_Bench_SHA1Batch, &hashing, SAL_Bench_BatchCount);
+			SAL_Bench_ReportHash("sha512_batch", SAL_Bench_SHA512Batch, &hashing, SAL_Bench_BatchCount);
+		}
+	}
+
+	free(hashing.Data);
+}
+
+typedef struct {
+	uint8* Buffer;
+	uint32 Length;
+	uint64 Sink;
+} SAL_Bench_Generating;
+
+static void SAL_Bench_RandomFill(void* const state, uint64 iterations) {
+	SAL_Bench_Generating* generating = (SAL_Bench_Generating*)state;
+
+	while (iterations--)
+		SAL_Cryptography_RandomFill(generating->Buffer, generating->Length);
+}
+
+static void SAL_Bench_RandomUInt32(void* const state, uint64 iterations) {
+	SAL_Bench_Generating* generating = (SAL_Bench_Generating*)state;
+
+	while (iterations--)
+		generating->Sink += SAL_Cryptography_RandomUInt32(0, 1000);
+}
+
+static void SAL_Bench_Random(void) {
+	static const uint32 lengths[3] = { 64, 4096, 65536 };
+	SAL_Bench_Generating generating;
+	uint64 iterations;
+	double seconds;
+	uint32 i;
+
+	generating.Buffer = (uint8*)malloc(lengths[2]);
+	generating.Sink = 0;
+
+	for (i = 0; i < 3; i++) {
+		generating.Length = lengths[i];
+		seconds = SAL_Bench_Measure(SAL_Bench_RandomFill, &generating, &iterations);
+
+		SAL_Bench_Begin("random_fill");
+		SAL_Bench_Integer("size", generating.Length);
+		SAL_Bench_Real("seconds", seconds);
+		SAL_Bench_Real("bytes_per_second", (double)iterations * generating.Length / seconds);
+		SAL_Bench_End();
+	}
+
+	seconds = SAL_Bench_Measure(SAL_Bench_RandomUInt32, &generating, &iterations);
+
+	SAL_Bench_Begin("random_uint32");
+	SAL_Bench_Integer("calls", iterations);
+	SAL_Bench_Real("ns_per_call", seconds * 1e9 / (double)iterations);
+	SAL_Bench_End();
+
+	free(generating.Buffer);
+}
+
+typedef struct {
+	int64 (*Clock)(void);
+	int64 Sink;
+} SAL_Bench_Timing;
+
+static void SAL_Bench_Clock(void* const state, uint64 iterations) {
+	SAL_Bench_Timing* timing = (SAL_Bench_Timing*)state;
+
+	while (iterations--)
+		timing->Sink += timing->Clock();
+}
+
+static void SAL_Bench_Time(void) {
+	static const int8* const names[5] = { "time_now", "time_monotonic", "time_monotonic_ns", "time_monotonic_coarse", "time_cycles" };
+	int64 (*clocks[5])(void) = { SAL_Time_Now, SAL_Time_Monotonic, SAL_Time_MonotonicNanoseconds, SAL_Time_MonotonicCoarse, SAL_Time_Cycles };
+	SAL_Bench_Timing timing;
+	uint64 iterations;
+	double seconds;
+	uint32 i;
+
+	for (i = 0; i < 5; i++) {
+		timing.Clock = clocks[i];
+		timing.Sink = 0;
+
+		/* the first call may start a clock thread or calibrate, which is not what is measured */
+		timing.Clock();
+
+		seconds = SAL_Bench_Measure(SAL_Bench_Clock, &timing, &iterations);
+
+		SAL_Bench_Begin(names[i]);
+		SAL_Bench_Integer("calls", iterations);
+		SAL_Bench_Real("ns_per_call", seconds * 1e9 / (double)iterations);
+		SAL_Bench_End();
+	}
+}
+
+int main(int argc, char** argv) {
+	uint32 step;
+
+	selected = (int8**)argv + 1;
+	selectedCount = (uint32)(argc > 1 ? argc - 1 : 0);
+
+#ifdef POSIX
+	/* a reset connection should fail the write, not end the run */
+	signal(SIGPIPE, SIG_IGN);
+	nextPort = (uint16)(30000 + getpid() % 20000);
+#else
+	nextPort = 30000;
+#endif
+
+	SAL_Bench_Begin("environment");
+	SAL_Bench_Integer("processors", SAL_Thread_ProcessorCount());
+	SAL_Bench_String("backend", SAL_Socket_GetBackend() == SAL_Socket_Backends_IOUring ? "io_uring" : "default");
+	SAL_Bench_Integer("time", (uint64)SAL_Time_Now());
+	SAL_Bench_End();
+
+	if (SAL_Bench_IsSelected("tcp")) {
+		for (step = 0; step < SAL_Bench_ConnectionSteps; step++) {
+			SAL_Bench_TCPLatency(connectionSteps[step]);
+			SAL_Bench_TCPThroughput(connectionSteps[step]);
+		}
+	}
+
+	if (SAL_Bench_IsSelected("accept"))
+		SAL_Bench_AcceptRate();
+
+	if (SAL_Bench_IsSelected("locks"))
+		SAL_Bench_Locks();
+
+	if (SAL_Bench_IsSelected("hash"))
+		SAL_Bench_Hash();
+
+	if (SAL_Bench_IsSelected("random"))
+		SAL_Bench_Random();
+
+	if (SAL_Bench_IsSelected("time"))
+		SAL_Bench_Time();
+
+	return 0;
+}
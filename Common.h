@@ -9,4 +9,18 @@
 
 #include <Utilities/Common.h>
 
+#ifdef _MSC_VER
+	#define SAL_ThreadLocal __declspec(thread)
+#else
+	#define SAL_ThreadLocal __thread
+#endif
+
+/*
+ * The headers also define the fast paths of a few hot functions inline and
+ * route calls to them there, so they compile into the caller instead of going
+ * through the library. Define SAL_NoInline to always call the exported
+ * functions, and SAL_Static when linking the static library, which lets the
+ * clock be read inline on Windows too.
+ */
+
 #endif
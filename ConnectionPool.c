@@ -0,0 +1,366 @@
+/** vim: set noet ci pi sts=0 sw=4 ts=4
+ * @file ConnectionPool.c
+ * @brief Reuse of outbound TCP connections per host and port.
+ *
+ * Connections handed back to the pool wait on the idle list of their
+ * endpoint, most recently used first, and are handed out again instead of
+ * opening a new connection. Endpoints are spread over shards with a lock
+ * each, so reactors checking out connections to different upstreams do not
+ * contend.
+ */
+
+#include "ConnectionPool.h"
+
+#include "Allocator.h"
+#include "Thread.h"
+#include "Time.h"
+
+#include <string.h>
+
+/* number of independently locked endpoint tables */
+#define SAL_ConnectionPool_Shards 16
+
+/* hash buckets per shard */
+#define SAL_ConnectionPool_Buckets 64
+
+typedef struct SAL_ConnectionPool_Endpoint SAL_ConnectionPool_Endpoint;
+typedef struct SAL_ConnectionPool_Entry SAL_ConnectionPool_Entry;
+
+/* the pool's bookkeeping for one connection, reachable from its socket through PoolEntry */
+struct SAL_ConnectionPool_Entry {
+	SAL_ConnectionPool_Endpoint* Endpoint;
+	SAL_Socket* Socket;
+	int64 Created;
+	SAL_ConnectionPool_Entry* Next; /* on the idle list */
+};
+
+struct SAL_ConnectionPool_Endpoint {
+	int8* Host;
+	int8* Port;
+	uint8 Family;
+	uint32 Hash;
+	uint32 Shard;
+	SAL_ConnectionPool_Entry* Idle;
+	uint32 IdleCount;
+	SAL_ConnectionPool_Endpoint* Next; /* in its bucket */
+};
+
+typedef struct {
+	SAL_Lock Lock;
+	SAL_ConnectionPool_Endpoint* Buckets[SAL_ConnectionPool_Buckets];
+} SAL_ConnectionPool_Shard;
+
+struct SAL_ConnectionPool {
+	uint32 MaxIdle;
+	uint32 MaxAge;
+	SAL_ConnectionPool_Shard Shards[SAL_ConnectionPool_Shards];
+};
+
+/* a SAL_ConnectionPool_CheckoutAsync waiting for its new connection */
+typedef struct {
+	SAL_ConnectionPool_Endpoint* Endpoint;
+	SAL_Socket_ConnectCallback Callback;
+	void* State;
+} SAL_ConnectionPool_Pending;
+
+static int8* SAL_ConnectionPool_Copy(const int8* const source) {
+	size_t length = strlen(source) + 1;
+	int8* copy;
+
+	copy = SAL_Allocator_NewArray(int8, length);
+	memcpy(copy, source, length);
+
+	return copy;
+}
+
+/* finds the endpoint for @a host and @a port, creating it on first use. Endpoints live as long as the pool. */
+static SAL_ConnectionPool_Endpoint* SAL_ConnectionPool_Find(SAL_ConnectionPool* pool, const int8* const host, const int8* const port, uint8 family) {
+	SAL_ConnectionPool_Endpoint* endpoint;
+	SAL_ConnectionPool_Shard* shard;
+	const int8* character;
+	uint32 hash = 2166136261U;
+
+	for (character = host; *character != '\0'; character++)
+		hash = (hash ^ (uint8)*character) * 16777619U;
+
+	for (character = port; *character != '\0'; character++)
+		hash = (hash ^ (uint8)*character) * 16777619U;
+
+	hash = (hash ^ family) * 16777619U;
+	shard = &pool->Shards[hash % SAL_ConnectionPool_Shards];
+
+	SAL_Lock_Acquire(&shard->Lock);
+
+	for (endpoint = shard->Buckets[(hash / SAL_ConnectionPool_Shards) % SAL_ConnectionPool_Buckets]; endpoint != NULL; endpoint = endpoint->Next)
+		if (endpoint->Hash == hash && endpoint->Family == family && strcmp(endpoint->Host, host) == 0 && strcmp(endpoint->Port, port) == 0)
+			break;
+
+	if (endpoint == NULL) {
+		endpoint = SAL_Allocator_New(SAL_ConnectionPool_Endpoint);
+		endpoint->Host = SAL_ConnectionPool_Copy(host);
+		endpoint->Port = SAL_ConnectionPool_Copy(port);
+		endpoint->Family = family;
+		endpoint->Hash = hash;
+		endpoint->Shard = hash % SAL_ConnectionPool_Shards;
+		endpoint->Idle = NULL;
+		endpoint->IdleCount = 0;
+		endpoint->Next = shard->Buckets[(hash / SAL_ConnectionPool_Shards) % SAL_ConnectionPool_Buckets];
+		shard->Buckets[(hash / SAL_ConnectionPool_Shards) % SAL_ConnectionPool_Buckets] = endpoint;
+	}
+
+	SAL_Lock_Release(&shard->Lock);
+
+	return endpoint;
+}
+
+/* takes the most recently returned idle connection of @a endpoint that is still usable, closing the stale ones on the way */
+static SAL_Socket* SAL_ConnectionPool_TakeIdle(SAL_ConnectionPool* pool, SAL_ConnectionPool_Endpoint* endpoint) {
+	SAL_ConnectionPool_Shard* shard = &pool->Shards[endpoint->Shard];
+	SAL_ConnectionPool_Entry* entry;
+	SAL_Socket* socket;
+
+	for (;;) {
+		SAL_Lock_Acquire(&shard->Lock);
+
+		entry = endpoint->Idle;
+		if (entry != NULL) {
+			endpoint->Idle = entry->Next;
+			endpoint->IdleCount--;
+		}
+
+		SAL_Lock_Release(&shard->Lock);
+
+		if (entry == NULL)
+			return NULL;
+
+		/* the checks run outside the lock, a health check is a system call */
+		socket = entry->Socket;
+		if (SAL_Time_Monotonic() - entry->Created < pool->MaxAge && SAL_Socket_IsIdle(socket))
+			return socket;
+
+		SAL_ConnectionPool_Discard(pool, socket);
+	}
+}
+
+/* prepares a new connection for pooling */
+static void SAL_ConnectionPool_Adopt(SAL_ConnectionPool_Endpoint* endpoint, SAL_Socket* socket) {
+	SAL_ConnectionPool_Entry* entry;
+
+	/* pooled connections sit idle for a while and carry short requests */
+	SAL_Socket_SetNoDelay(socket, true);
+	SAL_Socket_SetKeepAlive(socket, true);
+
+	entry = SAL_Allocator_New(SAL_ConnectionPool_Entry);
+	entry->Endpoint = endpoint;
+	entry->Socket = socket;
+	entry->Created = SAL_Time_Monotonic();
+	entry->Next = NULL;
+
+	socket->PoolEntry = entry;
+}
+
+static void SAL_ConnectionPool_Connected(SAL_Socket* socket, void* const state) {
+	SAL_ConnectionPool_Pending* pending = (SAL_ConnectionPool_Pending*)state;
+
+	if (socket != NULL)
+		SAL_ConnectionPool_Adopt(pending->Endpoint, socket);
+
+	pending->Callback(socket, pending->State);
+	SAL_Allocator_Free(pending);
+}
+
+/**
+ * Create a pool of outbound TCP connections.
+ *
+ * Every connection the pool opens has TCP_NODELAY and SO_KEEPALIVE set.
+ *
+ * @param maxIdle Most idle connections kept per endpoint, more are closed when
+ * returned
+ * @param maxAge Time in ms after which a connection is closed instead of being
+ * reused, however healthy
+ * @returns the new pool
+ */
+SAL_ConnectionPool* SAL_ConnectionPool_Create(uint32 maxIdle, uint32 maxAge) {
+	SAL_ConnectionPool* pool;
+	uint32 i;
+
+	pool = SAL_Allocator_New(SAL_ConnectionPool);
+	pool->MaxIdle = maxIdle;
+	pool->MaxAge = maxAge;
+
+	for (i = 0; i < SAL_ConnectionPool_Shards; i++) {
+		SAL_Lock_Initialize(&pool->Shards[i].Lock);
+		memset(pool->Shards[i].Buckets, 0, sizeof(pool->Shards[i].Buckets));
+	}
+
+	return pool;
+}
+
+/**
+ * Close every idle connection of @a pool and free it.
+ *
+ * @param pool Pool to free
+ *
+ * @warning Every connection checked out of @a pool has to be returned or
+ * discarded first.
+ */
+void SAL_ConnectionPool_Free(SAL_ConnectionPool* pool) {
+	SAL_ConnectionPool_Endpoint* endpoint;
+	SAL_ConnectionPool_Entry* entry;
+	uint32 i;
+	uint32 j;
+
+	assert(pool != NULL);
+
+	for (i = 0; i < SAL_ConnectionPool_Shards; i++) {
+		for (j = 0; j < SAL_ConnectionPool_Buckets; j++) {
+			while ((endpoint = pool->Shards[i].Buckets[j]) != NULL) {
+				pool->Shards[i].Buckets[j] = endpoint->Next;
+
+				while ((entry = endpoint->Idle) != NULL) {
+					endpoint->Idle = entry->Next;
+					SAL_Socket_Close(entry->Socket);
+					SAL_Allocator_Free(entry);
+				}
+
+				SAL_Allocator_Free(endpoint->Host);
+				SAL_Allocator_Free(endpoint->Port);
+				SAL_Allocator_Free(endpoint);
+			}
+		}
+	}
+
+	SAL_Allocator_Free(pool);
+}
+
+/**
+ * Get a connection to @a host and @a port, reusing an idle one if there is
+ * one that is younger than the pool's max age and has nothing unread on it.
+ * Otherwise a new blocking connection is made with @ref SAL_Socket_Connect.
+ *
+ * @param pool Pool to take the connection from
+ * @param host A string specifying the hostname to connect to
+ * @param port Port to connect to
+ * @returns the connection, or NULL if none could be made.
+ *
+ * @warning Hand the connection back with @ref SAL_ConnectionPool_Return or
+ * @ref SAL_ConnectionPool_Discard, never with @ref SAL_Socket_Close.
+ */
+SAL_Socket* SAL_ConnectionPool_Checkout(SAL_ConnectionPool* pool, const int8* const host, const int8* const port, uint8 family) {
+	SAL_ConnectionPool_Endpoint* endpoint;
+	SAL_Socket* socket;
+
+	assert(pool != NULL);
+	assert(host != NULL);
+	assert(port != NULL);
+
+	endpoint = SAL_ConnectionPool_Find(pool, host, port, family);
+
+	socket = SAL_ConnectionPool_TakeIdle(pool, endpoint);
+	if (socket != NULL)
+		return socket;
+
+	socket = SAL_Socket_Connect(host, port, family, SAL_Socket_Types_TCP);
+	if (socket != NULL)
+		SAL_ConnectionPool_Adopt(endpoint, socket);
+
+	return socket;
+}
+
+/**
+ * Like @ref SAL_ConnectionPool_Checkout, but a new connection is made with
+ * @ref SAL_Socket_ConnectAsync.
+ *
+ * An idle connection is handed to @a callback before this returns, on the
+ * calling thread. A new one is handed over on its reactor once connected, or
+ * NULL if it could not be made.
+ *
+ * @param pool Pool to take the connection from
+ * @param host A string specifying the hostname to connect to
+ * @param port Port to connect to
+ * @param callback The callback to call with the connection
+ */
+void SAL_ConnectionPool_CheckoutAsync(SAL_ConnectionPool* pool, const int8* const host, const int8* const port, uint8 family, SAL_Socket_ConnectCallback callback, void* const state) {
+	SAL_ConnectionPool_Endpoint* endpoint;
+	SAL_ConnectionPool_Pending* pending;
+	SAL_Socket* socket;
+
+	assert(pool != NULL);
+	assert(host != NULL);
+	assert(port != NULL);
+	assert(callback != NULL);
+
+	endpoint = SAL_ConnectionPool_Find(pool, host, port, family);
+
+	socket = SAL_ConnectionPool_TakeIdle(pool, endpoint);
+	if (socket != NULL) {
+		callback(socket, state);
+		return;
+	}
+
+	pending = SAL_Allocator_New(SAL_ConnectionPool_Pending);
+	pending->Endpoint = endpoint;
+	pending->Callback = callback;
+	pending->State = state;
+
+	SAL_Socket_ConnectAsync(host, port, family, SAL_Socket_Types_TCP, SAL_ConnectionPool_Connected, pending);
+}
+
+/**
+ * Hand a connection checked out of @a pool back for reuse. It is closed
+ * instead if it is past the pool's max age or its endpoint already has the
+ * maximum number of idle connections.
+ *
+ * @param pool Pool the connection was checked out of
+ * @param socket Connection to return
+ *
+ * @warning Only return connections that are between requests, with every
+ * response fully read and no callbacks registered.
+ */
+void SAL_ConnectionPool_Return(SAL_ConnectionPool* pool, SAL_Socket* socket) {
+	SAL_ConnectionPool_Entry* entry;
+	SAL_ConnectionPool_Shard* shard;
+	boolean kept = false;
+
+	assert(pool != NULL);
+	assert(socket != NULL);
+	assert(socket->PoolEntry != NULL);
+	assert(!socket->ReadCallback && !socket->WriteCallback);
+
+	entry = (SAL_ConnectionPool_Entry*)socket->PoolEntry;
+	shard = &pool->Shards[entry->Endpoint->Shard];
+
+	if (socket->Connected && SAL_Time_Monotonic() - entry->Created < pool->MaxAge) {
+		SAL_Lock_Acquire(&shard->Lock);
+
+		if (entry->Endpoint->IdleCount < pool->MaxIdle) {
+			entry->Next = entry->Endpoint->Idle;
+			entry->Endpoint->Idle = entry;
+			entry->Endpoint->IdleCount++;
+			kept = true;
+		}
+
+		SAL_Lock_Release(&shard->Lock);
+	}
+
+	if (!kept)
+		SAL_ConnectionPool_Discard(pool, socket);
+}
+
+/**
+ * Close a connection checked out of @a pool instead of returning it, for
+ * example after it failed.
+ *
+ * @param pool Pool the connection was checked out of
+ * @param socket Connection to close
+ */
+void SAL_ConnectionPool_Discard(SAL_ConnectionPool* pool, SAL_Socket* socket) {
+	assert(pool != NULL);
+	assert(socket != NULL);
+	assert(socket->PoolEntry != NULL);
+
+	(void)pool;
+
+	SAL_Allocator_Free(socket->PoolEntry);
+	SAL_Socket_Close(socket);
+}
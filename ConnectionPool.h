@@ -0,0 +1,16 @@
+#ifndef INCLUDE_SAL_CONNECTIONPOOL
+#define INCLUDE_SAL_CONNECTIONPOOL
+
+#include "Common.h"
+#include "Socket.h"
+
+typedef struct SAL_ConnectionPool SAL_ConnectionPool;
+
+public SAL_ConnectionPool* SAL_ConnectionPool_Create(uint32 maxIdle, uint32 maxAge);
+public void SAL_ConnectionPool_Free(SAL_ConnectionPool* pool);
+public SAL_Socket* SAL_ConnectionPool_Checkout(SAL_ConnectionPool* pool, const int8* const host, const int8* const port, uint8 family);
+public void SAL_ConnectionPool_CheckoutAsync(SAL_ConnectionPool* pool, const int8* const host, const int8* const port, uint8 family, SAL_Socket_ConnectCallback callback, void* const state);
+public void SAL_ConnectionPool_Return(SAL_ConnectionPool* pool, SAL_Socket* socket);
+public void SAL_ConnectionPool_Discard(SAL_ConnectionPool* pool, SAL_Socket* socket);
+
+#endif
@@ -4,60 +4,409 @@
  */
 
 #include "Cryptography.h"
+#include "Allocator.h"
+#include "Atomic.h"
+#include "Thread.h"
 #include "Time.h"
 
 #ifdef WINDOWS
 	#define WIN32_LEAN_AND_MEAN
 	#include <Windows.h>
-	#include <wincrypt.h>
+	#include <bcrypt.h>
 #elif defined POSIX
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <pthread.h>
+	#include <unistd.h>
 	#include <openssl/evp.h>
+
+	#ifdef __linux__
+		#include <sys/syscall.h>
+	#endif
+#endif
+
+#define SAL_Cryptography_Algorithms_Count 2
+
+#if (defined _MSC_VER && (defined _M_X64 || defined _M_IX86)) || ((defined __GNUC__ || defined __clang__) && (defined __x86_64__ || defined __i386__))
+	#define SAL_Cryptography_X86
+
+	#include <immintrin.h>
+
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define SAL_Cryptography_Target(features)
+	#else
+		#include <cpuid.h>
+		#define SAL_Cryptography_Target(features) __attribute__((target(features)))
+	#endif
+#elif defined __aarch64__ && (defined __ARM_FEATURE_CRYPTO || defined __ARM_FEATURE_SHA2)
+	#define SAL_Cryptography_ARM
+
+	#include <arm_neon.h>
 #endif
 
-#include <math.h>
+/* lanes of the AVX2 multi-buffer SHA-1 */
+#define SAL_Cryptography_Lanes 8
+
+/* ChaCha20 blocks each random generator refill makes, the first half block of which becomes the next key */
+#define SAL_Cryptography_RandomBlocks 8
+
+/* what SAL_Cryptography_GetFeatures found */
+#define SAL_Cryptography_Features_SHA 1
+#define SAL_Cryptography_Features_AVX2 2
+#define SAL_Cryptography_Features_Unknown 0x80000000
+
 #include <stdlib.h>
+#include <string.h>
+
+/* runs the SHA-1 compression over @a count consecutive 64 byte blocks */
+typedef void (*SAL_Cryptography_SHA1Compress)(uint32* state, const uint8* blocks, uint32 count);
+
+/* a digest being computed, reset after each SAL_Cryptography_Hash_Finish so its context is reused */
+struct SAL_Cryptography_Hash {
+	uint8 Algorithm;
+#ifdef WINDOWS
+	BCRYPT_HASH_HANDLE Handle;
+	uint8* Object; /* the hash state BCrypt works in, owned by us */
+#elif defined POSIX
+	EVP_MD_CTX* Context;
+	const EVP_MD* Digest;
+#endif
+};
+
+#ifdef WINDOWS
+/* the algorithm providers, opened once and shared by every thread */
+static BCRYPT_ALG_HANDLE providers[SAL_Cryptography_Algorithms_Count];
+#endif
+
+/* each thread's contexts for the one-shot hashes, created on first use and freed when the thread exits */
+typedef struct {
+	SAL_Cryptography_Hash* Hashes[SAL_Cryptography_Algorithms_Count];
+} SAL_Cryptography_ThreadHashes;
+
+static SAL_ThreadLocal SAL_Cryptography_ThreadHashes* threadHashes = NULL;
+
+/* the key whose destructor frees them: 0 before it is created, 1 while one thread creates it, 2 once it exists, 3 if it could not be */
+static uint32 threadHashesState = 0;
+#ifdef WINDOWS
+static DWORD threadHashesKey;
+#elif defined POSIX
+static pthread_key_t threadHashesKey;
+#endif
+
+#ifdef WINDOWS
+/* the shared provider for @a algorithm; threads racing to open it keep whichever is stored first */
+static BCRYPT_ALG_HANDLE SAL_Cryptography_GetProvider(uint8 algorithm) {
+	BCRYPT_ALG_HANDLE provider = SAL_Atomic_LoadPointer(&providers[algorithm]);
+
+	if (provider != NULL)
+		return provider;
+
+	if (BCryptOpenAlgorithmProvider(&provider, algorithm == SAL_Cryptography_Algorithms_SHA1 ? BCRYPT_SHA1_ALGORITHM : BCRYPT_SHA512_ALGORITHM, NULL, BCRYPT_HASH_REUSABLE_FLAG) != 0)
+		return NULL;
+
+	if (!SAL_Atomic_CompareExchangePointer(&providers[algorithm], NULL, provider)) {
+		BCryptCloseAlgorithmProvider(provider, 0);
+		provider = SAL_Atomic_LoadPointer(&providers[algorithm]);
+	}
+
+	return provider;
+}
+#endif
+
+static void SAL_Cryptography_FreeThreadHashes(void* state) {
+	SAL_Cryptography_ThreadHashes* hashes = (SAL_Cryptography_ThreadHashes*)state;
+	uint32 i;
+
+	for (i = 0; i < SAL_Cryptography_Algorithms_Count; i++)
+		if (hashes->Hashes[i] != NULL)
+			SAL_Cryptography_Hash_Free(hashes->Hashes[i]);
+
+	SAL_Allocator_Free(hashes);
+}
+
+#ifdef WINDOWS
+static VOID NTAPI SAL_Cryptography_OnThreadExit(PVOID state) {
+	if (state != NULL)
+		SAL_Cryptography_FreeThreadHashes(state);
+}
+#endif
+
+/* creates the thread-exit hook on the first call, racing first calls wait for it. Returns false if the system had none to give. */
+static boolean SAL_Cryptography_CreateThreadHashesKey(void) {
+	uint32 state = SAL_Atomic_Load32(&threadHashesState);
+	boolean created;
+
+	if (state >= 2)
+		return state == 2;
+
+	if (!SAL_Atomic_CompareExchange32(&threadHashesState, 0, 1)) {
+		while ((state = SAL_Atomic_Load32(&threadHashesState)) == 1)
+			SAL_Thread_Yield();
+
+		return state == 2;
+	}
+
+#ifdef WINDOWS
+	threadHashesKey = FlsAlloc(SAL_Cryptography_OnThreadExit);
+	created = threadHashesKey != FLS_OUT_OF_INDEXES;
+#elif defined POSIX
+	created = pthread_key_create(&threadHashesKey, SAL_Cryptography_FreeThreadHashes) == 0;
+#endif
+
+	SAL_Atomic_Store32(&threadHashesState, created ? 2 : 3);
+
+	return created;
+}
 
-static boolean seeded = false;
+/* the calling thread's context for @a algorithm, ready for a new message. NULL if it could not be created, or could not be freed when the thread exits. */
+static SAL_Cryptography_Hash* SAL_Cryptography_GetThreadHash(uint8 algorithm) {
+	SAL_Cryptography_ThreadHashes* hashes = threadHashes;
+	boolean registered;
+
+	if (hashes == NULL) {
+		if (!SAL_Cryptography_CreateThreadHashesKey())
+			return NULL;
+
+		hashes = SAL_Allocator_New(SAL_Cryptography_ThreadHashes);
+		memset(hashes, 0, sizeof(SAL_Cryptography_ThreadHashes));
+
+	#ifdef WINDOWS
+		registered = FlsSetValue(threadHashesKey, hashes) != 0;
+	#elif defined POSIX
+		registered = pthread_setspecific(threadHashesKey, hashes) == 0;
+	#endif
+
+		if (!registered) {
+			SAL_Allocator_Free(hashes);
+			return NULL;
+		}
+
+		threadHashes = hashes;
+	}
+
+	if (hashes->Hashes[algorithm] == NULL)
+		hashes->Hashes[algorithm] = SAL_Cryptography_Hash_Create(algorithm);
+
+	return hashes->Hashes[algorithm];
+}
+
+/* hashes one message with a context of its own, for threads that have none. Without the algorithm @a digest is zeroed. */
+static void SAL_Cryptography_HashOnce(uint8 algorithm, const uint8* source, uint32 length, uint8* digest) {
+	SAL_Cryptography_Hash* hash = SAL_Cryptography_Hash_Create(algorithm);
+
+	if (hash == NULL) {
+		memset(digest, 0, algorithm == SAL_Cryptography_Algorithms_SHA1 ? SAL_Cryptography_SHA1Length : SAL_Cryptography_SHA512Length);
+		return;
+	}
+
+	SAL_Cryptography_Hash_Update(hash, source, length);
+	SAL_Cryptography_Hash_Finish(hash, digest);
+	SAL_Cryptography_Hash_Free(hash);
+}
 
 /**
- * Hash a block of memory using SHA512.
+ * Create a context for hashing a message that arrives in pieces. Feed it with
+ * @ref SAL_Cryptography_Hash_Update and get the digest with
+ * @ref SAL_Cryptography_Hash_Finish, after which it is ready for the next
+ * message: a single context hashes any number of messages without
+ * allocating again.
  *
- * @param source [in] pointer to block of memory to hash
- * @param length [in] number of bytes from source to hash.
- * @returns pointer to digest (64 bytes in length)
+ * @param algorithm One of the SAL_Cryptography_Algorithms values
+ * @returns the new context, or NULL if the system cannot provide
+ * @a algorithm.
  *
- * @warning You need to free the returned memory yourself
+ * @warning A context may only be used by one thread at a time.
  */
-uint8* SAL_Cryptography_SHA512(uint8* source, uint32 length) {
+SAL_Cryptography_Hash* SAL_Cryptography_Hash_Create(uint8 algorithm) {
+	SAL_Cryptography_Hash* hash;
+
+	assert(algorithm < SAL_Cryptography_Algorithms_Count);
+
 #ifdef WINDOWS
-	HCRYPTPROV provider = 0;
-	HCRYPTHASH hasher = 0;
-	DWORD hashLength;
-	uint8* hash;
+	{
+		BCRYPT_ALG_HANDLE provider = SAL_Cryptography_GetProvider(algorithm);
+		DWORD objectLength;
+		ULONG written;
 
-	CryptAcquireContext(&provider, NULL, NULL, PROV_RSA_AES, CRYPT_VERIFYCONTEXT);
-	CryptCreateHash(provider, CALG_SHA_512, 0, 0, &hasher);
-	CryptHashData(hasher, source, length, 0);
+		if (provider == NULL || BCryptGetProperty(provider, BCRYPT_OBJECT_LENGTH, (PUCHAR)&objectLength, sizeof(DWORD), &written, 0) != 0)
+			return NULL;
 
-	hash = AllocateArray(uint8, 64);
-	CryptGetHashParam(hasher, HP_HASHVAL, hash, &hashLength, 0);
+		hash = SAL_Allocator_New(SAL_Cryptography_Hash);
+		hash->Algorithm = algorithm;
+		hash->Object = SAL_Allocator_NewArray(uint8, objectLength);
 
-	CryptDestroyHash(hasher);
-	CryptReleaseContext(provider, 0);
+		/* reusable hashes reset themselves when finished */
+		if (BCryptCreateHash(provider, &hash->Handle, hash->Object, objectLength, NULL, 0, BCRYPT_HASH_REUSABLE_FLAG) != 0) {
+			SAL_Allocator_Free(hash->Object);
+			SAL_Allocator_Free(hash);
+			return NULL;
+		}
+	}
+#elif defined POSIX
+	hash = SAL_Allocator_New(SAL_Cryptography_Hash);
+	hash->Algorithm = algorithm;
+	hash->Digest = algorithm == SAL_Cryptography_Algorithms_SHA1 ? EVP_sha1() : EVP_sha512();
+	hash->Context = EVP_MD_CTX_create();
+
+	if (hash->Context == NULL || EVP_DigestInit_ex(hash->Context, hash->Digest, NULL) != 1) {
+		EVP_MD_CTX_destroy(hash->Context);
+		SAL_Allocator_Free(hash);
+		return NULL;
+	}
+#endif
 
 	return hash;
+}
+
+/**
+ * Free @a hash, dropping any message it was part way through.
+ *
+ * @param hash Context to free
+ */
+void SAL_Cryptography_Hash_Free(SAL_Cryptography_Hash* hash) {
+	assert(hash != NULL);
+
+#ifdef WINDOWS
+	BCryptDestroyHash(hash->Handle);
+	SAL_Allocator_Free(hash->Object);
 #elif defined POSIX
-	EVP_MD_CTX *ctx = EVP_MD_CTX_create();
-	uint8 *hash = AllocateArray(uint8, EVP_MD_size(EVP_sha512()));
+	EVP_MD_CTX_destroy(hash->Context);
+#endif
 
-	EVP_DigestInit_ex(ctx, EVP_sha512(), NULL);
-	EVP_DigestUpdate(ctx, (void*)source, length);
-	EVP_DigestFinal_ex(ctx, (unsigned char*)hash, NULL);
+	SAL_Allocator_Free(hash);
+}
 
-	return hash;
+/**
+ * Add the next @a length bytes of the message to @a hash.
+ *
+ * @param hash Context to add to
+ * @param source [in] the bytes to add
+ * @param length [in] number of bytes in @a source, may be 0
+ */
+void SAL_Cryptography_Hash_Update(SAL_Cryptography_Hash* hash, const uint8* source, uint32 length) {
+	assert(hash != NULL);
+	assert(source != NULL || length == 0);
+
+#ifdef WINDOWS
+	BCryptHashData(hash->Handle, (PUCHAR)source, length, 0);
+#elif defined POSIX
+	EVP_DigestUpdate(hash->Context, source, length);
+#endif
+}
+
+/**
+ * Write the digest of everything added to @a hash since it was created or
+ * last finished, then start it over for a new message.
+ *
+ * @param hash Context to finish
+ * @param digest [out] room for @ref SAL_Cryptography_Hash_GetLength bytes
+ */
+void SAL_Cryptography_Hash_Finish(SAL_Cryptography_Hash* hash, uint8* digest) {
+	assert(hash != NULL);
+	assert(digest != NULL);
+
+#ifdef WINDOWS
+	BCryptFinishHash(hash->Handle, digest, SAL_Cryptography_Hash_GetLength(hash), 0);
+#elif defined POSIX
+	EVP_DigestFinal_ex(hash->Context, digest, NULL);
+	EVP_DigestInit_ex(hash->Context, hash->Digest, NULL);
 #endif
 }
 
+/**
+ * Drop the message @a hash was part way through and start it over.
+ *
+ * @param hash Context to reset
+ */
+void SAL_Cryptography_Hash_Reset(SAL_Cryptography_Hash* hash) {
+	assert(hash != NULL);
+
+#ifdef WINDOWS
+	{
+		uint8 discarded[SAL_Cryptography_SHA512Length];
+
+		BCryptFinishHash(hash->Handle, discarded, SAL_Cryptography_Hash_GetLength(hash), 0);
+	}
+#elif defined POSIX
+	EVP_DigestInit_ex(hash->Context, hash->Digest, NULL);
+#endif
+}
+
+/**
+ * @param hash Context to ask about
+ * @returns the size in bytes of the digests @a hash produces.
+ */
+uint32 SAL_Cryptography_Hash_GetLength(SAL_Cryptography_Hash* hash) {
+	assert(hash != NULL);
+
+	return hash->Algorithm == SAL_Cryptography_Algorithms_SHA1 ? SAL_Cryptography_SHA1Length : SAL_Cryptography_SHA512Length;
+}
+
+/**
+ * Hash a block of memory using SHA512 into caller-provided storage, with a
+ * context kept by the calling thread, so nothing is allocated after the
+ * thread's first call.
+ *
+ * @param source [in] pointer to block of memory to hash
+ * @param length [in] number of bytes from source to hash.
+ * @param digest [out] room for @ref SAL_Cryptography_SHA512Length bytes
+ *
+ * @warning @a digest is zeroed if the system cannot provide SHA512.
+ */
+void SAL_Cryptography_SHA512Into(const uint8* source, uint32 length, uint8* digest) {
+	SAL_Cryptography_Hash* hash = SAL_Cryptography_GetThreadHash(SAL_Cryptography_Algorithms_SHA512);
+
+	if (hash == NULL) {
+		SAL_Cryptography_HashOnce(SAL_Cryptography_Algorithms_SHA512, source, length, digest);
+		return;
+	}
+
+	SAL_Cryptography_Hash_Update(hash, source, length);
+	SAL_Cryptography_Hash_Finish(hash, digest);
+}
+
+/**
+ * Hash a block of memory using SHA-1 into caller-provided storage, with a
+ * context kept by the calling thread, so nothing is allocated after the
+ * thread's first call.
+ *
+ * @param source [in] pointer to block of memory to hash
+ * @param length [in] number of bytes from source to hash.
+ * @param digest [out] room for @ref SAL_Cryptography_SHA1Length bytes
+ *
+ * @warning @a digest is zeroed if the system cannot provide SHA-1.
+ */
+void SAL_Cryptography_SHA1Into(const uint8* source, uint32 length, uint8* digest) {
+	SAL_Cryptography_Hash* hash = SAL_Cryptography_GetThreadHash(SAL_Cryptography_Algorithms_SHA1);
+
+	if (hash == NULL) {
+		SAL_Cryptography_HashOnce(SAL_Cryptography_Algorithms_SHA1, source, length, digest);
+		return;
+	}
+
+	SAL_Cryptography_Hash_Update(hash, source, length);
+	SAL_Cryptography_Hash_Finish(hash, digest);
+}
+
+/**
+ * Hash a block of memory using SHA512.
+ *
+ * @param source [in] pointer to block of memory to hash
+ * @param length [in] number of bytes from source to hash.
+ * @returns pointer to digest (64 bytes in length)
+ *
+ * @warning Free the returned memory with @ref SAL_Allocator_Free, or use
+ * @ref SAL_Cryptography_SHA512Into to write into memory of your own.
+ */
+uint8* SAL_Cryptography_SHA512(uint8* source, uint32 length) {
+	uint8* hash = SAL_Allocator_NewArray(uint8, SAL_Cryptography_SHA512Length);
+
+	SAL_Cryptography_SHA512Into(source, length, hash);
+
+	return hash;
+}
+
 /**
  * Hash a block of memory using SHA-1
  *
@@ -65,146 +414,1004 @@ uint8* SAL_Cryptography_SHA512(uint8* source, uint32 length) {
  * @param length [in] number of bytes from source to hash.
  * @returns pointer to digest (20 bytes in length)
  *
- * @warning You need to free the returned memory yourself
+ * @warning Free the returned memory with @ref SAL_Allocator_Free, or use
+ * @ref SAL_Cryptography_SHA1Into to write into memory of your own.
  */
 uint8* SAL_Cryptography_SHA1(uint8* source, uint32 length) {
-#ifdef WINDOWS
-	HCRYPTPROV provider = 0;
-	HCRYPTHASH hasher = 0;
-	DWORD hashLength;
-	uint8* hash;
+	uint8* hash = SAL_Allocator_NewArray(uint8, SAL_Cryptography_SHA1Length);
 
-	CryptAcquireContext(&provider, NULL, NULL, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT);
-	CryptCreateHash(provider, CALG_SHA1, 0, 0, &hasher);
-	CryptHashData(hasher, source, length, 0);
+	SAL_Cryptography_SHA1Into(source, length, hash);
 
-	hash = AllocateArray(uint8, 20);
-	CryptGetHashParam(hasher, HP_HASHVAL, hash, &hashLength, 0);
+	return hash;
+}
 
-	CryptDestroyHash(hasher);
-	CryptReleaseContext(provider, 0);
+/* the initial SHA-1 state */
+static const uint32 sha1Initial[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
 
-	return hash;
+static uint32 SAL_Cryptography_LoadBig32(const uint8* source) {
+	return ((uint32)source[0] << 24) | ((uint32)source[1] << 16) | ((uint32)source[2] << 8) | (uint32)source[3];
+}
+
+static void SAL_Cryptography_StoreBig32(uint8* target, uint32 value) {
+	target[0] = (uint8)(value >> 24);
+	target[1] = (uint8)(value >> 16);
+	target[2] = (uint8)(value >> 8);
+	target[3] = (uint8)value;
+}
+
+/* builds the padded final blocks of a @a length byte message, whose last @a restLength bytes are at @a rest, in @a tail. Returns the block count, 1 or 2. */
+static uint32 SAL_Cryptography_SHA1_Pad(const uint8* rest, uint32 restLength, uint32 length, uint8* tail) {
+	uint64 bits = (uint64)length * 8;
+	uint32 blocks = restLength + 9 <= 64 ? 1 : 2;
+	uint32 i;
+
+	memcpy(tail, rest, restLength);
+	tail[restLength] = 0x80;
+	memset(tail + restLength + 1, 0, blocks * 64 - restLength - 1 - 8);
+
+	for (i = 0; i < 8; i++)
+		tail[blocks * 64 - 1 - i] = (uint8)(bits >> (8 * i));
+
+	return blocks;
+}
+
+static void SAL_Cryptography_SHA1_CompressScalar(uint32* state, const uint8* blocks, uint32 count) {
+	uint32 w[16];
+	uint32 a, b, c, d, e, f, k, t;
+	uint32 i;
+
+	for (; count > 0; count--, blocks += 64) {
+		for (i = 0; i < 16; i++)
+			w[i] = SAL_Cryptography_LoadBig32(blocks + 4 * i);
+
+		a = state[0];
+		b = state[1];
+		c = state[2];
+		d = state[3];
+		e = state[4];
+
+		for (i = 0; i < 80; i++) {
+			if (i >= 16) {
+				t = w[(i - 3) & 15] ^ w[(i - 8) & 15] ^ w[(i - 14) & 15] ^ w[i & 15];
+				w[i & 15] = (t << 1) | (t >> 31);
+			}
+
+			if (i < 20) {
+				f = (b & c) | (~b & d);
+				k = 0x5A827999;
+			}
+			else if (i < 40) {
+				f = b ^ c ^ d;
+				k = 0x6ED9EBA1;
+			}
+			else if (i < 60) {
+				f = (b & c) | (d & (b | c));
+				k = 0x8F1BBCDC;
+			}
+			else {
+				f = b ^ c ^ d;
+				k = 0xCA62C1D6;
+			}
+
+			t = ((a << 5) | (a >> 27)) + f + e + k + w[i & 15];
+			e = d;
+			d = c;
+			c = (b << 30) | (b >> 2);
+			b = a;
+			a = t;
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+	}
+}
+
+#ifdef SAL_Cryptography_X86
+/* SSE with the SHA extensions: one block takes 20 four-round instructions, with the message schedule computed in step */
+#define SAL_Cryptography_SHA1_Group(current, other, message, next1, next2, next3, function) \
+	current = _mm_sha1nexte_epu32(current, message); \
+	other = abcd; \
+	next1 = _mm_sha1msg2_epu32(next1, message); \
+	abcd = _mm_sha1rnds4_epu32(abcd, current, function); \
+	next3 = _mm_sha1msg1_epu32(next3, message); \
+	next2 = _mm_xor_si128(next2, message);
+
+SAL_Cryptography_Target("sha,sse4.1,ssse3")
+static void SAL_Cryptography_SHA1_CompressSHA(uint32* state, const uint8* blocks, uint32 count) {
+	const __m128i order = _mm_set_epi64x(0x0001020304050607ULL, 0x08090A0B0C0D0E0FULL);
+	__m128i abcd, savedAbcd, e0, e1, savedE0;
+	__m128i m0, m1, m2, m3;
+
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1B);
+	e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+	for (; count > 0; count--, blocks += 64) {
+		savedAbcd = abcd;
+		savedE0 = e0;
+
+		/* rounds 0 to 15 load the block as they go */
+		m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)blocks), order);
+		e0 = _mm_add_epi32(e0, m0);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+		m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(blocks + 16)), order);
+		e1 = _mm_sha1nexte_epu32(e1, m1);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+		m0 = _mm_sha1msg1_epu32(m0, m1);
+
+		m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(blocks + 32)), order);
+		e0 = _mm_sha1nexte_epu32(e0, m2);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		m1 = _mm_sha1msg1_epu32(m1, m2);
+		m0 = _mm_xor_si128(m0, m2);
+
+		m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(blocks + 48)), order);
+		SAL_Cryptography_SHA1_Group(e1, e0, m3, m0, m1, m2, 0);
+
+		/* rounds 16 to 67 */
+		SAL_Cryptography_SHA1_Group(e0, e1, m0, m1, m2, m3, 0);
+		SAL_Cryptography_SHA1_Group(e1, e0, m1, m2, m3, m0, 1);
+		SAL_Cryptography_SHA1_Group(e0, e1, m2, m3, m0, m1, 1);
+		SAL_Cryptography_SHA1_Group(e1, e0, m3, m0, m1, m2, 1);
+		SAL_Cryptography_SHA1_Group(e0, e1, m0, m1, m2, m3, 1);
+		SAL_Cryptography_SHA1_Group(e1, e0, m1, m2, m3, m0, 1);
+		SAL_Cryptography_SHA1_Group(e0, e1, m2, m3, m0, m1, 2);
+		SAL_Cryptography_SHA1_Group(e1, e0, m3, m0, m1, m2, 2);
+		SAL_Cryptography_SHA1_Group(e0, e1, m0, m1, m2, m3, 2);
+		SAL_Cryptography_SHA1_Group(e1, e0, m1, m2, m3, m0, 2);
+		SAL_Cryptography_SHA1_Group(e0, e1, m2, m3, m0, m1, 2);
+		SAL_Cryptography_SHA1_Group(e1, e0, m3, m0, m1, m2, 3);
+		SAL_Cryptography_SHA1_Group(e0, e1, m0, m1, m2, m3, 3);
+
+		/* rounds 68 to 79 only finish the schedule */
+		e1 = _mm_sha1nexte_epu32(e1, m1);
+		e0 = abcd;
+		m2 = _mm_sha1msg2_epu32(m2, m1);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+		m3 = _mm_xor_si128(m3, m1);
+
+		e0 = _mm_sha1nexte_epu32(e0, m2);
+		e1 = abcd;
+		m3 = _mm_sha1msg2_epu32(m3, m2);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+		e1 = _mm_sha1nexte_epu32(e1, m3);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+		e0 = _mm_sha1nexte_epu32(e0, savedE0);
+		abcd = _mm_add_epi32(abcd, savedAbcd);
+	}
+
+	_mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(abcd, 0x1B));
+	state[4] = (uint32)_mm_extract_epi32(e0, 3);
+}
+
+#define SAL_Cryptography_Rotate8(value, bits) _mm256_or_si256(_mm256_slli_epi32(value, bits), _mm256_srli_epi32(value, 32 - (bits)))
+
+/* one round for all eight lanes, @a f being the round function of b, c and d */
+#define SAL_Cryptography_SHA1_Round8(f, k) \
+	if (i >= 16) { \
+		t = _mm256_xor_si256(_mm256_xor_si256(w[(i - 3) & 15], w[(i - 8) & 15]), _mm256_xor_si256(w[(i - 14) & 15], w[i & 15])); \
+		w[i & 15] = SAL_Cryptography_Rotate8(t, 1); \
+	} \
+	t = _mm256_add_epi32(_mm256_add_epi32(SAL_Cryptography_Rotate8(a, 5), f), _mm256_add_epi32(_mm256_add_epi32(e, k), w[i & 15])); \
+	e = d; \
+	d = c; \
+	c = SAL_Cryptography_Rotate8(b, 30); \
+	b = a; \
+	a = t;
+
+/* AVX2 multi-buffer: one block from each of eight messages, @a state holding each word for the eight lanes side by side */
+SAL_Cryptography_Target("avx2")
+static void SAL_Cryptography_SHA1_Compress8(uint32* state, const uint8* const* blocks) {
+	__m256i w[16];
+	__m256i a, b, c, d, e, t, k;
+	uint32 i;
+
+	for (i = 0; i < 16; i++)
+		w[i] = _mm256_setr_epi32((int)SAL_Cryptography_LoadBig32(blocks[0] + 4 * i), (int)SAL_Cryptography_LoadBig32(blocks[1] + 4 * i), (int)SAL_Cryptography_LoadBig32(blocks[2] + 4 * i), (int)SAL_Cryptography_LoadBig32(blocks[3] + 4 * i), (int)SAL_Cryptography_LoadBig32(blocks[4] + 4 * i), (int)SAL_Cryptography_LoadBig32(blocks[5] + 4 * i), (int)SAL_Cryptography_LoadBig32(blocks[6] + 4 * i), (int)SAL_Cryptography_LoadBig32(blocks[7] + 4 * i));
+
+	a = _mm256_loadu_si256((const __m256i*)(state + 0 * SAL_Cryptography_Lanes));
+	b = _mm256_loadu_si256((const __m256i*)(state + 1 * SAL_Cryptography_Lanes));
+	c = _mm256_loadu_si256((const __m256i*)(state + 2 * SAL_Cryptography_Lanes));
+	d = _mm256_loadu_si256((const __m256i*)(state + 3 * SAL_Cryptography_Lanes));
+	e = _mm256_loadu_si256((const __m256i*)(state + 4 * SAL_Cryptography_Lanes));
+
+	k = _mm256_set1_epi32(0x5A827999);
+	for (i = 0; i < 20; i++) {
+		SAL_Cryptography_SHA1_Round8(_mm256_or_si256(_mm256_and_si256(b, c), _mm256_andnot_si256(b, d)), k);
+	}
+
+	k = _mm256_set1_epi32(0x6ED9EBA1);
+	for (; i < 40; i++) {
+		SAL_Cryptography_SHA1_Round8(_mm256_xor_si256(_mm256_xor_si256(b, c), d), k);
+	}
+
+	k = _mm256_set1_epi32((int)0x8F1BBCDC);
+	for (; i < 60; i++) {
+		SAL_Cryptography_SHA1_Round8(_mm256_or_si256(_mm256_and_si256(b, c), _mm256_and_si256(d, _mm256_or_si256(b, c))), k);
+	}
+
+	k = _mm256_set1_epi32((int)0xCA62C1D6);
+	for (; i < 80; i++) {
+		SAL_Cryptography_SHA1_Round8(_mm256_xor_si256(_mm256_xor_si256(b, c), d), k);
+	}
+
+	_mm256_storeu_si256((__m256i*)(state + 0 * SAL_Cryptography_Lanes), _mm256_add_epi32(a, _mm256_loadu_si256((const __m256i*)(state + 0 * SAL_Cryptography_Lanes))));
+	_mm256_storeu_si256((__m256i*)(state + 1 * SAL_Cryptography_Lanes), _mm256_add_epi32(b, _mm256_loadu_si256((const __m256i*)(state + 1 * SAL_Cryptography_Lanes))));
+	_mm256_storeu_si256((__m256i*)(state + 2 * SAL_Cryptography_Lanes), _mm256_add_epi32(c, _mm256_loadu_si256((const __m256i*)(state + 2 * SAL_Cryptography_Lanes))));
+	_mm256_storeu_si256((__m256i*)(state + 3 * SAL_Cryptography_Lanes), _mm256_add_epi32(d, _mm256_loadu_si256((const __m256i*)(state + 3 * SAL_Cryptography_Lanes))));
+	_mm256_storeu_si256((__m256i*)(state + 4 * SAL_Cryptography_Lanes), _mm256_add_epi32(e, _mm256_loadu_si256((const __m256i*)(state + 4 * SAL_Cryptography_Lanes))));
+}
+
+/* a message being hashed in one lane of SAL_Cryptography_SHA1_Compress8 */
+typedef struct {
+	const uint8* Next; /* the message's next full block */
+	uint32 FullBlocks; /* full blocks left, taken before the ones in Tail */
+	uint32 TailBlocks;
+	uint32 TailNext;
+	uint8 Tail[128];
+	uint8* Digest; /* NULL for an idle lane */
+} SAL_Cryptography_SHA1Lane;
+
+/* sets lane @a index of @a state up for @a source */
+static void SAL_Cryptography_SHA1_StartLane(SAL_Cryptography_SHA1Lane* lane, uint32* state, uint32 index, const uint8* source, uint32 length, uint8* digest) {
+	uint32 i;
+
+	for (i = 0; i < 5; i++)
+		state[i * SAL_Cryptography_Lanes + index] = sha1Initial[i];
+
+	lane->Next = source;
+	lane->FullBlocks = length / 64;
+	lane->TailBlocks = SAL_Cryptography_SHA1_Pad(source + length / 64 * 64, length % 64, length, lane->Tail);
+	lane->TailNext = 0;
+	lane->Digest = digest;
+}
+
+/* hashes every message eight at a time, each lane taking the next message as soon as its own is done */
+static void SAL_Cryptography_SHA1_BatchLanes(const uint8* const* sources, const uint32* lengths, uint32 count, uint8* digests) {
+	static const uint8 idle[64] = { 0 };
+	SAL_Cryptography_SHA1Lane lanes[SAL_Cryptography_Lanes];
+	uint32 state[5 * SAL_Cryptography_Lanes];
+	uint32 single[5];
+	const uint8* blocks[SAL_Cryptography_Lanes];
+	SAL_Cryptography_SHA1Lane* lane;
+	uint32 next = 0;
+	uint32 active = 0;
+	uint32 i;
+	uint32 j;
+
+	for (i = 0; i < SAL_Cryptography_Lanes; i++) {
+		lanes[i].Digest = NULL;
+
+		if (next < count) {
+			SAL_Cryptography_SHA1_StartLane(&lanes[i], state, i, sources[next], lengths[next], digests + next * SAL_Cryptography_SHA1Length);
+			next++;
+			active++;
+		}
+	}
+
+	/* once the last messages are running a lone lane is cheaper on its own */
+	while (active > 1 || (active == 1 && next < count)) {
+		for (i = 0; i < SAL_Cryptography_Lanes; i++) {
+			lane = &lanes[i];
+
+			if (lane->Digest == NULL) {
+				blocks[i] = idle;
+			}
+			else if (lane->FullBlocks > 0) {
+				blocks[i] = lane->Next;
+				lane->Next += 64;
+				lane->FullBlocks--;
+			}
+			else {
+				blocks[i] = lane->Tail + 64 * lane->TailNext++;
+			}
+		}
+
+		SAL_Cryptography_SHA1_Compress8(state, blocks);
+
+		for (i = 0; i < SAL_Cryptography_Lanes; i++) {
+			lane = &lanes[i];
+
+			if (lane->Digest == NULL || lane->FullBlocks > 0 || lane->TailNext < lane->TailBlocks)
+				continue;
+
+			for (j = 0; j < 5; j++)
+				SAL_Cryptography_StoreBig32(lane->Digest + 4 * j, state[j * SAL_Cryptography_Lanes + i]);
+
+			lane->Digest = NULL;
+			active--;
+
+			if (next < count) {
+				SAL_Cryptography_SHA1_StartLane(lane, state, i, sources[next], lengths[next], digests + next * SAL_Cryptography_SHA1Length);
+				next++;
+				active++;
+			}
+		}
+	}
+
+	for (i = 0; i < SAL_Cryptography_Lanes; i++) {
+		lane = &lanes[i];
+
+		if (lane->Digest == NULL)
+			continue;
+
+		for (j = 0; j < 5; j++)
+			single[j] = state[j * SAL_Cryptography_Lanes + i];
+
+		SAL_Cryptography_SHA1_CompressScalar(single, lane->Next, lane->FullBlocks);
+		SAL_Cryptography_SHA1_CompressScalar(single, lane->Tail + 64 * lane->TailNext, lane->TailBlocks - lane->TailNext);
+
+		for (j = 0; j < 5; j++)
+			SAL_Cryptography_StoreBig32(lane->Digest + 4 * j, single[j]);
+	}
+}
+#endif
+
+#ifdef SAL_Cryptography_ARM
+/* the ARMv8 crypto extensions: four rounds per instruction, @a operation being c, p or m for the round function */
+#define SAL_Cryptography_SHA1_GroupARM(operation, current, next, temporary) \
+	next = vsha1h_u32(vgetq_lane_u32(abcd, 0)); \
+	abcd = operation(abcd, current, temporary);
+
+static void SAL_Cryptography_SHA1_CompressARM(uint32* state, const uint8* blocks, uint32 count) {
+	const uint32x4_t k0 = vdupq_n_u32(0x5A827999);
+	const uint32x4_t k1 = vdupq_n_u32(0x6ED9EBA1);
+	const uint32x4_t k2 = vdupq_n_u32(0x8F1BBCDC);
+	const uint32x4_t k3 = vdupq_n_u32(0xCA62C1D6);
+	uint32x4_t abcd, savedAbcd;
+	uint32x4_t t0, t1;
+	uint32x4_t m0, m1, m2, m3;
+	uint32_t e0, e1, savedE0;
+
+	abcd = vld1q_u32(state);
+	e0 = state[4];
+
+	for (; count > 0; count--, blocks += 64) {
+		savedAbcd = abcd;
+		savedE0 = e0;
+
+		m0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks)));
+		m1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + 16)));
+		m2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + 32)));
+		m3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + 48)));
+
+		t0 = vaddq_u32(m0, k0);
+		t1 = vaddq_u32(m1, k0);
+
+		/* each group adds the constant for the group two ahead and advances the schedule for the one four ahead */
+		SAL_Cryptography_SHA1_GroupARM(vsha1cq_u32, e0, e1, t0); t0 = vaddq_u32(m2, k0); m0 = vsha1su0q_u32(m0, m1, m2);
+		SAL_Cryptography_SHA1_GroupARM(vsha1cq_u32, e1, e0, t1); t1 = vaddq_u32(m3, k0); m0 = vsha1su1q_u32(m0, m3); m1 = vsha1su0q_u32(m1, m2, m3);
+		SAL_Cryptography_SHA1_GroupARM(vsha1cq_u32, e0, e1, t0); t0 = vaddq_u32(m0, k0); m1 = vsha1su1q_u32(m1, m0); m2 = vsha1su0q_u32(m2, m3, m0);
+		SAL_Cryptography_SHA1_GroupARM(vsha1cq_u32, e1, e0, t1); t1 = vaddq_u32(m1, k1); m2 = vsha1su1q_u32(m2, m1); m3 = vsha1su0q_u32(m3, m0, m1);
+		SAL_Cryptography_SHA1_GroupARM(vsha1cq_u32, e0, e1, t0); t0 = vaddq_u32(m2, k1); m3 = vsha1su1q_u32(m3, m2); m0 = vsha1su0q_u32(m0, m1, m2);
+		SAL_Cryptography_SHA1_GroupARM(vsha1pq_u32, e1, e0, t1); t1 = vaddq_u32(m3, k1); m0 = vsha1su1q_u32(m0, m3); m1 = vsha1su0q_u32(m1, m2, m3);
+		SAL_Cryptography_SHA1_GroupARM(vsha1pq_u32, e0, e1, t0); t0 = vaddq_u32(m0, k1); m1 = vsha1su1q_u32(m1, m0); m2 = vsha1su0q_u32(m2, m3, m0);
+		SAL_Cryptography_SHA1_GroupARM(vsha1pq_u32, e1, e0, t1); t1 = vaddq_u32(m1, k1); m2 = vsha1su1q_u32(m2, m1); m3 = vsha1su0q_u32(m3, m0, m1);
+		SAL_Cryptography_SHA1_GroupARM(vsha1pq_u32, e0, e1, t0); t0 = vaddq_u32(m2, k2); m3 = vsha1su1q_u32(m3, m2); m0 = vsha1su0q_u32(m0, m1, m2);
+		SAL_Cryptography_SHA1_GroupARM(vsha1pq_u32, e1, e0, t1); t1 = vaddq_u32(m3, k2); m0 = vsha1su1q_u32(m0, m3); m1 = vsha1su0q_u32(m1, m2, m3);
+		SAL_Cryptography_SHA1_GroupARM(vsha1mq_u32, e0, e1, t0); t0 = vaddq_u32(m0, k2); m1 = vsha1su1q_u32(m1, m0); m2 = vsha1su0q_u32(m2, m3, m0);
+		SAL_Cryptography_SHA1_GroupARM(vsha1mq_u32, e1, e0, t1); t1 = vaddq_u32(m1, k2); m2 = vsha1su1q_u32(m2, m1); m3 = vsha1su0q_u32(m3, m0, m1);
+		SAL_Cryptography_SHA1_GroupARM(vsha1mq_u32, e0, e1, t0); t0 = vaddq_u32(m2, k2); m3 = vsha1su1q_u32(m3, m2); m0 = vsha1su0q_u32(m0, m1, m2);
+		SAL_Cryptography_SHA1_GroupARM(vsha1mq_u32, e1, e0, t1); t1 = vaddq_u32(m3, k3); m0 = vsha1su1q_u32(m0, m3); m1 = vsha1su0q_u32(m1, m2, m3);
+		SAL_Cryptography_SHA1_GroupARM(vsha1mq_u32, e0, e1, t0); t0 = vaddq_u32(m0, k3); m1 = vsha1su1q_u32(m1, m0); m2 = vsha1su0q_u32(m2, m3, m0);
+		SAL_Cryptography_SHA1_GroupARM(vsha1pq_u32, e1, e0, t1); t1 = vaddq_u32(m1, k3); m2 = vsha1su1q_u32(m2, m1); m3 = vsha1su0q_u32(m3, m0, m1);
+		SAL_Cryptography_SHA1_GroupARM(vsha1pq_u32, e0, e1, t0); t0 = vaddq_u32(m2, k3); m3 = vsha1su1q_u32(m3, m2);
+		SAL_Cryptography_SHA1_GroupARM(vsha1pq_u32, e1, e0, t1); t1 = vaddq_u32(m3, k3);
+		SAL_Cryptography_SHA1_GroupARM(vsha1pq_u32, e0, e1, t0);
+		SAL_Cryptography_SHA1_GroupARM(vsha1pq_u32, e1, e0, t1);
+
+		e0 += savedE0;
+		abcd = vaddq_u32(abcd, savedAbcd);
+	}
+
+	vst1q_u32(state, abcd);
+	state[4] = e0;
+}
+#endif
+
+/* the processor features the batch hashes can use, looked up once */
+static uint32 SAL_Cryptography_GetFeatures(void) {
+	static uint32 features = SAL_Cryptography_Features_Unknown;
+	uint32 found = 0;
+
+	if (SAL_Atomic_Load32(&features) != SAL_Cryptography_Features_Unknown)
+		return features;
+
+#if defined SAL_Cryptography_X86 && defined _MSC_VER
+	{
+		int registers[4];
+		boolean saved;
+
+		__cpuid(registers, 1);
+		saved = (registers[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6; /* the OS keeps the AVX registers across switches */
+
+		__cpuidex(registers, 7, 0);
+		if (registers[1] & (1 << 29))
+			found |= SAL_Cryptography_Features_SHA;
+
+		if (saved && (registers[1] & (1 << 5)))
+			found |= SAL_Cryptography_Features_AVX2;
+	}
+#elif defined SAL_Cryptography_X86
+	{
+		unsigned int eax, ebx, ecx, edx;
+		unsigned int low, high;
+		boolean saved = false;
+
+		if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1 << 27))) {
+			__asm__ __volatile__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+			saved = (low & 6) == 6; /* the OS keeps the AVX registers across switches */
+		}
+
+		if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+			if (ebx & (1 << 29))
+				found |= SAL_Cryptography_Features_SHA;
+
+			if (saved && (ebx & (1 << 5)))
+				found |= SAL_Cryptography_Features_AVX2;
+		}
+	}
+#elif defined SAL_Cryptography_ARM
+	found |= SAL_Cryptography_Features_SHA;
+#endif
+
+	SAL_Atomic_Store32(&features, found);
+
+	return found;
+}
+
+/* SHA-1 of one message with @a compress, without a context */
+static void SAL_Cryptography_SHA1_Message(const uint8* source, uint32 length, uint8* digest, SAL_Cryptography_SHA1Compress compress) {
+	uint32 state[5];
+	uint8 tail[128];
+	uint32 tailBlocks;
+	uint32 i;
+
+	memcpy(state, sha1Initial, sizeof(state));
+
+	compress(state, source, length / 64);
+
+	tailBlocks = SAL_Cryptography_SHA1_Pad(source + length / 64 * 64, length % 64, length, tail);
+	compress(state, tail, tailBlocks);
+
+	for (i = 0; i < 5; i++)
+		SAL_Cryptography_StoreBig32(digest + 4 * i, state[i]);
+}
+
+/**
+ * Hash @a count independent messages using SHA-1 in one call, for the many
+ * small messages (keys, handshake tokens) where the setup of each hash would
+ * cost more than the hashing.
+ *
+ * On x86 processors with AVX2, eight messages are hashed at once, one per
+ * vector lane, each lane moving on to the next message as soon as its own is
+ * done. Smaller batches and other processors use the SHA instructions where
+ * they exist (SHA-NI on x86, the ARMv8 crypto extensions) and portable code
+ * otherwise. No path allocates.
+ *
+ * @param sources [in] the messages
+ * @param lengths [in] the length of each message in bytes
+ * @param count [in] number of messages
+ * @param digests [out] room for @a count digests of
+ * @ref SAL_Cryptography_SHA1Length bytes, stored one after another in the
+ * order of @a sources
+ */
+void SAL_Cryptography_SHA1Batch(const uint8* const* sources, const uint32* lengths, uint32 count, uint8* digests) {
+	SAL_Cryptography_SHA1Compress compress = SAL_Cryptography_SHA1_CompressScalar;
+	uint32 features = SAL_Cryptography_GetFeatures();
+	uint32 i;
+
+	assert(sources != NULL || count == 0);
+	assert(lengths != NULL || count == 0);
+	assert(digests != NULL || count == 0);
+
+#ifdef SAL_Cryptography_X86
+	/* eight lanes outrun even the SHA instructions, once there are enough messages to keep most of them busy */
+	if ((features & SAL_Cryptography_Features_AVX2) && count >= SAL_Cryptography_Lanes / 2) {
+		SAL_Cryptography_SHA1_BatchLanes(sources, lengths, count, digests);
+		return;
+	}
+
+	if (features & SAL_Cryptography_Features_SHA)
+		compress = SAL_Cryptography_SHA1_CompressSHA;
+#elif defined SAL_Cryptography_ARM
+	if (features & SAL_Cryptography_Features_SHA)
+		compress = SAL_Cryptography_SHA1_CompressARM;
+#else
+	(void)features;
+#endif
+
+	for (i = 0; i < count; i++)
+		SAL_Cryptography_SHA1_Message(sources[i], lengths[i], digests + i * SAL_Cryptography_SHA1Length, compress);
+}
+
+/**
+ * Hash @a count independent messages using SHA512 in one call, with one
+ * context kept by the calling thread for all of them.
+ *
+ * @param sources [in] the messages
+ * @param lengths [in] the length of each message in bytes
+ * @param count [in] number of messages
+ * @param digests [out] room for @a count digests of
+ * @ref SAL_Cryptography_SHA512Length bytes, stored one after another in the
+ * order of @a sources
+ */
+void SAL_Cryptography_SHA512Batch(const uint8* const* sources, const uint32* lengths, uint32 count, uint8* digests) {
+	SAL_Cryptography_Hash* hash;
+	uint32 i;
+
+	assert(sources != NULL || count == 0);
+	assert(lengths != NULL || count == 0);
+	assert(digests != NULL || count == 0);
+
+	if (count == 0)
+		return;
+
+	hash = SAL_Cryptography_GetThreadHash(SAL_Cryptography_Algorithms_SHA512);
+
+	if (hash == NULL) {
+		for (i = 0; i < count; i++)
+			SAL_Cryptography_HashOnce(SAL_Cryptography_Algorithms_SHA512, sources[i], lengths[i], digests + i * SAL_Cryptography_SHA512Length);
+
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		SAL_Cryptography_Hash_Update(hash, sources[i], lengths[i]);
+		SAL_Cryptography_Hash_Finish(hash, digests + i * SAL_Cryptography_SHA512Length);
+	}
+}
+
+/* ChaCha20 generator state; each thread has its own, so generating never takes a lock */
+typedef struct {
+	uint32 Key[8];
+	uint64 Counter;
+	uint8 Buffer[SAL_Cryptography_RandomBlocks * 64];
+	uint32 Available; /* unread bytes at the end of Buffer */
+	uint32 Generation; /* forkGeneration when the key was last drawn from the system */
+	boolean Seeded;
+} SAL_Cryptography_Generator;
+
+static SAL_ThreadLocal SAL_Cryptography_Generator generator;
+
+/* bumped in fork children so they rekey instead of repeating their parent's output */
+static uint32 forkGeneration = 0;
+
+#ifdef POSIX
+static void SAL_Cryptography_OnFork(void) {
+	SAL_Atomic_Increment32(&forkGeneration);
+}
+#endif
+
+#define SAL_Cryptography_Rotate(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
+
+#define SAL_Cryptography_QuarterRound(a, b, c, d) \
+	a += b; d ^= a; d = SAL_Cryptography_Rotate(d, 16); \
+	c += d; b ^= c; b = SAL_Cryptography_Rotate(b, 12); \
+	a += b; d ^= a; d = SAL_Cryptography_Rotate(d, 8); \
+	c += d; b ^= c; b = SAL_Cryptography_Rotate(b, 7);
+
+#if defined SAL_Cryptography_X86 && (defined __x86_64__ || defined _M_X64)
+#define SAL_Cryptography_Rotate4(value, bits) _mm_or_si128(_mm_slli_epi32(value, bits), _mm_srli_epi32(value, 32 - (bits)))
+
+#define SAL_Cryptography_QuarterRound4(a, b, c, d) \
+	a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = SAL_Cryptography_Rotate4(d, 16); \
+	c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = SAL_Cryptography_Rotate4(b, 12); \
+	a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = SAL_Cryptography_Rotate4(d, 8); \
+	c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = SAL_Cryptography_Rotate4(b, 7);
+
+/* four consecutive blocks at once with SSE2, which every x64 processor has: each vector holds one word of all four */
+static void SAL_Cryptography_ChaCha20x4(SAL_Cryptography_Generator* state, uint8* output) {
+	static const uint32 constants[4] = { 0x61707865, 0x3320646E, 0x79622D32, 0x6B206574 };
+	__m128i input[16];
+	__m128i x[16];
+	__m128i t0, t1, t2, t3;
+	uint64 counter = state->Counter;
+	uint32 i;
+
+	for (i = 0; i < 4; i++)
+		input[i] = _mm_set1_epi32((int)constants[i]);
+
+	for (i = 0; i < 8; i++)
+		input[4 + i] = _mm_set1_epi32((int)state->Key[i]);
+
+	input[12] = _mm_setr_epi32((int)(uint32)counter, (int)(uint32)(counter + 1), (int)(uint32)(counter + 2), (int)(uint32)(counter + 3));
+	input[13] = _mm_setr_epi32((int)(uint32)(counter >> 32), (int)(uint32)((counter + 1) >> 32), (int)(uint32)((counter + 2) >> 32), (int)(uint32)((counter + 3) >> 32));
+	input[14] = _mm_setzero_si128();
+	input[15] = _mm_setzero_si128();
+	state->Counter += 4;
+
+	for (i = 0; i < 16; i++)
+		x[i] = input[i];
+
+	for (i = 0; i < 10; i++) {
+		SAL_Cryptography_QuarterRound4(x[0], x[4], x[8], x[12]);
+		SAL_Cryptography_QuarterRound4(x[1], x[5], x[9], x[13]);
+		SAL_Cryptography_QuarterRound4(x[2], x[6], x[10], x[14]);
+		SAL_Cryptography_QuarterRound4(x[3], x[7], x[11], x[15]);
+		SAL_Cryptography_QuarterRound4(x[0], x[5], x[10], x[15]);
+		SAL_Cryptography_QuarterRound4(x[1], x[6], x[11], x[12]);
+		SAL_Cryptography_QuarterRound4(x[2], x[7], x[8], x[13]);
+		SAL_Cryptography_QuarterRound4(x[3], x[4], x[9], x[14]);
+	}
+
+	/* transposed four words at a time back into block order */
+	for (i = 0; i < 16; i += 4) {
+		t0 = _mm_unpacklo_epi32(_mm_add_epi32(x[i], input[i]), _mm_add_epi32(x[i + 1], input[i + 1]));
+		t1 = _mm_unpacklo_epi32(_mm_add_epi32(x[i + 2], input[i + 2]), _mm_add_epi32(x[i + 3], input[i + 3]));
+		t2 = _mm_unpackhi_epi32(_mm_add_epi32(x[i], input[i]), _mm_add_epi32(x[i + 1], input[i + 1]));
+		t3 = _mm_unpackhi_epi32(_mm_add_epi32(x[i + 2], input[i + 2]), _mm_add_epi32(x[i + 3], input[i + 3]));
+
+		_mm_storeu_si128((__m128i*)(output + 0 * 64 + 4 * i), _mm_unpacklo_epi64(t0, t1));
+		_mm_storeu_si128((__m128i*)(output + 1 * 64 + 4 * i), _mm_unpackhi_epi64(t0, t1));
+		_mm_storeu_si128((__m128i*)(output + 2 * 64 + 4 * i), _mm_unpacklo_epi64(t2, t3));
+		_mm_storeu_si128((__m128i*)(output + 3 * 64 + 4 * i), _mm_unpackhi_epi64(t2, t3));
+	}
+}
+#define SAL_Cryptography_HaveChaCha20x4
+#endif
+
+/* writes @a count ChaCha20 blocks of the thread's key stream to @a output and advances the counter */
+static void SAL_Cryptography_ChaCha20(SAL_Cryptography_Generator* state, uint8* output, uint32 count) {
+	uint32 input[16];
+	uint32 x[16];
+	uint32 i;
+
+#ifdef SAL_Cryptography_HaveChaCha20x4
+	for (; count >= 4; count -= 4, output += 4 * 64)
+		SAL_Cryptography_ChaCha20x4(state, output);
+#endif
+
+	/* "expand 32-byte k" */
+	input[0] = 0x61707865;
+	input[1] = 0x3320646E;
+	input[2] = 0x79622D32;
+	input[3] = 0x6B206574;
+	memcpy(input + 4, state->Key, sizeof(state->Key));
+	input[14] = 0;
+	input[15] = 0;
+
+	for (; count > 0; count--, output += 64) {
+		input[12] = (uint32)state->Counter;
+		input[13] = (uint32)(state->Counter >> 32);
+		state->Counter++;
+
+		memcpy(x, input, sizeof(x));
+
+		for (i = 0; i < 10; i++) {
+			SAL_Cryptography_QuarterRound(x[0], x[4], x[8], x[12]);
+			SAL_Cryptography_QuarterRound(x[1], x[5], x[9], x[13]);
+			SAL_Cryptography_QuarterRound(x[2], x[6], x[10], x[14]);
+			SAL_Cryptography_QuarterRound(x[3], x[7], x[11], x[15]);
+			SAL_Cryptography_QuarterRound(x[0], x[5], x[10], x[15]);
+			SAL_Cryptography_QuarterRound(x[1], x[6], x[11], x[12]);
+			SAL_Cryptography_QuarterRound(x[2], x[7], x[8], x[13]);
+			SAL_Cryptography_QuarterRound(x[3], x[4], x[9], x[14]);
+		}
+
+		for (i = 0; i < 16; i++) {
+			x[i] += input[i];
+			output[4 * i + 0] = (uint8)x[i];
+			output[4 * i + 1] = (uint8)(x[i] >> 8);
+			output[4 * i + 2] = (uint8)(x[i] >> 16);
+			output[4 * i + 3] = (uint8)(x[i] >> 24);
+		}
+	}
+}
+
+/* fills @a buffer from the system's random source, false if it failed */
+static boolean SAL_Cryptography_SystemRandom(uint8* buffer, uint32 count) {
+#ifdef WINDOWS
+	return BCryptGenRandom(NULL, buffer, count, BCRYPT_USE_SYSTEM_PREFERRED_RNG) == 0;
 #elif defined POSIX
-	EVP_MD_CTX *ctx = EVP_MD_CTX_create();
-	uint8 *hash = AllocateArray(uint8, EVP_MD_size(EVP_sha1()));
+	ssize_t result;
+	int source;
 
-	EVP_DigestInit_ex(ctx, EVP_sha1(), NULL);
-	EVP_DigestUpdate(ctx, (void*)source, length);
-	EVP_DigestFinal_ex(ctx, (unsigned char*)hash, NULL);
+	#ifdef __linux__
+		while (count > 0) {
+			result = syscall(SYS_getrandom, buffer, (size_t)count, 0);
 
-	return hash;
+			if (result < 0 && errno == EINTR)
+				continue;
+
+			if (result <= 0)
+				break;
+
+			buffer += result;
+			count -= (uint32)result;
+		}
+
+		if (count == 0)
+			return true;
+	#endif
+
+	/* kernels without getrandom, and the other systems */
+	source = open("/dev/urandom", O_RDONLY);
+	if (source < 0)
+		return false;
+
+	while (count > 0) {
+		result = read(source, buffer, count);
+
+		if (result < 0 && errno == EINTR)
+			continue;
+
+		if (result <= 0)
+			break;
+
+		buffer += result;
+		count -= (uint32)result;
+	}
+
+	close(source);
+
+	return count == 0;
 #endif
 }
 
+/* draws a fresh key for the calling thread from the system */
+static void SAL_Cryptography_Seed(SAL_Cryptography_Generator* state) {
+#ifdef POSIX
+	static uint32 registered = 0;
+
+	if (SAL_Atomic_Load32(&registered) == 0 && SAL_Atomic_CompareExchange32(&registered, 0, 1))
+		pthread_atfork(NULL, NULL, SAL_Cryptography_OnFork);
+#endif
+
+	state->Generation = SAL_Atomic_Load32(&forkGeneration);
+
+	if (!SAL_Cryptography_SystemRandom((uint8*)state->Key, sizeof(state->Key))) {
+		/* no system source at all: far weaker, but still distinct per thread and per run */
+		state->Key[0] ^= (uint32)SAL_Time_MonotonicNanoseconds();
+		state->Key[1] ^= (uint32)((uint64)SAL_Time_MonotonicNanoseconds() >> 32);
+		state->Key[2] ^= (uint32)SAL_Time_Now();
+		state->Key[3] ^= (uint32)(uintptr_t)state;
+		state->Key[4] ^= (uint32)((uint64)(uintptr_t)state >> 32);
+		state->Key[5] ^= (uint32)SAL_Time_Cycles();
+	}
+
+	state->Counter = 0;
+	state->Available = 0;
+	state->Seeded = true;
+}
+
+/* generates the next blocks into the thread's buffer; the first 32 bytes replace the key at once, so output already handed out cannot be recomputed from a later state */
+static void SAL_Cryptography_Refill(SAL_Cryptography_Generator* state) {
+	SAL_Cryptography_ChaCha20(state, state->Buffer, SAL_Cryptography_RandomBlocks);
+
+	memcpy(state->Key, state->Buffer, sizeof(state->Key));
+	memset(state->Buffer, 0, sizeof(state->Key));
+
+	state->Available = sizeof(state->Buffer) - sizeof(state->Key);
+}
+
+/* the calling thread's generator, keyed */
+static SAL_Cryptography_Generator* SAL_Cryptography_GetGenerator(void) {
+	SAL_Cryptography_Generator* state = &generator;
+
+	if (!state->Seeded || state->Generation != SAL_Atomic_Load32(&forkGeneration))
+		SAL_Cryptography_Seed(state);
+
+	return state;
+}
 
 /**
- * Generate pseudorandom bytes.
+ * Fill @a buffer with cryptographically secure random bytes.
  *
- * @param count [in] number of bytes to generate
- * @returns pointer to @a count bytes.
+ * Each thread runs its own ChaCha20 generator, keyed from the system
+ * (getrandom, /dev/urandom or BCryptGenRandom) on first use and again after
+ * a fork, so generating scales across threads without any locking. The key
+ * is replaced after every batch, so a thread's state never reveals output it
+ * already produced.
  *
- * @warning You need to free the returned memory yourself
+ * @param buffer [out] where to write the bytes
+ * @param count [in] number of bytes to write
  */
-uint8* SAL_Cryptography_RandomBytes(uint64 count) {
-	uint8* bytes = NULL;
-	uint8 i;
+void SAL_Cryptography_RandomFill(uint8* buffer, uint64 count) {
+	SAL_Cryptography_Generator* state;
+	uint64 blocks;
+	uint32 chunk;
 
-	if (count > 0) {
-		bytes = AllocateArray(uint8, count); // Integer division rounds towards 0, count % 4 is the remainder
+	assert(buffer != NULL || count == 0);
+
+	if (count == 0)
+		return;
 
-		if (!seeded) {
-			srand( (uint32)SAL_Time_Now() );
-			seeded = true;
+	state = SAL_Cryptography_GetGenerator();
+
+	while (true) {
+		chunk = count < state->Available ? (uint32)count : state->Available;
+
+		memcpy(buffer, state->Buffer + sizeof(state->Buffer) - state->Available, chunk);
+		memset(state->Buffer + sizeof(state->Buffer) - state->Available, 0, chunk);
+		state->Available -= chunk;
+		buffer += chunk;
+		count -= chunk;
+
+		/* large requests get their whole blocks straight from the key stream, the key only changing once afterwards */
+		if (count >= sizeof(state->Buffer)) {
+			blocks = count / 64;
+			while (blocks > 0) {
+				chunk = blocks > 0x10000 ? 0x10000 : (uint32)blocks;
+				SAL_Cryptography_ChaCha20(state, buffer, chunk);
+				buffer += (uint64)chunk * 64;
+				count -= (uint64)chunk * 64;
+				blocks -= chunk;
+			}
 		}
 
-		for (; count > 3; count -= 4)
-			*((uint32*)bytes + count - 4) = rand();
+		if (state->Available == 0)
+			SAL_Cryptography_Refill(state);
 
-		for (i = 0; i < count; i++)
-			*(bytes + i) = (uint8)rand();
+		if (count == 0)
+			return;
 	}
+}
 
-	return bytes;
+/* a uniformly random 32 bit value */
+static uint32 SAL_Cryptography_Random32(void) {
+	SAL_Cryptography_Generator* state = SAL_Cryptography_GetGenerator();
+	uint32 value;
+
+	if (state->Available < sizeof(uint32))
+		SAL_Cryptography_Refill(state);
+
+	memcpy(&value, state->Buffer + sizeof(state->Buffer) - state->Available, sizeof(uint32));
+	memset(state->Buffer + sizeof(state->Buffer) - state->Available, 0, sizeof(uint32));
+	state->Available -= sizeof(uint32);
+
+	return value;
+}
+
+static uint64 SAL_Cryptography_Random64(void) {
+	uint64 value = SAL_Cryptography_Random32();
+
+	return (value << 32) | SAL_Cryptography_Random32();
+}
+
+/* the full 128 bit product of @a a and @a b: the low half is returned, the high half stored in @a high */
+static uint64 SAL_Cryptography_Multiply64(uint64 a, uint64 b, uint64* high) {
+#if defined __SIZEOF_INT128__
+	unsigned __int128 product = (unsigned __int128)a * b;
+
+	*high = (uint64)(product >> 64);
+
+	return (uint64)product;
+#elif defined _MSC_VER && defined _M_X64
+	return _umul128(a, b, high);
+#else
+	uint64 lowLow = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+	uint64 highLow = (a >> 32) * (b & 0xFFFFFFFF);
+	uint64 lowHigh = (a & 0xFFFFFFFF) * (b >> 32);
+	uint64 highHigh = (a >> 32) * (b >> 32);
+	uint64 middle = (lowLow >> 32) + (highLow & 0xFFFFFFFF) + lowHigh;
+
+	*high = highHigh + (highLow >> 32) + (middle >> 32);
+
+	return (middle << 32) | (lowLow & 0xFFFFFFFF);
+#endif
+}
+
+/* a uniformly random value below @a range, by Lemire's multiply-and-reject: no division unless the first draw lands in the biased sliver */
+static uint32 SAL_Cryptography_Below32(uint32 range) {
+	uint64 product = (uint64)SAL_Cryptography_Random32() * range;
+	uint32 threshold;
+
+	if ((uint32)product < range) {
+		threshold = (uint32)(0 - range) % range;
+
+		while ((uint32)product < threshold)
+			product = (uint64)SAL_Cryptography_Random32() * range;
+	}
+
+	return (uint32)(product >> 32);
+}
+
+static uint64 SAL_Cryptography_Below64(uint64 range) {
+	uint64 high;
+	uint64 low = SAL_Cryptography_Multiply64(SAL_Cryptography_Random64(), range, &high);
+	uint64 threshold;
+
+	if (low < range) {
+		threshold = (0 - range) % range;
+
+		while (low < threshold)
+			low = SAL_Cryptography_Multiply64(SAL_Cryptography_Random64(), range, &high);
+	}
+
+	return high;
 }
 
 /**
- * Generate a 8 byte pseudorandom value.
+ * Generate cryptographically secure random bytes, see
+ * @ref SAL_Cryptography_RandomFill.
  *
- * @param floor [in] Lower bound of random value
- * @param ceiling [in] Upper bound of random value
- * @returns 8 pseudorandom bytes
+ * @param count [in] number of bytes to generate
+ * @returns pointer to @a count bytes.
+ *
+ * @warning Free the returned memory with @ref SAL_Allocator_Free, or use
+ * @ref SAL_Cryptography_RandomFill to write into memory of your own.
  */
-uint64 SAL_Cryptography_RandomUInt64(uint64 floor, uint64 ceiling) {
-	uint64 result;
+uint8* SAL_Cryptography_RandomBytes(uint64 count) {
+	uint8* bytes = NULL;
 
-	if (!seeded) {
-		srand( (uint32)SAL_Time_Now() );
-		seeded = true;
+	if (count > 0) {
+		bytes = SAL_Allocator_NewArray(uint8, count);
+		SAL_Cryptography_RandomFill(bytes, count);
 	}
 
-	result = (uint32)rand();
-	result <<= 32;
-	result += (uint32)rand();
+	return bytes;
+}
 
-	result = result % (ceiling - floor) + floor;
+/**
+ * Generate a 8 byte random value. Every value in the range is equally
+ * likely.
+ *
+ * @param floor [in] Lower bound of random value
+ * @param ceiling [in] Upper bound of random value, excluded
+ * @returns a value from @a floor up to but not including @a ceiling, or
+ * @a floor if the range is empty
+ */
+uint64 SAL_Cryptography_RandomUInt64(uint64 floor, uint64 ceiling) {
+	if (ceiling <= floor)
+		return floor;
 
-	return result;
+	return floor + SAL_Cryptography_Below64(ceiling - floor);
 }
 
 /**
- * Generate a 4 byte pseudorandom value.
+ * Generate a 4 byte random value. Every value in the range is equally
+ * likely.
  *
  * @param floor [in] Lower bound of random value
- * @param ceiling [in] Upper bound of random value
- * @returns 4 pseudorandom bytes
+ * @param ceiling [in] Upper bound of random value, excluded
+ * @returns a value from @a floor up to but not including @a ceiling, or
+ * @a floor if the range is empty
  */
 uint32 SAL_Cryptography_RandomUInt32(uint32 floor, uint32 ceiling) {
-	uint32 result;
+	if (ceiling <= floor)
+		return floor;
 
-	if (!seeded) {
-		srand( (uint32)SAL_Time_Now() );
-		seeded = true;
-	}
-	result = rand() % (ceiling - floor) + floor;
-
-	return (uint32)result;
+	return floor + SAL_Cryptography_Below32(ceiling - floor);
 }
 
 /**
- * Generate a 2 byte pseudorandom value.
+ * Generate a 2 byte random value. Every value in the range is equally
+ * likely.
  *
  * @param floor [in] Lower bound of random value
- * @param ceiling [in] Upper bound of random value
- * @returns 2 pseudorandom bytes
+ * @param ceiling [in] Upper bound of random value, excluded
+ * @returns a value from @a floor up to but not including @a ceiling, or
+ * @a floor if the range is empty
  */
 uint16 SAL_Cryptography_RandomUInt16(uint16 floor, uint16 ceiling) {
-	uint16 result;
-
-	if (!seeded) {
-		srand( (uint32)SAL_Time_Now() );
-		seeded = true;
-	}
-	result = rand() % (ceiling - floor) + floor;
+	if (ceiling <= floor)
+		return floor;
 
-	return (uint16)result;
+	return (uint16)(floor + SAL_Cryptography_Below32((uint32)(ceiling - floor)));
 }
 
 /**
- * Generate a 1 byte pseudorandom value.
+ * Generate a 1 byte random value. Every value in the range is equally
+ * likely.
  *
  * @param floor [in] Lower bound of random value
- * @param ceiling [in] Upper bound of random value
- * @returns 1 pseudorandom byte
+ * @param ceiling [in] Upper bound of random value, excluded
+ * @returns a value from @a floor up to but not including @a ceiling, or
+ * @a floor if the range is empty
  */
 uint8 SAL_Cryptography_RandomUInt8(uint8 floor, uint8 ceiling) {
-	uint8 result;
-
-	if (!seeded) {
-		srand( (uint32)SAL_Time_Now() );
-		seeded = true;
-	}
-	result = rand() % (ceiling - floor) + floor;
+	if (ceiling <= floor)
+		return floor;
 
-	return (uint8)result;
+	return (uint8)(floor + SAL_Cryptography_Below32((uint32)(ceiling - floor)));
 }
@@ -3,10 +3,32 @@
 
 #include "Common.h"
 
+/* algorithms for SAL_Cryptography_Hash_Create */
+#define SAL_Cryptography_Algorithms_SHA1 0
+#define SAL_Cryptography_Algorithms_SHA512 1
+
+/* digest sizes in bytes */
+#define SAL_Cryptography_SHA1Length 20
+#define SAL_Cryptography_SHA512Length 64
+
+typedef struct SAL_Cryptography_Hash SAL_Cryptography_Hash;
+
 public uint8* SAL_Cryptography_SHA512(uint8* source, uint32 length);
 public uint8* SAL_Cryptography_SHA1(uint8* source, uint32 length);
+public void SAL_Cryptography_SHA512Into(const uint8* source, uint32 length, uint8* digest);
+public void SAL_Cryptography_SHA1Into(const uint8* source, uint32 length, uint8* digest);
+public void SAL_Cryptography_SHA512Batch(const uint8* const* sources, const uint32* lengths, uint32 count, uint8* digests);
+public void SAL_Cryptography_SHA1Batch(const uint8* const* sources, const uint32* lengths, uint32 count, uint8* digests);
+
+public SAL_Cryptography_Hash* SAL_Cryptography_Hash_Create(uint8 algorithm);
+public void SAL_Cryptography_Hash_Free(SAL_Cryptography_Hash* hash);
+public void SAL_Cryptography_Hash_Update(SAL_Cryptography_Hash* hash, const uint8* source, uint32 length);
+public void SAL_Cryptography_Hash_Finish(SAL_Cryptography_Hash* hash, uint8* digest);
+public void SAL_Cryptography_Hash_Reset(SAL_Cryptography_Hash* hash);
+public uint32 SAL_Cryptography_Hash_GetLength(SAL_Cryptography_Hash* hash);
 
 public uint8* SAL_Cryptography_RandomBytes(uint64 count);
+public void SAL_Cryptography_RandomFill(uint8* buffer, uint64 count);
 
 public uint64 SAL_Cryptography_RandomUInt64(uint64 floor, uint64 ceiling);
 public uint32 SAL_Cryptography_RandomUInt32(uint32 floor, uint32 ceiling);
@@ -0,0 +1,276 @@
+/** vim: set noet ci pi sts=0 sw=4 ts=4
+ * @file Queue.c
+ * @brief Bounded lock-free queues for handing items between threads.
+ *
+ * SAL_MPMCQueue is Dmitry Vyukov's bounded queue: every cell carries a
+ * sequence number that tells producers and consumers whether it is theirs to
+ * fill or empty, so each side claims a position with one compare-exchange and
+ * never waits on the other. SAL_SPSCQueue serves a single producer and a
+ * single consumer with plain loads and stores, each side caching the other's
+ * position so the shared line is only read when the queue looks full or
+ * empty. Neither queue blocks: a full push and an empty pop fail at once.
+ */
+
+#include "Queue.h"
+
+#include "Allocator.h"
+#include "Atomic.h"
+
+#define SAL_Queue_CacheLine 64
+
+typedef struct {
+	uint32 Sequence;
+	void* Item;
+} SAL_MPMCQueue_Cell;
+
+/* producers and consumers each move one position, kept on lines of their own */
+struct SAL_MPMCQueue {
+	SAL_MPMCQueue_Cell* Cells;
+	uint32 Mask;
+	uint8 Padding0[SAL_Queue_CacheLine - sizeof(SAL_MPMCQueue_Cell*) - sizeof(uint32)];
+	uint32 Enqueue;
+	uint8 Padding1[SAL_Queue_CacheLine - sizeof(uint32)];
+	uint32 Dequeue;
+	uint8 Padding2[SAL_Queue_CacheLine - sizeof(uint32)];
+};
+
+/* Tail is written by the producer, Head by the consumer, each keeps its last view of the other */
+struct SAL_SPSCQueue {
+	void** Items;
+	uint32 Mask;
+	uint8 Padding0[SAL_Queue_CacheLine - sizeof(void**) - sizeof(uint32)];
+	uint32 Tail;
+	uint32 CachedHead;
+	uint8 Padding1[SAL_Queue_CacheLine - 2 * sizeof(uint32)];
+	uint32 Head;
+	uint32 CachedTail;
+	uint8 Padding2[SAL_Queue_CacheLine - 2 * sizeof(uint32)];
+};
+
+/* rounds @a capacity up to a power of two, at least 2 */
+static uint32 SAL_Queue_RoundCapacity(uint32 capacity) {
+	uint32 rounded = 2;
+
+	while (rounded < capacity && rounded < 0x80000000)
+		rounded <<= 1;
+
+	return rounded;
+}
+
+/**
+ * Create a queue any number of threads can push to and pop from at once.
+ *
+ * @param capacity Most items held at once, rounded up to a power of two
+ * @returns the new queue.
+ */
+SAL_MPMCQueue* SAL_MPMCQueue_Create(uint32 capacity) {
+	SAL_MPMCQueue* queue;
+	uint32 i;
+
+	capacity = SAL_Queue_RoundCapacity(capacity);
+
+	queue = SAL_Allocator_New(SAL_MPMCQueue);
+	queue->Cells = SAL_Allocator_NewArray(SAL_MPMCQueue_Cell, capacity);
+	queue->Mask = capacity - 1;
+	queue->Enqueue = 0;
+	queue->Dequeue = 0;
+
+	/* a cell is free for the producer at position p while its sequence is p */
+	for (i = 0; i < capacity; i++) {
+		queue->Cells[i].Sequence = i;
+		queue->Cells[i].Item = NULL;
+	}
+
+	return queue;
+}
+
+/**
+ * Free @a queue. Items still in it are not touched.
+ *
+ * @param queue Queue to free, no longer used by any thread
+ */
+void SAL_MPMCQueue_Free(SAL_MPMCQueue* queue) {
+	assert(queue != NULL);
+
+	SAL_Allocator_Free(queue->Cells);
+	SAL_Allocator_Free(queue);
+}
+
+/**
+ * Add @a item to the back of @a queue. May be called from any thread.
+ *
+ * @param queue Queue to add to
+ * @param item Item to add, not NULL
+ * @returns true on success, false if @a queue is full.
+ */
+boolean SAL_MPMCQueue_Push(SAL_MPMCQueue* queue, void* item) {
+	SAL_MPMCQueue_Cell* cell;
+	uint32 position;
+	int32 difference;
+
+	assert(queue != NULL);
+	assert(item != NULL);
+
+	position = SAL_Atomic_Load32(&queue->Enqueue);
+
+	while (true) {
+		cell = &queue->Cells[position & queue->Mask];
+		difference = (int32)(SAL_Atomic_Load32(&cell->Sequence) - position);
+
+		if (difference == 0) {
+			if (SAL_Atomic_CompareExchange32(&queue->Enqueue, position, position + 1))
+				break;
+
+			position = SAL_Atomic_Load32(&queue->Enqueue);
+		}
+		else if (difference < 0) {
+			/* the cell still holds the item from a lap ago */
+			return false;
+		}
+		else {
+			position = SAL_Atomic_Load32(&queue->Enqueue);
+		}
+	}
+
+	cell->Item = item;
+
+	/* hands the cell to the consumer of this position */
+	SAL_Atomic_Store32(&cell->Sequence, position + 1);
+
+	return true;
+}
+
+/**
+ * Take the item at the front of @a queue. May be called from any thread.
+ *
+ * @param queue Queue to take from
+ * @returns the item, or NULL if @a queue is empty.
+ */
+void* SAL_MPMCQueue_Pop(SAL_MPMCQueue* queue) {
+	SAL_MPMCQueue_Cell* cell;
+	uint32 position;
+	int32 difference;
+	void* item;
+
+	assert(queue != NULL);
+
+	position = SAL_Atomic_Load32(&queue->Dequeue);
+
+	while (true) {
+		cell = &queue->Cells[position & queue->Mask];
+		difference = (int32)(SAL_Atomic_Load32(&cell->Sequence) - (position + 1));
+
+		if (difference == 0) {
+			if (SAL_Atomic_CompareExchange32(&queue->Dequeue, position, position + 1))
+				break;
+
+			position = SAL_Atomic_Load32(&queue->Dequeue);
+		}
+		else if (difference < 0) {
+			return NULL;
+		}
+		else {
+			position = SAL_Atomic_Load32(&queue->Dequeue);
+		}
+	}
+
+	item = cell->Item;
+
+	/* hands the cell to the producer one lap later */
+	SAL_Atomic_Store32(&cell->Sequence, position + queue->Mask + 1);
+
+	return item;
+}
+
+/**
+ * Create a queue for exactly one producing and one consuming thread.
+ *
+ * @param capacity Most items held at once, rounded up to a power of two
+ * @returns the new queue.
+ */
+SAL_SPSCQueue* SAL_SPSCQueue_Create(uint32 capacity) {
+	SAL_SPSCQueue* queue;
+
+	capacity = SAL_Queue_RoundCapacity(capacity);
+
+	queue = SAL_Allocator_New(SAL_SPSCQueue);
+	queue->Items = SAL_Allocator_NewArray(void*, capacity);
+	queue->Mask = capacity - 1;
+	queue->Tail = 0;
+	queue->CachedHead = 0;
+	queue->Head = 0;
+	queue->CachedTail = 0;
+
+	return queue;
+}
+
+/**
+ * Free @a queue. Items still in it are not touched.
+ *
+ * @param queue Queue to free, no longer used by either thread
+ */
+void SAL_SPSCQueue_Free(SAL_SPSCQueue* queue) {
+	assert(queue != NULL);
+
+	SAL_Allocator_Free(queue->Items);
+	SAL_Allocator_Free(queue);
+}
+
+/**
+ * Add @a item to the back of @a queue.
+ *
+ * @param queue Queue to add to
+ * @param item Item to add, not NULL
+ * @returns true on success, false if @a queue is full.
+ *
+ * @warning Only the one producing thread may call this.
+ */
+boolean SAL_SPSCQueue_Push(SAL_SPSCQueue* queue, void* item) {
+	uint32 tail;
+
+	assert(queue != NULL);
+	assert(item != NULL);
+
+	tail = queue->Tail;
+
+	if (tail - queue->CachedHead > queue->Mask) {
+		queue->CachedHead = SAL_Atomic_Load32(&queue->Head);
+
+		if (tail - queue->CachedHead > queue->Mask)
+			return false;
+	}
+
+	queue->Items[tail & queue->Mask] = item;
+	SAL_Atomic_Store32(&queue->Tail, tail + 1);
+
+	return true;
+}
+
+/**
+ * Take the item at the front of @a queue.
+ *
+ * @param queue Queue to take from
+ * @returns the item, or NULL if @a queue is empty.
+ *
+ * @warning Only the one consuming thread may call this.
+ */
+void* SAL_SPSCQueue_Pop(SAL_SPSCQueue* queue) {
+	uint32 head;
+	void* item;
+
+	assert(queue != NULL);
+
+	head = queue->Head;
+
+	if (head == queue->CachedTail) {
+		queue->CachedTail = SAL_Atomic_Load32(&queue->Tail);
+
+		if (head == queue->CachedTail)
+			return NULL;
+	}
+
+	item = queue->Items[head & queue->Mask];
+	SAL_Atomic_Store32(&queue->Head, head + 1);
+
+	return item;
+}
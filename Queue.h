@@ -0,0 +1,19 @@
+#ifndef INCLUDE_SAL_QUEUE
+#define INCLUDE_SAL_QUEUE
+
+#include "Common.h"
+
+typedef struct SAL_MPMCQueue SAL_MPMCQueue;
+typedef struct SAL_SPSCQueue SAL_SPSCQueue;
+
+public SAL_MPMCQueue* SAL_MPMCQueue_Create(uint32 capacity);
+public void SAL_MPMCQueue_Free(SAL_MPMCQueue* queue);
+public boolean SAL_MPMCQueue_Push(SAL_MPMCQueue* queue, void* item);
+public void* SAL_MPMCQueue_Pop(SAL_MPMCQueue* queue);
+
+public SAL_SPSCQueue* SAL_SPSCQueue_Create(uint32 capacity);
+public void SAL_SPSCQueue_Free(SAL_SPSCQueue* queue);
+public boolean SAL_SPSCQueue_Push(SAL_SPSCQueue* queue, void* item);
+public void* SAL_SPSCQueue_Pop(SAL_SPSCQueue* queue);
+
+#endif
@@ -0,0 +1,406 @@
+/** vim: set noet ci pi sts=0 sw=4 ts=4
+ * @file Resolver.c
+ * @brief Asynchronous host name resolution with an in-process cache.
+ *
+ * Lookups run on a few resolver threads so no caller ever blocks on DNS, and
+ * their results are cached for a while so reconnects skip the lookup. Callers
+ * asking for a host that is already being looked up wait for that lookup
+ * instead of starting their own.
+ */
+
+#include "Resolver.h"
+
+#include "Allocator.h"
+#include "Atomic.h"
+#include "Thread.h"
+#include "Time.h"
+
+#ifdef WINDOWS
+	#define WIN32_LEAN_AND_MEAN
+	#include <Windows.h>
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+#elif defined POSIX
+	#include <sys/socket.h>
+	#include <sys/types.h>
+	#include <netinet/in.h>
+	#include <netdb.h>
+#endif
+
+#include <string.h>
+
+/* hash buckets of the cache */
+#define SAL_Resolver_Buckets 256
+
+/* lookups that can be in flight at once */
+#define SAL_Resolver_Threads 4
+
+/* how long a result is kept by default, getaddrinfo does not report the record's own TTL */
+#define SAL_Resolver_DefaultTimeToLive 30000
+
+typedef struct SAL_Resolver_Waiter SAL_Resolver_Waiter;
+typedef struct SAL_Resolver_Entry SAL_Resolver_Entry;
+
+struct SAL_Resolver_Waiter {
+	SAL_Resolver_Callback Callback;
+	void* State;
+	SAL_Resolver_Waiter* Next;
+};
+
+/* a cached result, or a lookup in flight while Pending is set */
+struct SAL_Resolver_Entry {
+	int8* Host;
+	int8* Port;
+	uint8 Family;
+	uint32 Hash;
+	boolean Pending;
+	int64 Expires;
+	SAL_Resolver_Address Addresses[SAL_Resolver_MaxAddresses];
+	uint32 Count;
+	SAL_Resolver_Waiter* Waiters;
+	SAL_Resolver_Entry* Next; /* in its bucket */
+	SAL_Resolver_Entry* NextQueued; /* in the lookup queue */
+};
+
+/* the cache is read far more than it changes: hits only take the lock for reading */
+static SAL_RWLock lock = SAL_RWLock_Initializer;
+static SAL_Semaphore queued = NULL;
+static uint32 started = 0;
+static SAL_Resolver_Entry* queueHead = NULL;
+static SAL_Resolver_Entry* queueTail = NULL;
+static SAL_Resolver_Entry* buckets[SAL_Resolver_Buckets];
+static uint32 timeToLive = SAL_Resolver_DefaultTimeToLive;
+
+static SAL_Thread_Start(SAL_Resolver_Run);
+
+static uint32 SAL_Resolver_Hash(const int8* const host, const int8* const port, uint8 family) {
+	const int8* character;
+	uint32 hash = 2166136261U;
+
+	for (character = host; *character != '\0'; character++)
+		hash = (hash ^ (uint8)*character) * 16777619U;
+
+	for (character = port; *character != '\0'; character++)
+		hash = (hash ^ (uint8)*character) * 16777619U;
+
+	return (hash ^ family) * 16777619U;
+}
+
+static int8* SAL_Resolver_Copy(const int8* const source) {
+	size_t length = strlen(source) + 1;
+	int8* copy;
+
+	copy = SAL_Allocator_NewArray(int8, length);
+	memcpy(copy, source, length);
+
+	return copy;
+}
+
+/* the first call starts the resolver threads, racing first calls wait for it to finish */
+static void SAL_Resolver_Initialize(void) {
+	uint32 i;
+
+	if (SAL_Atomic_Load32(&started) == 2)
+		return;
+
+	if (!SAL_Atomic_CompareExchange32(&started, 0, 1)) {
+		while (SAL_Atomic_Load32(&started) != 2)
+			SAL_Thread_Yield();
+
+		return;
+	}
+
+#ifdef WINDOWS
+	{
+		WSADATA startupData;
+		WSAStartup(514, &startupData);
+	}
+#endif
+
+	queued = SAL_Semaphore_Create();
+
+	for (i = 0; i < SAL_Resolver_Threads; i++)
+		SAL_Thread_Create(SAL_Resolver_Run, NULL);
+
+	SAL_Atomic_Store32(&started, 2);
+}
+
+/* the cached entry for @a host and @a port, NULL if there is none. Called with the lock held either way. */
+static SAL_Resolver_Entry* SAL_Resolver_Find(const int8* const host, const int8* const port, uint8 family, uint32 hash) {
+	SAL_Resolver_Entry* entry;
+
+	for (entry = buckets[hash % SAL_Resolver_Buckets]; entry != NULL; entry = entry->Next)
+		if (entry->Hash == hash && entry->Family == family && strcmp(entry->Host, host) == 0 && strcmp(entry->Port, port) == 0)
+			break;
+
+	return entry;
+}
+
+static void SAL_Resolver_Free(SAL_Resolver_Entry* entry) {
+	SAL_Allocator_Free(entry->Host);
+	SAL_Allocator_Free(entry->Port);
+	SAL_Allocator_Free(entry);
+}
+
+/* unlinks the cached results in the bucket of @a hash that have expired by @a now, so hosts that are never asked for again do not stay forever. Called with the lock held for writing. */
+static void SAL_Resolver_Sweep(uint32 hash, int64 now) {
+	SAL_Resolver_Entry** link;
+	SAL_Resolver_Entry* entry;
+
+	link = &buckets[hash % SAL_Resolver_Buckets];
+
+	while ((entry = *link) != NULL) {
+		if (entry->Pending || entry->Expires > now) {
+			link = &entry->Next;
+			continue;
+		}
+
+		*link = entry->Next;
+		SAL_Resolver_Free(entry);
+	}
+}
+
+/* runs getaddrinfo and orders its results for happy eyeballs: the families alternate, starting with the one getaddrinfo preferred */
+static uint32 SAL_Resolver_Lookup(const int8* const host, const int8* const port, uint8 family, SAL_Resolver_Address* addresses) {
+	SAL_Resolver_Address byFamily[2][SAL_Resolver_MaxAddresses];
+	uint32 counts[2] = { 0, 0 };
+	struct addrinfo hints;
+	struct addrinfo* results;
+	struct addrinfo* result;
+	uint32 first;
+	uint32 index;
+	uint32 count;
+	uint32 i;
+
+	memset(&hints, 0, sizeof(struct addrinfo));
+	hints.ai_socktype = SOCK_STREAM;
+
+	switch (family) {
+		case SAL_Socket_Families_IPV4: hints.ai_family = AF_INET; break;
+		case SAL_Socket_Families_IPV6: hints.ai_family = AF_INET6; break;
+		default: hints.ai_family = AF_UNSPEC; hints.ai_flags = AI_ADDRCONFIG; break;
+	}
+
+	if (getaddrinfo(host, port, &hints, &results) != 0)
+		return 0;
+
+	first = results->ai_family == AF_INET6 ? 1 : 0;
+
+	for (result = results; result != NULL; result = result->ai_next) {
+		if (result->ai_family == AF_INET && counts[0] < SAL_Resolver_MaxAddresses) {
+			index = counts[0]++;
+			byFamily[0][index].Family = SAL_Socket_Families_IPV4;
+			byFamily[0][index].Port = ntohs(((struct sockaddr_in*)result->ai_addr)->sin_port);
+			memset(byFamily[0][index].Address, 0, SAL_Socket_AddressLength);
+			memcpy(byFamily[0][index].Address, &((struct sockaddr_in*)result->ai_addr)->sin_addr, sizeof(struct in_addr));
+		}
+		else if (result->ai_family == AF_INET6 && counts[1] < SAL_Resolver_MaxAddresses) {
+			index = counts[1]++;
+			byFamily[1][index].Family = SAL_Socket_Families_IPV6;
+			byFamily[1][index].Port = ntohs(((struct sockaddr_in6*)result->ai_addr)->sin6_port);
+			memcpy(byFamily[1][index].Address, &((struct sockaddr_in6*)result->ai_addr)->sin6_addr, sizeof(struct in6_addr));
+		}
+	}
+
+	freeaddrinfo(results);
+
+	for (count = 0, i = 0; count < SAL_Resolver_MaxAddresses && (i < counts[0] || i < counts[1]); i++) {
+		if (i < counts[first] && count < SAL_Resolver_MaxAddresses)
+			addresses[count++] = byFamily[first][i];
+
+		if (i < counts[1 - first] && count < SAL_Resolver_MaxAddresses)
+			addresses[count++] = byFamily[1 - first][i];
+	}
+
+	return count;
+}
+
+static SAL_Thread_Start(SAL_Resolver_Run) {
+	SAL_Resolver_Address addresses[SAL_Resolver_MaxAddresses];
+	SAL_Resolver_Waiter* waiters;
+	SAL_Resolver_Waiter* waiter;
+	SAL_Resolver_Entry* entry;
+	uint32 count;
+
+	(void)startupArgument;
+
+	for (;;) {
+		SAL_Semaphore_Decrement(queued);
+
+		SAL_RWLock_AcquireWrite(&lock);
+		entry = queueHead;
+		queueHead = entry->NextQueued;
+		if (queueHead == NULL)
+			queueTail = NULL;
+		SAL_RWLock_ReleaseWrite(&lock);
+
+		/* the entry cannot go away while Pending, so its key is safe to read unlocked */
+		count = SAL_Resolver_Lookup(entry->Host, entry->Port, entry->Family, addresses);
+
+		SAL_RWLock_AcquireWrite(&lock);
+		memcpy(entry->Addresses, addresses, count * sizeof(SAL_Resolver_Address));
+		entry->Count = count;
+		entry->Expires = count > 0 ? SAL_Time_Monotonic() + timeToLive : 0; /* failures are not cached */
+		entry->Pending = false;
+		waiters = entry->Waiters;
+		entry->Waiters = NULL;
+		SAL_RWLock_ReleaseWrite(&lock);
+
+		while (waiters != NULL) {
+			waiter = waiters;
+			waiters = waiter->Next;
+			waiter->Callback(addresses, count, waiter->State);
+			SAL_Allocator_Free(waiter);
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Resolve @a host without blocking.
+ *
+ * @a callback is given the addresses @a host resolves to, or a count of 0 if
+ * it could not be resolved. A result still in the cache is handed to @a
+ * callback before this returns, on the calling thread; otherwise @a callback
+ * runs on a resolver thread once the lookup completes. When @a family is
+ * @ref SAL_Socket_Families_IPAny the addresses alternate between IPv6 and IPv4,
+ * starting with the family the system prefers, ready for happy eyeballs.
+ *
+ * @param host Host name or numeric address to resolve
+ * @param port String with the port number or name (e.g, "http" or "80")
+ * @param family One of the SAL_Socket_Families values
+ * @param callback The callback to call with the result
+ *
+ * @warning @a callback must not block, other lookups wait for it.
+ */
+void SAL_Resolver_Resolve(const int8* const host, const int8* const port, uint8 family, SAL_Resolver_Callback callback, void* const state) {
+	SAL_Resolver_Address addresses[SAL_Resolver_MaxAddresses];
+	SAL_Resolver_Waiter* waiter;
+	SAL_Resolver_Entry* entry;
+	boolean enqueue = false;
+	uint32 count;
+	uint32 hash;
+	int64 now;
+
+	assert(host != NULL);
+	assert(port != NULL);
+	assert(callback != NULL);
+
+	SAL_Resolver_Initialize();
+
+	hash = SAL_Resolver_Hash(host, port, family);
+
+	SAL_RWLock_AcquireRead(&lock);
+
+	entry = SAL_Resolver_Find(host, port, family, hash);
+
+	if (entry != NULL && !entry->Pending && entry->Expires > SAL_Time_Monotonic()) {
+		count = entry->Count;
+		memcpy(addresses, entry->Addresses, count * sizeof(SAL_Resolver_Address));
+		SAL_RWLock_ReleaseRead(&lock);
+
+		callback(addresses, count, state);
+
+		return;
+	}
+
+	SAL_RWLock_ReleaseRead(&lock);
+
+	/* a miss changes the table, look again under the write lock in case another thread got here first */
+	SAL_RWLock_AcquireWrite(&lock);
+
+	now = SAL_Time_Monotonic();
+	SAL_Resolver_Sweep(hash, now);
+
+	entry = SAL_Resolver_Find(host, port, family, hash);
+
+	if (entry != NULL && !entry->Pending && entry->Expires > now) {
+		count = entry->Count;
+		memcpy(addresses, entry->Addresses, count * sizeof(SAL_Resolver_Address));
+		SAL_RWLock_ReleaseWrite(&lock);
+
+		callback(addresses, count, state);
+
+		return;
+	}
+
+	if (entry == NULL) {
+		entry = SAL_Allocator_New(SAL_Resolver_Entry);
+		entry->Host = SAL_Resolver_Copy(host);
+		entry->Port = SAL_Resolver_Copy(port);
+		entry->Family = family;
+		entry->Hash = hash;
+		entry->Pending = false;
+		entry->Waiters = NULL;
+		entry->Next = buckets[hash % SAL_Resolver_Buckets];
+		buckets[hash % SAL_Resolver_Buckets] = entry;
+	}
+
+	waiter = SAL_Allocator_New(SAL_Resolver_Waiter);
+	waiter->Callback = callback;
+	waiter->State = state;
+	waiter->Next = entry->Waiters;
+	entry->Waiters = waiter;
+
+	/* everyone asking while a lookup is in flight shares its result */
+	if (!entry->Pending) {
+		entry->Pending = true;
+		entry->NextQueued = NULL;
+
+		if (queueTail != NULL)
+			queueTail->NextQueued = entry;
+		else
+			queueHead = entry;
+
+		queueTail = entry;
+		enqueue = true;
+	}
+
+	SAL_RWLock_ReleaseWrite(&lock);
+
+	if (enqueue)
+		SAL_Semaphore_Increment(queued);
+}
+
+/**
+ * Set how long resolved addresses are cached. Defaults to 30 seconds.
+ *
+ * The system resolver does not report the TTL of the records it returns, so
+ * this should be no longer than the shortest TTL of the hosts used.
+ *
+ * @param milliseconds Time a result stays in the cache, 0 disables caching
+ */
+void SAL_Resolver_SetTimeToLive(uint32 milliseconds) {
+	timeToLive = milliseconds;
+}
+
+/**
+ * Drop every cached result, so the next resolution of each host does a fresh
+ * lookup. Lookups in flight are not affected.
+ */
+void SAL_Resolver_Flush(void) {
+	SAL_Resolver_Entry** link;
+	SAL_Resolver_Entry* entry;
+	uint32 i;
+
+	SAL_Resolver_Initialize();
+
+	SAL_RWLock_AcquireWrite(&lock);
+
+	for (i = 0; i < SAL_Resolver_Buckets; i++) {
+		link = &buckets[i];
+
+		while ((entry = *link) != NULL) {
+			if (entry->Pending) {
+				link = &entry->Next;
+				continue;
+			}
+
+			*link = entry->Next;
+			SAL_Resolver_Free(entry);
+		}
+	}
+
+	SAL_RWLock_ReleaseWrite(&lock);
+}
@@ -0,0 +1,23 @@
+#ifndef INCLUDE_SAL_RESOLVER
+#define INCLUDE_SAL_RESOLVER
+
+#include "Common.h"
+#include "Socket.h"
+
+/* most addresses kept for one host */
+#define SAL_Resolver_MaxAddresses 16
+
+/* one resolved address */
+typedef struct {
+	uint8 Family; /* SAL_Socket_Families_IPV4 or SAL_Socket_Families_IPV6 */
+	uint16 Port; /* in host byte order */
+	uint8 Address[SAL_Socket_AddressLength]; /* in network byte order */
+} SAL_Resolver_Address;
+
+typedef void (*SAL_Resolver_Callback)(const SAL_Resolver_Address* addresses, uint32 count, void* const state);
+
+public void SAL_Resolver_Resolve(const int8* const host, const int8* const port, uint8 family, SAL_Resolver_Callback callback, void* const state);
+public void SAL_Resolver_SetTimeToLive(uint32 milliseconds);
+public void SAL_Resolver_Flush(void);
+
+#endif
@@ -7,453 +7,4209 @@
  */
 #include "Socket.h"
 
-#include <Utilities/AsyncLinkedList.h>
-#include <Utilities/Memory.h>
+/* the exported versions of what Socket.h inlines */
+#undef SAL_Socket_HostToNetworkShort
+#undef SAL_Socket_NetworkToHostShort
+
+#include "Allocator.h"
+#include "Atomic.h"
+#include "Resolver.h"
 #include "Thread.h"
+#include "Time.h"
+#include "TLS.h"
 
 #ifdef WINDOWS
 	#define WIN32_LEAN_AND_MEAN
-	#define FD_SETSIZE 1024
 	#include <Windows.h>
 	#include <winsock2.h>
 	#include <ws2tcpip.h>
+	#include <mswsock.h>
+	#include <string.h>
+
+	#define SAL_Socket_Backend_IOCP
 
 	static boolean winsockInitialized = false;
+	static LPFN_CONNECTEX connectEx = NULL;
 #elif defined POSIX
-	#include <sys/select.h>
 	#include <sys/socket.h>
 	#include <sys/types.h>
+	#include <sys/uio.h>
 	#include <netinet/in.h>
+	#include <netinet/tcp.h>
 	#include <arpa/inet.h>
 	#include <netdb.h>
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <poll.h>
 	#include <stdio.h>
 	#include <string.h>
+	#include <unistd.h>
+
+	#if defined __linux__
+		#include <sys/epoll.h>
+		#include <sys/eventfd.h>
+		#include <sys/sendfile.h>
+		#include <netinet/udp.h>
+
+		#define SAL_Socket_Backend_Epoll
+
+		/* io_uring can be chosen at runtime, epoll stays the fallback for kernels without it */
+		#ifdef SAL_HAVE_IO_URING
+			#include <linux/io_uring.h>
+			#include <sys/mman.h>
+			#include <sys/syscall.h>
+			#include <stdint.h>
+
+			#define SAL_Socket_Backend_IOUring
+
+			/* headers new enough for multishot receives into a provided buffer ring, Linux 6.0 */
+			#ifdef IORING_RECV_MULTISHOT
+				#define SAL_Socket_Backend_RingReceive
+			#endif
+		#endif
+	#elif defined __APPLE__ || defined __FreeBSD__ || defined __NetBSD__ || defined __OpenBSD__ || defined __DragonFly__
+		#include <sys/event.h>
+		#include <sys/time.h>
+		#include <sys/uio.h>
+
+		#define SAL_Socket_Backend_Kqueue
+	#else
+		#error "No socket event backend is available for this platform"
+	#endif
+
+	/* a peer that went away should fail the send rather than raise SIGPIPE */
+	#ifdef MSG_NOSIGNAL
+		#define SAL_Socket_SendFlags MSG_NOSIGNAL
+	#else
+		#define SAL_Socket_SendFlags 0
+	#endif
+#endif
+
+/* maximum number of readiness events a reactor takes from the kernel per wait */
+#define SAL_Socket_MaxEvents 64
+
+/* maximum number of queued buffers gathered into one send by SAL_Socket_Flush */
+#define SAL_Socket_MaxIOVectors 64
+
+/* bounce buffer size and per-call cap of SAL_Socket_SendFile */
+#define SAL_Socket_SendFileChunk 65536
+#define SAL_Socket_SendFileMaximum 0x7FFFF000
+
+/* size of the pooled buffers handed to receive callbacks, and how many are carved at once */
+#define SAL_Socket_ReceiveBufferSize 16384
+#define SAL_Socket_PoolSlab 64
+
+/* submission queue size of each io_uring reactor */
+#define SAL_Socket_RingEntries 256
+
+/* pool buffers each io_uring reactor lends the kernel for multishot receives, a power of two, and the group they are registered as */
+#define SAL_Socket_RingBuffers 64
+#define SAL_Socket_RingBufferGroup 0
+
+/* sockets are carved from cache-line aligned slabs so that two sockets hot on different reactors never share a line */
+#define SAL_Socket_CacheLine 64
+#define SAL_Socket_SlabSlots 64
+
+/* most datagrams moved by one SAL_Socket_ReceiveDatagrams or SAL_Socket_SendDatagrams call */
+#define SAL_Socket_MaxDatagrams 64
+
+/* head start, in ms, each connection attempt of SAL_Socket_ConnectAsync gets before the next address is tried */
+#define SAL_Socket_AttemptDelay 250
+
+/* most connections handed to an accept callback at once */
+#define SAL_Socket_MaxAcceptBatch 64
+
+/* room AcceptEx needs for each of the two addresses it reports */
+#define SAL_Socket_AcceptAddressLength (sizeof(struct sockaddr_in6) + 16)
+
+/* upper bound for @ref SAL_Socket_SetReactorCount */
+#define SAL_Socket_MaxReactors 64
+
+/* values of reactorsState: not started, being started by one thread, running */
+#define SAL_Socket_Reactors_Unstarted 0
+#define SAL_Socket_Reactors_Starting 1
+#define SAL_Socket_Reactors_Started 2
+
+/* each reactor's timer wheel: 6 levels of 64 slots, 1 ms apart on the lowest, covering 2^36 ms */
+#define SAL_Socket_TimerLevels 6
+#define SAL_Socket_TimerSlotBits 6
+#define SAL_Socket_TimerSlots (1 << SAL_Socket_TimerSlotBits)
+
+/*
+ * Callbacks are run by a pool of reactors, each a thread with its own kernel
+ * readiness set. Every reactor sits on top of a small backend interface:
+ * sockets are added to the kernel's interest set once when a callback is
+ * registered and removed when it is cleared, and the reactor blocks until the
+ * kernel reports readiness. Each backend provides SAL_Socket_Event and the
+ * Poller functions.
+ */
+#if defined SAL_Socket_Backend_Epoll
+	typedef struct epoll_event SAL_Socket_Event;
+	typedef int SAL_Socket_PollerHandle;
+#elif defined SAL_Socket_Backend_Kqueue
+	typedef struct kevent SAL_Socket_Event;
+	typedef int SAL_Socket_PollerHandle;
+#elif defined SAL_Socket_Backend_IOCP
+	typedef OVERLAPPED_ENTRY SAL_Socket_Event;
+	typedef HANDLE SAL_Socket_PollerHandle;
+#endif
+
+#if defined SAL_Socket_Backend_IOCP || defined SAL_Socket_Backend_IOUring
+	/*
+	 * Completion-based backends learn about readiness from a one-shot request per
+	 * direction: a zero-byte WSARecv/WSASend on IOCP, a POLL_ADD on io_uring.
+	 * Each socket keeps its two requests for reuse. A request that is still
+	 * pending when its socket is unregistered is detached instead and freed by
+	 * the reactor once the kernel hands it back.
+	 */
+	typedef struct {
+		#if defined SAL_Socket_Backend_IOCP
+			OVERLAPPED Overlapped;
+		#endif
+		SAL_Socket* Socket;
+		boolean IsWrite;
+		boolean Pending;
+		#if defined SAL_Socket_Backend_IOUring
+			boolean IsReceive; /* a multishot receive rather than a poll, pending for as long as the kernel keeps it armed */
+		#endif
+		#if defined SAL_Socket_Backend_IOCP
+			/* on a listener the read request is an AcceptEx, which leaves the new socket and both addresses here */
+			uint64 AcceptSocket;
+			uint8 AcceptAddresses[2 * SAL_Socket_AcceptAddressLength];
+		#endif
+	} SAL_Socket_Request;
+#endif
+
+#if defined SAL_Socket_Backend_IOUring
+	/* the rings shared with the kernel. Submissions may come from any thread and take Lock, completions are only reaped by the owning reactor. */
+	typedef struct {
+		int Descriptor;
+		SAL_Mutex Lock;
+
+		/* the three mappings, MAP_FAILED until made, kept to unmap them */
+		uint8* SubmissionRing;
+		size_t SubmissionSize;
+		uint8* CompletionRing;
+		size_t CompletionSize;
+		size_t EntriesSize;
+
+		uint32* SubmissionHead;
+		uint32* SubmissionTail;
+		uint32 SubmissionMask;
+		uint32 SubmissionEntries;
+		uint32* SubmissionArray;
+		struct io_uring_sqe* Entries;
+
+		uint32* CompletionHead;
+		uint32* CompletionTail;
+		uint32 CompletionMask;
+		struct io_uring_cqe* Completions;
+
+		#if defined SAL_Socket_Backend_RingReceive
+			/* pool buffers lent to the kernel by buffer id, only touched by the reactor thread. Buffers is NULL where the kernel has no provided buffer rings, Receives is set once they are lent. */
+			struct io_uring_buf_ring* Buffers;
+			SAL_Socket_Buffer* Lent[SAL_Socket_RingBuffers];
+			uint16 BuffersTail;
+			uint32 Receives;
+		#endif
+	} SAL_Socket_Ring;
+
+	#if defined SAL_Socket_Backend_RingReceive
+		/* what a receive completion carries beyond the epoll-style event it is copied into */
+		typedef struct {
+			int32 Result;
+			uint32 Flags;
+		} SAL_Socket_RingCompletion;
+	#endif
+#endif
+
+/* work handed to a reactor's thread by SAL_Socket_Reactor_Post */
+typedef void (*SAL_Socket_PostCallback)(void* const state);
+
+typedef struct SAL_Socket_Post SAL_Socket_Post;
+typedef struct SAL_Socket_Connection SAL_Socket_Connection;
+
+struct SAL_Socket_Post {
+	SAL_Socket_PostCallback Callback;
+	void* State;
+	SAL_Socket_Post* Next;
+};
+
+/* a SAL_Socket_ConnectAsync racing its addresses, owned by the reactor that will get the winning socket */
+struct SAL_Socket_Connection {
+	SAL_Socket_ConnectCallback Callback;
+	void* State;
+	uint8 Type;
+	SAL_Socket_Reactor* Reactor;
+	SAL_Resolver_Address Addresses[SAL_Resolver_MaxAddresses];
+	uint32 AddressCount;
+	uint32 NextAddress;
+	SAL_Socket* Attempts[SAL_Resolver_MaxAddresses];
+	uint32 AttemptCount;
+	SAL_Socket_Timer AttemptTimer; /* pending while an address is left to try if no attempt has finished by then */
+};
+
+/*
+ * Level 0 holds the timers due within the 64 ms block Current is in, one slot
+ * per ms. Each level up has slots 64 times as long, holding timers due within
+ * its own block, and a slot's timers are filed down a level when the wheel
+ * reaches it. Occupied has a bit per non-empty slot so the next deadline is
+ * found without walking empty slots.
+ */
+typedef struct {
+	SAL_Socket_Timer* Slots[SAL_Socket_TimerLevels][SAL_Socket_TimerSlots];
+	uint64 Occupied[SAL_Socket_TimerLevels];
+	int64 Current; /* the last ms processed, every timer due by then has fired */
+	uint32 Count;
+} SAL_Socket_TimerWheel;
+
+/* a SAL_Socket_SetTimer made off the timer's reactor, applied on it */
+typedef struct {
+	SAL_Socket_Reactor* Reactor;
+	SAL_Socket_Timer* Timer;
+	int64 Deadline;
+	SAL_Socket_TimerCallback Callback;
+	void* State;
+} SAL_Socket_TimerRequest;
+
+/*
+ * Everything a reactor touches while dispatching is its own, so reactors never
+ * contend with each other. The socket list is only used for registration
+ * bookkeeping, never on the dispatch path.
+ */
+struct SAL_Socket_Reactor {
+	SAL_Thread Thread;
+	SAL_Socket_PollerHandle Poller;
+	boolean Running;
+	uint8 Backend;
+#if defined SAL_Socket_Backend_IOUring
+	SAL_Socket_Ring Ring;
+#endif
+
+	/* the batch being dispatched and the socket whose callbacks are running, so sockets removed by a callback can be dropped from both */
+	SAL_Socket_Event Events[SAL_Socket_MaxEvents];
+	int32 DispatchNext;
+	int32 DispatchCount;
+	SAL_Socket* Current;
+
+	/* receive buffer pool: FreeBuffers is only touched by the reactor thread, other threads push released buffers onto ReturnedBuffers */
+	SAL_Socket_Buffer* FreeBuffers;
+	SAL_Socket_Buffer* ReturnedBuffers;
+
+	/* work posted by other threads, pushed lock-free and taken all at once after each wait. Wake interrupts the wait. */
+	SAL_Socket_Post* Posted;
+#if defined SAL_Socket_Backend_Epoll
+	int Wake; /* eventfd */
+#elif defined SAL_Socket_Backend_Kqueue
+	int Wake[2]; /* pipe */
+#endif
+#if defined SAL_Socket_Backend_IOUring
+	struct __kernel_timespec RingTimeout;
+	int64 RingDeadline; /* when the pending IORING_OP_TIMEOUT fires, 0 if none is pending */
+#endif
+#if defined SAL_Socket_Backend_RingReceive
+	/* results and flags of the batch's completions, and the buffer a multishot receive filled for the socket being dispatched */
+	SAL_Socket_RingCompletion RingCompletions[SAL_Socket_MaxEvents];
+	SAL_Socket_Buffer* Received;
+	boolean HasReceived;
+#endif
+
+	/* timeouts, only touched by the reactor thread; they bound its wait */
+	SAL_Socket_TimerWheel Timers;
+
+	/* the reactor thread's own counters, NULL until it starts */
+	SAL_Socket_Statistics* Statistics;
+};
+
+#if defined __linux__
+	/* room for the one UDP_SEGMENT or UDP_GRO control message a datagram carries */
+	typedef union {
+		struct cmsghdr Header;
+		uint8 Data[CMSG_SPACE(sizeof(int))];
+	} SAL_Socket_Control;
 #endif
 
 static void SAL_Socket_Initialize(SAL_Socket* socket);
 static SAL_Socket* SAL_Socket_PrepareRawSocket(const int8* const address, const int8* port, uint8 family, uint8 type, boolean willListenOn, struct addrinfo** addressInfo);
-static void SAL_Socket_CallbackWorker_Initialize();
-static void SAL_Socket_CallbackWorker_Shutdown();
-static SAL_Thread_Start(SAL_Socket_CallbackWorker_Run);
+static SAL_Socket* SAL_Socket_ListenOn(const int8* const port, uint8 family, uint8 type, const SAL_Socket_Options* options);
+static boolean SAL_Socket_ApplyCreationOptions(SAL_Socket* socket, const SAL_Socket_Options* options, boolean willListen);
+static uint32 SAL_Socket_TranslateError(SAL_Socket* socket, boolean isWrite);
+static boolean SAL_Socket_WaitReadable(SAL_Socket* socket, uint32 timeout);
+static boolean SAL_Socket_WaitWritable(SAL_Socket* socket, uint32 timeout);
+static boolean SAL_Socket_Reactors_Initialize(void);
+static SAL_Socket_Reactor* SAL_Socket_Reactors_Assign(SAL_Socket* socket);
+static int SAL_Socket_BuildAddress(uint8 family, uint16 port, const uint8* const address, struct sockaddr_storage* target);
+static void SAL_Socket_Reactor_Register(SAL_Socket* socket, boolean wasRegistered);
+static SAL_Thread_Start(SAL_Socket_Reactor_Run);
+static boolean SAL_Socket_Poller_Create(SAL_Socket_Reactor* reactor);
+static void SAL_Socket_Poller_Destroy(SAL_Socket_Reactor* reactor);
+static boolean SAL_Socket_Poller_IsOneShot(SAL_Socket_Reactor* reactor);
+static boolean SAL_Socket_Poller_Add(SAL_Socket* socket);
+static void SAL_Socket_Poller_Update(SAL_Socket* socket);
+static void SAL_Socket_Poller_Remove(SAL_Socket* socket);
+static int32 SAL_Socket_Poller_Wait(SAL_Socket_Reactor* reactor, int32 timeout);
+static void SAL_Socket_Poller_Wake(SAL_Socket_Reactor* reactor);
+static SAL_Socket* SAL_Socket_Poller_GetSocket(SAL_Socket_Reactor* reactor, SAL_Socket_Event* event, boolean* readable, boolean* writable);
+static void SAL_Socket_Reactor_RunPosted(SAL_Socket_Reactor* reactor);
+static void SAL_Socket_Connect_Next(SAL_Socket_Connection* connection);
+static int32 SAL_Socket_Timers_Timeout(SAL_Socket_Reactor* reactor);
+static void SAL_Socket_Timers_Expire(SAL_Socket_Reactor* reactor);
+static void SAL_Socket_Connect_Delayed(SAL_Socket_Timer* timer, void* const state);
+static SAL_Socket* SAL_Socket_New(uint8 family, uint8 type);
+static SAL_Socket_Statistics* SAL_Socket_Statistics_Get(void);
+static void SAL_Socket_Statistics_Add(uint64* counter, uint64 amount);
+static void SAL_Socket_Statistics_Time(SAL_Socket_Statistics* statistics, int64 started);
+static void SAL_Socket_CountTransfer(SAL_Socket* socket, boolean isWrite, uint32 bytes);
+static uint32 SAL_Socket_RecordError(SAL_Socket* socket, boolean isWrite, boolean wouldBlock);
+static SAL_Socket_Buffer* SAL_Socket_Pool_Take(SAL_Socket_Reactor* reactor);
+static void SAL_Socket_Receive(SAL_Socket* socket, void* const state);
 
-static AsyncLinkedList asyncSocketList;
-static SAL_Thread asyncWorker;
-static boolean asyncWorkerRunning = false;
+static SAL_Socket_Reactor* reactors = NULL;
+static uint32 reactorCount = 1;
+static uint32 nextReactor = 0;
+static uint32 reactorsState = SAL_Socket_Reactors_Unstarted;
+static SAL_Thread_Attributes* reactorAttributes = NULL;
+static boolean reactorSpread = false;
+static uint8 requestedBackend = SAL_Socket_Backends_Default;
 
-static SAL_Thread_Start(SAL_Socket_CallbackWorker_Run) {
-#ifdef WINDOWS
-	fd_set readSet;
-	uint32 i;
-	SAL_Socket* asyncSocket;
-	AsyncLinkedList_Iterator selectIterator;
-	struct timeval selectTimeout;
+/* the reactor whose thread this is, NULL on every other thread */
+static SAL_ThreadLocal SAL_Socket_Reactor* currentReactor = NULL;
 
-	AsyncLinkedList_InitializeIterator(&selectIterator, &asyncSocketList);
-	selectTimeout.tv_usec = 250;
-	selectTimeout.tv_sec = 0;
+/* every thread that did socket I/O counts into a block of its own, linked here once so snapshots can sum them */
+typedef struct SAL_Socket_StatisticsBlock SAL_Socket_StatisticsBlock;
 
-	while (asyncWorkerRunning) {
-		FD_ZERO(&readSet);
+struct SAL_Socket_StatisticsBlock {
+	SAL_Socket_Statistics Statistics;
+	SAL_Socket_StatisticsBlock* Next;
+};
 
-		/* iterates over all sockets with registered callbacks. It either finishes when 1024 sockets have been added or the socket list is exhausted. If the socket list is greater than 1024, the position is remembered on the next loop   */
-		for (i = 0, asyncSocket = (SAL_Socket*)AsyncLinkedList_Iterate(&selectIterator); i < FD_SETSIZE && asyncSocket != NULL; i++, asyncSocket = (SAL_Socket*)AsyncLinkedList_Iterate(&selectIterator)) {
-			#ifdef WINDOWS
-				FD_SET((SOCKET)asyncSocket->RawSocket, &readSet);
-			#else defined POSIX
+static SAL_ThreadLocal SAL_Socket_StatisticsBlock* threadStatistics = NULL;
+static SAL_Socket_StatisticsBlock* allStatistics = NULL;
+static uint32 callbackTiming = false;
 
-			#endif
+#if defined SAL_Socket_Backend_IOUring
+static int SAL_Socket_Ring_Enter(SAL_Socket_Ring* ring, uint32 toSubmit, uint32 minimumComplete, uint32 flags) {
+	return (int)syscall(__NR_io_uring_enter, ring->Descriptor, toSubmit, minimumComplete, flags, NULL, 0);
+}
+
+#if defined SAL_Socket_Backend_RingReceive
+/* registers the ring multishot receives take buffers from. Where the kernel has none, pooled receives keep polling for readiness. */
+static void SAL_Socket_Ring_RegisterBuffers(SAL_Socket_Ring* ring) {
+	struct io_uring_buf_reg registration;
+	size_t size;
+	void* memory;
+
+	ring->Buffers = NULL;
+	ring->BuffersTail = 0;
+	ring->Receives = false;
+
+	/* the kernel wants the ring page aligned */
+	size = SAL_Socket_RingBuffers * sizeof(struct io_uring_buf);
+	memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED)
+		return;
+
+	memset(&registration, 0, sizeof(struct io_uring_buf_reg));
+	registration.ring_addr = (uint64)(uintptr_t)memory;
+	registration.ring_entries = SAL_Socket_RingBuffers;
+	registration.bgid = SAL_Socket_RingBufferGroup;
+
+	if (syscall(__NR_io_uring_register, ring->Descriptor, IORING_REGISTER_PBUF_RING, &registration, 1) != 0) {
+		munmap(memory, size);
+		return;
+	}
+
+	ring->Buffers = (struct io_uring_buf_ring*)memory;
+}
+#endif
+
+/* unmaps and closes what SAL_Socket_Ring_Create set up so far, shared mappings outlive the descriptor so they go first */
+static void SAL_Socket_Ring_Destroy(SAL_Socket_Ring* ring) {
+#if defined SAL_Socket_Backend_RingReceive
+	if (ring->Buffers != NULL)
+		munmap(ring->Buffers, SAL_Socket_RingBuffers * sizeof(struct io_uring_buf));
+#endif
+
+	if (ring->Entries != (struct io_uring_sqe*)MAP_FAILED)
+		munmap(ring->Entries, ring->EntriesSize);
+
+	if (ring->CompletionRing != (uint8*)MAP_FAILED && ring->CompletionRing != ring->SubmissionRing)
+		munmap(ring->CompletionRing, ring->CompletionSize);
+
+	if (ring->SubmissionRing != (uint8*)MAP_FAILED)
+		munmap(ring->SubmissionRing, ring->SubmissionSize);
+
+	if (ring->Lock != NULL)
+		SAL_Mutex_Free(ring->Lock);
+
+	close(ring->Descriptor);
+}
+
+/* maps the rings of a new io_uring instance. Returns false where the kernel has no io_uring, so the reactor can fall back to epoll. */
+static boolean SAL_Socket_Ring_Create(SAL_Socket_Ring* ring) {
+	struct io_uring_params parameters;
+	uint8* submission;
+	uint8* completion;
+
+	ring->Lock = NULL;
+	ring->SubmissionRing = (uint8*)MAP_FAILED;
+	ring->CompletionRing = (uint8*)MAP_FAILED;
+	ring->Entries = (struct io_uring_sqe*)MAP_FAILED;
+#if defined SAL_Socket_Backend_RingReceive
+	ring->Buffers = NULL;
+#endif
+
+	memset(&parameters, 0, sizeof(struct io_uring_params));
+
+	ring->Descriptor = (int)syscall(__NR_io_uring_setup, SAL_Socket_RingEntries, &parameters);
+	if (ring->Descriptor < 0)
+		return false;
+
+	ring->SubmissionSize = parameters.sq_off.array + parameters.sq_entries * sizeof(uint32);
+	ring->CompletionSize = parameters.cq_off.cqes + parameters.cq_entries * sizeof(struct io_uring_cqe);
+	ring->EntriesSize = parameters.sq_entries * sizeof(struct io_uring_sqe);
+
+	if (parameters.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->CompletionSize > ring->SubmissionSize)
+			ring->SubmissionSize = ring->CompletionSize;
+		ring->CompletionSize = ring->SubmissionSize;
+	}
+
+	ring->SubmissionRing = (uint8*)mmap(NULL, ring->SubmissionSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->Descriptor, IORING_OFF_SQ_RING);
+	if (ring->SubmissionRing == MAP_FAILED)
+		goto error;
+
+	if (parameters.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->CompletionRing = ring->SubmissionRing;
+	}
+	else {
+		ring->CompletionRing = (uint8*)mmap(NULL, ring->CompletionSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->Descriptor, IORING_OFF_CQ_RING);
+		if (ring->CompletionRing == MAP_FAILED)
+			goto error;
+	}
+
+	ring->Entries = (struct io_uring_sqe*)mmap(NULL, ring->EntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->Descriptor, IORING_OFF_SQES);
+	if (ring->Entries == MAP_FAILED)
+		goto error;
+
+	submission = ring->SubmissionRing;
+	completion = ring->CompletionRing;
+
+	ring->SubmissionHead = (uint32*)(submission + parameters.sq_off.head);
+	ring->SubmissionTail = (uint32*)(submission + parameters.sq_off.tail);
+	ring->SubmissionMask = *(uint32*)(submission + parameters.sq_off.ring_mask);
+	ring->SubmissionEntries = *(uint32*)(submission + parameters.sq_off.ring_entries);
+	ring->SubmissionArray = (uint32*)(submission + parameters.sq_off.array);
+
+	ring->CompletionHead = (uint32*)(completion + parameters.cq_off.head);
+	ring->CompletionTail = (uint32*)(completion + parameters.cq_off.tail);
+	ring->CompletionMask = *(uint32*)(completion + parameters.cq_off.ring_mask);
+	ring->Completions = (struct io_uring_cqe*)(completion + parameters.cq_off.cqes);
+
+	ring->Lock = SAL_Mutex_Create();
+
+#if defined SAL_Socket_Backend_RingReceive
+	SAL_Socket_Ring_RegisterBuffers(ring);
+#endif
+
+	return true;
+
+error:
+	SAL_Socket_Ring_Destroy(ring);
+	return false;
+}
+
+/*
+ * Queues one submission. Off the reactor thread it is handed to the kernel
+ * right away since the reactor may be asleep; on the reactor thread it goes
+ * out with the next wait, batching every re-arm of a dispatch into one enter.
+ */
+static void SAL_Socket_Ring_SubmitEntry(SAL_Socket_Reactor* reactor, const struct io_uring_sqe* prepared) {
+	SAL_Socket_Ring* ring = &reactor->Ring;
+	uint32 tail;
+	uint32 index;
+
+	SAL_Mutex_Acquire(ring->Lock);
+
+	tail = *ring->SubmissionTail;
+	while (tail - __atomic_load_n(ring->SubmissionHead, __ATOMIC_ACQUIRE) == ring->SubmissionEntries)
+		SAL_Socket_Ring_Enter(ring, ring->SubmissionEntries, 0, 0);
+
+	index = tail & ring->SubmissionMask;
+	ring->Entries[index] = *prepared;
+	ring->SubmissionArray[index] = index;
+	__atomic_store_n(ring->SubmissionTail, tail + 1, __ATOMIC_RELEASE);
+
+	if (currentReactor != reactor)
+		SAL_Socket_Ring_Enter(ring, 1, 0, 0);
+
+	SAL_Mutex_Release(ring->Lock);
+}
+
+/* queues a poll, cancellation, timeout or wake-up, see SAL_Socket_Ring_SubmitEntry */
+static void SAL_Socket_Ring_Submit(SAL_Socket_Reactor* reactor, uint8 opcode, int descriptor, uint32 pollEvents, uint64 address, uint64 userData) {
+	struct io_uring_sqe entry;
+
+	memset(&entry, 0, sizeof(struct io_uring_sqe));
+	entry.opcode = opcode;
+	entry.fd = descriptor;
+	entry.poll32_events = pollEvents;
+	entry.addr = address;
+	entry.len = opcode == IORING_OP_TIMEOUT ? 1 : 0; /* a timeout reads one timespec at addr */
+	entry.user_data = userData;
+
+	SAL_Socket_Ring_SubmitEntry(reactor, &entry);
+}
+
+/* submits whatever is queued, waits up to @a timeout ms (forever if negative) for a completion and copies the completions into the reactor's batch as epoll events */
+static int32 SAL_Socket_Ring_Wait(SAL_Socket_Reactor* reactor, int32 timeout) {
+	SAL_Socket_Ring* ring = &reactor->Ring;
+	struct io_uring_cqe* completion;
+	uint32 toSubmit;
+	uint32 head;
+	uint32 tail;
+	int32 count;
+	int64 deadline;
+
+	/* the wait is bounded by a timeout request; one already pending that fires soon enough is reused */
+	if (timeout >= 0) {
+		deadline = SAL_Time_Monotonic() + timeout;
+
+		if (reactor->RingDeadline == 0 || deadline < reactor->RingDeadline) {
+			reactor->RingTimeout.tv_sec = timeout / 1000;
+			reactor->RingTimeout.tv_nsec = (timeout % 1000) * 1000000;
+			reactor->RingDeadline = deadline;
+			SAL_Socket_Ring_Submit(reactor, IORING_OP_TIMEOUT, -1, 0, (uint64)(uintptr_t)&reactor->RingTimeout, (uint64)(uintptr_t)&reactor->RingTimeout);
 		}
-		
-		if (asyncSocket == NULL) /* AsyncLinkedList_Iterate returns NULL when the list is empty. we need to reset it then. */
-			AsyncLinkedList_ResetIterator(&selectIterator);
+	}
 
-		select(0, &readSet, NULL, NULL, &selectTimeout);
+	SAL_Mutex_Acquire(ring->Lock);
+	toSubmit = *ring->SubmissionTail - __atomic_load_n(ring->SubmissionHead, __ATOMIC_ACQUIRE);
+	SAL_Mutex_Release(ring->Lock);
 
-		for (i = 0; i < readSet.fd_count; i++) {
-			AsyncLinkedList_ForEach(asyncSocket, &asyncSocketList, SAL_Socket*) {
-				if (asyncSocket->RawSocket == readSet.fd_array[i]) {
-					asyncSocket->ReadCallback(asyncSocket, asyncSocket->ReadCallbackState);
-				}
-			}
+	if (SAL_Socket_Ring_Enter(ring, toSubmit, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR && errno != EBUSY)
+		return -1;
+
+	head = *ring->CompletionHead;
+	tail = __atomic_load_n(ring->CompletionTail, __ATOMIC_ACQUIRE);
+
+	for (count = 0; head != tail && count < SAL_Socket_MaxEvents; head++) {
+		completion = &ring->Completions[head & ring->CompletionMask];
+
+		/* cancellations complete with no user data, only the cancelled poll itself matters */
+		if (completion->user_data == 0)
+			continue;
+
+		reactor->Events[count].data.ptr = (void*)(uintptr_t)completion->user_data;
+		reactor->Events[count].events = completion->res < 0 ? EPOLLERR : (uint32)completion->res;
+	#if defined SAL_Socket_Backend_RingReceive
+		reactor->RingCompletions[count].Result = completion->res;
+		reactor->RingCompletions[count].Flags = completion->flags;
+	#endif
+		count++;
+	}
+
+	__atomic_store_n(ring->CompletionHead, head, __ATOMIC_RELEASE);
+
+	return count;
+}
+#endif
+
+#if defined SAL_Socket_Backend_IOCP || defined SAL_Socket_Backend_IOUring
+#if defined SAL_Socket_Backend_RingReceive
+/* whether the read request of @a socket can be a multishot receive: its data goes to a receive callback and not through a TLS session */
+static boolean SAL_Socket_Ring_Receives(SAL_Socket* socket) {
+	return SAL_Atomic_Load32(&socket->Reactor->Ring.Receives) && socket->ReadCallback == SAL_Socket_Receive && socket->TLS == NULL && !socket->Listening;
+}
+
+/* queues a multishot receive for @a request, which stays armed until the connection ends or the lent buffers run out */
+static void SAL_Socket_Ring_SubmitReceive(SAL_Socket* socket, SAL_Socket_Request* request) {
+	struct io_uring_sqe entry;
+
+	memset(&entry, 0, sizeof(struct io_uring_sqe));
+	entry.opcode = IORING_OP_RECV;
+	entry.fd = socket->RawSocket;
+	entry.flags = IOSQE_BUFFER_SELECT;
+	entry.ioprio = IORING_RECV_MULTISHOT;
+	entry.buf_group = SAL_Socket_RingBufferGroup;
+	entry.user_data = (uint64)(uintptr_t)request;
+
+	SAL_Socket_Ring_SubmitEntry(socket->Reactor, &entry);
+}
+#endif
+
+/* posts the one-shot request whose completion tells the reactor @a socket is readable or writable, unless one is already pending */
+static boolean SAL_Socket_Poller_Arm(SAL_Socket* socket, boolean isWrite) {
+	SAL_Socket_Request* request;
+	void** pollerData;
+#if defined SAL_Socket_Backend_IOCP
+	struct sockaddr_storage localAddress;
+	int localLength;
+	WSABUF buffer;
+	DWORD flags;
+	DWORD received;
+	int result;
+#endif
+
+	pollerData = isWrite ? &socket->PollerWriteData : &socket->PollerData;
+	request = (SAL_Socket_Request*)*pollerData;
+
+	if (request == NULL) {
+		request = SAL_Allocator_New(SAL_Socket_Request);
+		request->Socket = socket;
+		request->IsWrite = isWrite;
+	#if defined SAL_Socket_Backend_IOCP
+		request->AcceptSocket = INVALID_SOCKET;
+	#endif
+		*pollerData = request;
+	}
+	else if (request->Pending) {
+		return true;
+	}
+
+	request->Pending = true;
+
+#if defined SAL_Socket_Backend_IOCP
+	/* the last accepted connection was never taken, report it again instead of accepting another */
+	if (socket->Listening && request->AcceptSocket != INVALID_SOCKET)
+		return PostQueuedCompletionStatus(socket->Reactor->Poller, 0, 0, &request->Overlapped) != 0;
+
+	memset(&request->Overlapped, 0, sizeof(OVERLAPPED));
+	buffer.buf = NULL;
+	buffer.len = 0;
+	flags = 0;
+
+	if (socket->Listening) {
+		/* a zero-byte WSARecv fails on a listener, so readability is learned from an AcceptEx that reads no data */
+		localLength = sizeof(struct sockaddr_storage);
+		getsockname((SOCKET)socket->RawSocket, (struct sockaddr*)&localAddress, &localLength);
+
+		request->AcceptSocket = WSASocketW(localAddress.ss_family, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED);
+		if (request->AcceptSocket == INVALID_SOCKET) {
+			request->Pending = false;
+			return false;
 		}
 
-		SAL_Thread_Sleep(25);
+		if (AcceptEx((SOCKET)socket->RawSocket, (SOCKET)request->AcceptSocket, request->AcceptAddresses, 0, SAL_Socket_AcceptAddressLength, SAL_Socket_AcceptAddressLength, &received, &request->Overlapped))
+			result = 0;
+		else
+			result = SOCKET_ERROR;
 	}
-	
-	AsyncLinkedList_Uninitialize(&asyncSocketList);
+	else if (isWrite && socket->ConnectTarget != NULL) {
+		/* a socket still connecting cannot take a zero-byte WSASend, its writability is the ConnectEx completing */
+		const SAL_Resolver_Address* target = (const SAL_Resolver_Address*)socket->ConnectTarget;
+		struct sockaddr_storage address;
+		int addressLength;
 
-	return 0;
-#elif defined POSIX
+		if (connectEx == NULL) {
+			GUID guid = WSAID_CONNECTEX;
+			DWORD returned;
+
+			WSAIoctl((SOCKET)socket->RawSocket, SIO_GET_EXTENSION_FUNCTION_POINTER, &guid, sizeof(GUID), &connectEx, sizeof(LPFN_CONNECTEX), &returned, NULL, NULL);
+		}
 
+		addressLength = SAL_Socket_BuildAddress(target->Family, target->Port, target->Address, &address);
+
+		if (connectEx != NULL && connectEx((SOCKET)socket->RawSocket, (struct sockaddr*)&address, addressLength, NULL, 0, NULL, &request->Overlapped))
+			result = 0;
+		else
+			result = SOCKET_ERROR;
+	}
+	else if (isWrite) {
+		result = WSASend((SOCKET)socket->RawSocket, &buffer, 1, NULL, 0, &request->Overlapped, NULL);
+	}
+	else {
+		result = WSARecv((SOCKET)socket->RawSocket, &buffer, 1, NULL, &flags, &request->Overlapped, NULL);
+	}
+
+	if (result == SOCKET_ERROR && WSAGetLastError() != WSA_IO_PENDING) {
+		request->Pending = false;
+		return false;
+	}
+#elif defined SAL_Socket_Backend_IOUring
+	#if defined SAL_Socket_Backend_RingReceive
+		/* pooled receives skip the readiness round trip, the kernel receives straight into lent buffers */
+		request->IsReceive = !isWrite && SAL_Socket_Ring_Receives(socket);
+
+		if (request->IsReceive) {
+			SAL_Socket_Ring_SubmitReceive(socket, request);
+			return true;
+		}
+	#endif
+
+	SAL_Socket_Ring_Submit(socket->Reactor, IORING_OP_POLL_ADD, socket->RawSocket, isWrite ? POLLOUT : POLLIN, 0, (uint64)(uintptr_t)request);
 #endif
+
+	return true;
 }
 
-static void SAL_Socket_CallbackWorker_Initialize() {
-	AsyncLinkedList_Initialize(&asyncSocketList, NULL);
-	asyncWorkerRunning = true;
-	asyncWorker = SAL_Thread_Create(SAL_Socket_CallbackWorker_Run, NULL);
+/* frees a request, closing a connection its AcceptEx took that was never handed out */
+static void SAL_Socket_Poller_Free(SAL_Socket_Request* request) {
+#if defined SAL_Socket_Backend_IOCP
+	if (request->AcceptSocket != INVALID_SOCKET)
+		closesocket((SOCKET)request->AcceptSocket);
+#endif
+
+	SAL_Allocator_Free(request);
 }
 
-static void SAL_Socket_CallbackWorker_Shutdown() {
-	asyncWorkerRunning = false;
+/* detaches a request from @a socket. An idle one is freed here, a pending one is cancelled and freed by the reactor once the cancellation comes back. */
+static void SAL_Socket_Poller_Cancel(SAL_Socket* socket, void** pollerData) {
+	SAL_Socket_Request* request;
+
+	request = (SAL_Socket_Request*)*pollerData;
+	*pollerData = NULL;
+
+	if (request == NULL)
+		return;
+
+	if (!request->Pending) {
+		SAL_Socket_Poller_Free(request);
+		return;
+	}
+
+	request->Socket = NULL;
+#if defined SAL_Socket_Backend_IOCP
+	CancelIoEx((HANDLE)socket->RawSocket, &request->Overlapped);
+#elif defined SAL_Socket_Backend_IOUring
+	SAL_Socket_Ring_Submit(socket->Reactor, request->IsReceive ? IORING_OP_ASYNC_CANCEL : IORING_OP_POLL_REMOVE, -1, 0, (uint64)(uintptr_t)request, 0);
+#endif
 }
 
-static SAL_Socket* SAL_Socket_New(uint8 family, uint8 type) {
+/* takes a request back from the kernel. Returns its socket, or NULL (after freeing the request) if the socket was unregistered while it was pending. */
+static SAL_Socket* SAL_Socket_Poller_Complete(SAL_Socket_Request* request, boolean* readable, boolean* writable) {
 	SAL_Socket* socket;
-	
-	socket = Allocate(SAL_Socket);
-	socket->RawSocket = 0;
-	socket->Connected = false;
-	socket->LastError = 0;
-	socket->ReadCallback = NULL;
-	socket->ReadCallbackState = NULL;
-	socket->Family = family;
-	socket->Type = type;
+
+	socket = request->Socket;
+	request->Pending = false;
+	*readable = !request->IsWrite;
+	*writable = request->IsWrite;
+
+	if (socket == NULL)
+		SAL_Socket_Poller_Free(request);
 
 	return socket;
 }
+#endif
 
-static SAL_Socket* SAL_Socket_PrepareRawSocket(const int8* const address, const int8* port, uint8 family, uint8 type, boolean willListenOn, struct addrinfo** addressInfo) {
-	struct addrinfo serverHints;
-	struct addrinfo* serverAddrInfo;
-	SAL_Socket* listener;
+#if defined SAL_Socket_Backend_RingReceive
+/* lends a buffer from the pool to the kernel as buffer @a id, on the reactor thread */
+static void SAL_Socket_Ring_Lend(SAL_Socket_Reactor* reactor, uint16 id) {
+	SAL_Socket_Ring* ring = &reactor->Ring;
+	SAL_Socket_Buffer* buffer;
+	struct io_uring_buf* entry;
 
-#ifdef WINDOWS
-	SOCKET rawSocket;
+	buffer = SAL_Socket_Pool_Take(reactor);
+	ring->Lent[id] = buffer;
 
-	if (!winsockInitialized) {
-		WSADATA startupData;
-		WSAStartup(514, &startupData);
-		winsockInitialized = true;
+	entry = &ring->Buffers->bufs[ring->BuffersTail & (SAL_Socket_RingBuffers - 1)];
+	entry->addr = (uint64)(uintptr_t)buffer->Data;
+	entry->len = buffer->Capacity;
+	entry->bid = id;
+
+	ring->BuffersTail++;
+	__atomic_store_n(&ring->Buffers->tail, ring->BuffersTail, __ATOMIC_RELEASE);
+}
+
+/* fills the registered buffer ring when the reactor thread starts, after which receive callbacks use multishot receives */
+static void SAL_Socket_Ring_LendAll(SAL_Socket_Reactor* reactor) {
+	uint16 id;
+
+	if (reactor->Backend != SAL_Socket_Backends_IOUring || reactor->Ring.Buffers == NULL)
+		return;
+
+	for (id = 0; id < SAL_Socket_RingBuffers; id++)
+		SAL_Socket_Ring_Lend(reactor, id);
+
+	SAL_Atomic_Store32(&reactor->Ring.Receives, true);
+}
+
+/*
+ * Takes one completion of a multishot receive. The buffer it filled is
+ * replaced in the kernel's ring at once and left in Received for
+ * SAL_Socket_Receive, which hands it to the receive callback. Returns the
+ * socket to dispatch, or NULL when there is nothing to dispatch.
+ */
+static SAL_Socket* SAL_Socket_Ring_Received(SAL_Socket_Reactor* reactor, SAL_Socket_Request* request, const SAL_Socket_RingCompletion* completion, boolean* readable, boolean* writable) {
+	SAL_Socket_Buffer* buffer;
+	SAL_Socket* socket;
+	uint16 id;
+
+	socket = request->Socket;
+	buffer = NULL;
+
+	if (completion->Flags & IORING_CQE_F_BUFFER) {
+		id = (uint16)(completion->Flags >> IORING_CQE_BUFFER_SHIFT);
+		buffer = reactor->Ring.Lent[id];
+		buffer->Length = completion->Result > 0 ? (uint32)completion->Result : 0;
+
+		SAL_Socket_Ring_Lend(reactor, id);
 	}
-#elif defined POSIX
-	int rawSocket;
-#endif
 
-	memset(&serverHints, 0, sizeof(struct addrinfo));
+	/* the request stays armed for as long as the kernel says more completions follow */
+	if (!(completion->Flags & IORING_CQE_F_MORE))
+		request->Pending = false;
 
-	switch (family) {
-		case SAL_Socket_Families_IPV4: serverHints.ai_family = AF_INET; break;
-		case SAL_Socket_Families_IPV6: serverHints.ai_family = AF_INET6; break;
-		case SAL_Socket_Families_IPAny: serverHints.ai_family = AF_UNSPEC; break;
-		default: return NULL;
+	if (socket == NULL) {
+		if (buffer != NULL)
+			SAL_Socket_Buffer_Release(buffer);
+
+		if (!request->Pending)
+			SAL_Socket_Poller_Free(request);
+
+		return NULL;
 	}
 
-	switch (type) {
-		case SAL_Socket_Types_TCP: serverHints.ai_socktype = SOCK_STREAM; break;
-		default: return NULL;
+	if (completion->Result == -ENOBUFS || completion->Result == -ECANCELED) {
+		if (!request->Pending)
+			SAL_Socket_Poller_Arm(socket, false);
+
+		return NULL;
 	}
 
-	if (willListenOn)
-		serverHints.ai_flags = AI_PASSIVE;
-		
-	if (getaddrinfo(address, port, &serverHints, &serverAddrInfo) != 0) {
+	/* a kernel with buffer rings but no multishot receives, the reactor goes back to polling */
+	if (completion->Result == -EINVAL && buffer == NULL) {
+		SAL_Atomic_Store32(&reactor->Ring.Receives, false);
+
+		if (!request->Pending)
+			SAL_Socket_Poller_Arm(socket, false);
+
 		return NULL;
 	}
 
-	if (serverAddrInfo == NULL) {
-		return NULL;
+	if (completion->Result >= 0) {
+		SAL_Socket_CountTransfer(socket, false, (uint32)completion->Result);
+
+		if (completion->Result == 0)
+			socket->LastError = SAL_Socket_Errors_Closed;
+	}
+	else {
+		SAL_Socket_RecordError(socket, false, false);
+	}
+
+	reactor->Received = buffer;
+	reactor->HasReceived = true;
+	*readable = true;
+	*writable = false;
+
+	return socket;
+}
+#endif
+
+#if defined SAL_Socket_Backend_Epoll
+/* non-blocking sockets are edge-triggered, blocking ones stay level-triggered so each callback only has to read once */
+static uint32 SAL_Socket_Poller_Interest(SAL_Socket* socket) {
+	uint32 events = 0;
+
+	if (socket->ReadCallback)
+		events |= EPOLLIN;
+
+	if (socket->WriteCallback)
+		events |= EPOLLOUT;
+
+	if (socket->NonBlocking)
+		events |= EPOLLET;
+
+	return events;
+}
+#elif defined SAL_Socket_Backend_Kqueue
+/* applies one filter change, each separately so deleting a filter that was never added cannot hide the other change */
+static boolean SAL_Socket_Poller_Change(SAL_Socket* socket, int16 filter, boolean enable) {
+	struct kevent change;
+	uint16 flags;
+
+	flags = enable ? EV_ADD : EV_DELETE;
+	if (enable && socket->NonBlocking)
+		flags |= EV_CLEAR;
+
+	EV_SET(&change, socket->RawSocket, filter, flags, 0, 0, socket);
+
+	return kevent(socket->Reactor->Poller, &change, 1, NULL, 0, NULL) == 0;
+}
+#endif
+
+static boolean SAL_Socket_Poller_Create(SAL_Socket_Reactor* reactor) {
+	reactor->Backend = SAL_Socket_Backends_Default;
+
+#if defined SAL_Socket_Backend_Epoll
+	#if defined SAL_Socket_Backend_IOUring
+		if (requestedBackend == SAL_Socket_Backends_IOUring && SAL_Socket_Ring_Create(&reactor->Ring)) {
+			reactor->Backend = SAL_Socket_Backends_IOUring;
+			return true;
+		}
+	#endif
+
+	{
+		struct epoll_event event;
+
+		reactor->Poller = epoll_create1(EPOLL_CLOEXEC);
+		if (reactor->Poller == -1)
+			return false;
+
+		reactor->Wake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (reactor->Wake == -1) {
+			close(reactor->Poller);
+			return false;
+		}
+
+		memset(&event, 0, sizeof(struct epoll_event));
+		event.events = EPOLLIN;
+		event.data.ptr = reactor;
+
+		if (epoll_ctl(reactor->Poller, EPOLL_CTL_ADD, reactor->Wake, &event) != 0) {
+			SAL_Socket_Poller_Destroy(reactor);
+			return false;
+		}
+
+		return true;
+	}
+#elif defined SAL_Socket_Backend_Kqueue
+	{
+		struct kevent change;
+
+		reactor->Poller = kqueue();
+		if (reactor->Poller == -1)
+			return false;
+
+		if (pipe(reactor->Wake) != 0) {
+			close(reactor->Poller);
+			return false;
+		}
+
+		fcntl(reactor->Wake[0], F_SETFL, O_NONBLOCK);
+		fcntl(reactor->Wake[1], F_SETFL, O_NONBLOCK);
+
+		EV_SET(&change, reactor->Wake[0], EVFILT_READ, EV_ADD, 0, 0, reactor);
+
+		if (kevent(reactor->Poller, &change, 1, NULL, 0, NULL) != 0) {
+			SAL_Socket_Poller_Destroy(reactor);
+			return false;
+		}
+
+		return true;
+	}
+#elif defined SAL_Socket_Backend_IOCP
+	reactor->Poller = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+	return reactor->Poller != NULL;
+#endif
+}
+
+/* closes the poller of a reactor whose thread never started, or one that was only partly set up */
+static void SAL_Socket_Poller_Destroy(SAL_Socket_Reactor* reactor) {
+#if defined SAL_Socket_Backend_Epoll
+	#if defined SAL_Socket_Backend_IOUring
+		if (reactor->Backend == SAL_Socket_Backends_IOUring) {
+			SAL_Socket_Ring_Destroy(&reactor->Ring);
+			return;
+		}
+	#endif
+
+	close(reactor->Wake);
+	close(reactor->Poller);
+#elif defined SAL_Socket_Backend_Kqueue
+	close(reactor->Wake[0]);
+	close(reactor->Wake[1]);
+	close(reactor->Poller);
+#elif defined SAL_Socket_Backend_IOCP
+	CloseHandle(reactor->Poller);
+#endif
+}
+
+/* one-shot backends report each readiness once, reads are re-armed after dispatch and writes after a send would block */
+static boolean SAL_Socket_Poller_IsOneShot(SAL_Socket_Reactor* reactor) {
+#if defined SAL_Socket_Backend_IOCP
+	return true;
+#else
+	return reactor->Backend != SAL_Socket_Backends_Default;
+#endif
+}
+
+static boolean SAL_Socket_Poller_Add(SAL_Socket* socket) {
+	SAL_Socket_Reactor* reactor = socket->Reactor;
+#if defined SAL_Socket_Backend_Epoll
+	struct epoll_event event;
+
+	#if defined SAL_Socket_Backend_IOUring
+		if (reactor->Backend == SAL_Socket_Backends_IOUring) {
+			if (socket->ReadCallback)
+				SAL_Socket_Poller_Arm(socket, false);
+
+			if (socket->WriteCallback)
+				SAL_Socket_Poller_Arm(socket, true);
+
+			return true;
+		}
+	#endif
+
+	memset(&event, 0, sizeof(struct epoll_event));
+	event.events = SAL_Socket_Poller_Interest(socket);
+	event.data.ptr = socket;
+
+	return epoll_ctl(reactor->Poller, EPOLL_CTL_ADD, socket->RawSocket, &event) == 0;
+#elif defined SAL_Socket_Backend_Kqueue
+	if (socket->ReadCallback && !SAL_Socket_Poller_Change(socket, EVFILT_READ, true))
+		return false;
+
+	if (socket->WriteCallback && !SAL_Socket_Poller_Change(socket, EVFILT_WRITE, true)) {
+		SAL_Socket_Poller_Change(socket, EVFILT_READ, false);
+		return false;
+	}
+
+	return true;
+#elif defined SAL_Socket_Backend_IOCP
+	/* a socket can only be associated with a port once, so re-registering after an unset is expected to fail here */
+	if (CreateIoCompletionPort((HANDLE)socket->RawSocket, reactor->Poller, 0, 0) == NULL && GetLastError() != ERROR_INVALID_PARAMETER)
+		return false;
+
+	if (socket->ReadCallback && !SAL_Socket_Poller_Arm(socket, false))
+		return false;
+
+	if (socket->WriteCallback && !SAL_Socket_Poller_Arm(socket, true)) {
+		SAL_Socket_Poller_Cancel(socket, &socket->PollerData);
+		return false;
+	}
+
+	return true;
+#endif
+}
+
+/* called when the set of callbacks on an already registered socket changes */
+static void SAL_Socket_Poller_Update(SAL_Socket* socket) {
+	SAL_Socket_Reactor* reactor = socket->Reactor;
+#if defined SAL_Socket_Backend_Epoll
+	struct epoll_event event;
+
+	if (reactor->Backend == SAL_Socket_Backends_Default) {
+		memset(&event, 0, sizeof(struct epoll_event));
+		event.events = SAL_Socket_Poller_Interest(socket);
+		event.data.ptr = socket;
+
+		epoll_ctl(reactor->Poller, EPOLL_CTL_MOD, socket->RawSocket, &event);
+		return;
+	}
+#elif defined SAL_Socket_Backend_Kqueue
+	SAL_Socket_Poller_Change(socket, EVFILT_READ, socket->ReadCallback != NULL);
+	SAL_Socket_Poller_Change(socket, EVFILT_WRITE, socket->WriteCallback != NULL);
+	(void)reactor;
+#endif
+
+#if defined SAL_Socket_Backend_IOCP || defined SAL_Socket_Backend_IOUring
+	if (socket->ReadCallback)
+		SAL_Socket_Poller_Arm(socket, false);
+
+	if (socket->WriteCallback)
+		SAL_Socket_Poller_Arm(socket, true);
+	(void)reactor;
+#endif
+}
+
+static void SAL_Socket_Poller_Remove(SAL_Socket* socket) {
+	SAL_Socket_Reactor* reactor = socket->Reactor;
+	int32 i;
+
+	if (reactor->Current == socket)
+		reactor->Current = NULL;
+
+#if defined SAL_Socket_Backend_Epoll
+	if (reactor->Backend == SAL_Socket_Backends_Default) {
+		struct epoll_event event;
+
+		epoll_ctl(reactor->Poller, EPOLL_CTL_DEL, socket->RawSocket, &event);
+
+		/* events still waiting in the current batch carry a pointer that is about to dangle */
+		for (i = reactor->DispatchNext; i < reactor->DispatchCount; i++)
+			if (reactor->Events[i].data.ptr == socket)
+				reactor->Events[i].data.ptr = NULL;
+	}
+#elif defined SAL_Socket_Backend_Kqueue
+	SAL_Socket_Poller_Change(socket, EVFILT_READ, false);
+	SAL_Socket_Poller_Change(socket, EVFILT_WRITE, false);
+
+	/* events still waiting in the current batch carry a pointer that is about to dangle */
+	for (i = reactor->DispatchNext; i < reactor->DispatchCount; i++)
+		if (reactor->Events[i].udata == socket)
+			reactor->Events[i].udata = NULL;
+#endif
+
+#if defined SAL_Socket_Backend_IOCP || defined SAL_Socket_Backend_IOUring
+	/* pending requests are detached from the socket, nothing in the batch needs fixing up */
+	SAL_Socket_Poller_Cancel(socket, &socket->PollerData);
+	SAL_Socket_Poller_Cancel(socket, &socket->PollerWriteData);
+	(void)i;
+#endif
+}
+
+/* blocks until at least one socket registered with @a reactor is ready or @a timeout ms have passed, forever if @a timeout is negative. Returns the number of events written to its batch, -1 on failure. */
+static int32 SAL_Socket_Poller_Wait(SAL_Socket_Reactor* reactor, int32 timeout) {
+#if defined SAL_Socket_Backend_Epoll
+	#if defined SAL_Socket_Backend_IOUring
+		if (reactor->Backend == SAL_Socket_Backends_IOUring)
+			return SAL_Socket_Ring_Wait(reactor, timeout);
+	#endif
+
+	return epoll_wait(reactor->Poller, reactor->Events, SAL_Socket_MaxEvents, timeout);
+#elif defined SAL_Socket_Backend_Kqueue
+	struct timespec limit;
+
+	limit.tv_sec = timeout / 1000;
+	limit.tv_nsec = (timeout % 1000) * 1000000;
+
+	return kevent(reactor->Poller, NULL, 0, reactor->Events, SAL_Socket_MaxEvents, timeout >= 0 ? &limit : NULL);
+#elif defined SAL_Socket_Backend_IOCP
+	ULONG count;
+
+	if (!GetQueuedCompletionStatusEx(reactor->Poller, reactor->Events, SAL_Socket_MaxEvents, &count, timeout >= 0 ? (DWORD)timeout : INFINITE, FALSE))
+		return GetLastError() == WAIT_TIMEOUT ? 0 : -1;
+
+	return (int32)count;
+#endif
+}
+
+/* interrupts the wait of @a reactor from any thread */
+static void SAL_Socket_Poller_Wake(SAL_Socket_Reactor* reactor) {
+#if defined SAL_Socket_Backend_Epoll
+	uint64 value = 1;
+	ssize_t written;
+
+	#if defined SAL_Socket_Backend_IOUring
+		if (reactor->Backend == SAL_Socket_Backends_IOUring) {
+			SAL_Socket_Ring_Submit(reactor, IORING_OP_NOP, -1, 0, 0, (uint64)(uintptr_t)reactor);
+			return;
+		}
+	#endif
+
+	written = write(reactor->Wake, &value, sizeof(uint64));
+	(void)written;
+#elif defined SAL_Socket_Backend_Kqueue
+	uint8 value = 0;
+	ssize_t written;
+
+	written = write(reactor->Wake[1], &value, 1);
+	(void)written;
+#elif defined SAL_Socket_Backend_IOCP
+	PostQueuedCompletionStatus(reactor->Poller, 0, 0, NULL);
+#endif
+}
+
+/* maps a readiness event back to its socket in constant time. Returns NULL for events that no longer belong to a registered socket. */
+static SAL_Socket* SAL_Socket_Poller_GetSocket(SAL_Socket_Reactor* reactor, SAL_Socket_Event* event, boolean* readable, boolean* writable) {
+#if defined SAL_Socket_Backend_Epoll
+	#if defined SAL_Socket_Backend_IOUring
+		if (reactor->Backend == SAL_Socket_Backends_IOUring) {
+			/* wake-ups and timeouts only end the wait */
+			if (event->data.ptr == reactor)
+				return NULL;
+
+			if (event->data.ptr == &reactor->RingTimeout) {
+				reactor->RingDeadline = 0;
+				return NULL;
+			}
+
+		#if defined SAL_Socket_Backend_RingReceive
+			if (((SAL_Socket_Request*)event->data.ptr)->IsReceive)
+				return SAL_Socket_Ring_Received(reactor, (SAL_Socket_Request*)event->data.ptr, &reactor->RingCompletions[event - reactor->Events], readable, writable);
+		#endif
+
+			return SAL_Socket_Poller_Complete((SAL_Socket_Request*)event->data.ptr, readable, writable);
+		}
+	#endif
+
+	if (event->data.ptr == reactor) {
+		uint64 value;
+		ssize_t drained;
+
+		drained = read(reactor->Wake, &value, sizeof(uint64));
+		(void)drained;
+
+		return NULL;
+	}
+
+	/* errors and hang-ups go to both callbacks so whichever is registered finds out */
+	*readable = (event->events & (EPOLLIN | EPOLLERR | EPOLLHUP)) != 0;
+	*writable = (event->events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) != 0;
+
+	return (SAL_Socket*)event->data.ptr;
+#elif defined SAL_Socket_Backend_Kqueue
+	if (event->udata == reactor) {
+		uint8 values[64];
+
+		while (read(reactor->Wake[0], values, sizeof(values)) > 0)
+			;
+
+		return NULL;
+	}
+
+	*readable = event->filter == EVFILT_READ;
+	*writable = event->filter == EVFILT_WRITE;
+
+	return (SAL_Socket*)event->udata;
+#elif defined SAL_Socket_Backend_IOCP
+	(void)reactor;
+
+	/* a wake-up carries no request */
+	if (event->lpOverlapped == NULL)
+		return NULL;
+
+	return SAL_Socket_Poller_Complete((SAL_Socket_Request*)event->lpOverlapped, readable, writable);
+#endif
+}
+
+static SAL_Thread_Start(SAL_Socket_Reactor_Run) {
+	SAL_Socket_Reactor* reactor = (SAL_Socket_Reactor*)startupArgument;
+	SAL_Socket_Statistics* statistics;
+	SAL_Socket* asyncSocket;
+	boolean readable;
+	boolean writable;
+	boolean timing;
+	int64 woken;
+	int64 started;
+	int32 count;
+
+	currentReactor = reactor;
+	statistics = SAL_Socket_Statistics_Get();
+	SAL_Atomic_StorePointer(&reactor->Statistics, statistics);
+
+#if defined SAL_Socket_Backend_RingReceive
+	SAL_Socket_Ring_LendAll(reactor);
+#endif
+
+	while (reactor->Running) {
+		count = SAL_Socket_Poller_Wait(reactor, SAL_Socket_Timers_Timeout(reactor));
+		reactor->DispatchCount = count > 0 ? count : 0;
+
+		/* timing is sampled once per turn so a change takes effect at the next wait */
+		timing = SAL_Atomic_Load32(&callbackTiming) != 0;
+		woken = timing ? SAL_Time_Cycles() : 0;
+		started = 0;
+
+		SAL_Socket_Statistics_Add(&statistics->Iterations, 1);
+		SAL_Socket_Statistics_Add(&statistics->Events, (uint64)reactor->DispatchCount);
+
+		for (reactor->DispatchNext = 0; reactor->DispatchNext < reactor->DispatchCount; ) {
+			asyncSocket = SAL_Socket_Poller_GetSocket(reactor, &reactor->Events[reactor->DispatchNext++], &readable, &writable);
+			if (asyncSocket == NULL)
+				continue;
+
+			SAL_Socket_Statistics_Add(&statistics->Dispatches, 1);
+
+			if (timing)
+				started = SAL_Time_Cycles();
+
+			/* Current is cleared if a callback unregisters or closes the socket, after which it must not be touched */
+			reactor->Current = asyncSocket;
+
+			if (readable && asyncSocket->ReadCallback != NULL)
+				asyncSocket->ReadCallback(asyncSocket, asyncSocket->ReadCallbackState);
+
+			/* queued output is resumed first, the write callback only hears about writability once it is gone */
+			if (writable && reactor->Current != NULL && asyncSocket->OutputCount > 0)
+				SAL_Socket_Flush(asyncSocket);
+
+			if (writable && reactor->Current != NULL && asyncSocket->WriteCallback != NULL && asyncSocket->OutputCount == 0)
+				asyncSocket->WriteCallback(asyncSocket, asyncSocket->WriteCallbackState);
+
+			#if defined SAL_Socket_Backend_IOCP || defined SAL_Socket_Backend_IOUring
+				/* one-shot backends report a read once; ask again if the callback kept the socket registered */
+				if (readable && reactor->Current != NULL && asyncSocket->ReadCallback != NULL && SAL_Socket_Poller_IsOneShot(reactor))
+					SAL_Socket_Poller_Arm(asyncSocket, false);
+			#endif
+
+			#if defined SAL_Socket_Backend_RingReceive
+				/* a received buffer the dispatch did not take, its socket was unregistered or no longer has a receive callback */
+				if (reactor->HasReceived) {
+					if (reactor->Received != NULL)
+						SAL_Socket_Buffer_Release(reactor->Received);
+
+					reactor->Received = NULL;
+					reactor->HasReceived = false;
+				}
+			#endif
+
+			reactor->Current = NULL;
+
+			if (timing)
+				SAL_Socket_Statistics_Time(statistics, started);
+		}
+
+		reactor->DispatchCount = 0;
+
+		SAL_Socket_Reactor_RunPosted(reactor);
+		SAL_Socket_Timers_Expire(reactor);
+
+		if (timing)
+			SAL_Socket_Statistics_Add(&statistics->BusyTime, (uint64)SAL_Time_CyclesToNanoseconds(SAL_Time_Cycles() - woken));
+	}
+
+	return 0;
+}
+
+/*
+ * Starts the reactors on the first registration, after which they stay parked
+ * in the kernel wait so an empty socket set costs nothing. Racing first calls
+ * wait until the winner is done. Returns false if a poller could not be
+ * created, leaving the reactors unstarted for a later call to try again.
+ */
+static boolean SAL_Socket_Reactors_Initialize(void) {
+	SAL_Socket_Reactor* reactor;
+	SAL_Thread_Attributes attributes;
+	uint32 state;
+	uint32 i;
+
+	if (SAL_Atomic_Load32(&reactorsState) == SAL_Socket_Reactors_Started)
+		return true;
+
+	if (!SAL_Atomic_CompareExchange32(&reactorsState, SAL_Socket_Reactors_Unstarted, SAL_Socket_Reactors_Starting)) {
+		while ((state = SAL_Atomic_Load32(&reactorsState)) == SAL_Socket_Reactors_Starting)
+			SAL_Thread_Yield();
+
+		return state == SAL_Socket_Reactors_Started;
+	}
+
+	reactors = SAL_Allocator_NewArray(SAL_Socket_Reactor, reactorCount);
+
+	/* every poller exists before any thread starts, so a failure only has descriptors to close */
+	for (i = 0; i < reactorCount; i++) {
+		if (!SAL_Socket_Poller_Create(&reactors[i])) {
+			while (i > 0)
+				SAL_Socket_Poller_Destroy(&reactors[--i]);
+
+			SAL_Allocator_Free(reactors);
+			reactors = NULL;
+
+			SAL_Atomic_Store32(&reactorsState, SAL_Socket_Reactors_Unstarted);
+
+			return false;
+		}
+	}
+
+	for (i = 0; i < reactorCount; i++) {
+		reactor = &reactors[i];
+		reactor->DispatchNext = 0;
+		reactor->DispatchCount = 0;
+		reactor->Current = NULL;
+		reactor->FreeBuffers = NULL;
+		reactor->ReturnedBuffers = NULL;
+		reactor->Posted = NULL;
+		memset(&reactor->Timers, 0, sizeof(SAL_Socket_TimerWheel));
+		reactor->Timers.Current = SAL_Time_Monotonic();
+		reactor->Statistics = NULL;
+	#if defined SAL_Socket_Backend_IOUring
+		reactor->RingDeadline = 0;
+	#endif
+		reactor->Running = true;
+
+		if (reactorAttributes == NULL) {
+			reactor->Thread = SAL_Thread_Create(SAL_Socket_Reactor_Run, reactor);
+		}
+		else {
+			if (reactorSpread)
+				SAL_Thread_Attributes_Spread(reactorAttributes, i, &attributes);
+			else
+				attributes = *reactorAttributes;
+
+			reactor->Thread = SAL_Thread_CreateWithAttributes(SAL_Socket_Reactor_Run, reactor, &attributes);
+		}
+	}
+
+	SAL_Atomic_Store32(&reactorsState, SAL_Socket_Reactors_Started);
+
+	return true;
+}
+
+/* Picks the reactor that will own @a socket. Sockets that already have one (accepted from a sharded listener, for example) keep it, the rest are spread round-robin. May run on any thread, including a reactor handing out accepted sockets. Returns NULL if the reactors could not be started. */
+static SAL_Socket_Reactor* SAL_Socket_Reactors_Assign(SAL_Socket* socket) {
+	if (!SAL_Socket_Reactors_Initialize())
+		return NULL;
+
+	if (socket->Reactor == NULL)
+		socket->Reactor = &reactors[(SAL_Atomic_Increment32(&nextReactor) - 1) % reactorCount];
+
+	return socket->Reactor;
+}
+
+/* Called after a callback on @a socket was set. Registers the socket with its reactor the first time, otherwise updates the kernel interest set. */
+static void SAL_Socket_Reactor_Register(SAL_Socket* socket, boolean wasRegistered) {
+	if (wasRegistered) {
+		SAL_Socket_Poller_Update(socket);
+		return;
+	}
+
+	if (SAL_Socket_Reactors_Assign(socket) == NULL || !SAL_Socket_Poller_Add(socket)) {
+		socket->LastError = SAL_Socket_Errors_Failed;
+		socket->ReadCallback = NULL;
+		socket->ReadCallbackState = NULL;
+		socket->WriteCallback = NULL;
+		socket->WriteCallbackState = NULL;
+	}
+}
+
+/* carves a new slab of receive buffers for @a reactor's pool. The pool only grows, to the most buffers ever held at once. */
+static void SAL_Socket_Pool_Grow(SAL_Socket_Reactor* reactor) {
+	SAL_Socket_Buffer* buffers;
+	uint8* data;
+	uint32 i;
+
+	buffers = SAL_Allocator_NewArray(SAL_Socket_Buffer, SAL_Socket_PoolSlab);
+	data = SAL_Allocator_NewArray(uint8, SAL_Socket_PoolSlab * SAL_Socket_ReceiveBufferSize);
+
+	for (i = 0; i < SAL_Socket_PoolSlab; i++) {
+		buffers[i].Data = data + i * SAL_Socket_ReceiveBufferSize;
+		buffers[i].Length = 0;
+		buffers[i].Capacity = SAL_Socket_ReceiveBufferSize;
+		buffers[i].References = 0;
+		buffers[i].Reactor = reactor;
+		buffers[i].Next = reactor->FreeBuffers;
+		reactor->FreeBuffers = &buffers[i];
+	}
+}
+
+/* takes a buffer from @a reactor's pool on its own thread, most recently released first so it is likely still in cache */
+static SAL_Socket_Buffer* SAL_Socket_Pool_Take(SAL_Socket_Reactor* reactor) {
+	SAL_Socket_Buffer* buffer;
+
+	if (reactor->FreeBuffers == NULL)
+		reactor->FreeBuffers = (SAL_Socket_Buffer*)SAL_Atomic_ExchangePointer(&reactor->ReturnedBuffers, NULL);
+
+	if (reactor->FreeBuffers == NULL)
+		SAL_Socket_Pool_Grow(reactor);
+
+	buffer = reactor->FreeBuffers;
+	reactor->FreeBuffers = buffer->Next;
+	buffer->Next = NULL;
+	buffer->Length = 0;
+	buffer->References = 1;
+
+	return buffer;
+}
+
+/* runs as the read callback of sockets registered with SAL_Socket_SetReceiveCallback */
+static void SAL_Socket_Receive(SAL_Socket* socket, void* const state) {
+	SAL_Socket_Reactor* reactor = socket->Reactor;
+	SAL_Socket_Buffer* buffer;
+	uint32 received;
+
+#if defined SAL_Socket_Backend_RingReceive
+	/* a multishot receive already filled a buffer, or saw the connection end */
+	if (reactor->HasReceived) {
+		buffer = reactor->Received;
+		reactor->Received = NULL;
+		reactor->HasReceived = false;
+
+		socket->ReceiveCallback(socket, buffer != NULL && buffer->Length > 0 ? buffer : NULL, buffer != NULL ? buffer->Length : 0, state);
+
+		if (buffer != NULL)
+			SAL_Socket_Buffer_Release(buffer);
+
+		return;
+	}
+#endif
+
+	do {
+		buffer = SAL_Socket_Pool_Take(reactor);
+
+		received = SAL_Socket_Read(socket, buffer->Data, buffer->Capacity);
+		if (received == SAL_Socket_WouldBlock) {
+			SAL_Socket_Buffer_Release(buffer);
+			break;
+		}
+
+		buffer->Length = received;
+		socket->ReceiveCallback(socket, received > 0 ? buffer : NULL, received, state);
+		SAL_Socket_Buffer_Release(buffer);
+
+		/* the callback may have closed the socket, after which it must not be touched */
+		if (received == 0 || reactor->Current != socket)
+			break;
+	} while (socket->NonBlocking);
+}
+
+/**
+ * Keep @a buffer alive past the receive callback it was passed to. Every
+ * retain has to be matched by a @ref SAL_Socket_Buffer_Release.
+ *
+ * @param buffer Buffer handed to a receive callback
+ */
+void SAL_Socket_Buffer_Retain(SAL_Socket_Buffer* buffer) {
+	assert(buffer != NULL);
+
+	SAL_Atomic_Increment32(&buffer->References);
+}
+
+/**
+ * Drop a reference to @a buffer, returning it to its reactor's pool when the
+ * last one goes. May be called from any thread.
+ *
+ * @param buffer Buffer to release
+ */
+void SAL_Socket_Buffer_Release(SAL_Socket_Buffer* buffer) {
+	SAL_Socket_Reactor* reactor;
+	SAL_Socket_Buffer* head;
+
+	assert(buffer != NULL);
+
+	if (SAL_Atomic_Decrement32(&buffer->References) != 0)
+		return;
+
+	reactor = buffer->Reactor;
+
+	/* the owning reactor keeps its free list to itself, other threads hand buffers back through a lock-free stack it drains when the list runs dry */
+	if (currentReactor == reactor) {
+		buffer->Next = reactor->FreeBuffers;
+		reactor->FreeBuffers = buffer;
+	}
+	else {
+		do {
+			head = (SAL_Socket_Buffer*)SAL_Atomic_LoadPointer(&reactor->ReturnedBuffers);
+			buffer->Next = head;
+		} while (!SAL_Atomic_CompareExchangePointer(&reactor->ReturnedBuffers, head, buffer));
+	}
+}
+
+/**
+ * Choose the kernel interface the reactors wait on.
+ *
+ * @ref SAL_Socket_Backends_Default is epoll on Linux, kqueue on the BSDs and
+ * macOS and IOCP on Windows. @ref SAL_Socket_Backends_IOUring uses io_uring on
+ * Linux, submitting every poll re-arm of a dispatch together with the next
+ * wait in one system call. Reactors fall back to the default backend where the
+ * kernel has no io_uring. Callbacks behave the same on every backend.
+ *
+ * @param backend One of the SAL_Socket_Backends values
+ * @returns true on success, false if the backend was not compiled in or the
+ * reactors have already been started by registering a callback.
+ */
+boolean SAL_Socket_SetBackend(uint8 backend) {
+	if (SAL_Atomic_Load32(&reactorsState) != SAL_Socket_Reactors_Unstarted)
+		return false;
+
+#if defined SAL_Socket_Backend_IOUring
+	if (backend != SAL_Socket_Backends_Default && backend != SAL_Socket_Backends_IOUring)
+		return false;
+#else
+	if (backend != SAL_Socket_Backends_Default)
+		return false;
+#endif
+
+	requestedBackend = backend;
+
+	return true;
+}
+
+/**
+ * @returns the backend the reactors are using, or the one they will try to use
+ * if they have not been started yet.
+ */
+uint8 SAL_Socket_GetBackend(void) {
+	return SAL_Atomic_Load32(&reactorsState) == SAL_Socket_Reactors_Started ? reactors[0].Backend : requestedBackend;
+}
+
+/**
+ * Set the number of reactor threads that run socket callbacks.
+ *
+ * Each reactor owns the sockets assigned to it and dispatches their callbacks
+ * on its own thread, so a slow callback only stalls the sockets that share its
+ * reactor. Defaults to a single reactor.
+ *
+ * @param count Number of reactor threads, between 1 and 64
+ * @returns true on success, false if @a count is out of range or the reactors
+ * have already been started by registering a callback.
+ */
+boolean SAL_Socket_SetReactorCount(uint32 count) {
+	if (SAL_Atomic_Load32(&reactorsState) != SAL_Socket_Reactors_Unstarted || count == 0 || count > SAL_Socket_MaxReactors)
+		return false;
+
+	reactorCount = count;
+
+	return true;
+}
+
+/**
+ * Set how the reactor threads are created: where they run, their stack size,
+ * priority and name.
+ *
+ * Together with @ref SAL_Socket_SetReactorCount and sharded listeners this
+ * gives one reactor per core, each pinned to its processor, so a socket's
+ * callbacks, buffers and kernel queues all stay on one core.
+ *
+ * @param attributes How to create every reactor thread, copied, or NULL to
+ * go back to plain threads
+ * @param spread Whether to pin reactor i alone to the i th processor
+ * @a attributes allows (see @ref SAL_Thread_Attributes_Spread) instead of
+ * giving every reactor the same set
+ * @returns true on success, false if the reactors have already been started
+ * by registering a callback.
+ */
+boolean SAL_Socket_SetReactorAttributes(const SAL_Thread_Attributes* attributes, boolean spread) {
+	if (SAL_Atomic_Load32(&reactorsState) != SAL_Socket_Reactors_Unstarted)
+		return false;
+
+	if (attributes == NULL) {
+		if (reactorAttributes != NULL)
+			SAL_Allocator_Free(reactorAttributes);
+
+		reactorAttributes = NULL;
+		reactorSpread = false;
+
+		return true;
+	}
+
+	if (reactorAttributes == NULL)
+		reactorAttributes = SAL_Allocator_New(SAL_Thread_Attributes);
+
+	*reactorAttributes = *attributes;
+	reactorSpread = spread;
+
+	return true;
+}
+
+/* the calling thread's counters, linked into allStatistics the first time it does I/O */
+static SAL_Socket_Statistics* SAL_Socket_Statistics_Get(void) {
+	SAL_Socket_StatisticsBlock* block = threadStatistics;
+	SAL_Socket_StatisticsBlock* head;
+
+	if (block != NULL)
+		return &block->Statistics;
+
+	/* never freed, a thread that exits leaves its totals behind for later snapshots */
+	block = threadStatistics = SAL_Allocator_New(SAL_Socket_StatisticsBlock);
+	memset(block, 0, sizeof(SAL_Socket_StatisticsBlock));
+
+	do {
+		head = (SAL_Socket_StatisticsBlock*)SAL_Atomic_LoadPointer(&allStatistics);
+		block->Next = head;
+	} while (!SAL_Atomic_CompareExchangePointer(&allStatistics, head, block));
+
+	return &block->Statistics;
+}
+
+/* bumps a counter only its own thread writes: no locked instruction, but snapshots on other threads never see it torn */
+static void SAL_Socket_Statistics_Add(uint64* counter, uint64 amount) {
+	SAL_Atomic_Store64(counter, SAL_Atomic_Load64(counter) + amount);
+}
+
+/* ends a callback timed from @a started, a SAL_Time_Cycles stamp, adding it to the total and the histogram */
+static void SAL_Socket_Statistics_Time(SAL_Socket_Statistics* statistics, int64 started) {
+	uint64 elapsed = (uint64)SAL_Time_CyclesToNanoseconds(SAL_Time_Cycles() - started);
+	uint64 microseconds = elapsed / 1000;
+	uint32 bucket = 0;
+
+	while (microseconds > 0 && bucket < SAL_Socket_HistogramBuckets - 1) {
+		microseconds >>= 1;
+		bucket++;
+	}
+
+	SAL_Socket_Statistics_Add(&statistics->CallbackTime, elapsed);
+	SAL_Socket_Statistics_Add(&statistics->CallbackHistogram[bucket], 1);
+}
+
+/* records a receive or send on @a socket that moved @a bytes, in its counters and the calling thread's. The application and the reactor may both be using the socket, so its counters take a locked add. */
+static void SAL_Socket_CountTransfer(SAL_Socket* socket, boolean isWrite, uint32 bytes) {
+	SAL_Socket_Counters* thread = &SAL_Socket_Statistics_Get()->IO;
+
+	if (isWrite) {
+		SAL_Atomic_Add64(&socket->Counters.Writes, 1);
+		SAL_Atomic_Add64(&socket->Counters.BytesWritten, bytes);
+		SAL_Socket_Statistics_Add(&thread->Writes, 1);
+		SAL_Socket_Statistics_Add(&thread->BytesWritten, bytes);
+	}
+	else {
+		SAL_Atomic_Add64(&socket->Counters.Reads, 1);
+		SAL_Atomic_Add64(&socket->Counters.BytesRead, bytes);
+		SAL_Socket_Statistics_Add(&thread->Reads, 1);
+		SAL_Socket_Statistics_Add(&thread->BytesRead, bytes);
+	}
+}
+
+/* adds each counter in @a source to @a total, both laid out as arrays of uint64 */
+static void SAL_Socket_Statistics_Sum(SAL_Socket_Statistics* total, SAL_Socket_Statistics* source) {
+	uint64* to = (uint64*)total;
+	uint64* from = (uint64*)source;
+	uint32 i;
+
+	for (i = 0; i < sizeof(SAL_Socket_Statistics) / sizeof(uint64); i++)
+		to[i] += SAL_Atomic_Load64(&from[i]);
+}
+
+/**
+ * Sum the counters of every thread that has done socket I/O, reactors
+ * included, into @a statistics.
+ *
+ * Each thread counts into its own block without locks, so this can run at
+ * any rate without slowing the I/O down. Counters are read one at a time
+ * while they keep moving, so totals taken together may be a few operations
+ * apart.
+ *
+ * @param statistics Filled with the totals
+ */
+void SAL_Socket_GetStatistics(SAL_Socket_Statistics* statistics) {
+	SAL_Socket_StatisticsBlock* block;
+
+	assert(statistics != NULL);
+
+	memset(statistics, 0, sizeof(SAL_Socket_Statistics));
+
+	for (block = (SAL_Socket_StatisticsBlock*)SAL_Atomic_LoadPointer(&allStatistics); block != NULL; block = block->Next)
+		SAL_Socket_Statistics_Sum(statistics, &block->Statistics);
+}
+
+/**
+ * Fill @a statistics with the counters of one reactor thread, which cover the
+ * callbacks it ran and the I/O they did. A reactor whose histogram leans to
+ * the high buckets has a callback starving its other sockets.
+ *
+ * @param index Reactor to read, from 0 to the count given to @ref
+ * SAL_Socket_SetReactorCount
+ * @param statistics Filled with the reactor's counters
+ * @returns true on success, false if there is no such reactor running.
+ */
+boolean SAL_Socket_GetReactorStatistics(uint32 index, SAL_Socket_Statistics* statistics) {
+	SAL_Socket_Statistics* source;
+
+	assert(statistics != NULL);
+
+	memset(statistics, 0, sizeof(SAL_Socket_Statistics));
+
+	if (SAL_Atomic_Load32(&reactorsState) != SAL_Socket_Reactors_Started || index >= reactorCount)
+		return false;
+
+	source = (SAL_Socket_Statistics*)SAL_Atomic_LoadPointer(&reactors[index].Statistics);
+	if (source == NULL)
+		return false;
+
+	SAL_Socket_Statistics_Sum(statistics, source);
+
+	return true;
+}
+
+/**
+ * Time every dispatch and posted callback the reactors run, filling @a
+ * CallbackTime, @a CallbackHistogram and @a BusyTime. Off by default since it
+ * reads the clock twice per callback; the other counters are always kept.
+ *
+ * @param enable true to start timing, false to stop
+ */
+void SAL_Socket_SetCallbackTiming(boolean enable) {
+	SAL_Atomic_Store32(&callbackTiming, enable ? 1 : 0);
+}
+
+/* the slot of a socket made by SAL_Socket_New: sockets are handed out from slabs of these, each padded to whole cache lines */
+typedef struct SAL_Socket_Slot SAL_Socket_Slot;
+typedef struct SAL_Socket_Cache SAL_Socket_Cache;
+
+struct SAL_Socket_Slot {
+	SAL_Socket Socket;
+	SAL_Socket_Cache* Cache;
+	SAL_Socket_Slot* Next;
+};
+
+/* the free slots of one thread: Free is private to the thread, other threads closing its sockets push them onto Returned, kept on a line of its own */
+struct SAL_Socket_Cache {
+	SAL_Socket_Slot* Free;
+	uint8 Padding[SAL_Socket_CacheLine - sizeof(SAL_Socket_Slot*)];
+	SAL_Socket_Slot* Returned;
+};
+
+#define SAL_Socket_SlotSize ((sizeof(SAL_Socket_Slot) + SAL_Socket_CacheLine - 1) / SAL_Socket_CacheLine * SAL_Socket_CacheLine)
+
+static SAL_ThreadLocal SAL_Socket_Cache* socketCache = NULL;
+
+/* carves a new cache-line aligned slab of slots for @a cache. Slabs are never returned to the heap, a thread's cache only grows to the most sockets it had open at once. */
+static void SAL_Socket_Cache_Grow(SAL_Socket_Cache* cache) {
+	SAL_Socket_Slot* slot;
+	uint8* slab;
+	uint32 i;
+
+	slab = SAL_Allocator_NewArray(uint8, SAL_Socket_SlabSlots * SAL_Socket_SlotSize + SAL_Socket_CacheLine);
+	slab += SAL_Socket_CacheLine - (size_t)slab % SAL_Socket_CacheLine;
+
+	for (i = 0; i < SAL_Socket_SlabSlots; i++) {
+		slot = (SAL_Socket_Slot*)(slab + i * SAL_Socket_SlotSize);
+		slot->Cache = cache;
+		slot->Next = cache->Free;
+		cache->Free = slot;
+	}
+}
+
+/* takes a zeroed socket from the calling thread's cache */
+static SAL_Socket* SAL_Socket_Cache_Take(void) {
+	SAL_Socket_Cache* cache = socketCache;
+	SAL_Socket_Slot* slot;
+
+	if (cache == NULL)
+		cache = socketCache = SAL_Allocator_New(SAL_Socket_Cache);
+
+	if (cache->Free == NULL)
+		cache->Free = (SAL_Socket_Slot*)SAL_Atomic_ExchangePointer(&cache->Returned, NULL);
+
+	if (cache->Free == NULL)
+		SAL_Socket_Cache_Grow(cache);
+
+	slot = cache->Free;
+	cache->Free = slot->Next;
+	memset(&slot->Socket, 0, sizeof(SAL_Socket));
+
+	return &slot->Socket;
+}
+
+/* returns @a socket to the cache of the thread that made it */
+static void SAL_Socket_Cache_Return(SAL_Socket* socket) {
+	SAL_Socket_Slot* slot = (SAL_Socket_Slot*)socket;
+	SAL_Socket_Cache* cache = slot->Cache;
+	SAL_Socket_Slot* head;
+
+	if (cache == socketCache) {
+		slot->Next = cache->Free;
+		cache->Free = slot;
+	}
+	else {
+		do {
+			head = (SAL_Socket_Slot*)SAL_Atomic_LoadPointer(&cache->Returned);
+			slot->Next = head;
+		} while (!SAL_Atomic_CompareExchangePointer(&cache->Returned, head, slot));
+	}
+}
+
+static SAL_Socket* SAL_Socket_New(uint8 family, uint8 type) {
+	SAL_Socket* socket;
+	
+	socket = SAL_Socket_Cache_Take();
+	socket->RawSocket = 0;
+	socket->Connected = false;
+	socket->LastError = 0;
+	memset(&socket->Counters, 0, sizeof(SAL_Socket_Counters));
+	socket->ReadCallback = NULL;
+	socket->ReadCallbackState = NULL;
+	socket->ReceiveCallback = NULL;
+	socket->AcceptCallback = NULL;
+	socket->WriteCallback = NULL;
+	socket->WriteCallbackState = NULL;
+	socket->NonBlocking = false;
+	socket->Listening = false;
+	socket->Sharded = false;
+	socket->SegmentOffload = false;
+	socket->SegmentSendRejected = false;
+	socket->Corked = false;
+	socket->Output = NULL;
+	socket->OutputCount = 0;
+	socket->OutputCapacity = 0;
+	socket->OutputOffset = 0;
+	socket->Reactor = NULL;
+	socket->PollerData = NULL;
+	socket->PollerWriteData = NULL;
+	socket->PoolEntry = NULL;
+	socket->TLS = NULL;
+#ifdef WINDOWS
+	socket->ConnectTarget = NULL;
+#endif
+	socket->Family = family;
+	socket->Type = type;
+
+	return socket;
+}
+
+/* records a failed transfer in @a LastError and returns what Read and Write report for it */
+static uint32 SAL_Socket_RecordError(SAL_Socket* socket, boolean isWrite, boolean wouldBlock) {
+	SAL_Socket_Counters* thread;
+
+	/* the error is read first, the thread's counters may be allocated here */
+	thread = &SAL_Socket_Statistics_Get()->IO;
+	SAL_Socket_CountTransfer(socket, isWrite, 0);
+
+	if (wouldBlock) {
+		socket->LastError = SAL_Socket_Errors_WouldBlock;
+		SAL_Atomic_Add64(&socket->Counters.WouldBlocks, 1);
+		SAL_Socket_Statistics_Add(&thread->WouldBlocks, 1);
+
+	#if defined SAL_Socket_Backend_IOCP || defined SAL_Socket_Backend_IOUring
+		/* one-shot backends only watch for writability once a send has actually filled the socket */
+		if (isWrite && socket->WriteCallback && SAL_Socket_Poller_IsOneShot(socket->Reactor))
+			SAL_Socket_Poller_Arm(socket, true);
+	#endif
+
+		return SAL_Socket_WouldBlock;
+	}
+
+	socket->LastError = SAL_Socket_Errors_Failed;
+	SAL_Atomic_Add64(&socket->Counters.Errors, 1);
+	SAL_Socket_Statistics_Add(&thread->Errors, 1);
+
+	return 0;
+}
+
+/* records why a recv or send failed in @a LastError and returns what Read and Write report for it */
+static uint32 SAL_Socket_TranslateError(SAL_Socket* socket, boolean isWrite) {
+#ifdef WINDOWS
+	return SAL_Socket_RecordError(socket, isWrite, WSAGetLastError() == WSAEWOULDBLOCK);
+#elif defined POSIX
+	return SAL_Socket_RecordError(socket, isWrite, errno == EAGAIN || errno == EWOULDBLOCK);
+#endif
+}
+
+/* whether writes on @a socket have to go through its TLS session rather than straight to the kernel */
+static boolean SAL_Socket_SendsThroughTLS(SAL_Socket* socket) {
+	return socket->TLS != NULL && !SAL_TLS_IsOffloaded(socket, true);
+}
+
+/* waits up to @a timeout milliseconds for @a socket to be able to take more data */
+static boolean SAL_Socket_WaitWritable(SAL_Socket* socket, uint32 timeout) {
+	struct pollfd descriptor;
+
+	descriptor.fd = socket->RawSocket;
+	descriptor.events = POLLOUT;
+	descriptor.revents = 0;
+
+#ifdef WINDOWS
+	return WSAPoll(&descriptor, 1, (INT)timeout) > 0;
+#elif defined POSIX
+	return poll(&descriptor, 1, (int)timeout) > 0;
+#endif
+}
+
+/* waits up to @a timeout milliseconds for @a socket to have data or, on a listener, a connection */
+static boolean SAL_Socket_WaitReadable(SAL_Socket* socket, uint32 timeout) {
+	struct pollfd descriptor;
+
+	descriptor.fd = socket->RawSocket;
+	descriptor.events = POLLIN;
+	descriptor.revents = 0;
+
+#ifdef WINDOWS
+	return WSAPoll(&descriptor, 1, (INT)timeout) > 0;
+#elif defined POSIX
+	return poll(&descriptor, 1, (int)timeout) > 0;
+#endif
+}
+
+static SAL_Socket* SAL_Socket_PrepareRawSocket(const int8* const address, const int8* port, uint8 family, uint8 type, boolean willListenOn, struct addrinfo** addressInfo) {
+	struct addrinfo serverHints;
+	struct addrinfo* serverAddrInfo;
+	SAL_Socket* listener;
+
+#ifdef WINDOWS
+	SOCKET rawSocket;
+
+	if (!winsockInitialized) {
+		WSADATA startupData;
+		WSAStartup(514, &startupData);
+		winsockInitialized = true;
+	}
+#elif defined POSIX
+	int rawSocket;
+#endif
+
+	memset(&serverHints, 0, sizeof(struct addrinfo));
+
+	switch (family) {
+		case SAL_Socket_Families_IPV4: serverHints.ai_family = AF_INET; break;
+		case SAL_Socket_Families_IPV6: serverHints.ai_family = AF_INET6; break;
+		case SAL_Socket_Families_IPAny: serverHints.ai_family = AF_UNSPEC; break;
+		default: return NULL;
+	}
+
+	switch (type) {
+		case SAL_Socket_Types_TCP: serverHints.ai_socktype = SOCK_STREAM; break;
+		case SAL_Socket_Types_UDP: serverHints.ai_socktype = SOCK_DGRAM; break;
+		default: return NULL;
+	}
+
+	if (willListenOn)
+		serverHints.ai_flags = AI_PASSIVE;
+		
+	if (getaddrinfo(address, port, &serverHints, &serverAddrInfo) != 0) {
+		return NULL;
+	}
+
+	if (serverAddrInfo == NULL) {
+		return NULL;
+	}
+	
+	rawSocket = socket(serverAddrInfo->ai_family, serverAddrInfo->ai_socktype, serverAddrInfo->ai_protocol);
+#ifdef WINDOWS
+	if (rawSocket == INVALID_SOCKET) {
+		closesocket(rawSocket); // It might be invalid, who cares?
+		freeaddrinfo(serverAddrInfo);
+		return NULL;
+	}
+#elif defined POSIX
+	if (rawSocket == -1) {
+		close(rawSocket);
+		freeaddrinfo(serverAddrInfo);
+		return NULL;
+	}
+#endif
+
+	listener = SAL_Socket_New(family, type);
+	listener->RawSocket = rawSocket;
+	*addressInfo = serverAddrInfo;
+
+	return listener;
+}
+
+
+
+
+/**
+ * Create a TCP connection to a host.
+ *
+ * With @ref SAL_Socket_Types_UDP no connection is made, the socket only sends
+ * to and receives from that host.
+ *
+ * Blocks on the lookup and the handshake and only tries the first address,
+ * see @ref SAL_Socket_ConnectAsync for a connect that does neither.
+ *
+ * @param address A string specifying the hostname to connect to
+ * @param port Port to connect to
+ */
+SAL_Socket* SAL_Socket_Connect(const int8* const address, const int8* port, uint8 family, uint8 type) {
+	SAL_Socket_Options options;
+
+	SAL_Socket_Options_Initialize(&options);
+
+	return SAL_Socket_ConnectWithOptions(address, port, family, type, &options);
+}
+
+/**
+ * Create a TCP connection to a host with @a options applied before the
+ * handshake, which is when buffer sizes and fast open have to be set.
+ *
+ * @param address A string specifying the hostname to connect to
+ * @param port Port to connect to
+ * @param options Options for the connection, see @ref SAL_Socket_Options
+ * @returns the connected socket, or NULL on failure.
+ */
+SAL_Socket* SAL_Socket_ConnectWithOptions(const int8* const address, const int8* port, uint8 family, uint8 type, const SAL_Socket_Options* options) {
+	SAL_Socket* server;
+	struct addrinfo* serverAddrInfo;
+
+	assert(options != NULL);
+	
+	server = SAL_Socket_PrepareRawSocket(address, port, family, type, false, &serverAddrInfo);
+	if (server == NULL) {
+		return NULL;
+	}
+
+	if (!SAL_Socket_ApplyCreationOptions(server, options, false)) {
+		goto error;
+	}
+
+	SAL_Socket_ApplyOptions(server, options);
+
+	if (connect(server->RawSocket, serverAddrInfo->ai_addr, (int)serverAddrInfo->ai_addrlen) != 0) {
+		goto error;
+	}
+	
+	freeaddrinfo(serverAddrInfo);
+
+	server->Connected = true;
+
+	if (options->NonBlocking && !SAL_Socket_SetNonBlocking(server, true)) {
+		SAL_Socket_Close(server);
+		return NULL;
+	}
+
+	return server;
+
+error:
+#ifdef WINDOWS
+	closesocket(server->RawSocket); // It might be invalid, who cares?
+#elif defined POSIX
+	close(server->RawSocket);
+#endif
+	freeaddrinfo(serverAddrInfo);
+	SAL_Socket_Cache_Return(server);
+
+	return NULL;
+}
+
+/* fills @a target with one address and port. Returns its length, 0 if @a family is not an IP family. */
+static int SAL_Socket_BuildAddress(uint8 family, uint16 port, const uint8* const address, struct sockaddr_storage* target) {
+	memset(target, 0, sizeof(struct sockaddr_storage));
+
+	if (family == SAL_Socket_Families_IPV6) {
+		((struct sockaddr_in6*)target)->sin6_family = AF_INET6;
+		((struct sockaddr_in6*)target)->sin6_port = htons(port);
+		memcpy(&((struct sockaddr_in6*)target)->sin6_addr, address, sizeof(struct in6_addr));
+
+		return sizeof(struct sockaddr_in6);
+	}
+	else if (family == SAL_Socket_Families_IPV4) {
+		((struct sockaddr_in*)target)->sin_family = AF_INET;
+		((struct sockaddr_in*)target)->sin_port = htons(port);
+		memcpy(&((struct sockaddr_in*)target)->sin_addr, address, sizeof(struct in_addr));
+
+		return sizeof(struct sockaddr_in);
+	}
+
+	return 0;
+}
+
+/* hands @a callback to the thread of @a reactor, which runs it after its current batch. Only an idle reactor needs waking. */
+static void SAL_Socket_Reactor_Post(SAL_Socket_Reactor* reactor, SAL_Socket_PostCallback callback, void* const state) {
+	SAL_Socket_Post* post;
+	SAL_Socket_Post* head;
+
+	post = SAL_Allocator_New(SAL_Socket_Post);
+	post->Callback = callback;
+	post->State = state;
+
+	do {
+		head = (SAL_Socket_Post*)SAL_Atomic_LoadPointer(&reactor->Posted);
+		post->Next = head;
+	} while (!SAL_Atomic_CompareExchangePointer(&reactor->Posted, head, post));
+
+	if (head == NULL)
+		SAL_Socket_Poller_Wake(reactor);
+}
+
+/* runs everything posted to @a reactor so far, oldest first */
+static void SAL_Socket_Reactor_RunPosted(SAL_Socket_Reactor* reactor) {
+	SAL_Socket_Statistics* statistics;
+	boolean timing;
+	int64 started;
+	SAL_Socket_Post* posts;
+	SAL_Socket_Post* ordered = NULL;
+	SAL_Socket_Post* post;
+
+	if (SAL_Atomic_LoadPointer(&reactor->Posted) == NULL)
+		return;
+
+	posts = (SAL_Socket_Post*)SAL_Atomic_ExchangePointer(&reactor->Posted, NULL);
+
+	while (posts != NULL) {
+		post = posts;
+		posts = post->Next;
+		post->Next = ordered;
+		ordered = post;
+	}
+
+	statistics = reactor->Statistics;
+	timing = SAL_Atomic_Load32(&callbackTiming) != 0;
+	started = 0;
+
+	while (ordered != NULL) {
+		post = ordered;
+		ordered = post->Next;
+
+		if (timing)
+			started = SAL_Time_Cycles();
+
+		post->Callback(post->State);
+		SAL_Allocator_Free(post);
+
+		SAL_Socket_Statistics_Add(&statistics->Posted, 1);
+
+		if (timing)
+			SAL_Socket_Statistics_Time(statistics, started);
+	}
+}
+
+/* the index of the lowest set bit of @a bits, which is not 0 */
+static uint32 SAL_Socket_Timers_LowestBit(uint64 bits) {
+#ifdef _MSC_VER
+	unsigned long index;
+
+	_BitScanForward64(&index, bits);
+
+	return (uint32)index;
+#else
+	return (uint32)__builtin_ctzll(bits);
+#endif
+}
+
+/* files @a timer on the lowest level whose block holds both Current and its deadline */
+static void SAL_Socket_Timers_Link(SAL_Socket_TimerWheel* wheel, SAL_Socket_Timer* timer) {
+	uint64 deadline = (uint64)timer->Deadline;
+	uint64 current = (uint64)wheel->Current;
+	uint32 level;
+	uint32 slot;
+
+	for (level = 0; level < SAL_Socket_TimerLevels - 1; level++)
+		if ((deadline >> (SAL_Socket_TimerSlotBits * (level + 1))) == (current >> (SAL_Socket_TimerSlotBits * (level + 1))))
+			break;
+
+	slot = (uint32)(deadline >> (SAL_Socket_TimerSlotBits * level)) & (SAL_Socket_TimerSlots - 1);
+
+	/* past the top level's block: parked in its last slot and filed again once that is reached */
+	if ((deadline >> (SAL_Socket_TimerSlotBits * SAL_Socket_TimerLevels)) != (current >> (SAL_Socket_TimerSlotBits * SAL_Socket_TimerLevels)))
+		slot = SAL_Socket_TimerSlots - 1;
+
+	timer->Level = (uint8)level;
+	timer->Slot = (uint8)slot;
+	timer->Previous = NULL;
+	timer->Next = wheel->Slots[level][slot];
+
+	if (timer->Next != NULL)
+		timer->Next->Previous = timer;
+
+	wheel->Slots[level][slot] = timer;
+	wheel->Occupied[level] |= (uint64)1 << slot;
+}
+
+static void SAL_Socket_Timers_Unlink(SAL_Socket_TimerWheel* wheel, SAL_Socket_Timer* timer) {
+	if (timer->Previous != NULL) {
+		timer->Previous->Next = timer->Next;
+	}
+	else {
+		wheel->Slots[timer->Level][timer->Slot] = timer->Next;
+
+		if (timer->Next == NULL)
+			wheel->Occupied[timer->Level] &= ~((uint64)1 << timer->Slot);
+	}
+
+	if (timer->Next != NULL)
+		timer->Next->Previous = timer->Previous;
+
+	timer->Next = NULL;
+	timer->Previous = NULL;
+}
+
+/* (re)starts @a timer on @a reactor, which must be the calling thread's. Deadlines already passed fire on the next ms. */
+static void SAL_Socket_Timers_Add(SAL_Socket_Reactor* reactor, SAL_Socket_Timer* timer, int64 deadline, SAL_Socket_TimerCallback callback, void* const state) {
+	SAL_Socket_TimerWheel* wheel = &reactor->Timers;
+
+	assert(!timer->Pending || timer->Reactor == reactor);
+
+	if (timer->Pending)
+		SAL_Socket_Timers_Unlink(wheel, timer);
+	else
+		wheel->Count++;
+
+	timer->Callback = callback;
+	timer->State = state;
+	timer->Deadline = deadline > wheel->Current ? deadline : wheel->Current + 1;
+	timer->Reactor = reactor;
+	timer->Pending = true;
+
+	SAL_Socket_Timers_Link(wheel, timer);
+}
+
+/* stops @a timer from firing, false if it was not pending */
+static boolean SAL_Socket_Timers_Remove(SAL_Socket_Timer* timer) {
+	if (!timer->Pending)
+		return false;
+
+	SAL_Socket_Timers_Unlink(&timer->Reactor->Timers, timer);
+	timer->Reactor->Timers.Count--;
+	timer->Pending = false;
+
+	return true;
+}
+
+/* the next ms at which a timer fires or a slot is to be filed down, -1 if no timer is pending */
+static int64 SAL_Socket_Timers_Next(SAL_Socket_TimerWheel* wheel) {
+	uint64 current = (uint64)wheel->Current;
+	uint64 pending;
+	uint32 shift;
+	uint32 level;
+	uint32 index;
+
+	if (wheel->Count == 0)
+		return -1;
+
+	/* on each level the slots after Current's are the ones still ahead, and the lowest level with any holds the soonest */
+	for (level = 0; level < SAL_Socket_TimerLevels; level++) {
+		shift = SAL_Socket_TimerSlotBits * level;
+		index = (uint32)(current >> shift) & (SAL_Socket_TimerSlots - 1);
+		pending = index == SAL_Socket_TimerSlots - 1 ? 0 : wheel->Occupied[level] & (~(uint64)0 << (index + 1));
+
+		if (pending != 0)
+			return (int64)(((current >> (shift + SAL_Socket_TimerSlotBits)) << (shift + SAL_Socket_TimerSlotBits)) + ((uint64)SAL_Socket_Timers_LowestBit(pending) << shift));
+	}
+
+	/* only timers parked past the top level's block are left */
+	return (int64)(((current >> (SAL_Socket_TimerSlotBits * SAL_Socket_TimerLevels)) + 1) << (SAL_Socket_TimerSlotBits * SAL_Socket_TimerLevels));
+}
+
+/* how long @a reactor may wait before its next timer is due, -1 if none is pending */
+static int32 SAL_Socket_Timers_Timeout(SAL_Socket_Reactor* reactor) {
+	int64 next = SAL_Socket_Timers_Next(&reactor->Timers);
+	int64 now;
+
+	if (next < 0)
+		return -1;
+
+	now = SAL_Time_Monotonic();
+
+	if (next <= now)
+		return 0;
+
+	return next - now > 0x7FFFFFFF ? 0x7FFFFFFF : (int32)(next - now);
+}
+
+/* empties slot @a slot of @a level, filing its timers again from Current */
+static void SAL_Socket_Timers_Refile(SAL_Socket_TimerWheel* wheel, uint32 level, uint32 slot) {
+	SAL_Socket_Timer* timer = wheel->Slots[level][slot];
+	SAL_Socket_Timer* next;
+
+	wheel->Slots[level][slot] = NULL;
+	wheel->Occupied[level] &= ~((uint64)1 << slot);
+
+	for (; timer != NULL; timer = next) {
+		next = timer->Next;
+		SAL_Socket_Timers_Link(wheel, timer);
+	}
+}
+
+/* fires every timer of @a reactor that is due, soonest first. Empty stretches of the wheel are skipped in one step. */
+static void SAL_Socket_Timers_Expire(SAL_Socket_Reactor* reactor) {
+	SAL_Socket_TimerWheel* wheel = &reactor->Timers;
+	SAL_Socket_Timer* timer;
+	uint32 level;
+	uint32 slot;
+	int64 tick;
+	int64 now;
+
+	now = SAL_Time_Monotonic();
+
+	while ((tick = SAL_Socket_Timers_Next(wheel)) >= 0 && tick <= now) {
+		wheel->Current = tick;
+
+		/* a new top level block: the timers parked for later ones are filed again first */
+		if (((uint64)tick & (((uint64)1 << (SAL_Socket_TimerSlotBits * SAL_Socket_TimerLevels)) - 1)) == 0)
+			SAL_Socket_Timers_Refile(wheel, SAL_Socket_TimerLevels - 1, SAL_Socket_TimerSlots - 1);
+
+		/* the slots starting at this ms are filed down, highest first so their timers can land on any level below */
+		for (level = SAL_Socket_TimerLevels - 1; level > 0; level--)
+			if (((uint64)tick & (((uint64)1 << (SAL_Socket_TimerSlotBits * level)) - 1)) == 0)
+				SAL_Socket_Timers_Refile(wheel, level, (uint32)((uint64)tick >> (SAL_Socket_TimerSlotBits * level)) & (SAL_Socket_TimerSlots - 1));
+
+		/* taken one at a time: a callback may cancel the others, and what it starts lands in a later slot */
+		slot = (uint32)tick & (SAL_Socket_TimerSlots - 1);
+
+		while ((timer = wheel->Slots[0][slot]) != NULL) {
+			SAL_Socket_Timers_Remove(timer);
+			timer->Callback(timer, timer->State);
+		}
+	}
+
+	if (now > wheel->Current)
+		wheel->Current = now;
+}
+
+/* posted by SAL_Socket_SetTimer from other threads */
+static void SAL_Socket_Timers_Start(void* const state) {
+	SAL_Socket_TimerRequest* request = (SAL_Socket_TimerRequest*)state;
+
+	SAL_Socket_Timers_Add(request->Reactor, request->Timer, request->Deadline, request->Callback, request->State);
+
+	SAL_Allocator_Free(request);
+}
+
+/* the first attempt to finish wins, the others are closed before @a connection's callback hears the outcome */
+static void SAL_Socket_Connect_Finish(SAL_Socket_Connection* connection, SAL_Socket* socket) {
+	uint32 i;
+
+	for (i = 0; i < connection->AttemptCount; i++)
+		SAL_Socket_Close(connection->Attempts[i]);
+
+	SAL_Socket_Timers_Remove(&connection->AttemptTimer);
+
+	connection->Callback(socket, connection->State);
+	SAL_Allocator_Free(connection);
+}
+
+/* whether the connect started on @a socket succeeded, once the reactor reported it writable */
+static boolean SAL_Socket_Connect_Succeeded(SAL_Socket* socket) {
+#ifdef WINDOWS
+	SAL_Socket_Request* request = (SAL_Socket_Request*)socket->PollerWriteData;
+
+	if (socket->ConnectTarget == NULL)
+		return true;
+
+	socket->ConnectTarget = NULL;
+
+	return request != NULL && request->Overlapped.Internal == 0 && setsockopt((SOCKET)socket->RawSocket, SOL_SOCKET, SO_UPDATE_CONNECT_CONTEXT, NULL, 0) == 0;
+#elif defined POSIX
+	socklen_t length = sizeof(int);
+	int error = 0;
+
+	return getsockopt(socket->RawSocket, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0;
+#endif
+}
+
+static void SAL_Socket_Connect_Ready(SAL_Socket* socket, void* const state) {
+	SAL_Socket_Connection* connection = (SAL_Socket_Connection*)state;
+	uint32 i;
+
+	for (i = 0; i < connection->AttemptCount; i++) {
+		if (connection->Attempts[i] == socket) {
+			connection->Attempts[i] = connection->Attempts[--connection->AttemptCount];
+			break;
+		}
+	}
+
+	if (SAL_Socket_Connect_Succeeded(socket)) {
+		SAL_Socket_UnsetSocketCallback(socket);
+		socket->Connected = true;
+		SAL_Socket_Connect_Finish(connection, socket);
+		return;
+	}
+
+	SAL_Socket_Close(socket);
+
+	/* a failed address makes way for the next one right away instead of after the attempt delay */
+	if (connection->NextAddress < connection->AddressCount)
+		SAL_Socket_Connect_Next(connection);
+	else if (connection->AttemptCount == 0)
+		SAL_Socket_Connect_Finish(connection, NULL);
+}
+
+/* starts a non-blocking connect to @a address. Returns NULL if it failed outright, otherwise a socket that is either connected or watched for the outcome. */
+static SAL_Socket* SAL_Socket_Connect_Attempt(SAL_Socket_Connection* connection, const SAL_Resolver_Address* address) {
+	struct sockaddr_storage target;
+	SAL_Socket* attempt;
+	int length;
+#ifdef WINDOWS
+	SOCKET rawSocket;
+#elif defined POSIX
+	int rawSocket;
+#endif
+
+	length = SAL_Socket_BuildAddress(address->Family, address->Port, address->Address, &target);
+
+	rawSocket = socket(target.ss_family, connection->Type == SAL_Socket_Types_UDP ? SOCK_DGRAM : SOCK_STREAM, 0);
+#ifdef WINDOWS
+	if (rawSocket == INVALID_SOCKET)
+		return NULL;
+#elif defined POSIX
+	if (rawSocket == -1)
+		return NULL;
+#endif
+
+	attempt = SAL_Socket_New(address->Family, connection->Type);
+	attempt->RawSocket = rawSocket;
+	attempt->Reactor = connection->Reactor;
+	memcpy(attempt->RemoteEndpointAddress, address->Address, SAL_Socket_AddressLength);
+
+	if (!SAL_Socket_SetNonBlocking(attempt, true))
+		goto error;
+
+#ifdef WINDOWS
+	/* IOCP hears about the connection from a ConnectEx issued by the write request, and ConnectEx wants a bound socket */
+	if (connection->Type == SAL_Socket_Types_TCP) {
+		struct sockaddr_storage local;
+
+		memset(&local, 0, sizeof(struct sockaddr_storage));
+		local.ss_family = target.ss_family;
+
+		if (bind(rawSocket, (struct sockaddr*)&local, length) != 0)
+			goto error;
+
+		attempt->ConnectTarget = (void*)address;
+		SAL_Socket_SetWriteCallback(attempt, SAL_Socket_Connect_Ready, connection);
+
+		if (attempt->WriteCallback == NULL) {
+			attempt->ConnectTarget = NULL;
+			goto error;
+		}
+
+		return attempt;
+	}
+#endif
+
+	if (connect(rawSocket, (struct sockaddr*)&target, length) == 0) {
+		attempt->Connected = true;
+		return attempt;
+	}
+
+#ifdef WINDOWS
+	if (WSAGetLastError() != WSAEWOULDBLOCK)
+		goto error;
+#elif defined POSIX
+	if (errno != EINPROGRESS)
+		goto error;
+#endif
+
+	SAL_Socket_SetWriteCallback(attempt, SAL_Socket_Connect_Ready, connection);
+	if (attempt->WriteCallback == NULL)
+		goto error;
+
+	return attempt;
+
+error:
+	SAL_Socket_Close(attempt);
+
+	return NULL;
+}
+
+/* starts an attempt on the next address that does not fail outright, or finishes @a connection if none is left and none is running */
+static void SAL_Socket_Connect_Next(SAL_Socket_Connection* connection) {
+	SAL_Socket* socket;
+
+	while (connection->NextAddress < connection->AddressCount) {
+		socket = SAL_Socket_Connect_Attempt(connection, &connection->Addresses[connection->NextAddress++]);
+		if (socket == NULL)
+			continue;
+
+		if (socket->Connected) {
+			SAL_Socket_Connect_Finish(connection, socket);
+			return;
+		}
+
+		connection->Attempts[connection->AttemptCount++] = socket;
+
+		if (connection->NextAddress < connection->AddressCount)
+			SAL_Socket_Timers_Add(connection->Reactor, &connection->AttemptTimer, SAL_Time_Monotonic() + SAL_Socket_AttemptDelay, SAL_Socket_Connect_Delayed, connection);
+		else
+			SAL_Socket_Timers_Remove(&connection->AttemptTimer);
+
+		return;
+	}
+
+	SAL_Socket_Timers_Remove(&connection->AttemptTimer);
+
+	if (connection->AttemptCount == 0)
+		SAL_Socket_Connect_Finish(connection, NULL);
+}
+
+/* the running attempts of @a state, a connection, had their head start */
+static void SAL_Socket_Connect_Delayed(SAL_Socket_Timer* timer, void* const state) {
+	(void)timer;
+
+	SAL_Socket_Connect_Next((SAL_Socket_Connection*)state);
+}
+
+/* posted to the connection's reactor once its addresses are known */
+static void SAL_Socket_Connect_Start(void* const state) {
+	SAL_Socket_Connection* connection = (SAL_Socket_Connection*)state;
+
+	if (connection->AddressCount == 0) {
+		SAL_Socket_Connect_Finish(connection, NULL);
+		return;
+	}
+
+	SAL_Socket_Connect_Next(connection);
+}
+
+static void SAL_Socket_Connect_Resolved(const SAL_Resolver_Address* addresses, uint32 count, void* const state) {
+	SAL_Socket_Connection* connection = (SAL_Socket_Connection*)state;
+
+	memcpy(connection->Addresses, addresses, count * sizeof(SAL_Resolver_Address));
+	connection->AddressCount = count;
+
+	SAL_Socket_Reactor_Post(connection->Reactor, SAL_Socket_Connect_Start, connection);
+}
+
+/**
+ * Connect to a host without blocking the caller, neither on DNS nor on the
+ * TCP handshake.
+ *
+ * @a address is resolved through the cache of @ref SAL_Resolver_Resolve, then
+ * its addresses are raced happy-eyeballs style (RFC 8305): a new attempt is
+ * started every 250ms, or as soon as the previous one fails, alternating
+ * between IPv6 and IPv4, and the first connection to complete wins.
+ *
+ * @a callback runs on the reactor that will dispatch the new socket's
+ * callbacks, with the connected non-blocking socket or NULL if every address
+ * failed or @a address could not be resolved. If the reactors cannot be
+ * started it runs with NULL on the calling thread before this returns.
+ *
+ * @param address A string specifying the hostname to connect to
+ * @param port Port to connect to
+ * @param callback The callback to call with the connected socket
+ */
+void SAL_Socket_ConnectAsync(const int8* const address, const int8* port, uint8 family, uint8 type, SAL_Socket_ConnectCallback callback, void* const state) {
+	SAL_Socket_Connection* connection;
+
+	assert(address != NULL);
+	assert(port != NULL);
+	assert(callback != NULL);
+
+	if (!SAL_Socket_Reactors_Initialize()) {
+		callback(NULL, state);
+		return;
+	}
+
+	connection = SAL_Allocator_New(SAL_Socket_Connection);
+	connection->Callback = callback;
+	connection->State = state;
+	connection->Type = type;
+	connection->Reactor = &reactors[(SAL_Atomic_Increment32(&nextReactor) - 1) % reactorCount];
+	connection->AddressCount = 0;
+	connection->NextAddress = 0;
+	connection->AttemptCount = 0;
+	SAL_Socket_Timer_Initialize(&connection->AttemptTimer);
+
+	SAL_Resolver_Resolve(address, port, family, SAL_Socket_Connect_Resolved, connection);
+}
+
+static SAL_Socket* SAL_Socket_ListenOn(const int8* const port, uint8 family, uint8 type, const SAL_Socket_Options* options) {
+	SAL_Socket* listener;
+	struct addrinfo* serverAddrInfo;
+
+	listener = SAL_Socket_PrepareRawSocket(NULL, port, family, type, true, &serverAddrInfo);
+	if (listener == NULL) {
+		return NULL;
+	}
+
+	/* tuning goes on before listen, accepted sockets inherit most of it */
+	if (!SAL_Socket_ApplyCreationOptions(listener, options, true)) {
+		goto error;
+	}
+
+	SAL_Socket_ApplyOptions(listener, options);
+
+	if (bind(listener->RawSocket, serverAddrInfo->ai_addr, (int)serverAddrInfo->ai_addrlen) != 0) {
+		goto error;
+	}
+
+	if (type == SAL_Socket_Types_TCP && listen(listener->RawSocket, options->Backlog > 0 ? (int)options->Backlog : SOMAXCONN) != 0) {
+		goto error;
+	}
+
+#if defined TCP_FASTOPEN && (defined __FreeBSD__ || defined __DragonFly__)
+	/* FreeBSD only takes fast open on a socket that is already listening */
+	if (type == SAL_Socket_Types_TCP && options->FastOpen > 0) {
+		int enable = 1;
+		setsockopt(listener->RawSocket, IPPROTO_TCP, TCP_FASTOPEN, &enable, sizeof(enable));
+	}
+#endif
+	
+	freeaddrinfo(serverAddrInfo);
+
+	listener->Connected = true;
+	listener->Listening = type == SAL_Socket_Types_TCP;
+
+	if (options->NonBlocking && !SAL_Socket_SetNonBlocking(listener, true)) {
+		SAL_Socket_Close(listener);
+		return NULL;
+	}
+
+	return listener;
+
+error:
+#ifdef WINDOWS
+	closesocket(listener->RawSocket); // It might be invalid, who cares?
+#elif defined POSIX
+	close(listener->RawSocket);
+#endif
+	freeaddrinfo(serverAddrInfo);
+	SAL_Socket_Cache_Return(listener);
+
+	return NULL;
+}
+
+/**
+ * Create a listening socket on all interfaces.
+ *
+ * With @ref SAL_Socket_Types_UDP the socket is only bound, use @ref
+ * SAL_Socket_ReceiveDatagrams on it instead of accepting.
+ *
+ * @param port String with the port number or name (e.g, "http" or "80")
+ * @returns a socket you can call @ref SAL_Socket_Accept on
+ */
+SAL_Socket* SAL_Socket_Listen(const int8* const port, uint8 family, uint8 type) {
+	SAL_Socket_Options options;
+
+	SAL_Socket_Options_Initialize(&options);
+
+	return SAL_Socket_ListenOn(port, family, type, &options);
+}
+
+/**
+ * Create a listening socket on all interfaces with @a options applied before
+ * it starts listening, so sockets accepted from it inherit them where the
+ * platform allows.
+ *
+ * @param port String with the port number or name (e.g, "http" or "80")
+ * @param options Options for the listener, see @ref SAL_Socket_Options
+ * @returns a socket you can call @ref SAL_Socket_Accept on, or NULL if it
+ * could not be created or @a ReuseAddress or @a ReusePort could not be set.
+ */
+SAL_Socket* SAL_Socket_ListenWithOptions(const int8* const port, uint8 family, uint8 type, const SAL_Socket_Options* options) {
+	assert(options != NULL);
+
+	return SAL_Socket_ListenOn(port, family, type, options);
+}
+
+/**
+ * Create one listening socket per reactor on the same port using SO_REUSEPORT,
+ * so the kernel spreads incoming connections across the reactors.
+ *
+ * Listener @a i is owned by reactor @a i modulo the reactor count, and the
+ * connections it accepts stay on that reactor. Call @ref
+ * SAL_Socket_SetReactorCount first.
+ *
+ * @param port String with the port number or name (e.g, "http" or "80")
+ * @param listeners [out] Array receiving the listening sockets
+ * @param count Number of listeners to create, usually the reactor count
+ * @returns the number of listeners created
+ *
+ * @warning Only available where the platform has SO_REUSEPORT. Elsewhere this
+ * returns 0 and @ref SAL_Socket_Listen should be used instead.
+ */
+uint32 SAL_Socket_ListenSharded(const int8* const port, uint8 family, uint8 type, SAL_Socket** const listeners, uint32 count) {
+	SAL_Socket_Options options;
+	uint32 i;
+
+	assert(listeners != NULL);
+
+	if (!SAL_Socket_Reactors_Initialize())
+		return 0;
+
+	SAL_Socket_Options_Initialize(&options);
+	options.ReusePort = true;
+
+	for (i = 0; i < count; i++) {
+		listeners[i] = SAL_Socket_ListenOn(port, family, type, &options);
+		if (listeners[i] == NULL)
+			break;
+
+		listeners[i]->Reactor = &reactors[i % reactorCount];
+		listeners[i]->Sharded = true;
+	}
+
+	return i;
+}
+
+/* records the peer address of an accepted @a socket */
+static void SAL_Socket_SetRemoteEndpoint(SAL_Socket* socket, const struct sockaddr* address) {
+	if (address->sa_family == AF_INET)
+		memcpy(socket->RemoteEndpointAddress, &((const struct sockaddr_in*)address)->sin_addr, sizeof(struct in_addr));
+	else if (address->sa_family == AF_INET6)
+		memcpy(socket->RemoteEndpointAddress, &((const struct sockaddr_in6*)address)->sin6_addr, sizeof(struct in6_addr));
+}
+
+/* accepts one pending connection on @a listener. Unless @a wait is set, a blocking listener is only accepted on when a connection is already queued. */
+static SAL_Socket* SAL_Socket_AcceptOne(SAL_Socket* listener, boolean wait) {
+	SAL_Socket* socket;
+	struct sockaddr_storage remoteAddress;
+	struct sockaddr* remote = (struct sockaddr*)&remoteAddress;
+
+#ifdef WINDOWS
+	SAL_Socket_Request* request = (SAL_Socket_Request*)listener->PollerData;
+	struct sockaddr* local;
+	int localLength;
+	int remoteLength;
+	int addressLength = sizeof(struct sockaddr_storage);
+	SOCKET rawSocket = INVALID_SOCKET;
+
+	/* a connection taken by the AcceptEx the reactor posted comes first, its addresses are already in the request */
+	if (request != NULL && !request->Pending && request->AcceptSocket != INVALID_SOCKET) {
+		rawSocket = (SOCKET)request->AcceptSocket;
+		request->AcceptSocket = INVALID_SOCKET;
+
+		if (request->Overlapped.Internal != 0 || setsockopt(rawSocket, SOL_SOCKET, SO_UPDATE_ACCEPT_CONTEXT, (char*)&listener->RawSocket, sizeof(SOCKET)) != 0) {
+			closesocket(rawSocket);
+			rawSocket = INVALID_SOCKET;
+		}
+		else {
+			GetAcceptExSockaddrs(request->AcceptAddresses, 0, SAL_Socket_AcceptAddressLength, SAL_Socket_AcceptAddressLength, &local, &localLength, &remote, &remoteLength);
+		}
+	}
+
+	if (rawSocket == INVALID_SOCKET) {
+		if (!wait && !listener->NonBlocking && !SAL_Socket_WaitReadable(listener, 0))
+			return NULL;
+
+		rawSocket = accept((SOCKET)listener->RawSocket, remote, &addressLength);
+		if (rawSocket == INVALID_SOCKET) {
+			listener->LastError = WSAGetLastError() == WSAEWOULDBLOCK ? SAL_Socket_Errors_WouldBlock : SAL_Socket_Errors_Failed;
+			return NULL;
+		}
+	}
+#elif defined POSIX
+	socklen_t addressLength = sizeof(struct sockaddr_storage);
+	int rawSocket;
+
+	if (!wait && !listener->NonBlocking && !SAL_Socket_WaitReadable(listener, 0))
+		return NULL;
+
+	/* a connection reset while still queued is skipped, not reported */
+	do {
+	#if defined SOCK_NONBLOCK && defined SOCK_CLOEXEC
+		rawSocket = accept4(listener->RawSocket, remote, &addressLength, SOCK_CLOEXEC | (listener->NonBlocking ? SOCK_NONBLOCK : 0));
+	#else
+		rawSocket = accept(listener->RawSocket, remote, &addressLength);
+		if (rawSocket != -1)
+			fcntl(rawSocket, F_SETFD, FD_CLOEXEC);
+	#endif
+	} while (rawSocket == -1 && (errno == EINTR || errno == ECONNABORTED));
+
+	if (rawSocket == -1) {
+		listener->LastError = (errno == EAGAIN || errno == EWOULDBLOCK) ? SAL_Socket_Errors_WouldBlock : SAL_Socket_Errors_Failed;
+		return NULL;
+	}
+#endif
+
+	SAL_Socket_Statistics_Add(&SAL_Socket_Statistics_Get()->Accepts, 1);
+
+	socket = SAL_Socket_New(listener->Family, listener->Type);
+	socket->RawSocket = rawSocket;
+	socket->Connected = true;
+	socket->Reactor = listener->Sharded ? listener->Reactor : NULL;
+	SAL_Socket_SetRemoteEndpoint(socket, remote);
+
+#if defined POSIX && defined SOCK_NONBLOCK && defined SOCK_CLOEXEC
+	socket->NonBlocking = listener->NonBlocking;
+#else
+	if (listener->NonBlocking && !SAL_Socket_SetNonBlocking(socket, true)) {
+		SAL_Socket_Close(socket);
+		return NULL;
+	}
+#endif
+
+	return socket;
+}
+
+/**
+ * Accept an incoming connection on a listening socket (one created by @ref
+ * SAL_Socket_Listen).
+ *
+ * The peer's address is stored in @a RemoteEndpointAddress of the returned
+ * socket: 4 network bytes for IPv4, 16 for IPv6.
+ *
+ * @param listener The listening socket to accept a connection on
+ * @returns the accepted socket, or NULL on failure or if @a listener is
+ * non-blocking and no connection is pending (see @a LastError of @a listener).
+ */
+SAL_Socket* SAL_Socket_Accept(SAL_Socket* listener) {
+	assert(listener != NULL);
+
+	return SAL_Socket_AcceptOne(listener, true);
+}
+
+/**
+ * Accept up to @a maximum queued connections on @a listener in one go.
+ *
+ * A blocking listener waits for the first connection, then only takes the
+ * ones already queued. A non-blocking listener returns as soon as the
+ * backlog is empty.
+ *
+ * @param listener The listening socket to accept connections on
+ * @param sockets [out] Array receiving the accepted sockets
+ * @param maximum Size of @a sockets
+ * @returns the number of sockets accepted
+ */
+uint32 SAL_Socket_AcceptBatch(SAL_Socket* listener, SAL_Socket** const sockets, uint32 maximum) {
+	uint32 count;
+
+	assert(listener != NULL);
+	assert(sockets != NULL);
+
+	for (count = 0; count < maximum; count++) {
+		sockets[count] = SAL_Socket_AcceptOne(listener, count == 0);
+		if (sockets[count] == NULL)
+			break;
+	}
+
+	return count;
+}
+
+/**
+ * Disconnect and close the socket.
+ *
+ * Buffers still queued by @ref SAL_Socket_QueueWrite are dropped and released.
+ *
+ * @param socket Socket to close
+ */
+void SAL_Socket_Close(SAL_Socket* socket) {
+	uint32 i;
+
+	assert(socket != NULL);
+
+	SAL_Socket_UnsetSocketCallback(socket);
+	socket->Connected = false;
+
+	for (i = 0; i < socket->OutputCount; i++)
+		if (socket->Output[i].Release)
+			socket->Output[i].Release(socket->Output[i].Data, socket->Output[i].ReleaseState);
+
+	if (socket->Output != NULL)
+		SAL_Allocator_Free(socket->Output);
+
+	if (socket->TLS != NULL)
+		SAL_TLS_Stop(socket);
+
+#ifdef WINDOWS
+	shutdown((SOCKET)socket->RawSocket, SD_BOTH);
+	closesocket((SOCKET)socket->RawSocket);
+	socket->RawSocket = INVALID_SOCKET;
+#elif defined POSIX
+	shutdown(socket->RawSocket, SHUT_RDWR);
+	close(socket->RawSocket);
+	socket->RawSocket = -1;
+#endif
+	SAL_Socket_Cache_Return(socket);
+}
+
+/**
+ * Switch @a socket between blocking and non-blocking mode.
+ *
+ * In non-blocking mode @ref SAL_Socket_Read and @ref SAL_Socket_Write return
+ * @ref SAL_Socket_WouldBlock instead of waiting, and readiness is reported
+ * edge-triggered: a read callback is only called again once new data arrives,
+ * so it has to keep reading until @ref SAL_Socket_WouldBlock is returned.
+ * Sockets accepted from a non-blocking listener are non-blocking as well.
+ *
+ * @param socket Socket to change
+ * @param nonBlocking true for non-blocking mode, false for blocking mode
+ * @returns true on success, false on failure.
+ *
+ * @warning Set the mode before registering any callbacks on @a socket.
+ */
+boolean SAL_Socket_SetNonBlocking(SAL_Socket* socket, boolean nonBlocking) {
+	assert(socket != NULL);
+	assert(!socket->ReadCallback && !socket->WriteCallback);
+
+#ifdef WINDOWS
+	u_long mode = nonBlocking ? 1 : 0;
+
+	if (ioctlsocket((SOCKET)socket->RawSocket, FIONBIO, &mode) != 0)
+		return false;
+#elif defined POSIX
+	int flags;
+
+	flags = fcntl(socket->RawSocket, F_GETFL, 0);
+	if (flags == -1)
+		return false;
+
+	flags = nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+	if (fcntl(socket->RawSocket, F_SETFL, flags) == -1)
+		return false;
+#endif
+
+	socket->NonBlocking = nonBlocking;
+
+	return true;
+}
+
+/**
+ * Disable Nagle's algorithm on @a socket so small writes go out at once
+ * instead of waiting for earlier data to be acknowledged.
+ *
+ * @param socket TCP socket to change
+ * @param enable true to send immediately, false to coalesce small writes
+ * @returns true on success, false on failure.
+ */
+boolean SAL_Socket_SetNoDelay(SAL_Socket* socket, boolean enable) {
+	int value = enable ? 1 : 0;
+
+	assert(socket != NULL);
+
+	return setsockopt(socket->RawSocket, IPPROTO_TCP, TCP_NODELAY, (const void*)&value, sizeof(value)) == 0;
+}
+
+/**
+ * Have the kernel probe an idle connection so a peer that vanished without
+ * closing it is eventually noticed.
+ *
+ * @param socket TCP socket to change
+ * @param enable true to send keepalive probes, false to stop them
+ * @returns true on success, false on failure.
+ */
+boolean SAL_Socket_SetKeepAlive(SAL_Socket* socket, boolean enable) {
+	int value = enable ? 1 : 0;
+
+	assert(socket != NULL);
+
+	return setsockopt(socket->RawSocket, SOL_SOCKET, SO_KEEPALIVE, (const void*)&value, sizeof(value)) == 0;
+}
+
+/* sets an integer socket option, the form every tuning knob takes */
+static boolean SAL_Socket_SetIntegerOption(SAL_Socket* socket, int level, int name, int value) {
+	return setsockopt(socket->RawSocket, level, name, (const void*)&value, sizeof(value)) == 0;
+}
+
+/**
+ * Fill @a options with the defaults: blocking, nothing changed from what the
+ * operating system picks.
+ *
+ * @param options Options to reset
+ */
+void SAL_Socket_Options_Initialize(SAL_Socket_Options* options) {
+	assert(options != NULL);
+
+	memset(options, 0, sizeof(SAL_Socket_Options));
+
+	options->IncomingCpu = -1;
+}
+
+/* options that only mean something before bind or connect, false if a required one could not be set */
+static boolean SAL_Socket_ApplyCreationOptions(SAL_Socket* socket, const SAL_Socket_Options* options, boolean willListen) {
+#ifdef POSIX
+	if (options->ReuseAddress && !SAL_Socket_SetIntegerOption(socket, SOL_SOCKET, SO_REUSEADDR, 1))
+		return false;
+#endif
+
+	if (options->ReusePort) {
+#if defined POSIX && defined SO_REUSEPORT
+		if (!SAL_Socket_SetIntegerOption(socket, SOL_SOCKET, SO_REUSEPORT, 1))
+			return false;
+#else
+		return false;
+#endif
+	}
+
+	if (options->FastOpen > 0 && socket->Type == SAL_Socket_Types_TCP) {
+		if (willListen) {
+#if defined TCP_FASTOPEN && !defined __FreeBSD__ && !defined __DragonFly__
+			SAL_Socket_SetIntegerOption(socket, IPPROTO_TCP, TCP_FASTOPEN, (int)options->FastOpen);
+#endif
+		}
+		else {
+#if defined TCP_FASTOPEN_CONNECT
+			SAL_Socket_SetIntegerOption(socket, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1);
+#elif defined WINDOWS && defined TCP_FASTOPEN
+			SAL_Socket_SetIntegerOption(socket, IPPROTO_TCP, TCP_FASTOPEN, 1);
+#endif
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Apply the tuning fields of @a options to @a socket. Fields left at their
+ * defaults are not touched, and fields the platform has no equivalent for
+ * are skipped. NonBlocking, ReuseAddress, ReusePort, FastOpen and Backlog
+ * only take effect when the socket is created.
+ *
+ * @param socket Socket to tune
+ * @param options Options to apply, see @ref SAL_Socket_Options
+ * @returns true if every supported option was set, false if any failed.
+ *
+ * @warning QuickAck is not sticky on Linux: the kernel drops back to delayed
+ * acknowledgements on its own, so set it again after reads if it matters.
+ */
+boolean SAL_Socket_ApplyOptions(SAL_Socket* socket, const SAL_Socket_Options* options) {
+	boolean applied = true;
+
+	assert(socket != NULL);
+	assert(options != NULL);
+
+	if (socket->Type == SAL_Socket_Types_TCP) {
+		if (options->NoDelay && !SAL_Socket_SetNoDelay(socket, true))
+			applied = false;
+
+		if (options->KeepAlive && !SAL_Socket_SetKeepAlive(socket, true))
+			applied = false;
+
+#ifdef TCP_QUICKACK
+		if (options->QuickAck && !SAL_Socket_SetIntegerOption(socket, IPPROTO_TCP, TCP_QUICKACK, 1))
+			applied = false;
+#endif
+	}
+
+	if (options->SendBuffer > 0 && !SAL_Socket_SetIntegerOption(socket, SOL_SOCKET, SO_SNDBUF, (int)options->SendBuffer))
+		applied = false;
+
+	if (options->ReceiveBuffer > 0 && !SAL_Socket_SetIntegerOption(socket, SOL_SOCKET, SO_RCVBUF, (int)options->ReceiveBuffer))
+		applied = false;
+
+#ifdef SO_BUSY_POLL
+	if (options->BusyPoll > 0 && !SAL_Socket_SetIntegerOption(socket, SOL_SOCKET, SO_BUSY_POLL, (int)options->BusyPoll))
+		applied = false;
+#endif
+
+#ifdef SO_INCOMING_CPU
+	if (options->IncomingCpu >= 0 && !SAL_Socket_SetIntegerOption(socket, SOL_SOCKET, SO_INCOMING_CPU, (int)options->IncomingCpu))
+		applied = false;
+#endif
+
+	return applied;
+}
+
+/**
+ * Check, without blocking, that nothing arrived on a connected @a socket that
+ * has not been read: no data, no close and no error. A connection that sat
+ * unused and is not idle was closed by its peer or holds a stale response.
+ *
+ * @param socket Socket to check
+ * @returns true if @a socket is connected and idle.
+ */
+boolean SAL_Socket_IsIdle(SAL_Socket* socket) {
+	assert(socket != NULL);
+
+	return socket->Connected && !SAL_Socket_WaitReadable(socket, 0);
+}
+
+/**
+ * Read up to @a bufferSize bytes into @a buffer from @a socket.
+ *
+ * @param socket Socket to read from
+ * @param buffer Address to write the read data too
+ * @param bufferSize Size of @a buffer
+ * @returns Number of bytes read, 0 if the connection was closed or failed
+ * (see @a LastError) or @ref SAL_Socket_WouldBlock if @a socket is
+ * non-blocking and has no data available.
+ */
+uint32 SAL_Socket_Read(SAL_Socket* socket, uint8* const buffer, const uint32 bufferSize) {
+	int32 received;
+
+	assert(buffer != NULL);
+	assert(socket != NULL);
+
+	if (socket->TLS != NULL) {
+		received = SAL_TLS_Receive(socket, buffer, bufferSize);
+		if (received < 0)
+			return SAL_Socket_RecordError(socket, false, received == SAL_TLS_Results_WouldBlock);
+	}
+	else {
+	#ifdef WINDOWS
+		received = recv((SOCKET)socket->RawSocket, (int8* const)buffer, bufferSize, 0);
+	#elif defined POSIX
+		received = recv(socket->RawSocket, (int8* const)buffer, bufferSize, 0);
+	#endif
+
+		if (received < 0)
+			return SAL_Socket_TranslateError(socket, false);
+	}
+
+	SAL_Socket_CountTransfer(socket, false, (uint32)received);
+
+	if (received == 0) {
+		socket->LastError = SAL_Socket_Errors_Closed;
+		return 0;
+	}
+
+	return (uint32)received;
+}
+
+/**
+ * Send @a writeAmount bytes from @a toWrite over @a socket.
+ *
+ * @param socket Socket to write to
+ * @param toWrite Buffer to write from
+ * @param writeAmount Number of bytes to write
+ * @returns number of bytes sent, 0 on failure (see @a LastError) or @ref
+ * SAL_Socket_WouldBlock if @a socket is non-blocking and its send buffer is
+ * full. A write callback is told when the socket can take more data.
+ */
+uint32 SAL_Socket_Write(SAL_Socket* socket, const uint8* const toWrite, const uint32 writeAmount) {
+	int32 result;
+
+	assert(socket != NULL);
+	assert(toWrite != NULL);
+
+	if (SAL_Socket_SendsThroughTLS(socket)) {
+		if (writeAmount == 0)
+			return 0;
+
+		result = SAL_TLS_Send(socket, toWrite, writeAmount);
+		if (result < 0)
+			return SAL_Socket_RecordError(socket, true, result == SAL_TLS_Results_WouldBlock);
+	}
+	else {
+	#ifdef WINDOWS
+		result = send((SOCKET)socket->RawSocket, (const int8*)toWrite, writeAmount, 0);
+	#elif defined POSIX
+		result = send(socket->RawSocket, (const int8*)toWrite, writeAmount, SAL_Socket_SendFlags);
+	#endif
+
+		if (result < 0)
+			return SAL_Socket_TranslateError(socket, true);
+	}
+
+	SAL_Socket_CountTransfer(socket, true, (uint32)result);
+
+	return (uint32)result;
+}
+
+/**
+ * Send @a writeAmount bytes from @a toWrite over @a socket trying @a maxAttempts times to send the data before giving up.
+ *
+ * Between attempts this waits up to attempt * 50 milliseconds for the socket
+ * to become writable, returning to the send as soon as it is.
+ *
+ * @param socket Socket to write to
+ * @param toWrite Buffer to write from
+ * @param writeAmount Number of bytes to write
+ * @param maxAttempts Number of times to try and send all the data
+ * @returns the number of bytes that were sent.
+ */
+uint32 SAL_Socket_EnsureWrite(SAL_Socket* socket, const uint8* const toWrite, const uint32 writeAmount, uint8 maxAttempts) {
+	uint32 sentSoFar;
+	int32 result;
+	uint8 tries;
+
+	assert(socket != NULL);
+	assert(toWrite != NULL);
+
+	sentSoFar = 0;
+	tries = 0;
+
+	while (true) {
+	
+		if (SAL_Socket_SendsThroughTLS(socket)) {
+			result = sentSoFar < writeAmount ? SAL_TLS_Send(socket, toWrite + sentSoFar, writeAmount - sentSoFar) : 0;
+			if (result > 0)
+				sentSoFar += result;
+		}
+		else {
+		#ifdef WINDOWS
+			result = send((SOCKET)socket->RawSocket, (const int8*)(toWrite + sentSoFar), writeAmount - sentSoFar, 0);
+			if (result != SOCKET_ERROR)
+				sentSoFar += result;
+		#elif defined POSIX
+			result = send(socket->RawSocket, (const int8*)(toWrite + sentSoFar), writeAmount - sentSoFar, SAL_Socket_SendFlags);
+			if (result != -1)
+				sentSoFar += result;
+		#endif
+		}
+
+		SAL_Socket_CountTransfer(socket, true, result > 0 ? (uint32)result : 0);
+
+		tries++;
+
+		if (sentSoFar == writeAmount || tries == maxAttempts)
+			break;
+
+		SAL_Socket_WaitWritable(socket, tries * 50);
+	}
+
+
+	return sentSoFar;
+}
+
+/**
+ * Queue @a length bytes at @a buffer to be sent on @a socket by the next
+ * @ref SAL_Socket_Flush. The bytes are not copied.
+ *
+ * @param socket Socket to write to
+ * @param buffer Bytes to send, which must stay valid until @a release is called
+ * @param length Number of bytes to send
+ * @param release Called with @a buffer and @a releaseState once the bytes are
+ * sent or dropped by @ref SAL_Socket_Close, may be NULL
+ * @param releaseState Passed to @a release
+ *
+ * @warning Do not mix queued and direct writes on a socket that has queued data,
+ * the direct write would be sent ahead of it.
+ */
+void SAL_Socket_QueueWrite(SAL_Socket* socket, const uint8* const buffer, const uint32 length, SAL_Socket_ReleaseCallback release, void* const releaseState) {
+	SAL_Socket_OutputBuffer* output;
+	SAL_Socket_OutputBuffer* grown;
+
+	assert(socket != NULL);
+	assert(buffer != NULL);
+
+	if (socket->OutputCount == socket->OutputCapacity) {
+		socket->OutputCapacity = socket->OutputCapacity ? socket->OutputCapacity * 2 : SAL_Socket_MaxIOVectors;
+		grown = SAL_Allocator_NewArray(SAL_Socket_OutputBuffer, socket->OutputCapacity);
+
+		if (socket->Output != NULL) {
+			memcpy(grown, socket->Output, socket->OutputCount * sizeof(SAL_Socket_OutputBuffer));
+			SAL_Allocator_Free(socket->Output);
+		}
+
+		socket->Output = grown;
+	}
+
+	output = &socket->Output[socket->OutputCount++];
+	output->Data = buffer;
+	output->Length = length;
+	output->Release = release;
+	output->ReleaseState = releaseState;
+}
+
+/* sends the queue one buffer at a time through the socket's TLS session, which takes no gathered writes */
+static uint32 SAL_Socket_FlushThroughTLS(SAL_Socket* socket) {
+	SAL_Socket_OutputBuffer* output;
+	uint32 sentSoFar;
+	uint32 done;
+	uint32 sent;
+
+	sentSoFar = 0;
+	sent = 0;
+
+	for (done = 0; done < socket->OutputCount; done++) {
+		output = &socket->Output[done];
+
+		while (socket->OutputOffset < output->Length) {
+			sent = SAL_Socket_Write(socket, output->Data + socket->OutputOffset, output->Length - socket->OutputOffset);
+			if (sent == 0 || sent == SAL_Socket_WouldBlock)
+				break;
+
+			sentSoFar += sent;
+			socket->OutputOffset += sent;
+		}
+
+		if (socket->OutputOffset < output->Length)
+			break;
+
+		socket->OutputOffset = 0;
+
+		if (output->Release)
+			output->Release(output->Data, output->ReleaseState);
+	}
+
+	socket->OutputCount -= done;
+	memmove(socket->Output, socket->Output + done, socket->OutputCount * sizeof(SAL_Socket_OutputBuffer));
+
+	if (socket->OutputCount > 0 && sentSoFar == 0)
+		return sent;
+
+	return sentSoFar;
+}
+
+/**
+ * Send everything queued with @a SAL_Socket_QueueWrite, gathering up to 64
+ * buffers into each writev/WSASend call. A TLS session the kernel does not
+ * encrypt for takes the buffers one at a time instead.
+ *
+ * When a non-blocking socket fills up, the rest stays queued. If the socket
+ * has a write callback, the reactor resumes the flush when the socket becomes
+ * writable and only calls the write callback once the queue has drained.
+ *
+ * @param socket Socket to flush
+ * @returns the number of bytes sent, 0 on failure (see @a LastError) or @ref
+ * SAL_Socket_WouldBlock if nothing could be sent. Nothing is sent while the
+ * socket is corked.
+ */
+uint32 SAL_Socket_Flush(SAL_Socket* socket) {
+	SAL_Socket_OutputBuffer* output;
+	uint32 sentSoFar;
+	uint32 vectorCount;
+	uint32 done;
+	uint32 i;
+	uint32 result;
+	boolean wouldBlock;
+#ifdef WINDOWS
+	WSABUF vectors[SAL_Socket_MaxIOVectors];
+	DWORD sent;
+#elif defined POSIX
+	struct iovec vectors[SAL_Socket_MaxIOVectors];
+	struct msghdr message;
+	ssize_t sent;
+#endif
+
+	assert(socket != NULL);
+
+	if (socket->Corked)
+		return 0;
+
+	if (SAL_Socket_SendsThroughTLS(socket))
+		return SAL_Socket_FlushThroughTLS(socket);
+
+	sentSoFar = 0;
+	wouldBlock = false;
+
+	while (socket->OutputCount > 0 && !socket->Corked) {
+		vectorCount = socket->OutputCount < SAL_Socket_MaxIOVectors ? socket->OutputCount : SAL_Socket_MaxIOVectors;
+
+		/* the first buffer may have been partially sent by the previous call */
+		for (i = 0; i < vectorCount; i++) {
+			output = &socket->Output[i];
+		#ifdef WINDOWS
+			vectors[i].buf = (char*)output->Data + (i == 0 ? socket->OutputOffset : 0);
+			vectors[i].len = output->Length - (i == 0 ? socket->OutputOffset : 0);
+		#elif defined POSIX
+			vectors[i].iov_base = (void*)(output->Data + (i == 0 ? socket->OutputOffset : 0));
+			vectors[i].iov_len = output->Length - (i == 0 ? socket->OutputOffset : 0);
+		#endif
+		}
+
+	#ifdef WINDOWS
+		if (WSASend((SOCKET)socket->RawSocket, vectors, vectorCount, &sent, 0, NULL, NULL) == SOCKET_ERROR) {
+			wouldBlock = WSAGetLastError() == WSAEWOULDBLOCK;
+			break;
+		}
+	#elif defined POSIX
+		/* sendmsg rather than writev so the send flags apply */
+		memset(&message, 0, sizeof(struct msghdr));
+		message.msg_iov = vectors;
+		message.msg_iovlen = vectorCount;
+
+		sent = sendmsg(socket->RawSocket, &message, SAL_Socket_SendFlags);
+		if (sent < 0) {
+			wouldBlock = errno == EAGAIN || errno == EWOULDBLOCK;
+			break;
+		}
+	#endif
+
+		SAL_Socket_CountTransfer(socket, true, (uint32)sent);
+
+		sentSoFar += (uint32)sent;
+		sent += socket->OutputOffset;
+
+		/* release every buffer that went out completely and remember how far into the next one the kernel got */
+		for (done = 0; done < socket->OutputCount && (uint32)sent >= socket->Output[done].Length; done++) {
+			output = &socket->Output[done];
+			sent -= output->Length;
+
+			if (output->Release)
+				output->Release(output->Data, output->ReleaseState);
+		}
+
+		socket->OutputCount -= done;
+		socket->OutputOffset = (uint32)sent;
+		memmove(socket->Output, socket->Output + done, socket->OutputCount * sizeof(SAL_Socket_OutputBuffer));
+	}
+
+	if (socket->OutputCount == 0 || socket->Corked)
+		return sentSoFar;
+
+	/* a socket that filled after a partial flush still has to record it, which arms the write poll on one-shot backends; a failure after some bytes went out is left for the next call to report */
+	if (wouldBlock || sentSoFar == 0) {
+		result = SAL_Socket_RecordError(socket, true, wouldBlock);
+
+		if (sentSoFar == 0)
+			return result;
+	}
+
+	return sentSoFar;
+}
+
+/**
+ * Hold back queued writes until @ref SAL_Socket_Uncork so a whole response
+ * leaves in one flush. The kernel is told to hold partial frames as well
+ * (TCP_CORK on Linux, TCP_NOPUSH on BSD), which also covers direct writes
+ * made while corked.
+ *
+ * @param socket Socket to cork
+ */
+void SAL_Socket_Cork(SAL_Socket* socket) {
+	assert(socket != NULL);
+
+	socket->Corked = true;
+#if defined POSIX && (defined TCP_CORK || defined TCP_NOPUSH)
+	{
+		int enable = 1;
+	#ifdef TCP_CORK
+		setsockopt(socket->RawSocket, IPPROTO_TCP, TCP_CORK, &enable, sizeof(enable));
+	#else
+		setsockopt(socket->RawSocket, IPPROTO_TCP, TCP_NOPUSH, &enable, sizeof(enable));
+	#endif
+	}
+#endif
+}
+
+/**
+ * Release a cork set by @ref SAL_Socket_Cork and flush everything queued.
+ *
+ * @param socket Socket to uncork
+ * @returns the result of the @ref SAL_Socket_Flush
+ */
+uint32 SAL_Socket_Uncork(SAL_Socket* socket) {
+	uint32 result;
+
+	assert(socket != NULL);
+
+	socket->Corked = false;
+	result = SAL_Socket_Flush(socket);
+
+#if defined POSIX && (defined TCP_CORK || defined TCP_NOPUSH)
+	{
+		int disable = 0;
+	#ifdef TCP_CORK
+		setsockopt(socket->RawSocket, IPPROTO_TCP, TCP_CORK, &disable, sizeof(disable));
+	#else
+		setsockopt(socket->RawSocket, IPPROTO_TCP, TCP_NOPUSH, &disable, sizeof(disable));
+	#endif
+	}
+#endif
+
+	return result;
+}
+
+/* copies the file through a bounce buffer where the platform has no sendfile or refuses this file */
+static uint32 SAL_Socket_SendFileFallback(SAL_Socket* socket, SAL_Socket_File file, uint64 offset, uint32 length) {
+	uint8 buffer[SAL_Socket_SendFileChunk];
+	uint32 sentSoFar;
+	uint32 chunk;
+	uint32 sent;
+#ifdef WINDOWS
+	OVERLAPPED position;
+	DWORD readAmount;
+#elif defined POSIX
+	ssize_t readAmount;
+#endif
+
+	sentSoFar = 0;
+
+	while (sentSoFar < length) {
+		chunk = length - sentSoFar < SAL_Socket_SendFileChunk ? length - sentSoFar : SAL_Socket_SendFileChunk;
+
+	#ifdef WINDOWS
+		memset(&position, 0, sizeof(OVERLAPPED));
+		position.Offset = (DWORD)(offset + sentSoFar);
+		position.OffsetHigh = (DWORD)((offset + sentSoFar) >> 32);
+
+		if (!ReadFile(file, buffer, chunk, &readAmount, &position) || readAmount == 0)
+			break;
+	#elif defined POSIX
+		readAmount = pread(file, buffer, chunk, (off_t)(offset + sentSoFar));
+		if (readAmount <= 0)
+			break;
+	#endif
+
+		sent = SAL_Socket_Write(socket, buffer, (uint32)readAmount);
+		if (sent == 0 || sent == SAL_Socket_WouldBlock)
+			return sentSoFar > 0 ? sentSoFar : sent;
+
+		sentSoFar += sent;
+
+		/* the rest of the bounce buffer would have to be read again anyway */
+		if (sent < (uint32)readAmount)
+			break;
+	}
+
+	return sentSoFar;
+}
+
+/**
+ * Send @a length bytes of @a file starting at @a offset over @a socket without
+ * copying them through userspace, using sendfile on Linux, the BSDs and macOS
+ * and TransmitFile on Windows. On a socket carrying TLS this needs the
+ * kernel to encrypt for the session, see @ref SAL_TLS_IsOffloaded; otherwise
+ * the file is read into a bounce buffer and encrypted by OpenSSL.
+ *
+ * Anything queued with @ref SAL_Socket_QueueWrite is flushed first so the file
+ * follows it on the wire. On a non-blocking socket only part of the range may
+ * be sent; call again with @a offset advanced by the returned count once the
+ * write callback reports the socket writable.
+ *
+ * @param socket Socket to write to
+ * @param file Open file to send from (a descriptor on POSIX, a HANDLE on Windows)
+ * @param offset Offset into @a file of the first byte to send
+ * @param length Number of bytes to send
+ * @returns the number of bytes sent, 0 on failure (see @a LastError) or @ref
+ * SAL_Socket_WouldBlock if nothing could be sent.
+ *
+ * @warning A single call sends at most 2GB, larger ranges take several calls.
+ */
+uint32 SAL_Socket_SendFile(SAL_Socket* socket, SAL_Socket_File file, uint64 offset, uint32 length) {
+	uint32 flushed;
+
+	assert(socket != NULL);
+
+	if (socket->OutputCount > 0) {
+		flushed = SAL_Socket_Flush(socket);
+		if (socket->OutputCount > 0)
+			return flushed == 0 ? 0 : SAL_Socket_WouldBlock;
+	}
+
+	if (length > SAL_Socket_SendFileMaximum)
+		length = SAL_Socket_SendFileMaximum;
+
+	/* until the kernel encrypts for the session the file has to pass through it */
+	if (SAL_Socket_SendsThroughTLS(socket))
+		return SAL_Socket_SendFileFallback(socket, file, offset, length);
+
+#ifdef WINDOWS
+	{
+		LARGE_INTEGER position;
+
+		position.QuadPart = (LONGLONG)offset;
+		if (!SetFilePointerEx(file, position, NULL, FILE_BEGIN)) {
+			socket->LastError = SAL_Socket_Errors_Failed;
+			return 0;
+		}
+
+		if (!TransmitFile((SOCKET)socket->RawSocket, file, length, 0, NULL, NULL, 0)) {
+			if (WSAGetLastError() == WSAEWOULDBLOCK)
+				return SAL_Socket_TranslateError(socket, true);
+
+			return SAL_Socket_SendFileFallback(socket, file, offset, length);
+		}
+
+		SAL_Socket_CountTransfer(socket, true, length);
+
+		return length;
+	}
+#elif defined __linux__
+	{
+		off_t position = (off_t)offset;
+		ssize_t sent;
+
+		sent = sendfile(socket->RawSocket, file, &position, length);
+		if (sent >= 0) {
+			SAL_Socket_CountTransfer(socket, true, (uint32)sent);
+			return (uint32)sent;
+		}
+
+		/* sendfile refuses some file types, those still work through the bounce buffer */
+		if (errno == EINVAL || errno == ENOSYS)
+			return SAL_Socket_SendFileFallback(socket, file, offset, length);
+
+		return SAL_Socket_TranslateError(socket, true);
+	}
+#elif defined __FreeBSD__ || defined __DragonFly__
+	{
+		off_t sent = 0;
+
+		/* a partial send still reports its progress through sent */
+		if (sendfile(file, socket->RawSocket, (off_t)offset, length, NULL, &sent, 0) == 0 || sent > 0) {
+			SAL_Socket_CountTransfer(socket, true, (uint32)sent);
+			return (uint32)sent;
+		}
+
+		if (errno == EOPNOTSUPP || errno == ENOTSOCK || errno == EINVAL)
+			return SAL_Socket_SendFileFallback(socket, file, offset, length);
+
+		return SAL_Socket_TranslateError(socket, true);
+	}
+#elif defined __APPLE__
+	{
+		off_t sent = (off_t)length;
+
+		/* a partial send still reports its progress through sent */
+		if (sendfile(file, socket->RawSocket, (off_t)offset, &sent, NULL, 0) == 0 || sent > 0) {
+			SAL_Socket_CountTransfer(socket, true, (uint32)sent);
+			return (uint32)sent;
+		}
+
+		if (errno == EOPNOTSUPP || errno == ENOTSOCK || errno == EINVAL)
+			return SAL_Socket_SendFileFallback(socket, file, offset, length);
+
+		return SAL_Socket_TranslateError(socket, true);
+	}
+#else
+	return SAL_Socket_SendFileFallback(socket, file, offset, length);
+#endif
+}
+
+/* stores the sender of a received datagram */
+static void SAL_Socket_Datagram_GetAddress(SAL_Socket_Datagram* datagram, const struct sockaddr_storage* address) {
+	if (address->ss_family == AF_INET6) {
+		datagram->Family = SAL_Socket_Families_IPV6;
+		datagram->Port = ntohs(((const struct sockaddr_in6*)address)->sin6_port);
+		memcpy(datagram->Address, &((const struct sockaddr_in6*)address)->sin6_addr, sizeof(struct in6_addr));
+	}
+	else {
+		datagram->Family = SAL_Socket_Families_IPV4;
+		datagram->Port = ntohs(((const struct sockaddr_in*)address)->sin_port);
+		memcpy(datagram->Address, &((const struct sockaddr_in*)address)->sin_addr, sizeof(struct in_addr));
+	}
+}
+
+/* builds the destination of a datagram to send. Returns its length, 0 if the datagram has none and goes to the connected peer. */
+static int SAL_Socket_Datagram_SetAddress(const SAL_Socket_Datagram* datagram, struct sockaddr_storage* address) {
+	if (datagram->Port == 0)
+		return 0;
+
+	return SAL_Socket_BuildAddress(datagram->Family, datagram->Port, datagram->Address, address);
+}
+
+/**
+ * Receive up to @a count datagrams from a UDP socket in as few system calls as
+ * possible, a single recvmmsg on Linux.
+ *
+ * Each datagram is read into the @a Data of the next entry of @a datagrams,
+ * which must have its @a Capacity set; @a Length and the sender's @a Family,
+ * @a Address and @a Port are filled in. A datagram larger than @a Capacity is
+ * truncated. A blocking socket waits for the first datagram and then only
+ * takes the ones already queued.
+ *
+ * @param socket UDP socket to receive from
+ * @param datagrams [in,out] Array of datagrams to receive into
+ * @param count Number of entries in @a datagrams, at most 64 are used per call
+ * @returns the number of datagrams received, 0 on failure (see @a LastError)
+ * or @ref SAL_Socket_WouldBlock if @a socket is non-blocking and nothing is queued.
+ *
+ * @warning With @ref SAL_Socket_SetSegmentOffload enabled one entry may hold
+ * several datagrams, see @a SegmentSize.
+ */
+uint32 SAL_Socket_ReceiveDatagrams(SAL_Socket* socket, SAL_Socket_Datagram* const datagrams, uint32 count) {
+	struct sockaddr_storage addresses[SAL_Socket_MaxDatagrams];
+	uint32 i;
+
+	assert(socket != NULL);
+	assert(datagrams != NULL);
+	assert(socket->Type == SAL_Socket_Types_UDP);
+
+	if (count > SAL_Socket_MaxDatagrams)
+		count = SAL_Socket_MaxDatagrams;
+
+#if defined __linux__
+	{
+		struct mmsghdr messages[SAL_Socket_MaxDatagrams];
+		struct iovec vectors[SAL_Socket_MaxDatagrams];
+		SAL_Socket_Control controls[SAL_Socket_MaxDatagrams];
+		struct cmsghdr* control;
+		uint32 total;
+		int received;
+
+		memset(messages, 0, count * sizeof(struct mmsghdr));
+
+		for (i = 0; i < count; i++) {
+			vectors[i].iov_base = datagrams[i].Data;
+			vectors[i].iov_len = datagrams[i].Capacity;
+			messages[i].msg_hdr.msg_name = &addresses[i];
+			messages[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+			messages[i].msg_hdr.msg_iov = &vectors[i];
+			messages[i].msg_hdr.msg_iovlen = 1;
+
+			if (socket->SegmentOffload) {
+				messages[i].msg_hdr.msg_control = controls[i].Data;
+				messages[i].msg_hdr.msg_controllen = sizeof(SAL_Socket_Control);
+			}
+		}
+
+		/* MSG_WAITFORONE only blocks for the first datagram, without it a blocking socket would wait for all of them */
+		received = recvmmsg(socket->RawSocket, messages, count, socket->NonBlocking ? 0 : MSG_WAITFORONE, NULL);
+		if (received < 0)
+			return SAL_Socket_TranslateError(socket, false);
+
+		for (i = 0, total = 0; i < (uint32)received; i++) {
+			datagrams[i].Length = messages[i].msg_len;
+			datagrams[i].SegmentSize = 0;
+			total += datagrams[i].Length;
+			SAL_Socket_Datagram_GetAddress(&datagrams[i], &addresses[i]);
+
+		#ifdef UDP_GRO
+			for (control = CMSG_FIRSTHDR(&messages[i].msg_hdr); control != NULL; control = CMSG_NXTHDR(&messages[i].msg_hdr, control))
+				if (control->cmsg_level == SOL_UDP && control->cmsg_type == UDP_GRO)
+					datagrams[i].SegmentSize = (uint32)*(int*)CMSG_DATA(control);
+		#else
+			(void)control;
+		#endif
+		}
+
+		SAL_Socket_CountTransfer(socket, false, total);
+
+		return (uint32)received;
+	}
+#else
+	{
+	#ifdef WINDOWS
+		int addressLength;
+		int received;
+	#elif defined POSIX
+		socklen_t addressLength;
+		ssize_t received;
+	#endif
+
+		for (i = 0; i < count; i++) {
+			if (i > 0 && !socket->NonBlocking && !SAL_Socket_WaitReadable(socket, 0))
+				break;
+
+			addressLength = sizeof(struct sockaddr_storage);
+			received = recvfrom(socket->RawSocket, (void*)datagrams[i].Data, datagrams[i].Capacity, 0, (struct sockaddr*)&addresses[i], &addressLength);
+			if (received < 0) {
+				if (i == 0)
+					return SAL_Socket_TranslateError(socket, false);
+
+				break;
+			}
+
+			datagrams[i].Length = (uint32)received;
+			datagrams[i].SegmentSize = 0;
+			SAL_Socket_Datagram_GetAddress(&datagrams[i], &addresses[i]);
+			SAL_Socket_CountTransfer(socket, false, (uint32)received);
+		}
+
+		return i;
 	}
-	
-	rawSocket = socket(serverAddrInfo->ai_family, serverAddrInfo->ai_socktype, serverAddrInfo->ai_protocol);
+#endif
+}
+
+/* sends each segment of @a datagrams with its own system call, for platforms and sockets without segmentation offload */
+static uint32 SAL_Socket_SendSegments(SAL_Socket* socket, const SAL_Socket_Datagram* const datagrams, uint32 count) {
+	struct sockaddr_storage address;
+	uint32 i;
+	uint32 offset;
+	uint32 segment;
+	int addressLength;
 #ifdef WINDOWS
-	if (rawSocket == INVALID_SOCKET) {
-		closesocket(rawSocket); // It might be invalid, who cares?
-		freeaddrinfo(serverAddrInfo);
-		return NULL;
-	}
+	int sent;
 #elif defined POSIX
-	if (rawSocket == -1) {
-		close(rawSocket);
-		freeaddrinfo(serverAddrInfo);
-		return NULL;
-	}
+	ssize_t sent;
 #endif
 
-	listener = SAL_Socket_New(family, type);
-	listener->RawSocket = rawSocket;
-	*addressInfo = serverAddrInfo;
+	for (i = 0; i < count; i++) {
+		addressLength = SAL_Socket_Datagram_SetAddress(&datagrams[i], &address);
+		segment = datagrams[i].SegmentSize > 0 ? datagrams[i].SegmentSize : datagrams[i].Length;
 
-	return listener;
-}
+		for (offset = 0; offset < datagrams[i].Length || offset == 0; offset += segment) {
+			if (segment > datagrams[i].Length - offset)
+				segment = datagrams[i].Length - offset;
+
+			sent = sendto(socket->RawSocket, (const void*)(datagrams[i].Data + offset), segment, SAL_Socket_SendFlags, addressLength > 0 ? (struct sockaddr*)&address : NULL, addressLength);
+			if (sent < 0)
+				return i == 0 && offset == 0 ? SAL_Socket_TranslateError(socket, true) : i;
 
+			SAL_Socket_CountTransfer(socket, true, (uint32)sent);
 
+			if (segment == 0)
+				break;
+		}
+	}
 
+	return i;
+}
 
 /**
- * Create a TCP connection to a host.
+ * Send up to @a count datagrams over a UDP socket in as few system calls as
+ * possible, a single sendmmsg on Linux.
  *
- * @param address A string specifying the hostname to connect to
- * @param port Port to connect to
+ * Each entry of @a datagrams sends @a Length bytes of @a Data to @a Address
+ * and @a Port, or to the connected peer if @a Port is 0. An entry with a
+ * @a SegmentSize smaller than its @a Length is split into datagrams of
+ * @a SegmentSize bytes, by the kernel (UDP_SEGMENT) where it can.
+ *
+ * @param socket UDP socket to send on
+ * @param datagrams Array of datagrams to send
+ * @param count Number of entries in @a datagrams, at most 64 are used per call
+ * @returns the number of entries sent, 0 on failure (see @a LastError) or
+ * @ref SAL_Socket_WouldBlock if @a socket is non-blocking and nothing could be sent.
  */
-SAL_Socket* SAL_Socket_Connect(const int8* const address, const int8* port, uint8 family, uint8 type) {
-	SAL_Socket* server;
-	struct addrinfo* serverAddrInfo;
-	
-	server = SAL_Socket_PrepareRawSocket(address, port, family, type, false, &serverAddrInfo);
-	if (server == NULL) {
-		return NULL;
-	}
-	if (connect(server->RawSocket, serverAddrInfo->ai_addr, (int)serverAddrInfo->ai_addrlen) != 0) {
-		goto error;
-	}
-	
-	freeaddrinfo(serverAddrInfo);
+uint32 SAL_Socket_SendDatagrams(SAL_Socket* socket, const SAL_Socket_Datagram* const datagrams, uint32 count) {
+	assert(socket != NULL);
+	assert(datagrams != NULL);
+	assert(socket->Type == SAL_Socket_Types_UDP);
 
-	server->Connected = true;
+	if (count > SAL_Socket_MaxDatagrams)
+		count = SAL_Socket_MaxDatagrams;
 
-	return server;
+#if defined __linux__ && defined UDP_SEGMENT
+	{
+		struct sockaddr_storage addresses[SAL_Socket_MaxDatagrams];
+		struct mmsghdr messages[SAL_Socket_MaxDatagrams];
+		struct iovec vectors[SAL_Socket_MaxDatagrams];
+		SAL_Socket_Control controls[SAL_Socket_MaxDatagrams];
+		struct cmsghdr* control;
+		boolean segmented;
+		uint32 total;
+		uint32 i;
+		int sent;
 
-error:
-#ifdef WINDOWS
-	closesocket(server->RawSocket); // It might be invalid, who cares?
-#elif defined POSIX
-	close(server->RawSocket);
-#endif
-	freeaddrinfo(serverAddrInfo);
-	Free(server);
+		memset(messages, 0, count * sizeof(struct mmsghdr));
+		segmented = false;
 
-	return NULL;
+		for (i = 0; i < count; i++) {
+			vectors[i].iov_base = datagrams[i].Data;
+			vectors[i].iov_len = datagrams[i].Length;
+			messages[i].msg_hdr.msg_namelen = SAL_Socket_Datagram_SetAddress(&datagrams[i], &addresses[i]);
+			messages[i].msg_hdr.msg_name = messages[i].msg_hdr.msg_namelen > 0 ? &addresses[i] : NULL;
+			messages[i].msg_hdr.msg_iov = &vectors[i];
+			messages[i].msg_hdr.msg_iovlen = 1;
+
+			/* the kernel, or the NIC, cuts the buffer into datagrams of SegmentSize bytes */
+			if (datagrams[i].SegmentSize > 0 && datagrams[i].SegmentSize < datagrams[i].Length) {
+				if (socket->SegmentSendRejected)
+					return SAL_Socket_SendSegments(socket, datagrams, count);
+
+				segmented = true;
+				messages[i].msg_hdr.msg_control = controls[i].Data;
+				messages[i].msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint16));
+
+				control = CMSG_FIRSTHDR(&messages[i].msg_hdr);
+				control->cmsg_level = SOL_UDP;
+				control->cmsg_type = UDP_SEGMENT;
+				control->cmsg_len = CMSG_LEN(sizeof(uint16));
+				*(uint16*)CMSG_DATA(control) = (uint16)datagrams[i].SegmentSize;
+			}
+		}
+
+		sent = sendmmsg(socket->RawSocket, messages, count, SAL_Socket_SendFlags);
+
+		/* a kernel too old for UDP_SEGMENT, or a route whose device cannot checksum it, rejects the whole batch: resend it split up and stop asking */
+		if (sent < 0 && segmented && (errno == EIO || errno == EINVAL)) {
+			socket->SegmentSendRejected = true;
+			return SAL_Socket_SendSegments(socket, datagrams, count);
+		}
+
+		if (sent < 0)
+			return SAL_Socket_TranslateError(socket, true);
+
+		for (i = 0, total = 0; i < (uint32)sent; i++)
+			total += datagrams[i].Length;
+
+		SAL_Socket_CountTransfer(socket, true, total);
+
+		return (uint32)sent;
+	}
+#else
+	return SAL_Socket_SendSegments(socket, datagrams, count);
+#endif
 }
 
 /**
- * Create a listening socket on all interfaces.
+ * Let the kernel coalesce consecutive datagrams from the same sender into one
+ * receive (UDP GRO), which cuts the per-datagram cost of busy UDP sockets.
  *
- * @param port String with the port number or name (e.g, "http" or "80")
- * @returns a socket you can call @ref SAL_Socket_Accept on
+ * Entries filled by @ref SAL_Socket_ReceiveDatagrams then carry a
+ * @a SegmentSize: if it is not 0, @a Data holds @a Length bytes of datagrams
+ * of @a SegmentSize bytes each, the last one possibly shorter. Receive buffers
+ * of 64KB let the most datagrams be coalesced.
+ *
+ * @param socket UDP socket to change
+ * @param enable true to enable coalescing, false to disable it
+ * @returns true on success, false if the platform does not support it.
  */
-SAL_Socket* SAL_Socket_Listen(const int8* const port, uint8 family, uint8 type) {
-	SAL_Socket* listener;
-	struct addrinfo* serverAddrInfo;
+boolean SAL_Socket_SetSegmentOffload(SAL_Socket* socket, boolean enable) {
+	assert(socket != NULL);
+	assert(socket->Type == SAL_Socket_Types_UDP);
 
-	listener = SAL_Socket_PrepareRawSocket(NULL, port, family, type, false, &serverAddrInfo);
-	if (listener == NULL) {
-		return NULL;
-	}
+#if defined __linux__ && defined UDP_GRO
+	{
+		int value = enable ? 1 : 0;
 
-	if (bind(listener->RawSocket, serverAddrInfo->ai_addr, (int)serverAddrInfo->ai_addrlen) != 0) {
-		goto error;
-	}
+		if (setsockopt(socket->RawSocket, SOL_UDP, UDP_GRO, &value, sizeof(value)) != 0)
+			return false;
 
-	if (listen(listener->RawSocket, SOMAXCONN) != 0) {
-		goto error;
+		socket->SegmentOffload = enable;
+
+		return true;
 	}
-	
-	freeaddrinfo(serverAddrInfo);
+#else
+	return !enable;
+#endif
+}
 
-	listener->Connected = true;
+/**
+ * Register @a callback to be called whenever data is available on @a socket.
+ *
+ * The socket is added to the kernel's readiness set (epoll, kqueue or an IOCP
+ * port) once, and @a callback runs on the thread of the reactor that owns the
+ * socket each time it becomes readable until @ref SAL_Socket_UnsetSocketCallback
+ * is called. Sockets are spread across the reactors round-robin when they are
+ * first registered; sockets accepted from a listener stay on its reactor.
+ * The readiness event carries the socket itself, so dispatch does not depend on
+ * how many sockets are registered.
+ *
+ * @param socket Socket to read from
+ * @param callback The callback to call
+ *
+ * @a callback reads from the socket itself. Use @ref SAL_Socket_SetReceiveCallback
+ * to have the reactor read into pooled buffers instead.
+ *
+ * @warning On a non-blocking socket @a callback has to read until @ref
+ * SAL_Socket_WouldBlock is returned, see @ref SAL_Socket_SetNonBlocking.
+ */
+void SAL_Socket_SetReadCallback(SAL_Socket* socket, SAL_Socket_ReadCallback callback, void* const state) {
+	boolean wasRegistered;
+	boolean wasReading;
 
-	return listener;
+	assert(socket != NULL);
+	assert(callback != NULL);
 
-error:
-#ifdef WINDOWS
-	closesocket(listener->RawSocket); // It might be invalid, who cares?
-#elif defined POSIX
-	close(listener->RawSocket);
-#endif
-	freeaddrinfo(serverAddrInfo);
-	Free(listener);
+	wasRegistered = socket->ReadCallback || socket->WriteCallback;
+	wasReading = socket->ReadCallback != NULL;
 
-	return NULL;
+	socket->ReadCallback = callback;
+	socket->ReadCallbackState = state;
+
+	if (!wasReading)
+		SAL_Socket_Reactor_Register(socket, wasRegistered);
 }
 
 /**
- * Accept an incoming connection on a listening socket (one created by @ref
- * SAL_Socket_Listen).
+ * Register @a callback to be handed the data that arrives on @a socket.
  *
- * @param listener The listening socket to accept a connection on
- * @param acceptedAddress 4 network bytes representing the client's IP address
+ * The reactor reads into a fixed-size buffer from its own pool and passes it to
+ * @a callback, so no callback has to allocate or read. On a non-blocking
+ * socket the reactor keeps reading until the socket would block, calling
+ * @a callback once per buffer. When the connection is closed or fails,
+ * @a callback is called with a NULL buffer and a length of 0.
+ *
+ * @param socket Socket to read from
+ * @param callback The callback to call
  *
- * @warning This function is currently broken and platform-dependent
+ * @warning The buffer is returned to the pool when @a callback returns, call
+ * @ref SAL_Socket_Buffer_Retain to keep it longer. Replaces any read callback.
+ * On io_uring the kernel receives ahead into buffers lent from the pool, so
+ * data already received is lost if a read callback replaces this one.
  */
-SAL_Socket* SAL_Socket_Accept(SAL_Socket* listener) {
-	SAL_Socket* socket;
-	struct sockaddr_in6 remoteAddress;
-	int addressLength = sizeof(struct sockaddr_in6);
+void SAL_Socket_SetReceiveCallback(SAL_Socket* socket, SAL_Socket_ReceiveCallback callback, void* const state) {
+	assert(socket != NULL);
+	assert(callback != NULL);
 
-#ifdef WINDOWS
-	SOCKET rawSocket;
-	
-	rawSocket = accept((SOCKET)listener->RawSocket, NULL, NULL); /* (struct sockaddr*)&remoteAddress, &addressLength); */
-	if (rawSocket == INVALID_SOCKET) {
-		return NULL;
-	}
-#elif defined POSIX
-	int rawSocket;
+	socket->ReceiveCallback = callback;
+	SAL_Socket_SetReadCallback(socket, SAL_Socket_Receive, state);
+}
 
-	rawSocket = accept(listener->RawSocket, NULL, NULL);
-	if (sock_fd == -1) {
-		return NULL;
-	}
-	
-#endif
+/* runs as the read callback of listeners registered with SAL_Socket_SetAcceptCallback */
+static void SAL_Socket_AcceptReady(SAL_Socket* listener, void* const state) {
+	SAL_Socket* sockets[SAL_Socket_MaxAcceptBatch];
+	SAL_Socket_Reactor* reactor = listener->Reactor;
+	uint32 count;
 
-	socket = SAL_Socket_New(listener->Family, listener->Type);
-	socket->RawSocket = rawSocket;
-	socket->Connected = true;
+	do {
+		count = SAL_Socket_AcceptBatch(listener, sockets, SAL_Socket_MaxAcceptBatch);
+		if (count > 0)
+			listener->AcceptCallback(listener, sockets, count, state);
 
-	return socket;
+		/* a blocking listener is level-triggered and would wait here if the backlog ran out exactly at a full batch */
+	} while (listener->NonBlocking && count == SAL_Socket_MaxAcceptBatch && reactor->Current == listener);
 }
 
 /**
- * Disconnect and close the socket.
+ * Register @a callback to be handed the connections that arrive on @a listener.
  *
- * @param socket Socket to close
+ * Each time the listener becomes readable the reactor drains its backlog and
+ * calls @a callback with up to 64 accepted sockets at a time. Sockets from a
+ * listener made by @ref SAL_Socket_ListenSharded stay on the listener's
+ * reactor, all others are spread round-robin over the reactor pool once a
+ * callback is registered on them.
+ *
+ * @param listener The listening socket to accept connections on
+ * @param callback The callback to call
+ *
+ * @warning A non-blocking listener drains its whole backlog per event, a
+ * blocking one is reported again while connections remain. Replaces any read
+ * callback.
  */
-void SAL_Socket_Close(SAL_Socket* socket) {
-	assert(socket != NULL);
+void SAL_Socket_SetAcceptCallback(SAL_Socket* listener, SAL_Socket_AcceptCallback callback, void* const state) {
+	assert(listener != NULL);
+	assert(callback != NULL);
 
-	SAL_Socket_UnsetSocketCallback(socket);
-	socket->Connected = false;
-#ifdef WINDOWS
-	shutdown((SOCKET)socket->RawSocket, SD_BOTH);
-	closesocket((SOCKET)socket->RawSocket);
-	socket->RawSocket = INVALID_SOCKET;
-#elif defined POSIX
-	shutdown(socket->RawSocket, SHUT_RDWR);
-	close(socket->RawSocket);
-	socket->RawSocket = -1;
-#endif
-	Free(socket);
+	listener->AcceptCallback = callback;
+	SAL_Socket_SetReadCallback(listener, SAL_Socket_AcceptReady, state);
 }
 
 /**
- * Read up to @a bufferSize bytes into @a buffer from @a socket.
+ * Register @a callback to be called whenever @a socket can accept more data
+ * after a write returned @ref SAL_Socket_WouldBlock.
  *
- * @param socket Socket to read from
- * @param buffer Address to write the read data too
- * @param bufferSize Size of @a buffer
- * @returns Number of bytes read
+ * The callback is called once after registration and from then on each time
+ * the socket goes from full to writable, which is where a partially sent
+ * buffer should be resumed.
+ *
+ * @param socket Non-blocking socket to watch
+ * @param callback The callback to call
+ *
+ * @warning Only non-blocking sockets can have a write callback. On Windows the
+ * reactor learns about writability from a zero-byte overlapped send posted
+ * after a write returns @ref SAL_Socket_WouldBlock.
  */
-uint32 SAL_Socket_Read(SAL_Socket* socket, uint8* const buffer, const uint32 bufferSize) {
-	int32 received;
+void SAL_Socket_SetWriteCallback(SAL_Socket* socket, SAL_Socket_WriteCallback callback, void* const state) {
+	boolean wasRegistered;
+	boolean wasWriting;
 
-	assert(buffer != NULL);
 	assert(socket != NULL);
+	assert(callback != NULL);
+	assert(socket->NonBlocking);
 
-#ifdef WINDOWS
-	received = recv((SOCKET)socket->RawSocket, (int8* const)buffer, bufferSize, 0);
-#elif defined POSIX
-	received = recv(socket->RawSocket, (int8* const)buffer, bufferSize, 0);
-#endif
+	wasRegistered = socket->ReadCallback || socket->WriteCallback;
+	wasWriting = socket->WriteCallback != NULL;
 
-	if (received <= 0)
-		return 0;
+	socket->WriteCallback = callback;
+	socket->WriteCallbackState = state;
 
-	return (uint32)received;
+	if (!wasWriting)
+		SAL_Socket_Reactor_Register(socket, wasRegistered);
 }
 
 /**
- * Send @a writeAmount bytes from @a toWrite over @a socket.
+ * Unregisters all callbacks for @a socket.
  *
- * @param socket Socket to write to
- * @param toWrite Buffer to write from
- * @param writeAmount Number of bytes to write
- * @returns number of bytes sent.
+ * @param socket The socket to clear all callbacks from
+ *
+ * @warning Callbacks may unregister or close any socket, but other threads
+ * must not unregister a socket whose callback may be running.
  */
-uint32 SAL_Socket_Write(SAL_Socket* socket, const uint8* const toWrite, const uint32 writeAmount) {
-	int32 result;
-
+void SAL_Socket_UnsetSocketCallback(SAL_Socket* socket) {
 	assert(socket != NULL);
-	assert(toWrite != NULL);
 
-#ifdef WINDOWS
-	result = send((SOCKET)socket->RawSocket, (const int8*)toWrite, writeAmount, 0);
-#elif defined POSIX
-	result = send(socket->RawSocket, (const int8*)toWrite, writeAmount, 0);
-#endif
+	if (socket->ReadCallback || socket->WriteCallback) {
+		SAL_Socket_Poller_Remove(socket);
 
-	return (uint32)result;
+		socket->ReadCallback = NULL;
+		socket->ReadCallbackState = NULL;
+		socket->ReceiveCallback = NULL;
+		socket->AcceptCallback = NULL;
+		socket->WriteCallback = NULL;
+		socket->WriteCallbackState = NULL;
+	}
 }
 
 /**
- * Send @a writeAmount bytes from @a toWrite over @a socket trying @a maxAttempts times to send the data before giving up.
+ * Prepare @a timer for its first @ref SAL_Socket_SetTimer.
  *
- * @param socket Socket to write to
- * @param toWrite Buffer to write from
- * @param writeAmount Number of bytes to write
- * @param maxAttempts Number of times to try and send all the data
- * @returns the number of bytes that were sent.
+ * @param timer Timer to reset, not pending
  */
-uint32 SAL_Socket_EnsureWrite(SAL_Socket* socket, const uint8* const toWrite, const uint32 writeAmount, uint8 maxAttempts) {
-	uint32 sentSoFar;
-	int32 result;
-	uint8 tries;
-	boolean isFirstTry;
+void SAL_Socket_Timer_Initialize(SAL_Socket_Timer* timer) {
+	assert(timer != NULL);
 
-	assert(socket != NULL);
-	assert(toWrite != NULL);
+	memset(timer, 0, sizeof(SAL_Socket_Timer));
+}
 
-	sentSoFar = 0;
-	tries = 0;
-	isFirstTry = true;
+/**
+ * Run @a callback once @a timeout ms from now, on the reactor that dispatches
+ * @a socket's callbacks, so it never runs concurrently with them. Setting a
+ * pending timer again moves its deadline, the way an idle timeout is pushed
+ * back on every read.
+ *
+ * Timers live in a hierarchical wheel on each reactor: setting, moving and
+ * cancelling one take constant time however many are pending, and the
+ * reactor's kernel wait ends exactly when the soonest is due, so no thread
+ * wakes up just to check. Timers fire in deadline order, within a ms of it.
+ *
+ * @param socket Socket whose reactor runs the timer. It need not have any
+ * callbacks set. NULL runs it on the calling reactor, or on one picked
+ * round-robin when called from any other thread.
+ * @param timer Timer to start, from @ref SAL_Socket_Timer_Initialize; it must
+ * stay valid until it fires or is cancelled
+ * @param timeout Delay in ms
+ * @param callback Function to call with @a timer
+ * @param state Passed to @a callback
+ *
+ * @warning When called off the reactor's thread the timer starts once the
+ * reactor gets to it, and must not be pending on another reactor.
+ */
+void SAL_Socket_SetTimer(SAL_Socket* socket, SAL_Socket_Timer* timer, uint32 timeout, SAL_Socket_TimerCallback callback, void* const state) {
+	SAL_Socket_Reactor* reactor;
+	SAL_Socket_TimerRequest* request;
+	int64 deadline;
 
-	while (true) {
-	
-		#ifdef WINDOWS
-			result = send((SOCKET)socket->RawSocket, (const int8*)(toWrite + sentSoFar), writeAmount - sentSoFar, 0);
-			if (result != SOCKET_ERROR)
-				sentSoFar += result;
-		#elif defined POSIX
-			result = send(socket->RawSocket, (const int8*)(toWrite + sentSoFar), writeAmount - sentSoFar, 0);
-			if (result != -1)
-				sentSoFar += result;
-		#endif
+	assert(timer != NULL);
+	assert(callback != NULL);
 
-		tries++;
+	if (socket != NULL) {
+		reactor = SAL_Socket_Reactors_Assign(socket);
+	}
+	else if (currentReactor != NULL) {
+		reactor = currentReactor;
+	}
+	else if (SAL_Socket_Reactors_Initialize()) {
+		reactor = &reactors[(SAL_Atomic_Increment32(&nextReactor) - 1) % reactorCount];
+	}
+	else {
+		reactor = NULL;
+	}
 
-		if (sentSoFar == writeAmount || tries == maxAttempts)
-			break;
+	/* no reactor could be started to run it */
+	if (reactor == NULL)
+		return;
+
+	deadline = SAL_Time_Monotonic() + timeout;
 
-		SAL_Thread_Sleep(tries * 50);
+	if (currentReactor == reactor) {
+		SAL_Socket_Timers_Add(reactor, timer, deadline, callback, state);
+		return;
 	}
 
+	request = SAL_Allocator_New(SAL_Socket_TimerRequest);
+	request->Reactor = reactor;
+	request->Timer = timer;
+	request->Deadline = deadline;
+	request->Callback = callback;
+	request->State = state;
 
-	return sentSoFar;
+	SAL_Socket_Reactor_Post(reactor, SAL_Socket_Timers_Start, request);
 }
 
 /**
- * Register @a callback to be called whenever data is available on @a socket.
+ * Stop @a timer from firing.
  *
- * @param socket Socket to read from
- * @param callback The callback to call
+ * @param timer Timer to cancel
+ * @returns true if @a timer was pending, false if it already fired or was
+ * never set.
  *
- * @warning The buffer passed to @a callback is the internal buffer. Do not reference it outside out the callback. 
+ * @warning Only the thread of the reactor running @a timer may cancel it,
+ * from one of its callbacks.
  */
-void SAL_Socket_SetReadCallback(SAL_Socket* socket, SAL_Socket_ReadCallback callback, void* const state) {
-	assert(socket != NULL);
-	assert(callback != NULL);
-	assert(state != NULL);
-
-	if (!asyncWorkerRunning) {
-		SAL_Socket_CallbackWorker_Initialize();
-		asyncWorkerRunning = true;
-	}
+boolean SAL_Socket_CancelTimer(SAL_Socket_Timer* timer) {
+	assert(timer != NULL);
+	assert(!timer->Pending || currentReactor == timer->Reactor);
 
-	if (!socket->ReadCallback)
-		AsyncLinkedList_Append(&asyncSocketList, socket);
-	
-	socket->ReadCallback = callback;
-	socket->ReadCallbackState = state;
+	return SAL_Socket_Timers_Remove(timer);
 }
 
 /**
- * Unregisters all callbacks for @a socket.
+ * Check whether the calling thread is the reactor that dispatches @a socket's
+ * callbacks, picking that reactor first if @a socket has none yet.
  *
- * @param socket The socket to clear all callbacks from
+ * @param socket Socket to check
+ * @returns true on @a socket's reactor thread, where its callbacks and timers
+ * can never run concurrently with the caller.
  */
-void SAL_Socket_UnsetSocketCallback(SAL_Socket* socket) {
+boolean SAL_Socket_IsReactorThread(SAL_Socket* socket) {
 	assert(socket != NULL);
 
-	if (socket->ReadCallback) {
-		socket->ReadCallback = NULL;
-		socket->ReadCallbackState = NULL;
-		
-		AsyncLinkedList_Remove(&asyncSocketList, socket);
-
-		if (AsyncLinkedList_GetCount(&asyncSocketList) == 0)
-			SAL_Socket_CallbackWorker_Shutdown();
-	}
+	return currentReactor != NULL && currentReactor == SAL_Socket_Reactors_Assign(socket);
 }
 
 uint16 SAL_Socket_HostToNetworkShort(uint16 value) {
@@ -2,20 +2,137 @@
 #define INCLUDE_SAL_SOCKET
 
 #include "Common.h"
+#include "Thread.h"
 
 /* forward declaration */
 typedef struct SAL_Socket SAL_Socket;
+typedef struct SAL_Socket_Reactor SAL_Socket_Reactor;
+typedef struct SAL_Socket_Buffer SAL_Socket_Buffer;
+typedef struct SAL_Socket_Timer SAL_Socket_Timer;
 
 typedef void (*SAL_Socket_ReadCallback)(SAL_Socket* socket, void* const state);
+typedef void (*SAL_Socket_ReceiveCallback)(SAL_Socket* socket, SAL_Socket_Buffer* buffer, uint32 length, void* const state);
+typedef void (*SAL_Socket_WriteCallback)(SAL_Socket* socket, void* const state);
+typedef void (*SAL_Socket_ConnectCallback)(SAL_Socket* socket, void* const state);
+typedef void (*SAL_Socket_AcceptCallback)(SAL_Socket* listener, SAL_Socket** sockets, uint32 count, void* const state);
+typedef void (*SAL_Socket_ReleaseCallback)(const uint8* buffer, void* const state);
+typedef void (*SAL_Socket_TimerCallback)(SAL_Socket_Timer* timer, void* const state);
 
 #define SAL_Socket_Families_IPV4 0
 #define SAL_Socket_Families_IPV6 1
 #define SAL_Socket_Families_IPAny 2
 
-#define SAL_Socket_Types_TCP 0 /* should probably add UDP eventually */
+#define SAL_Socket_Types_TCP 0
+#define SAL_Socket_Types_UDP 1
 
 #define SAL_Socket_AddressLength 16
 
+/* kernel interfaces for SAL_Socket_SetBackend */
+#define SAL_Socket_Backends_Default 0 /* epoll, kqueue or IOCP */
+#define SAL_Socket_Backends_IOUring 1 /* io_uring on Linux, falls back to epoll */
+
+/* returned by SAL_Socket_Read and SAL_Socket_Write when a non-blocking socket is not ready */
+#define SAL_Socket_WouldBlock 0xFFFFFFFF
+
+/* values of SAL_Socket.LastError */
+#define SAL_Socket_Errors_None 0
+#define SAL_Socket_Errors_WouldBlock 1
+#define SAL_Socket_Errors_Closed 2
+#define SAL_Socket_Errors_Failed 3
+
+/* buckets in SAL_Socket_Statistics.CallbackHistogram */
+#define SAL_Socket_HistogramBuckets 24
+
+/* an open file as accepted by SAL_Socket_SendFile */
+#ifdef WINDOWS
+	typedef void* SAL_Socket_File;
+#elif defined POSIX
+	typedef int SAL_Socket_File;
+#endif
+
+/* a buffer queued by SAL_Socket_QueueWrite */
+typedef struct {
+	const uint8* Data;
+	uint32 Length;
+	SAL_Socket_ReleaseCallback Release;
+	void* ReleaseState;
+} SAL_Socket_OutputBuffer;
+
+/* one datagram for SAL_Socket_ReceiveDatagrams and SAL_Socket_SendDatagrams */
+typedef struct {
+	uint8* Data;
+	uint32 Length; /* bytes received into Data, or to send from it */
+	uint32 Capacity; /* size of Data, only used when receiving */
+	uint32 SegmentSize; /* size of each datagram packed into Data, 0 if it holds just one */
+	uint16 Port; /* peer port in host byte order, 0 to send to the connected peer */
+	uint8 Family; /* SAL_Socket_Families_IPV4 or SAL_Socket_Families_IPV6 */
+	uint8 Address[SAL_Socket_AddressLength]; /* peer address in network byte order */
+} SAL_Socket_Datagram;
+
+/* creation and tuning options, start from SAL_Socket_Options_Initialize */
+typedef struct {
+	boolean NonBlocking; /* make the socket non-blocking once it is connected or listening */
+	boolean NoDelay; /* TCP_NODELAY */
+	boolean KeepAlive; /* SO_KEEPALIVE */
+	boolean QuickAck; /* TCP_QUICKACK, Linux only */
+	boolean ReuseAddress; /* SO_REUSEADDR, Windows already allows rebinding over TIME_WAIT */
+	boolean ReusePort; /* SO_REUSEPORT, creation fails where it is unsupported */
+	uint32 SendBuffer; /* SO_SNDBUF in bytes, 0 for the default */
+	uint32 ReceiveBuffer; /* SO_RCVBUF in bytes, 0 for the default */
+	uint32 BusyPoll; /* SO_BUSY_POLL in microseconds, 0 to leave off, Linux only */
+	uint32 FastOpen; /* TCP_FASTOPEN, the pending queue length on listeners and any non-zero value on connects */
+	uint32 Backlog; /* listen queue length, 0 for SOMAXCONN */
+	int32 IncomingCpu; /* SO_INCOMING_CPU, -1 to leave it, Linux only */
+} SAL_Socket_Options;
+
+/* I/O done on a socket or by a thread, kept without locks by whoever does it */
+typedef struct {
+	uint64 BytesRead;
+	uint64 BytesWritten;
+	uint64 Reads; /* receive calls, including ones that would block or failed */
+	uint64 Writes; /* send calls, including ones that would block or failed */
+	uint64 WouldBlocks;
+	uint64 Errors;
+} SAL_Socket_Counters;
+
+/* a snapshot from SAL_Socket_GetStatistics or SAL_Socket_GetReactorStatistics */
+typedef struct {
+	SAL_Socket_Counters IO;
+	uint64 Accepts;
+	uint64 Iterations; /* reactor loop turns, one per kernel wait */
+	uint64 Events; /* events the kernel returned, wake-ups included */
+	uint64 Dispatches; /* events that ran a socket's callbacks */
+	uint64 Posted; /* callbacks run through SAL_Socket_Reactor_Post */
+	uint64 BusyTime; /* ns spent outside the kernel wait, only while timing is on */
+	uint64 CallbackTime; /* ns spent in dispatches and posted callbacks, only while timing is on */
+	uint64 CallbackHistogram[SAL_Socket_HistogramBuckets]; /* their run times: bucket 0 is under 1us, bucket n is under 2^n us, the last holds the rest */
+} SAL_Socket_Statistics;
+
+/* a pooled receive buffer, see SAL_Socket_SetReceiveCallback */
+struct SAL_Socket_Buffer {
+	uint8* Data;
+	uint32 Length; /* bytes received into Data */
+	uint32 Capacity;
+	uint32 References;
+	SAL_Socket_Reactor* Reactor; /* pool the buffer returns to */
+	SAL_Socket_Buffer* Next;
+};
+
+/* a timeout run by a reactor, embedded in the caller's own structure so setting it allocates nothing, see SAL_Socket_SetTimer */
+struct SAL_Socket_Timer {
+	SAL_Socket_TimerCallback Callback;
+	void* State;
+	int64 Deadline; /* SAL_Time_Monotonic time it fires at */
+
+	/* owned by the reactor while the timer is pending */
+	SAL_Socket_Reactor* Reactor;
+	SAL_Socket_Timer* Next;
+	SAL_Socket_Timer* Previous;
+	uint8 Level;
+	uint8 Slot;
+	boolean Pending;
+};
+
 struct SAL_Socket {
 	#ifdef WINDOWS
 		uint64 RawSocket;
@@ -25,22 +142,94 @@ struct SAL_Socket {
 	uint8 Type;
 	uint8 Family;
 	boolean Connected;
+	boolean NonBlocking;
+	boolean Corked;
+	boolean Listening;
+	boolean Sharded; /* listener made by SAL_Socket_ListenSharded, its connections stay on its reactor */
+	boolean SegmentOffload; /* UDP socket receiving coalesced datagrams, see SAL_Socket_SetSegmentOffload */
+	boolean SegmentSendRejected; /* UDP socket whose kernel refused UDP_SEGMENT, SAL_Socket_SendDatagrams splits its segments itself */
 	uint8 LastError;
 	uint8 RemoteEndpointAddress[SAL_Socket_AddressLength];
+	SAL_Socket_Counters Counters;
 	SAL_Socket_ReadCallback ReadCallback;
 	void* ReadCallbackState;
+	SAL_Socket_ReceiveCallback ReceiveCallback;
+	SAL_Socket_AcceptCallback AcceptCallback;
+	SAL_Socket_WriteCallback WriteCallback;
+	void* WriteCallbackState;
+	SAL_Socket_OutputBuffer* Output; /* queued writes, oldest first */
+	uint32 OutputCount;
+	uint32 OutputCapacity;
+	uint32 OutputOffset; /* bytes of the oldest queued write already sent */
+	SAL_Socket_Reactor* Reactor; /* reactor that dispatches this socket's callbacks, assigned on first registration */
+	void* PollerData; /* readiness request for reads on IOCP and io_uring, owned by the reactor */
+	void* PollerWriteData; /* readiness request for writes on IOCP and io_uring, owned by the reactor */
+	void* PoolEntry; /* owned by the SAL_ConnectionPool the socket was checked out of */
+	void* TLS; /* session owned by SAL_TLS while the socket carries TLS, see SAL_TLS_Start */
+	#ifdef WINDOWS
+		void* ConnectTarget; /* address the write request issues a ConnectEx to while SAL_Socket_ConnectAsync is connecting */
+	#endif
 };
 
 public SAL_Socket* SAL_Socket_Connect(const int8* const address, const int8* port, uint8 family, uint8 type);
+public SAL_Socket* SAL_Socket_ConnectWithOptions(const int8* const address, const int8* port, uint8 family, uint8 type, const SAL_Socket_Options* options);
+public void SAL_Socket_ConnectAsync(const int8* const address, const int8* port, uint8 family, uint8 type, SAL_Socket_ConnectCallback callback, void* const state);
 public SAL_Socket* SAL_Socket_Listen(const int8* const port, uint8 family, uint8 type);
+public SAL_Socket* SAL_Socket_ListenWithOptions(const int8* const port, uint8 family, uint8 type, const SAL_Socket_Options* options);
+public uint32 SAL_Socket_ListenSharded(const int8* const port, uint8 family, uint8 type, SAL_Socket** const listeners, uint32 count);
 public SAL_Socket* SAL_Socket_Accept(SAL_Socket* listener);
+public uint32 SAL_Socket_AcceptBatch(SAL_Socket* listener, SAL_Socket** const sockets, uint32 maximum);
 public void SAL_Socket_Close(SAL_Socket* socket);
+public boolean SAL_Socket_SetNonBlocking(SAL_Socket* socket, boolean nonBlocking);
+public boolean SAL_Socket_SetNoDelay(SAL_Socket* socket, boolean enable);
+public boolean SAL_Socket_SetKeepAlive(SAL_Socket* socket, boolean enable);
+public void SAL_Socket_Options_Initialize(SAL_Socket_Options* options);
+public boolean SAL_Socket_ApplyOptions(SAL_Socket* socket, const SAL_Socket_Options* options);
+public boolean SAL_Socket_IsIdle(SAL_Socket* socket);
 public uint32 SAL_Socket_Read(SAL_Socket* socket, uint8* const buffer, const uint32 bufferSize);
 public uint32 SAL_Socket_Write(SAL_Socket* socket, const uint8* const toWrite, const uint32 writeAmount);
 public uint32 SAL_Socket_EnsureWrite(SAL_Socket* socket, const uint8* const toWrite, const uint32 writeAmount, uint8 maxAttempts);
+public void SAL_Socket_QueueWrite(SAL_Socket* socket, const uint8* const buffer, const uint32 length, SAL_Socket_ReleaseCallback release, void* const releaseState);
+public uint32 SAL_Socket_Flush(SAL_Socket* socket);
+public uint32 SAL_Socket_SendFile(SAL_Socket* socket, SAL_Socket_File file, uint64 offset, uint32 length);
+public uint32 SAL_Socket_ReceiveDatagrams(SAL_Socket* socket, SAL_Socket_Datagram* const datagrams, uint32 count);
+public uint32 SAL_Socket_SendDatagrams(SAL_Socket* socket, const SAL_Socket_Datagram* const datagrams, uint32 count);
+public boolean SAL_Socket_SetSegmentOffload(SAL_Socket* socket, boolean enable);
+public void SAL_Socket_Cork(SAL_Socket* socket);
+public uint32 SAL_Socket_Uncork(SAL_Socket* socket);
 public void SAL_Socket_SetReadCallback(SAL_Socket* socket, SAL_Socket_ReadCallback callback, void* const state);
+public void SAL_Socket_SetReceiveCallback(SAL_Socket* socket, SAL_Socket_ReceiveCallback callback, void* const state);
+public void SAL_Socket_Buffer_Retain(SAL_Socket_Buffer* buffer);
+public void SAL_Socket_Buffer_Release(SAL_Socket_Buffer* buffer);
+public void SAL_Socket_SetAcceptCallback(SAL_Socket* listener, SAL_Socket_AcceptCallback callback, void* const state);
+public void SAL_Socket_SetWriteCallback(SAL_Socket* socket, SAL_Socket_WriteCallback callback, void* const state);
 public void SAL_Socket_UnsetSocketCallback(SAL_Socket* socket);
+public void SAL_Socket_Timer_Initialize(SAL_Socket_Timer* timer);
+public void SAL_Socket_SetTimer(SAL_Socket* socket, SAL_Socket_Timer* timer, uint32 timeout, SAL_Socket_TimerCallback callback, void* const state);
+public boolean SAL_Socket_CancelTimer(SAL_Socket_Timer* timer);
+public boolean SAL_Socket_IsReactorThread(SAL_Socket* socket);
+public boolean SAL_Socket_SetReactorCount(uint32 count);
+public boolean SAL_Socket_SetReactorAttributes(const SAL_Thread_Attributes* attributes, boolean spread);
+public boolean SAL_Socket_SetBackend(uint8 backend);
+public uint8 SAL_Socket_GetBackend(void);
+public void SAL_Socket_GetStatistics(SAL_Socket_Statistics* statistics);
+public boolean SAL_Socket_GetReactorStatistics(uint32 index, SAL_Socket_Statistics* statistics);
+public void SAL_Socket_SetCallbackTiming(boolean enable);
 public uint16 SAL_Socket_HostToNetworkShort(uint16 value);
 public uint16 SAL_Socket_NetworkToHostShort(uint16 value);
 
+#ifndef SAL_NoInline
+	/* network order is big-endian, so converting either way is the same swap, or nothing */
+	static __inline uint16 SAL_Socket_SwapShortInline(uint16 value) {
+	#if defined __BYTE_ORDER__ && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		return value;
+	#else
+		return (uint16)((value << 8) | (value >> 8));
+	#endif
+	}
+
+	#define SAL_Socket_HostToNetworkShort(value) SAL_Socket_SwapShortInline(value)
+	#define SAL_Socket_NetworkToHostShort(value) SAL_Socket_SwapShortInline(value)
+#endif
+
 #endif
@@ -0,0 +1,418 @@
+/** vim: set noet ci pi sts=0 sw=4 ts=4
+ * @file TLS.c
+ * @brief TLS sessions carried directly on a SAL_Socket.
+ *
+ * A session reads and writes the socket's descriptor itself, so there is no
+ * extra BIO or buffer of the caller's between the record layer and the
+ * kernel. Where the kernel supports it, OpenSSL hands the negotiated keys to
+ * kernel TLS once the handshake is done. From then on the kernel encrypts
+ * everything sent on the socket, so SAL_Socket_Write, SAL_Socket_Flush and
+ * SAL_Socket_SendFile go straight to the kernel as on a plain connection, and
+ * sendfile stays zero-copy. Reads keep going through OpenSSL, which takes
+ * the plaintext from the kernel and handles alerts and session tickets.
+ *
+ * TLS uses the OpenSSL that is linked on POSIX systems. On Windows the
+ * functions fail.
+ */
+
+#include "TLS.h"
+
+#include "Allocator.h"
+
+#ifdef POSIX
+	#include <openssl/err.h>
+	#include <openssl/ssl.h>
+#endif
+
+struct SAL_TLS_Context {
+#ifdef POSIX
+	SSL_CTX* Context;
+#endif
+	boolean Server;
+	boolean Verify;
+};
+
+#ifdef POSIX
+/* a socket's session, reachable through its TLS field */
+typedef struct {
+	SSL* Session;
+	boolean Established; /* the handshake is done and the offload state below is known */
+	boolean KernelSend;
+	boolean KernelReceive;
+} SAL_TLS_Session;
+
+/* records whether the kernel took over either direction once the handshake has finished */
+static void SAL_TLS_Establish(SAL_TLS_Session* session) {
+	if (session->Established || !SSL_is_init_finished(session->Session))
+		return;
+
+	session->Established = true;
+	session->KernelSend = BIO_get_ktls_send(SSL_get_wbio(session->Session)) ? true : false;
+	session->KernelReceive = BIO_get_ktls_recv(SSL_get_rbio(session->Session)) ? true : false;
+}
+
+/* classifies the failed SSL call that returned @a result */
+static int32 SAL_TLS_TranslateError(SAL_TLS_Session* session, int result) {
+	switch (SSL_get_error(session->Session, result)) {
+		case SSL_ERROR_WANT_READ:
+		case SSL_ERROR_WANT_WRITE:
+			return SAL_TLS_Results_WouldBlock;
+
+		case SSL_ERROR_ZERO_RETURN:
+			return 0;
+
+		default:
+			/* the queue is per thread and has to be empty before the next call on it */
+			ERR_clear_error();
+			return SAL_TLS_Results_Failed;
+	}
+}
+#endif
+
+/**
+ * Create a context holding the settings shared by many TLS sessions.
+ *
+ * Sessions negotiate TLS 1.2 or later. Kernel TLS is requested wherever
+ * OpenSSL was built with it; sessions fall back to encrypting in userspace
+ * when the kernel or the negotiated cipher does not support it.
+ *
+ * @param server true for a context that accepts sessions, false for one that
+ * starts them
+ * @returns the new context, NULL on failure.
+ */
+SAL_TLS_Context* SAL_TLS_Context_Create(boolean server) {
+#ifdef POSIX
+	SAL_TLS_Context* context;
+	SSL_CTX* sslContext;
+
+	sslContext = SSL_CTX_new(server ? TLS_server_method() : TLS_client_method());
+	if (sslContext == NULL) {
+		ERR_clear_error();
+		return NULL;
+	}
+
+	SSL_CTX_set_min_proto_version(sslContext, TLS1_2_VERSION);
+
+	/* partial writes let a non-blocking send return what went out, like send does */
+	SSL_CTX_set_mode(sslContext, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+
+#ifdef SSL_OP_ENABLE_KTLS
+	SSL_CTX_set_options(sslContext, SSL_OP_ENABLE_KTLS);
+#endif
+
+	context = SAL_Allocator_New(SAL_TLS_Context);
+	context->Context = sslContext;
+	context->Server = server;
+	context->Verify = false;
+
+	return context;
+#else
+	return NULL;
+#endif
+}
+
+/**
+ * Free @a context. Sessions started from it keep working.
+ *
+ * @param context Context to free
+ */
+void SAL_TLS_Context_Free(SAL_TLS_Context* context) {
+	assert(context != NULL);
+
+#ifdef POSIX
+	SSL_CTX_free(context->Context);
+#endif
+
+	SAL_Allocator_Free(context);
+}
+
+/**
+ * Load the certificate chain and private key that @a context presents to
+ * peers. A server context needs them, a client context only for client
+ * certificates.
+ *
+ * @param context Context to change
+ * @param certificateFile PEM file with the certificate followed by any
+ * intermediates
+ * @param keyFile PEM file with the private key
+ * @returns true on success, false if either file could not be loaded or they
+ * do not match.
+ */
+boolean SAL_TLS_Context_SetCertificate(SAL_TLS_Context* context, const int8* const certificateFile, const int8* const keyFile) {
+	assert(context != NULL);
+	assert(certificateFile != NULL);
+	assert(keyFile != NULL);
+
+#ifdef POSIX
+	if (SSL_CTX_use_certificate_chain_file(context->Context, certificateFile) != 1 ||
+	    SSL_CTX_use_PrivateKey_file(context->Context, keyFile, SSL_FILETYPE_PEM) != 1 ||
+	    SSL_CTX_check_private_key(context->Context) != 1) {
+		ERR_clear_error();
+		return false;
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Make sessions of @a context verify the peer's certificate. Client sessions
+ * also check it names the host passed to @ref SAL_TLS_Start; server sessions
+ * require the client to present one.
+ *
+ * @param context Context to change
+ * @param authorityFile PEM file of trusted certificate authorities, NULL for
+ * the system's
+ * @returns true on success, false if the authorities could not be loaded.
+ */
+boolean SAL_TLS_Context_SetVerify(SAL_TLS_Context* context, const int8* const authorityFile) {
+	assert(context != NULL);
+
+#ifdef POSIX
+	if ((authorityFile != NULL ? SSL_CTX_load_verify_locations(context->Context, authorityFile, NULL) : SSL_CTX_set_default_verify_paths(context->Context)) != 1) {
+		ERR_clear_error();
+		return false;
+	}
+
+	SSL_CTX_set_verify(context->Context, context->Server ? SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT : SSL_VERIFY_PEER, NULL);
+	context->Verify = true;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Carry TLS on @a socket from now on. Every later @ref SAL_Socket_Read,
+ * @ref SAL_Socket_Write, @ref SAL_Socket_Flush and @ref SAL_Socket_SendFile
+ * moves plaintext, and @ref SAL_Socket_Close ends the session.
+ *
+ * The handshake runs as part of the first reads and writes, or explicitly
+ * through @ref SAL_TLS_Handshake.
+ *
+ * @param socket Connected TCP socket that has not sent or read anything yet
+ * @param context Client or server context to start the session from
+ * @param serverName Host name sent to the server and, with verification on,
+ * checked against its certificate. NULL on server sessions.
+ * @returns true on success, false on failure.
+ *
+ * @warning With callbacks, use a non-blocking socket and read until
+ * @ref SAL_Socket_WouldBlock: OpenSSL may hold decrypted data the kernel no
+ * longer reports as readable. OpenSSL writes the records it encrypts with
+ * write(2), so a peer that resets can raise SIGPIPE; ignore it in programs
+ * that use TLS.
+ */
+boolean SAL_TLS_Start(SAL_Socket* socket, SAL_TLS_Context* context, const int8* const serverName) {
+#ifdef POSIX
+	SAL_TLS_Session* session;
+	SSL* ssl;
+
+	assert(socket != NULL);
+	assert(context != NULL);
+	assert(socket->TLS == NULL);
+
+	ssl = SSL_new(context->Context);
+	if (ssl == NULL)
+		goto error;
+
+	if (SSL_set_fd(ssl, socket->RawSocket) != 1)
+		goto error;
+
+	if (context->Server) {
+		SSL_set_accept_state(ssl);
+	}
+	else {
+		if (serverName != NULL) {
+			if (SSL_set_tlsext_host_name(ssl, serverName) != 1)
+				goto error;
+
+			if (context->Verify && SSL_set1_host(ssl, serverName) != 1)
+				goto error;
+		}
+
+		SSL_set_connect_state(ssl);
+	}
+
+	session = SAL_Allocator_New(SAL_TLS_Session);
+	session->Session = ssl;
+	session->Established = false;
+	session->KernelSend = false;
+	session->KernelReceive = false;
+
+	socket->TLS = session;
+
+	return true;
+
+error:
+	if (ssl != NULL)
+		SSL_free(ssl);
+
+	ERR_clear_error();
+	socket->LastError = SAL_Socket_Errors_Failed;
+
+	return false;
+#else
+	socket->LastError = SAL_Socket_Errors_Failed;
+	return false;
+#endif
+}
+
+/**
+ * Advance the handshake of @a socket's session.
+ *
+ * @param socket Socket with a session from @ref SAL_TLS_Start
+ * @returns 1 once the handshake is complete, 0 if it failed (see @a LastError)
+ * or @ref SAL_Socket_WouldBlock if a non-blocking socket has to wait for the
+ * peer. Call again from the read callback in that case.
+ */
+uint32 SAL_TLS_Handshake(SAL_Socket* socket) {
+#ifdef POSIX
+	SAL_TLS_Session* session;
+	int result;
+
+	assert(socket != NULL);
+	assert(socket->TLS != NULL);
+
+	session = (SAL_TLS_Session*)socket->TLS;
+
+	if (session->Established)
+		return 1;
+
+	result = SSL_do_handshake(session->Session);
+	if (result == 1) {
+		SAL_TLS_Establish(session);
+		return 1;
+	}
+
+	if (SAL_TLS_TranslateError(session, result) == SAL_TLS_Results_WouldBlock) {
+		socket->LastError = SAL_Socket_Errors_WouldBlock;
+		return SAL_Socket_WouldBlock;
+	}
+
+	socket->LastError = SAL_Socket_Errors_Failed;
+	return 0;
+#else
+	return 0;
+#endif
+}
+
+/**
+ * Check whether the kernel encrypts or decrypts @a socket's records itself.
+ *
+ * @param socket Socket with a session from @ref SAL_TLS_Start
+ * @param isWrite true to ask about sending, false about receiving
+ * @returns true if that direction is offloaded, false while the handshake is
+ * running or when OpenSSL does the work.
+ */
+boolean SAL_TLS_IsOffloaded(SAL_Socket* socket, boolean isWrite) {
+#ifdef POSIX
+	SAL_TLS_Session* session;
+
+	assert(socket != NULL);
+	assert(socket->TLS != NULL);
+
+	session = (SAL_TLS_Session*)socket->TLS;
+
+	return isWrite ? session->KernelSend : session->KernelReceive;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Read up to @a length bytes of plaintext from @a socket's session. This is
+ * what @ref SAL_Socket_Read does on a socket carrying TLS.
+ *
+ * @param socket Socket with a session from @ref SAL_TLS_Start
+ * @param buffer Address to write the plaintext to
+ * @param length Size of @a buffer
+ * @returns the number of bytes read, 0 if the peer closed the session, or
+ * @ref SAL_TLS_Results_WouldBlock or @ref SAL_TLS_Results_Failed.
+ */
+int32 SAL_TLS_Receive(SAL_Socket* socket, uint8* const buffer, const uint32 length) {
+#ifdef POSIX
+	SAL_TLS_Session* session;
+	int result;
+
+	assert(socket != NULL);
+	assert(socket->TLS != NULL);
+
+	session = (SAL_TLS_Session*)socket->TLS;
+
+	result = SSL_read(session->Session, buffer, length > 0x7FFFFFFF ? 0x7FFFFFFF : (int)length);
+	SAL_TLS_Establish(session);
+
+	return result > 0 ? (int32)result : SAL_TLS_TranslateError(session, result);
+#else
+	return SAL_TLS_Results_Failed;
+#endif
+}
+
+/**
+ * Encrypt and send up to @a length bytes over @a socket's session. This is
+ * what @ref SAL_Socket_Write does on a socket carrying TLS until the kernel
+ * takes over sending.
+ *
+ * @param socket Socket with a session from @ref SAL_TLS_Start
+ * @param buffer Plaintext to send
+ * @param length Number of bytes to send, not 0
+ * @returns the number of bytes sent, or @ref SAL_TLS_Results_WouldBlock or
+ * @ref SAL_TLS_Results_Failed.
+ *
+ * @warning After @ref SAL_TLS_Results_WouldBlock, the next send must offer at
+ * least the same bytes again.
+ */
+int32 SAL_TLS_Send(SAL_Socket* socket, const uint8* const buffer, const uint32 length) {
+#ifdef POSIX
+	SAL_TLS_Session* session;
+	int result;
+
+	assert(socket != NULL);
+	assert(socket->TLS != NULL);
+	assert(length > 0);
+
+	session = (SAL_TLS_Session*)socket->TLS;
+
+	result = SSL_write(session->Session, buffer, length > 0x7FFFFFFF ? 0x7FFFFFFF : (int)length);
+	SAL_TLS_Establish(session);
+
+	if (result > 0)
+		return (int32)result;
+
+	result = SAL_TLS_TranslateError(session, result);
+
+	return result == 0 ? SAL_TLS_Results_Failed : result;
+#else
+	return SAL_TLS_Results_Failed;
+#endif
+}
+
+/**
+ * End @a socket's session, sending the peer a close notification if the
+ * socket can take it without blocking. @ref SAL_Socket_Close calls this.
+ *
+ * @param socket Socket with a session from @ref SAL_TLS_Start
+ *
+ * @warning The socket can only be closed afterwards.
+ */
+void SAL_TLS_Stop(SAL_Socket* socket) {
+#ifdef POSIX
+	SAL_TLS_Session* session;
+
+	assert(socket != NULL);
+	assert(socket->TLS != NULL);
+
+	session = (SAL_TLS_Session*)socket->TLS;
+
+	if (SSL_is_init_finished(session->Session) && SSL_shutdown(session->Session) < 0)
+		ERR_clear_error();
+
+	SSL_free(session->Session);
+	SAL_Allocator_Free(session);
+
+	socket->TLS = NULL;
+#endif
+}
@@ -0,0 +1,24 @@
+#ifndef INCLUDE_SAL_TLS
+#define INCLUDE_SAL_TLS
+
+#include "Common.h"
+#include "Socket.h"
+
+typedef struct SAL_TLS_Context SAL_TLS_Context;
+
+/* returned by SAL_TLS_Receive and SAL_TLS_Send instead of a byte count */
+#define SAL_TLS_Results_WouldBlock -1
+#define SAL_TLS_Results_Failed -2
+
+public SAL_TLS_Context* SAL_TLS_Context_Create(boolean server);
+public void SAL_TLS_Context_Free(SAL_TLS_Context* context);
+public boolean SAL_TLS_Context_SetCertificate(SAL_TLS_Context* context, const int8* const certificateFile, const int8* const keyFile);
+public boolean SAL_TLS_Context_SetVerify(SAL_TLS_Context* context, const int8* const authorityFile);
+public boolean SAL_TLS_Start(SAL_Socket* socket, SAL_TLS_Context* context, const int8* const serverName);
+public uint32 SAL_TLS_Handshake(SAL_Socket* socket);
+public boolean SAL_TLS_IsOffloaded(SAL_Socket* socket, boolean isWrite);
+public int32 SAL_TLS_Receive(SAL_Socket* socket, uint8* const buffer, const uint32 length);
+public int32 SAL_TLS_Send(SAL_Socket* socket, const uint8* const buffer, const uint32 length);
+public void SAL_TLS_Stop(SAL_Socket* socket);
+
+#endif
@@ -0,0 +1,326 @@
+/** vim: set noet ci pi sts=0 sw=4 ts=4
+ * @file Task.c
+ * @brief Sequential connection code run as coroutines on the socket reactors.
+ *
+ * A task is a body function that is left at every await and called again when
+ * the awaited operation completes; SAL_Task_Begin switches on the line it last
+ * awaited at to jump back in, the way protothreads do. No task owns a stack,
+ * so a task costs only its SAL_Task and whatever state the caller keeps with
+ * it, and thousands of them share the reactor threads. Operations try the
+ * socket first and only leave the body when it would block; the reactor then
+ * calls back into the task, which retries the operation and resumes the body.
+ * Every operation on a socket runs on that socket's reactor, so a task hops
+ * there through a timer before touching it and never races its own callbacks.
+ */
+
+#include "Task.h"
+
+static void SAL_Task_OnTimer(SAL_Socket_Timer* timer, void* const state);
+static void SAL_Task_OnReadable(SAL_Socket* socket, void* const state);
+static void SAL_Task_OnWritable(SAL_Socket* socket, void* const state);
+
+/* calls the body to run up to its next pending operation, the task must not be touched after as the body may have freed it */
+static void SAL_Task_Resume(SAL_Task* task) {
+	task->Operation = SAL_Task_Operations_None;
+	task->Target = NULL;
+
+	task->Body(task, task->State);
+}
+
+/* tries the pending socket operation once on the target's reactor, returns true if it completed */
+static boolean SAL_Task_Perform(SAL_Task* task) {
+	SAL_Socket* accepted;
+	uint32 result;
+
+	/* switched here rather than where the operation is issued, so the mode only ever changes on the thread dispatching the socket */
+	if (!task->Target->NonBlocking)
+		SAL_Socket_SetNonBlocking(task->Target, true);
+
+	switch (task->Operation) {
+		case SAL_Task_Operations_Read:
+			result = SAL_Socket_Read(task->Target, task->Buffer, task->Length);
+			if (result == SAL_Socket_WouldBlock)
+				return false;
+
+			task->Result = result;
+
+			return true;
+
+		case SAL_Task_Operations_Write:
+			while (task->Done < task->Length) {
+				result = SAL_Socket_Write(task->Target, task->Buffer + task->Done, task->Length - task->Done);
+				if (result == SAL_Socket_WouldBlock)
+					return false;
+
+				if (result == 0)
+					break;
+
+				task->Done += result;
+			}
+
+			task->Result = task->Done;
+
+			return true;
+
+		case SAL_Task_Operations_Accept:
+			accepted = SAL_Socket_Accept(task->Target);
+			if (accepted == NULL && task->Target->LastError == SAL_Socket_Errors_WouldBlock)
+				return false;
+
+			task->Socket = accepted;
+
+			return true;
+
+		default:
+			assert(false);
+			return true;
+	}
+}
+
+/* waits for the target to become ready for the pending operation, called on its reactor */
+static void SAL_Task_Wait(SAL_Task* task) {
+	SAL_Socket* socket = task->Target;
+
+	if (task->Operation == SAL_Task_Operations_Write) {
+		if (socket->WriteCallback != SAL_Task_OnWritable || socket->WriteCallbackState != task)
+			SAL_Socket_SetWriteCallback(socket, SAL_Task_OnWritable, task);
+	}
+	else {
+		if (socket->ReadCallback != SAL_Task_OnReadable || socket->ReadCallbackState != task)
+			SAL_Socket_SetReadCallback(socket, SAL_Task_OnReadable, task);
+	}
+}
+
+/* starts the socket operation set up in @a task, returns true if the body has to be left until it completes */
+static boolean SAL_Task_Issue(SAL_Task* task) {
+	if (!SAL_Socket_IsReactorThread(task->Target)) {
+		SAL_Socket_SetTimer(task->Target, &task->Timer, 0, SAL_Task_OnTimer, task);
+		return true;
+	}
+
+	if (SAL_Task_Perform(task)) {
+		task->Operation = SAL_Task_Operations_None;
+		task->Target = NULL;
+
+		return false;
+	}
+
+	SAL_Task_Wait(task);
+
+	return true;
+}
+
+/* a start, an expired sleep, or a socket operation that has reached its socket's reactor */
+static void SAL_Task_OnTimer(SAL_Socket_Timer* timer, void* const state) {
+	SAL_Task* task = (SAL_Task*)state;
+
+	(void)timer;
+
+	if (task->Operation == SAL_Task_Operations_Start || task->Operation == SAL_Task_Operations_Sleep) {
+		SAL_Task_Resume(task);
+	}
+	else if (SAL_Task_Perform(task)) {
+		SAL_Task_Resume(task);
+	}
+	else {
+		SAL_Task_Wait(task);
+	}
+}
+
+/* readiness is ignored unless the task is waiting to read or accept on @a socket, the callback stays set between operations */
+static void SAL_Task_OnReadable(SAL_Socket* socket, void* const state) {
+	SAL_Task* task = (SAL_Task*)state;
+
+	if (task->Target != socket || (task->Operation != SAL_Task_Operations_Read && task->Operation != SAL_Task_Operations_Accept))
+		return;
+
+	if (SAL_Task_Perform(task))
+		SAL_Task_Resume(task);
+}
+
+static void SAL_Task_OnWritable(SAL_Socket* socket, void* const state) {
+	SAL_Task* task = (SAL_Task*)state;
+
+	if (task->Target != socket || task->Operation != SAL_Task_Operations_Write)
+		return;
+
+	if (SAL_Task_Perform(task))
+		SAL_Task_Resume(task);
+}
+
+static void SAL_Task_OnConnected(SAL_Socket* socket, void* const state) {
+	SAL_Task* task = (SAL_Task*)state;
+
+	task->Socket = socket;
+
+	SAL_Task_Resume(task);
+}
+
+/**
+ * Start running @a body as a task on one of the reactors.
+ *
+ * @a body is called with @a task and @a state, and is written as one
+ * sequential piece of code between @ref SAL_Task_Begin and @ref SAL_Task_End
+ * that waits on each operation with @ref SAL_Task_Await:
+ *
+ * @code
+ * SAL_Task_Begin(task);
+ * SAL_Task_Await(task, SAL_Task_Read(task, echo->Socket, echo->Buffer, sizeof(echo->Buffer)));
+ * SAL_Task_Await(task, SAL_Task_Write(task, echo->Socket, echo->Buffer, task->Result));
+ * SAL_Task_End(task);
+ * @endcode
+ *
+ * The body is left at every await whose operation cannot complete at once
+ * and called again from the reactor when it does, carrying on after that
+ * await. The task may move between reactor threads as it works on different
+ * sockets but never runs on two at once.
+ *
+ * @param task Task to start; it must stay valid until the body finishes
+ * @param body Function of the task
+ * @param state Passed to @a body
+ *
+ * @warning Local variables of @a body do not survive an await, keep anything
+ * needed across one in @a state. Only one await may be written per line, and
+ * no switch may span one.
+ */
+void SAL_Task_Start(SAL_Task* task, SAL_Task_Body body, void* const state) {
+	assert(task != NULL);
+	assert(body != NULL);
+
+	task->Body = body;
+	task->State = state;
+	task->Resume = 0;
+	task->Finished = false;
+	task->Result = 0;
+	task->Socket = NULL;
+	task->Operation = SAL_Task_Operations_Start;
+	task->Target = NULL;
+	task->Buffer = NULL;
+	task->Length = 0;
+	task->Done = 0;
+
+	SAL_Socket_Timer_Initialize(&task->Timer);
+	SAL_Socket_SetTimer(NULL, &task->Timer, 0, SAL_Task_OnTimer, task);
+}
+
+/**
+ * Let @a task wait for @a timeout without holding up its reactor.
+ *
+ * @param task Task to wait
+ * @param timeout Delay in ms
+ * @returns true, the body is always left until the delay has passed.
+ */
+boolean SAL_Task_Sleep(SAL_Task* task, uint32 timeout) {
+	assert(task != NULL);
+	assert(task->Operation == SAL_Task_Operations_None);
+
+	task->Operation = SAL_Task_Operations_Sleep;
+
+	SAL_Socket_SetTimer(NULL, &task->Timer, timeout, SAL_Task_OnTimer, task);
+
+	return true;
+}
+
+/**
+ * Read up to @a bufferSize bytes from @a socket into @a buffer. @a Result of
+ * @a task is set to the number of bytes read, or 0 if the connection was
+ * closed or failed (see @a LastError).
+ *
+ * @param task Task to read with
+ * @param socket Socket to read from; it is made non-blocking
+ * @param buffer Buffer to read into, valid until the read completes
+ * @param bufferSize Size of @a buffer
+ * @returns true if the body has to be left until the read completes.
+ *
+ * @warning The task takes over the read and write callbacks of @a socket and
+ * leaves them set: only one task may use a socket, and the socket must be
+ * closed or its callbacks unset before the task's memory is freed.
+ */
+boolean SAL_Task_Read(SAL_Task* task, SAL_Socket* socket, uint8* const buffer, const uint32 bufferSize) {
+	assert(task != NULL);
+	assert(socket != NULL);
+	assert(buffer != NULL);
+	assert(task->Operation == SAL_Task_Operations_None);
+
+	task->Operation = SAL_Task_Operations_Read;
+	task->Target = socket;
+	task->Buffer = buffer;
+	task->Length = bufferSize;
+
+	return SAL_Task_Issue(task);
+}
+
+/**
+ * Write all of @a writeAmount bytes of @a toWrite to @a socket. @a Result of
+ * @a task is set to the number of bytes written, which is less than
+ * @a writeAmount only if the connection was closed or failed.
+ *
+ * @param task Task to write with
+ * @param socket Socket to write to; it is made non-blocking
+ * @param toWrite Bytes to write, valid until the write completes
+ * @param writeAmount Number of bytes to write
+ * @returns true if the body has to be left until the write completes.
+ *
+ * @warning See @ref SAL_Task_Read on sharing @a socket.
+ */
+boolean SAL_Task_Write(SAL_Task* task, SAL_Socket* socket, const uint8* const toWrite, const uint32 writeAmount) {
+	assert(task != NULL);
+	assert(socket != NULL);
+	assert(toWrite != NULL);
+	assert(task->Operation == SAL_Task_Operations_None);
+
+	task->Operation = SAL_Task_Operations_Write;
+	task->Target = socket;
+	task->Buffer = (uint8*)toWrite;
+	task->Length = writeAmount;
+	task->Done = 0;
+
+	return SAL_Task_Issue(task);
+}
+
+/**
+ * Accept a connection on @a listener. @a Socket of @a task is set to the
+ * accepted socket, or NULL if accepting failed (see @a LastError of
+ * @a listener).
+ *
+ * Accepting tasks usually start a new task for each socket they accept and
+ * then accept again.
+ *
+ * @param task Task to accept with
+ * @param listener Listening socket; it is made non-blocking
+ * @returns true if the body has to be left until a connection is accepted.
+ *
+ * @warning See @ref SAL_Task_Read on sharing @a listener.
+ */
+boolean SAL_Task_Accept(SAL_Task* task, SAL_Socket* listener) {
+	assert(task != NULL);
+	assert(listener != NULL);
+	assert(task->Operation == SAL_Task_Operations_None);
+
+	task->Operation = SAL_Task_Operations_Accept;
+	task->Target = listener;
+
+	return SAL_Task_Issue(task);
+}
+
+/**
+ * Connect to a host through @ref SAL_Socket_ConnectAsync. @a Socket of
+ * @a task is set to the connected non-blocking socket, or NULL if no
+ * connection could be made, and the task carries on on that socket's reactor.
+ *
+ * @param task Task to connect with
+ * @param address A string specifying the hostname to connect to
+ * @param port Port to connect to
+ * @returns true, the body is always left until the connection completes.
+ */
+boolean SAL_Task_Connect(SAL_Task* task, const int8* const address, const int8* port, uint8 family, uint8 type) {
+	assert(task != NULL);
+	assert(task->Operation == SAL_Task_Operations_None);
+
+	task->Operation = SAL_Task_Operations_Connect;
+	task->Socket = NULL;
+
+	SAL_Socket_ConnectAsync(address, port, family, type, SAL_Task_OnConnected, task);
+
+	return true;
+}
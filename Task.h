@@ -0,0 +1,58 @@
+#ifndef INCLUDE_SAL_TASK
+#define INCLUDE_SAL_TASK
+
+#include "Common.h"
+#include "Socket.h"
+
+typedef struct SAL_Task SAL_Task;
+
+typedef void (*SAL_Task_Body)(SAL_Task* task, void* const state);
+
+/* values of SAL_Task.Operation */
+#define SAL_Task_Operations_None 0
+#define SAL_Task_Operations_Start 1
+#define SAL_Task_Operations_Sleep 2
+#define SAL_Task_Operations_Read 3
+#define SAL_Task_Operations_Write 4
+#define SAL_Task_Operations_Accept 5
+#define SAL_Task_Operations_Connect 6
+
+/* a stackless coroutine run by the reactors, embedded in the caller's own structure so starting it allocates nothing, see SAL_Task_Start */
+struct SAL_Task {
+	SAL_Task_Body Body;
+	void* State;
+	uint32 Resume; /* line of the await the body continues after, 0 to run from the top */
+	boolean Finished;
+
+	uint32 Result; /* bytes moved by the last read or write, 0 if the connection closed or failed */
+	SAL_Socket* Socket; /* socket from the last accept or connect, NULL if it failed */
+
+	/* owned by the task while an operation is pending */
+	uint8 Operation;
+	SAL_Socket* Target;
+	uint8* Buffer;
+	uint32 Length;
+	uint32 Done;
+	SAL_Socket_Timer Timer;
+};
+
+/* opens a task body, nothing but declarations may come before it */
+#define SAL_Task_Begin(task) switch ((task)->Resume) { case 0:
+
+/* runs @a operation, one of the SAL_Task operations, and leaves the body until it completes unless it already has */
+#define SAL_Task_Await(task, operation) do { (task)->Resume = __LINE__; if (operation) return; case __LINE__:; } while (0)
+
+/* finishes the task from anywhere between SAL_Task_Begin and SAL_Task_End */
+#define SAL_Task_Exit(task) do { (task)->Resume = 0; (task)->Finished = true; return; } while (0)
+
+/* closes a task body, what follows it runs once when the task finishes */
+#define SAL_Task_End(task) } (task)->Resume = 0; (task)->Finished = true
+
+public void SAL_Task_Start(SAL_Task* task, SAL_Task_Body body, void* const state);
+public boolean SAL_Task_Sleep(SAL_Task* task, uint32 timeout);
+public boolean SAL_Task_Read(SAL_Task* task, SAL_Socket* socket, uint8* const buffer, const uint32 bufferSize);
+public boolean SAL_Task_Write(SAL_Task* task, SAL_Socket* socket, const uint8* const toWrite, const uint32 writeAmount);
+public boolean SAL_Task_Accept(SAL_Task* task, SAL_Socket* listener);
+public boolean SAL_Task_Connect(SAL_Task* task, const int8* const address, const int8* port, uint8 family, uint8 type);
+
+#endif
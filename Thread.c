@@ -5,11 +5,332 @@
 
 #include "Thread.h"
 
+/* the exported versions of what Thread.h inlines */
+#undef SAL_Lock_Acquire
+#undef SAL_Lock_TryAcquire
+#undef SAL_Lock_Release
+#undef SAL_Mutex_Acquire
+#undef SAL_Mutex_Release
+
+#include <string.h>
+#include "Allocator.h"
+#include "Atomic.h"
+#include "Time.h"
+
 #ifdef WINDOWS
 	#define WIN32_LEAN_AND_MEAN
 	#include <Windows.h>
 #elif defined POSIX
 	#include <errno.h>
+	#include <limits.h>
+	#include <stdio.h>
+	#include <time.h>
+	#include <unistd.h>
+	#include <sys/resource.h>
+
+	#ifdef __linux__
+		#include <sched.h>
+		#include <linux/futex.h>
+		#include <sys/syscall.h>
+	#endif
+#endif
+
+/* times a contended lock checks again, pausing in between, before its thread parks */
+#define SAL_Lock_SpinCount 128
+
+/* SAL_RWLock.State: a writer holds it, threads are parked on it, and the rest counts readers */
+#define SAL_RWLock_Writer 0x80000000
+#define SAL_RWLock_Parked 0x40000000
+#define SAL_RWLock_Readers 0x3FFFFFFF
+
+/* wakes every thread parked on an address */
+#define SAL_Thread_WakeAll 0x7FFFFFFF
+
+#if defined POSIX && !defined __linux__
+	/* without futexes, threads park on a condition in a bucket picked by the address they wait on */
+	#define SAL_Thread_ParkingBuckets 64
+
+	typedef struct {
+		pthread_mutex_t Lock;
+		pthread_cond_t Changed;
+	} SAL_Thread_ParkingBucket;
+
+	static SAL_Thread_ParkingBucket parkingLot[SAL_Thread_ParkingBuckets];
+	static pthread_once_t parkingLotOnce = PTHREAD_ONCE_INIT;
+
+	static void SAL_Thread_ParkingLot_Initialize(void) {
+		uint32 i;
+
+		for (i = 0; i < SAL_Thread_ParkingBuckets; i++) {
+			pthread_mutex_init(&parkingLot[i].Lock, NULL);
+			pthread_cond_init(&parkingLot[i].Changed, NULL);
+		}
+	}
+
+	static SAL_Thread_ParkingBucket* SAL_Thread_ParkingLot_Find(uint32* address) {
+		pthread_once(&parkingLotOnce, SAL_Thread_ParkingLot_Initialize);
+
+		return &parkingLot[((size_t)address >> 2) % SAL_Thread_ParkingBuckets];
+	}
+#endif
+
+/* parks the calling thread while *@a address is @a expected, up to @a timeout ms or forever if negative. May return early, callers check again. */
+static void SAL_Thread_WaitOnAddress(uint32* address, uint32 expected, int32 timeout) {
+#ifdef WINDOWS
+	WaitOnAddress(address, &expected, sizeof(uint32), timeout < 0 ? INFINITE : (DWORD)timeout);
+#elif defined __linux__
+	struct timespec duration;
+
+	duration.tv_sec = timeout / 1000;
+	duration.tv_nsec = (long)(timeout % 1000) * 1000000;
+
+	syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, expected, timeout < 0 ? NULL : &duration, NULL, 0);
+#elif defined POSIX
+	SAL_Thread_ParkingBucket* bucket = SAL_Thread_ParkingLot_Find(address);
+	struct timespec deadline;
+
+	if (timeout >= 0) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += timeout / 1000;
+		deadline.tv_nsec += (long)(timeout % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+
+	/* the value is checked under the bucket lock the waker takes, so a change between the check and the wait is not missed */
+	pthread_mutex_lock(&bucket->Lock);
+
+	if (SAL_Atomic_Load32(address) == expected) {
+		if (timeout < 0)
+			pthread_cond_wait(&bucket->Changed, &bucket->Lock);
+		else
+			pthread_cond_timedwait(&bucket->Changed, &bucket->Lock, &deadline);
+	}
+
+	pthread_mutex_unlock(&bucket->Lock);
+#endif
+}
+
+/* unparks up to @a count threads waiting on @a address, called after changing it */
+static void SAL_Thread_WakeAddress(uint32* address, uint32 count) {
+#ifdef WINDOWS
+	if (count == 1)
+		WakeByAddressSingle(address);
+	else
+		WakeByAddressAll(address);
+#elif defined __linux__
+	syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, count > INT_MAX ? INT_MAX : (int)count, NULL, NULL, 0);
+#elif defined POSIX
+	SAL_Thread_ParkingBucket* bucket = SAL_Thread_ParkingLot_Find(address);
+
+	/* a bucket is shared by many addresses, so everyone in it checks again */
+	(void)count;
+
+	pthread_mutex_lock(&bucket->Lock);
+	pthread_cond_broadcast(&bucket->Changed);
+	pthread_mutex_unlock(&bucket->Lock);
+#endif
+}
+
+/* what a new POSIX thread applies to itself before running its start function */
+#ifdef POSIX
+typedef struct {
+	SAL_Thread_StartAddress StartAddress;
+	void* StartArgument;
+	int32 Priority;
+	int8 Name[SAL_Thread_NameLength];
+} SAL_Thread_Startup;
+#endif
+
+/* ORs the processors of NUMA node @a node into @a mask, false if the node is unknown */
+static boolean SAL_Thread_GetNodeProcessors(int32 node, uint64* mask) {
+#ifdef WINDOWS
+	GROUP_AFFINITY affinity;
+	uint32 first;
+
+	if (!GetNumaNodeProcessorMaskEx((USHORT)node, &affinity))
+		return false;
+
+	first = (uint32)affinity.Group * 64;
+	if (first >= SAL_Thread_MaxProcessors)
+		return false;
+
+	mask[first / 64] |= (uint64)affinity.Mask;
+
+	return true;
+#elif defined __linux__
+	char path[64];
+	FILE* list;
+	unsigned int first;
+	unsigned int last;
+	unsigned int i;
+	int separator;
+
+	/* the kernel lists a node's processors as ranges, like 0-3,8-11 */
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", (int)node);
+
+	list = fopen(path, "r");
+	if (list == NULL)
+		return false;
+
+	while (fscanf(list, "%u", &first) == 1) {
+		last = first;
+
+		separator = fgetc(list);
+		if (separator == '-') {
+			if (fscanf(list, "%u", &last) != 1)
+				break;
+
+			separator = fgetc(list);
+		}
+
+		for (i = first; i <= last && i < SAL_Thread_MaxProcessors; i++)
+			mask[i / 64] |= (uint64)1 << (i % 64);
+
+		if (separator != ',')
+			break;
+	}
+
+	fclose(list);
+
+	return true;
+#else
+	(void)node;
+	(void)mask;
+
+	return false;
+#endif
+}
+
+/* the processors a thread made with @a attributes may use, all clear for no restriction */
+static void SAL_Thread_Attributes_Resolve(const SAL_Thread_Attributes* attributes, uint64* mask) {
+	uint64 node[SAL_Thread_MaxProcessors / 64];
+	boolean any = false;
+	boolean overlap = false;
+	uint32 i;
+
+	for (i = 0; i < SAL_Thread_MaxProcessors / 64; i++) {
+		mask[i] = attributes->Affinity[i];
+		node[i] = 0;
+		any = any || mask[i] != 0;
+	}
+
+	if (attributes->NumaNode < 0 || !SAL_Thread_GetNodeProcessors(attributes->NumaNode, node))
+		return;
+
+	for (i = 0; i < SAL_Thread_MaxProcessors / 64; i++)
+		overlap = overlap || (mask[i] & node[i]) != 0;
+
+	/* processors in both when there are some, otherwise the node wins */
+	for (i = 0; i < SAL_Thread_MaxProcessors / 64; i++)
+		mask[i] = any && overlap ? mask[i] & node[i] : node[i];
+}
+
+/**
+ * Fill @a attributes with the defaults: any processor, any node, the system
+ * stack size, normal priority and no name.
+ *
+ * @param attributes Attributes to reset
+ */
+void SAL_Thread_Attributes_Initialize(SAL_Thread_Attributes* attributes) {
+	assert(attributes != NULL);
+
+	memset(attributes, 0, sizeof(SAL_Thread_Attributes));
+
+	attributes->NumaNode = -1;
+	attributes->Priority = SAL_Thread_Priorities_Normal;
+}
+
+/**
+ * Allow threads made with @a attributes to run on @a processor.
+ *
+ * @param attributes Attributes to change
+ * @param processor Processor number, below @ref SAL_Thread_MaxProcessors
+ */
+void SAL_Thread_Attributes_AddProcessor(SAL_Thread_Attributes* attributes, uint32 processor) {
+	assert(attributes != NULL);
+	assert(processor < SAL_Thread_MaxProcessors);
+
+	attributes->Affinity[processor / 64] |= (uint64)1 << (processor % 64);
+}
+
+/**
+ * Derive the attributes of the @a index th thread of a one-thread-per-core
+ * layout: @a target is @a source pinned to a single processor, taken in turn
+ * from the processors @a source allows (the ones of its node if it has one,
+ * every processor if it has neither).
+ *
+ * @param source Attributes shared by every thread of the layout
+ * @param index Position of the thread in the layout, wrapping around once
+ * every processor has a thread
+ * @param target Filled with the attributes for that thread, may be @a source
+ */
+void SAL_Thread_Attributes_Spread(const SAL_Thread_Attributes* source, uint32 index, SAL_Thread_Attributes* target) {
+	uint64 mask[SAL_Thread_MaxProcessors / 64];
+	uint32 count = 0;
+	uint32 processor;
+	uint32 i;
+
+	assert(source != NULL);
+	assert(target != NULL);
+
+	SAL_Thread_Attributes_Resolve(source, mask);
+
+	for (i = 0; i < SAL_Thread_MaxProcessors; i++)
+		if (mask[i / 64] & ((uint64)1 << (i % 64)))
+			count++;
+
+	if (target != source)
+		memcpy(target, source, sizeof(SAL_Thread_Attributes));
+
+	memset(target->Affinity, 0, sizeof(target->Affinity));
+	target->NumaNode = -1;
+
+	if (count == 0) {
+		count = SAL_Thread_ProcessorCount();
+		SAL_Thread_Attributes_AddProcessor(target, index % (count < SAL_Thread_MaxProcessors ? count : SAL_Thread_MaxProcessors));
+		return;
+	}
+
+	index %= count;
+
+	for (processor = 0; processor < SAL_Thread_MaxProcessors; processor++) {
+		if (mask[processor / 64] & ((uint64)1 << (processor % 64))) {
+			if (index == 0)
+				break;
+
+			index--;
+		}
+	}
+
+	SAL_Thread_Attributes_AddProcessor(target, processor);
+}
+
+#ifdef POSIX
+/* runs first on a thread made by SAL_Thread_CreateWithAttributes, for the settings a thread can only make for itself */
+static void* SAL_Thread_StartWithAttributes(void* startupArgument) {
+	SAL_Thread_Startup startup = *(SAL_Thread_Startup*)startupArgument;
+
+	SAL_Allocator_Free(startupArgument);
+
+	if (startup.Name[0] != '\0') {
+	#if defined __APPLE__
+		pthread_setname_np(startup.Name);
+	#elif defined __linux__ || defined __FreeBSD__
+		pthread_setname_np(pthread_self(), startup.Name);
+	#endif
+	}
+
+	/* SCHED_OTHER threads have no pthread priority, Linux gives each thread its own nice value instead. Raising it needs privileges, failing leaves it normal. */
+#ifdef __linux__
+	if (startup.Priority != SAL_Thread_Priorities_Normal)
+		setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), -5 * startup.Priority);
+#endif
+
+	return startup.StartAddress(startup.StartArgument);
+}
 #endif
 
 /**
@@ -18,7 +339,7 @@
  * @param startAddress The function the thread will execute
  * @param startParameter The parameter the function will be called with
  *
- * @returns An opaque thread id object.
+ * @returns An opaque thread id object, zeroed if the thread could not be created.
  */
 SAL_Thread SAL_Thread_Create(SAL_Thread_StartAddress startAddress, void* startArgument) {
 #ifdef WINDOWS
@@ -26,12 +347,133 @@ SAL_Thread SAL_Thread_Create(SAL_Thread_StartAddress startAddress, void* startAr
 #elif defined POSIX
 	pthread_t threadId;
 
-	pthread_create(&threadId, NULL, startAddress, startArgument);
+	if (pthread_create(&threadId, NULL, startAddress, startArgument) != 0)
+		memset(&threadId, 0, sizeof(pthread_t));
 
 	return threadId;
 #endif
 }
 
+/**
+ * Create a thread set up by @a attributes: where it may run, its stack size,
+ * priority and name. Settings the system has no equivalent for are ignored,
+ * as are processor affinity on macOS and NUMA nodes outside Linux and
+ * Windows.
+ *
+ * The thread is placed before it starts running, so memory it touches first
+ * comes from its own node.
+ *
+ * @param startAddress The function the thread will execute
+ * @param startArgument The parameter the function will be called with
+ * @param attributes How to set the thread up, see @ref SAL_Thread_Attributes
+ *
+ * @returns An opaque thread id object, zeroed if the thread could not be created.
+ *
+ * @warning On Windows, a processor set spanning several processor groups is
+ * cut down to the group of its lowest processor.
+ */
+SAL_Thread SAL_Thread_CreateWithAttributes(SAL_Thread_StartAddress startAddress, void* startArgument, const SAL_Thread_Attributes* attributes) {
+	uint64 mask[SAL_Thread_MaxProcessors / 64];
+	uint32 i;
+
+	assert(attributes != NULL);
+
+	SAL_Thread_Attributes_Resolve(attributes, mask);
+
+#ifdef WINDOWS
+	{
+		static const int priorities[] = { THREAD_PRIORITY_LOWEST, THREAD_PRIORITY_BELOW_NORMAL, THREAD_PRIORITY_NORMAL, THREAD_PRIORITY_ABOVE_NORMAL, THREAD_PRIORITY_HIGHEST };
+		typedef HRESULT (WINAPI *SetThreadDescriptionFunction)(HANDLE, PCWSTR);
+		SetThreadDescriptionFunction setThreadDescription;
+		GROUP_AFFINITY affinity;
+		WCHAR name[SAL_Thread_NameLength];
+		HANDLE thread;
+		int32 priority;
+
+		/* suspended so it only runs once it is in place */
+		thread = CreateThread(NULL, attributes->StackSize, startAddress, startArgument, CREATE_SUSPENDED | (attributes->StackSize > 0 ? STACK_SIZE_PARAM_IS_A_RESERVATION : 0), NULL);
+		if (thread == NULL)
+			return NULL;
+
+		for (i = 0; i < SAL_Thread_MaxProcessors / 64 && mask[i] == 0; i++)
+			;
+
+		if (i < SAL_Thread_MaxProcessors / 64) {
+			memset(&affinity, 0, sizeof(GROUP_AFFINITY));
+			affinity.Group = (WORD)i;
+			affinity.Mask = (KAFFINITY)mask[i];
+			SetThreadGroupAffinity(thread, &affinity, NULL);
+		}
+
+		priority = attributes->Priority < SAL_Thread_Priorities_Lowest ? SAL_Thread_Priorities_Lowest : attributes->Priority > SAL_Thread_Priorities_Highest ? SAL_Thread_Priorities_Highest : attributes->Priority;
+		SetThreadPriority(thread, priorities[priority - SAL_Thread_Priorities_Lowest]);
+
+		/* SetThreadDescription only exists from Windows 10 1607 */
+		setThreadDescription = (SetThreadDescriptionFunction)GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "SetThreadDescription");
+		if (setThreadDescription != NULL && attributes->Name[0] != '\0') {
+			for (i = 0; i < SAL_Thread_NameLength - 1 && attributes->Name[i] != '\0'; i++)
+				name[i] = (WCHAR)(uint8)attributes->Name[i];
+
+			name[i] = L'\0';
+			setThreadDescription(thread, name);
+		}
+
+		ResumeThread(thread);
+
+		return thread;
+	}
+#elif defined POSIX
+	{
+		SAL_Thread_Startup* startup;
+		pthread_attr_t threadAttributes;
+		pthread_t threadId;
+		int result;
+	#ifdef __linux__
+		cpu_set_t processors;
+		boolean pinned = false;
+	#endif
+
+		startup = SAL_Allocator_New(SAL_Thread_Startup);
+		startup->StartAddress = startAddress;
+		startup->StartArgument = startArgument;
+		startup->Priority = attributes->Priority < SAL_Thread_Priorities_Lowest ? SAL_Thread_Priorities_Lowest : attributes->Priority > SAL_Thread_Priorities_Highest ? SAL_Thread_Priorities_Highest : attributes->Priority;
+		memcpy(startup->Name, attributes->Name, SAL_Thread_NameLength);
+		startup->Name[SAL_Thread_NameLength - 1] = '\0';
+
+		pthread_attr_init(&threadAttributes);
+
+		if (attributes->StackSize > 0)
+			pthread_attr_setstacksize(&threadAttributes, attributes->StackSize < PTHREAD_STACK_MIN ? PTHREAD_STACK_MIN : attributes->StackSize);
+
+	#ifdef __linux__
+		CPU_ZERO(&processors);
+
+		for (i = 0; i < SAL_Thread_MaxProcessors && i < CPU_SETSIZE; i++) {
+			if (mask[i / 64] & ((uint64)1 << (i % 64))) {
+				CPU_SET(i, &processors);
+				pinned = true;
+			}
+		}
+
+		if (pinned)
+			pthread_attr_setaffinity_np(&threadAttributes, sizeof(cpu_set_t), &processors);
+	#else
+		(void)i;
+	#endif
+
+		result = pthread_create(&threadId, &threadAttributes, SAL_Thread_StartWithAttributes, startup);
+		pthread_attr_destroy(&threadAttributes);
+
+		if (result != 0) {
+			SAL_Allocator_Free(startup);
+			memset(&threadId, 0, sizeof(pthread_t));
+		}
+
+		return threadId;
+	}
+#endif
+}
+
 /**
  * Wait for @a thread to exit.
  *
@@ -70,7 +512,12 @@ void SAL_Thread_Sleep(uint32 duration) {
 #ifdef WINDOWS
 	Sleep(duration);
 #elif defined POSIX
-	sleep(duration);
+	struct timespec remaining;
+
+	remaining.tv_sec = duration / 1000;
+	remaining.tv_nsec = (long)(duration % 1000) * 1000000;
+
+	while (nanosleep(&remaining, &remaining) == -1 && errno == EINTR);
 #endif
 }
 
@@ -87,6 +534,23 @@ void SAL_Thread_Exit(uint32 exitCode) {
 #endif
 }
 
+/**
+ * @returns the number of processors the system has online, at least 1.
+ */
+uint32 SAL_Thread_ProcessorCount(void) {
+#ifdef WINDOWS
+	SYSTEM_INFO information;
+
+	GetSystemInfo(&information);
+
+	return information.dwNumberOfProcessors > 0 ? (uint32)information.dwNumberOfProcessors : 1;
+#elif defined POSIX
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return count > 0 ? (uint32)count : 1;
+#endif
+}
+
 /**
  * Create a new mutex.
  *
@@ -96,18 +560,7 @@ void SAL_Thread_Exit(uint32 exitCode) {
  * @returns a new mutex
  */
 SAL_Mutex SAL_Mutex_Create(void) {
-#ifdef WINDOWS
-	CRITICAL_SECTION* criticalSection;
-
-	criticalSection = Allocate(CRITICAL_SECTION);
-	InitializeCriticalSection(criticalSection);
-
-	return (SAL_Mutex)criticalSection;
-#elif defined POSIX
-	pthread_mutex_t *mutex = Allocate(pthread_mutex_t);
-	pthread_mutex_init(mutex, NULL);
-	return mutex;
-#endif
+	return SAL_Mutex_Initialize(SAL_Allocator_New(SAL_Mutex_Storage));
 }
 
 /**
@@ -123,6 +576,45 @@ SAL_Mutex SAL_Mutex_Create(void) {
  * have a safety net.
  */
 uint8 SAL_Mutex_Free(SAL_Mutex mutex) {
+	if (SAL_Mutex_Destroy(mutex) != 0)
+		return 1;
+
+	SAL_Allocator_Free(mutex);
+
+	return 0;
+}
+
+/**
+ * Create a mutex in @a storage instead of allocating one.
+ *
+ * @param storage Memory for the mutex, which must stay in place until it is
+ * destroyed
+ * @returns a mutex to be destroyed with @ref SAL_Mutex_Destroy, not freed.
+ */
+SAL_Mutex SAL_Mutex_Initialize(SAL_Mutex_Storage* storage) {
+#ifdef WINDOWS
+	CRITICAL_SECTION* criticalSection = (CRITICAL_SECTION*)storage;
+
+	assert(sizeof(SAL_Mutex_Storage) >= sizeof(CRITICAL_SECTION));
+
+	InitializeCriticalSection(criticalSection);
+
+	return (SAL_Mutex)criticalSection;
+#elif defined POSIX
+	pthread_mutex_init(storage, NULL);
+	return storage;
+#endif
+}
+
+/**
+ * Destroy @a mutex from @ref SAL_Mutex_Initialize, leaving its storage to the
+ * caller.
+ *
+ * @param mutex mutex to destroy
+ * @returns 0 if the mutex is destroyed, 1 if it is still being used, as for
+ * @ref SAL_Mutex_Free.
+ */
+uint8 SAL_Mutex_Destroy(SAL_Mutex mutex) {
 #ifdef WINDOWS
 	DeleteCriticalSection((CRITICAL_SECTION*)mutex);
 	return 0;
@@ -164,6 +656,204 @@ void SAL_Mutex_Release(SAL_Mutex mutex) {
 #endif
 }
 
+/**
+ * Initialize a lock kept inside another structure. A zero-filled lock, or one
+ * set to @ref SAL_Lock_Initializer, is already initialized and nothing has to
+ * be freed.
+ *
+ * @param lock Lock to initialize
+ */
+void SAL_Lock_Initialize(SAL_Lock* lock) {
+	assert(lock != NULL);
+
+	SAL_Atomic_Store32(&lock->State, SAL_Lock_Unlocked);
+}
+
+/**
+ * Acquire @a lock, spinning briefly while another thread holds it before
+ * parking in the kernel until it is released.
+ *
+ * An uncontended acquire and release is one atomic operation each and never
+ * enters the kernel.
+ *
+ * @param lock Lock to acquire
+ *
+ * @warning Not recursive: acquiring a lock the thread already holds deadlocks.
+ */
+void SAL_Lock_Acquire(SAL_Lock* lock) {
+	uint32 state;
+	uint32 i;
+
+	assert(lock != NULL);
+
+	if (SAL_Atomic_CompareExchange32(&lock->State, SAL_Lock_Unlocked, SAL_Lock_Locked))
+		return;
+
+	/* short critical sections are usually over before a park would even start, but there is no point spinning behind parked threads */
+	for (i = 0; i < SAL_Lock_SpinCount; i++) {
+		state = SAL_Atomic_Load32(&lock->State);
+
+		if (state == SAL_Lock_Unlocked && SAL_Atomic_CompareExchange32(&lock->State, SAL_Lock_Unlocked, SAL_Lock_Locked))
+			return;
+
+		if (state == SAL_Lock_Contended)
+			break;
+
+		SAL_Atomic_Pause();
+	}
+
+	/* from here the lock is held as contended, so whoever releases it knows to wake a parked thread */
+	while (SAL_Atomic_Exchange32(&lock->State, SAL_Lock_Contended) != SAL_Lock_Unlocked)
+		SAL_Thread_WaitOnAddress(&lock->State, SAL_Lock_Contended, -1);
+}
+
+/**
+ * Acquire @a lock only if no other thread holds it.
+ *
+ * @param lock Lock to acquire
+ * @returns true if the lock was acquired, false if it is held.
+ */
+boolean SAL_Lock_TryAcquire(SAL_Lock* lock) {
+	assert(lock != NULL);
+
+	return SAL_Atomic_CompareExchange32(&lock->State, SAL_Lock_Unlocked, SAL_Lock_Locked);
+}
+
+/**
+ * Release @a lock, waking one parked thread if any are waiting for it.
+ *
+ * @param lock Lock to release, held by the calling thread
+ */
+void SAL_Lock_Release(SAL_Lock* lock) {
+	assert(lock != NULL);
+
+	if (SAL_Atomic_Exchange32(&lock->State, SAL_Lock_Unlocked) == SAL_Lock_Contended)
+		SAL_Thread_WakeAddress(&lock->State, 1);
+}
+
+/**
+ * Initialize a reader-writer lock kept inside another structure. A
+ * zero-filled lock, or one set to @ref SAL_RWLock_Initializer, is already
+ * initialized and nothing has to be freed.
+ *
+ * @param lock Lock to initialize
+ */
+void SAL_RWLock_Initialize(SAL_RWLock* lock) {
+	assert(lock != NULL);
+
+	SAL_Atomic_Store32(&lock->State, 0);
+	SAL_Atomic_Store32(&lock->WritersWaiting, 0);
+}
+
+/* marks @a lock as having parked threads and parks until its state moves from @a state */
+static void SAL_RWLock_Park(SAL_RWLock* lock, uint32 state) {
+	if (!(state & SAL_RWLock_Parked) && !SAL_Atomic_CompareExchange32(&lock->State, state, state | SAL_RWLock_Parked))
+		return;
+
+	SAL_Thread_WaitOnAddress(&lock->State, state | SAL_RWLock_Parked, -1);
+}
+
+/**
+ * Acquire @a lock for reading. Any number of readers can hold it at once, but
+ * new readers wait behind a writer that is waiting so writers are not starved.
+ *
+ * @param lock Lock to acquire
+ *
+ * @warning Not recursive: a thread that reads again while a writer waits
+ * deadlocks.
+ */
+void SAL_RWLock_AcquireRead(SAL_RWLock* lock) {
+	uint32 state;
+	uint32 i;
+
+	assert(lock != NULL);
+
+	for (i = 0; ; i++) {
+		state = SAL_Atomic_Load32(&lock->State);
+
+		if (!(state & SAL_RWLock_Writer) && SAL_Atomic_Load32(&lock->WritersWaiting) == 0) {
+			if (SAL_Atomic_CompareExchange32(&lock->State, state, state + 1))
+				return;
+
+			continue;
+		}
+
+		if (i < SAL_Lock_SpinCount) {
+			SAL_Atomic_Pause();
+		}
+		else if ((state & (SAL_RWLock_Writer | SAL_RWLock_Readers)) == 0) {
+			/* a waiting writer is about to take the free lock, parking now could miss its release */
+			SAL_Thread_Yield();
+		}
+		else {
+			SAL_RWLock_Park(lock, state);
+		}
+	}
+}
+
+/**
+ * Release @a lock after reading. The last reader out wakes parked threads.
+ *
+ * @param lock Lock to release, held for reading by the calling thread
+ */
+void SAL_RWLock_ReleaseRead(SAL_RWLock* lock) {
+	uint32 state;
+
+	assert(lock != NULL);
+
+	do {
+		state = SAL_Atomic_Load32(&lock->State);
+	} while (!SAL_Atomic_CompareExchange32(&lock->State, state, (state - 1) & ~((state & SAL_RWLock_Readers) == 1 ? SAL_RWLock_Parked : 0)));
+
+	if ((state & SAL_RWLock_Readers) == 1 && (state & SAL_RWLock_Parked))
+		SAL_Thread_WakeAddress(&lock->State, SAL_Thread_WakeAll);
+}
+
+/**
+ * Acquire @a lock for writing, waiting for readers and any other writer to
+ * leave.
+ *
+ * @param lock Lock to acquire
+ */
+void SAL_RWLock_AcquireWrite(SAL_RWLock* lock) {
+	uint32 state;
+	uint32 i;
+
+	assert(lock != NULL);
+
+	SAL_Atomic_Increment32(&lock->WritersWaiting);
+
+	for (i = 0; ; i++) {
+		state = SAL_Atomic_Load32(&lock->State);
+
+		if ((state & (SAL_RWLock_Writer | SAL_RWLock_Readers)) == 0) {
+			if (SAL_Atomic_CompareExchange32(&lock->State, state, state | SAL_RWLock_Writer))
+				break;
+
+			continue;
+		}
+
+		if (i < SAL_Lock_SpinCount)
+			SAL_Atomic_Pause();
+		else
+			SAL_RWLock_Park(lock, state);
+	}
+
+	SAL_Atomic_Decrement32(&lock->WritersWaiting);
+}
+
+/**
+ * Release @a lock after writing, waking every parked reader and writer.
+ *
+ * @param lock Lock to release, held for writing by the calling thread
+ */
+void SAL_RWLock_ReleaseWrite(SAL_RWLock* lock) {
+	assert(lock != NULL);
+
+	if (SAL_Atomic_Exchange32(&lock->State, 0) & SAL_RWLock_Parked)
+		SAL_Thread_WakeAddress(&lock->State, SAL_Thread_WakeAll);
+}
+
 /**
  * Create a new semaphore.
  *
@@ -171,10 +861,11 @@ void SAL_Mutex_Release(SAL_Mutex mutex) {
  */
 SAL_Semaphore SAL_Semaphore_Create(void) {
 #ifdef WINDOWS
-	return CreateSemaphore(NULL, 0, 4294967295, NULL);
+	return SAL_Semaphore_Initialize(NULL);
 #elif defined POSIX
-	sem_t *sem = Allocate(sem_t);
-	if (sem_init(sem, 0 /* shared between threads */, 0) != 0) {
+	sem_t *sem = SAL_Allocator_New(sem_t);
+	if (SAL_Semaphore_Initialize(sem) == NULL) {
+		SAL_Allocator_Free(sem);
 		return NULL;
 	}
 	return sem;
@@ -188,11 +879,44 @@ SAL_Semaphore SAL_Semaphore_Create(void) {
  * @warning Don't free a semaphor that is still in use (being waited on)
  */
 void SAL_Semaphore_Free(SAL_Semaphore semaphore) {
+	SAL_Semaphore_Destroy(semaphore);
+#ifdef POSIX
+	SAL_Allocator_Free(semaphore);
+#endif
+}
+
+/**
+ * Create a semaphore in @a storage instead of allocating one. On Windows the
+ * semaphore is a kernel handle and @a storage goes unused.
+ *
+ * @param storage Memory for the semaphore, which must stay in place until it
+ * is destroyed
+ * @returns a semaphore to be destroyed with @ref SAL_Semaphore_Destroy, not
+ * freed, or NULL on failure.
+ */
+SAL_Semaphore SAL_Semaphore_Initialize(SAL_Semaphore_Storage* storage) {
+#ifdef WINDOWS
+	return CreateSemaphore(NULL, 0, 4294967295, NULL);
+#elif defined POSIX
+	if (sem_init(storage, 0 /* shared between threads */, 0) != 0) {
+		return NULL;
+	}
+	return storage;
+#endif
+}
+
+/**
+ * Destroy @a semaphore from @ref SAL_Semaphore_Initialize, leaving its
+ * storage to the caller.
+ *
+ * @param semaphore to destroy
+ * @warning Don't destroy a semaphore that is still in use (being waited on)
+ */
+void SAL_Semaphore_Destroy(SAL_Semaphore semaphore) {
 #ifdef WINDOWS
 	CloseHandle(semaphore);
 #elif defined POSIX
 	sem_destroy(semaphore);
-	Free(semaphore);
 #endif
 }
 
@@ -223,3 +947,188 @@ void SAL_Semaphore_Increment(SAL_Semaphore semaphore) {
 	sem_post(semaphore);
 #endif
 }
+
+/**
+ * Decrement @a semaphore only if its count is above zero.
+ *
+ * @param semaphore to decrement
+ * @returns true if it was decremented, false if the count was zero.
+ */
+boolean SAL_Semaphore_TryDecrement(SAL_Semaphore semaphore) {
+#ifdef WINDOWS
+	return WaitForSingleObject(semaphore, 0) == WAIT_OBJECT_0;
+#elif defined POSIX
+	int result;
+
+	while ((result = sem_trywait(semaphore)) == -1 && errno == EINTR);
+
+	return result == 0;
+#endif
+}
+
+/**
+ * Decrement @a semaphore, waiting at most @a timeout ms for its count to rise
+ * above zero.
+ *
+ * @param semaphore to decrement
+ * @param timeout Longest time to wait, in milliseconds
+ * @returns true if it was decremented, false if the time ran out first.
+ */
+boolean SAL_Semaphore_DecrementTimeout(SAL_Semaphore semaphore, uint32 timeout) {
+#ifdef WINDOWS
+	return WaitForSingleObject(semaphore, timeout) == WAIT_OBJECT_0;
+#elif defined POSIX
+	struct timespec deadline;
+	int result;
+
+	/* sem_timedwait takes a wall clock deadline, a clock step shortens or stretches the wait */
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout / 1000;
+	deadline.tv_nsec += (long)(timeout % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	while ((result = sem_timedwait(semaphore, &deadline)) == -1 && errno == EINTR);
+
+	return result == 0;
+#endif
+}
+
+/**
+ * Increment @a semaphore by @a count, letting up to @a count waiting threads
+ * through.
+ *
+ * @param semaphore to increment
+ * @param count Amount to add
+ *
+ * @warning Windows does this in one call. POSIX semaphores only take one
+ * increment at a time, though each only enters the kernel if a thread is
+ * waiting; @ref SAL_FastSemaphore_Increment wakes them all in one call.
+ */
+void SAL_Semaphore_IncrementBy(SAL_Semaphore semaphore, uint32 count) {
+#ifdef WINDOWS
+	if (count > 0)
+		ReleaseSemaphore(semaphore, (LONG)count, NULL);
+#elif defined POSIX
+	uint32 i;
+
+	for (i = 0; i < count; i++)
+		sem_post(semaphore);
+#endif
+}
+
+/**
+ * Initialize a semaphore kept inside another structure.
+ *
+ * Unlike @ref SAL_Semaphore, it needs no allocation or freeing, and
+ * decrementing while the count is above zero and incrementing while no thread
+ * waits never enter the kernel. A zero-filled one starts with a count of 0.
+ *
+ * @param semaphore Semaphore to initialize
+ * @param count Initial count
+ */
+void SAL_FastSemaphore_Initialize(SAL_FastSemaphore* semaphore, uint32 count) {
+	assert(semaphore != NULL);
+
+	SAL_Atomic_Store32(&semaphore->Count, count);
+	SAL_Atomic_Store32(&semaphore->Waiters, 0);
+}
+
+/**
+ * Decrement @a semaphore only if its count is above zero.
+ *
+ * @param semaphore Semaphore to decrement
+ * @returns true if it was decremented, false if the count was zero.
+ */
+boolean SAL_FastSemaphore_TryDecrement(SAL_FastSemaphore* semaphore) {
+	uint32 count;
+
+	assert(semaphore != NULL);
+
+	while ((count = SAL_Atomic_Load32(&semaphore->Count)) > 0)
+		if (SAL_Atomic_CompareExchange32(&semaphore->Count, count, count - 1))
+			return true;
+
+	return false;
+}
+
+/* the decrement behind both waits: spins briefly, then parks until @a deadline (a SAL_Time_Monotonic time, negative for none) */
+static boolean SAL_FastSemaphore_Wait(SAL_FastSemaphore* semaphore, int64 deadline) {
+	boolean decremented = false;
+	int64 remaining;
+	uint32 i;
+
+	for (i = 0; i < SAL_Lock_SpinCount; i++) {
+		if (SAL_FastSemaphore_TryDecrement(semaphore))
+			return true;
+
+		SAL_Atomic_Pause();
+	}
+
+	/* announced before the count is checked again, so an increment either sees a waiter or leaves a count this thread will see */
+	SAL_Atomic_Increment32(&semaphore->Waiters);
+
+	while (!(decremented = SAL_FastSemaphore_TryDecrement(semaphore))) {
+		if (deadline < 0) {
+			remaining = -1;
+		}
+		else {
+			remaining = deadline - SAL_Time_Monotonic();
+			if (remaining <= 0)
+				break;
+		}
+
+		SAL_Thread_WaitOnAddress(&semaphore->Count, 0, (int32)remaining);
+	}
+
+	SAL_Atomic_Decrement32(&semaphore->Waiters);
+
+	return decremented;
+}
+
+/**
+ * Decrement @a semaphore, waiting for its count to rise above zero.
+ *
+ * @param semaphore Semaphore to decrement
+ */
+void SAL_FastSemaphore_Decrement(SAL_FastSemaphore* semaphore) {
+	assert(semaphore != NULL);
+
+	SAL_FastSemaphore_Wait(semaphore, -1);
+}
+
+/**
+ * Decrement @a semaphore, waiting at most @a timeout ms for its count to rise
+ * above zero. The wait is measured on the monotonic clock.
+ *
+ * @param semaphore Semaphore to decrement
+ * @param timeout Longest time to wait, in milliseconds, at most 2^31
+ * @returns true if it was decremented, false if the time ran out first.
+ */
+boolean SAL_FastSemaphore_DecrementTimeout(SAL_FastSemaphore* semaphore, uint32 timeout) {
+	assert(semaphore != NULL);
+
+	return SAL_FastSemaphore_Wait(semaphore, SAL_Time_Monotonic() + (timeout & 0x7FFFFFFF));
+}
+
+/**
+ * Increment @a semaphore by @a count, waking up to @a count waiting threads
+ * with a single call into the kernel, or none if no thread waits.
+ *
+ * @param semaphore Semaphore to increment
+ * @param count Amount to add
+ */
+void SAL_FastSemaphore_Increment(SAL_FastSemaphore* semaphore, uint32 count) {
+	assert(semaphore != NULL);
+
+	if (count == 0)
+		return;
+
+	SAL_Atomic_Add32(&semaphore->Count, count);
+	SAL_Atomic_Fence();
+
+	if (SAL_Atomic_Load32(&semaphore->Waiters) > 0)
+		SAL_Thread_WakeAddress(&semaphore->Count, count);
+}
@@ -9,6 +9,10 @@
 	typedef void* SAL_Thread;
 	typedef void* SAL_Mutex;
 	typedef void* SAL_Semaphore;
+
+	/* room for a CRITICAL_SECTION, or just the handle a semaphore is */
+	typedef struct { uint64 Opaque[5]; } SAL_Mutex_Storage;
+	typedef struct { void* Unused; } SAL_Semaphore_Storage;
 #elif defined POSIX
 	#include <pthread.h>
 	#include <semaphore.h>
@@ -19,22 +23,128 @@
 
 	typedef pthread_mutex_t* SAL_Mutex;
 	typedef sem_t* SAL_Semaphore;
+
+	typedef pthread_mutex_t SAL_Mutex_Storage;
+	typedef sem_t SAL_Semaphore_Storage;
 #endif
 
+#define SAL_Thread_MaxProcessors 256
+#define SAL_Thread_NameLength 16
+
+/* values of SAL_Thread_Attributes.Priority */
+#define SAL_Thread_Priorities_Lowest -2
+#define SAL_Thread_Priorities_Low -1
+#define SAL_Thread_Priorities_Normal 0
+#define SAL_Thread_Priorities_High 1
+#define SAL_Thread_Priorities_Highest 2
+
+/* how SAL_Thread_CreateWithAttributes sets up a thread, start from SAL_Thread_Attributes_Initialize */
+typedef struct {
+	uint64 Affinity[SAL_Thread_MaxProcessors / 64]; /* processors the thread may run on, none set for any */
+	int32 NumaNode; /* keeps the thread on this node's processors, -1 for any */
+	uint32 StackSize; /* in bytes, 0 for the system default */
+	int32 Priority; /* one of the SAL_Thread_Priorities values */
+	int8 Name[SAL_Thread_NameLength]; /* shown by debuggers and profilers, empty for none */
+} SAL_Thread_Attributes;
+
+/* a mutex kept inline in the structure it guards, unlocked when zero-filled */
+typedef struct {
+	uint32 State;
+} SAL_Lock;
+
+/* a reader-writer lock kept inline like SAL_Lock, unlocked when zero-filled */
+typedef struct {
+	uint32 State;
+	uint32 WritersWaiting;
+} SAL_RWLock;
+
+/* a counting semaphore kept inline that only enters the kernel when a thread has to sleep, see SAL_FastSemaphore_Initialize */
+typedef struct {
+	uint32 Count;
+	uint32 Waiters;
+} SAL_FastSemaphore;
+
+/* SAL_Lock.State: unlocked, locked, locked with threads parked on it */
+#define SAL_Lock_Unlocked 0
+#define SAL_Lock_Locked 1
+#define SAL_Lock_Contended 2
+
+#define SAL_Lock_Initializer { 0 }
+#define SAL_RWLock_Initializer { 0, 0 }
+
 public SAL_Thread SAL_Thread_Create(SAL_Thread_StartAddress startAddress, void* startParameter);
+public SAL_Thread SAL_Thread_CreateWithAttributes(SAL_Thread_StartAddress startAddress, void* startParameter, const SAL_Thread_Attributes* attributes);
 public uint64 SAL_Thread_Join(SAL_Thread thread);
 public void SAL_Thread_Yield(void);
 public void SAL_Thread_Sleep(uint32 duration);
 public void SAL_Thread_Exit(uint32 exitCode);
+public uint32 SAL_Thread_ProcessorCount(void);
+
+public void SAL_Thread_Attributes_Initialize(SAL_Thread_Attributes* attributes);
+public void SAL_Thread_Attributes_AddProcessor(SAL_Thread_Attributes* attributes, uint32 processor);
+public void SAL_Thread_Attributes_Spread(const SAL_Thread_Attributes* source, uint32 index, SAL_Thread_Attributes* target);
 
 public SAL_Mutex SAL_Mutex_Create(void);
 public uint8 SAL_Mutex_Free(SAL_Mutex mutex);
+public SAL_Mutex SAL_Mutex_Initialize(SAL_Mutex_Storage* storage);
+public uint8 SAL_Mutex_Destroy(SAL_Mutex mutex);
 public void SAL_Mutex_Acquire(SAL_Mutex mutex);
 public void SAL_Mutex_Release(SAL_Mutex mutex);
 
+public void SAL_Lock_Initialize(SAL_Lock* lock);
+public void SAL_Lock_Acquire(SAL_Lock* lock);
+public boolean SAL_Lock_TryAcquire(SAL_Lock* lock);
+public void SAL_Lock_Release(SAL_Lock* lock);
+
+public void SAL_RWLock_Initialize(SAL_RWLock* lock);
+public void SAL_RWLock_AcquireRead(SAL_RWLock* lock);
+public void SAL_RWLock_ReleaseRead(SAL_RWLock* lock);
+public void SAL_RWLock_AcquireWrite(SAL_RWLock* lock);
+public void SAL_RWLock_ReleaseWrite(SAL_RWLock* lock);
+
 public SAL_Semaphore SAL_Semaphore_Create(void);
 public void SAL_Semaphore_Free(SAL_Semaphore Semaphore);
+public SAL_Semaphore SAL_Semaphore_Initialize(SAL_Semaphore_Storage* storage);
+public void SAL_Semaphore_Destroy(SAL_Semaphore semaphore);
 public void SAL_Semaphore_Decrement(SAL_Semaphore Semaphore);
 public void SAL_Semaphore_Increment(SAL_Semaphore Semaphore);
+public boolean SAL_Semaphore_TryDecrement(SAL_Semaphore semaphore);
+public boolean SAL_Semaphore_DecrementTimeout(SAL_Semaphore semaphore, uint32 timeout);
+public void SAL_Semaphore_IncrementBy(SAL_Semaphore semaphore, uint32 count);
+
+public void SAL_FastSemaphore_Initialize(SAL_FastSemaphore* semaphore, uint32 count);
+public void SAL_FastSemaphore_Decrement(SAL_FastSemaphore* semaphore);
+public boolean SAL_FastSemaphore_TryDecrement(SAL_FastSemaphore* semaphore);
+public boolean SAL_FastSemaphore_DecrementTimeout(SAL_FastSemaphore* semaphore, uint32 timeout);
+public void SAL_FastSemaphore_Increment(SAL_FastSemaphore* semaphore, uint32 count);
+
+#ifndef SAL_NoInline
+	#include "Atomic.h"
+
+	/* an uncontended lock is taken and released right here, the exported functions only run once it is contended */
+	static __inline void SAL_Lock_AcquireInline(SAL_Lock* lock) {
+		if (!SAL_Atomic_CompareExchange32(&lock->State, SAL_Lock_Unlocked, SAL_Lock_Locked))
+			SAL_Lock_Acquire(lock);
+	}
+
+	static __inline boolean SAL_Lock_TryAcquireInline(SAL_Lock* lock) {
+		return SAL_Atomic_CompareExchange32(&lock->State, SAL_Lock_Unlocked, SAL_Lock_Locked);
+	}
+
+	/* still locked rather than contended means nobody is parked to be woken */
+	static __inline void SAL_Lock_ReleaseInline(SAL_Lock* lock) {
+		if (!SAL_Atomic_CompareExchange32(&lock->State, SAL_Lock_Locked, SAL_Lock_Unlocked))
+			SAL_Lock_Release(lock);
+	}
+
+	#define SAL_Lock_Acquire(lock) SAL_Lock_AcquireInline(lock)
+	#define SAL_Lock_TryAcquire(lock) SAL_Lock_TryAcquireInline(lock)
+	#define SAL_Lock_Release(lock) SAL_Lock_ReleaseInline(lock)
+
+	#ifdef POSIX
+		#define SAL_Mutex_Acquire(mutex) ((void)pthread_mutex_lock(mutex))
+		#define SAL_Mutex_Release(mutex) ((void)pthread_mutex_unlock(mutex))
+	#endif
+#endif
 
 #endif
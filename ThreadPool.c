@@ -0,0 +1,433 @@
+/** vim: set noet ci pi sts=0 sw=4 ts=4
+ * @file ThreadPool.c
+ * @brief A pool of worker threads that balance work by stealing it.
+ *
+ * Every worker runs tasks from its own Chase-Lev deque: it pushes and takes at
+ * the bottom without contention while idle workers steal from the top. Tasks
+ * submitted from outside the pool land on a shared lock-free stack that the
+ * first worker to look takes in one go, spreading the batch through its deque
+ * for the others to steal. Workers that find nothing anywhere search a few
+ * more times and then park on a semaphore until new work is submitted.
+ */
+
+#include "ThreadPool.h"
+
+#include <string.h>
+
+#include "Allocator.h"
+#include "Atomic.h"
+#include "Thread.h"
+
+/* tasks each worker's deque holds, a power of two */
+#define SAL_ThreadPool_DequeSize 1024
+
+/* searches an idle worker makes, yielding between them, before it parks */
+#define SAL_ThreadPool_SpinRounds 32
+
+#define SAL_ThreadPool_MaxWorkers 256
+#define SAL_ThreadPool_CacheLine 64
+
+typedef struct SAL_ThreadPool_Worker SAL_ThreadPool_Worker;
+
+/* Top and Bottom only ever grow, so Bottom - Top is the number of tasks in the deque. Top is moved by thieves, Bottom only by the owner, so they sit on separate lines. */
+struct SAL_ThreadPool_Worker {
+	uint32 Top;
+	uint8 Padding[SAL_ThreadPool_CacheLine - sizeof(uint32)];
+	uint32 Bottom;
+	uint32 Seed; /* picks the first victim to steal from */
+	SAL_ThreadPool* Pool;
+	SAL_Thread Thread;
+	SAL_ThreadPool_Task* Slots[SAL_ThreadPool_DequeSize];
+};
+
+struct SAL_ThreadPool {
+	SAL_ThreadPool_Worker** Workers;
+	uint32 WorkerCount;
+	SAL_ThreadPool_Task* Injected; /* tasks submitted from outside the pool, newest first */
+	uint32 Idle; /* workers that announced they are about to park and were not woken yet */
+	uint32 Running;
+	SAL_Semaphore Parked;
+};
+
+/* the worker whose thread this is, NULL on every other thread */
+static SAL_ThreadLocal SAL_ThreadPool_Worker* currentWorker = NULL;
+
+static SAL_Thread_Start(SAL_ThreadPool_Run);
+
+/* adds @a task at the bottom of the calling worker's own deque, false if it is full */
+static boolean SAL_ThreadPool_Push(SAL_ThreadPool_Worker* worker, SAL_ThreadPool_Task* task) {
+	uint32 bottom = worker->Bottom;
+	uint32 top = SAL_Atomic_Load32(&worker->Top);
+
+	if (bottom - top >= SAL_ThreadPool_DequeSize)
+		return false;
+
+	SAL_Atomic_StorePointer(&worker->Slots[bottom & (SAL_ThreadPool_DequeSize - 1)], task);
+
+	/* the release store publishes the slot to thieves */
+	SAL_Atomic_Store32(&worker->Bottom, bottom + 1);
+
+	return true;
+}
+
+/* takes the newest task from the calling worker's own deque, racing thieves only for the last one */
+static SAL_ThreadPool_Task* SAL_ThreadPool_Take(SAL_ThreadPool_Worker* worker) {
+	SAL_ThreadPool_Task* task;
+	uint32 bottom = worker->Bottom - 1;
+	uint32 top;
+
+	/* claim the slot before looking at Top, a thief reading Bottom after this will not take it */
+	SAL_Atomic_Store32(&worker->Bottom, bottom);
+	SAL_Atomic_Fence();
+	top = SAL_Atomic_Load32(&worker->Top);
+
+	if ((int32)(bottom - top) < 0) {
+		SAL_Atomic_Store32(&worker->Bottom, top);
+		return NULL;
+	}
+
+	task = (SAL_ThreadPool_Task*)SAL_Atomic_LoadPointer(&worker->Slots[bottom & (SAL_ThreadPool_DequeSize - 1)]);
+
+	if (bottom == top) {
+		if (!SAL_Atomic_CompareExchange32(&worker->Top, top, top + 1))
+			task = NULL;
+
+		SAL_Atomic_Store32(&worker->Bottom, top + 1);
+	}
+
+	return task;
+}
+
+/* takes the oldest task from @a victim's deque. Only a lost race makes it try again, and that means another thread got a task. */
+static SAL_ThreadPool_Task* SAL_ThreadPool_Steal(SAL_ThreadPool_Worker* victim) {
+	SAL_ThreadPool_Task* task;
+	uint32 bottom;
+	uint32 top;
+
+	while (true) {
+		top = SAL_Atomic_Load32(&victim->Top);
+		SAL_Atomic_Fence();
+		bottom = SAL_Atomic_Load32(&victim->Bottom);
+
+		if ((int32)(bottom - top) <= 0)
+			return NULL;
+
+		task = (SAL_ThreadPool_Task*)SAL_Atomic_LoadPointer(&victim->Slots[top & (SAL_ThreadPool_DequeSize - 1)]);
+
+		if (SAL_Atomic_CompareExchange32(&victim->Top, top, top + 1))
+			return task;
+	}
+}
+
+/* pushes the chain from @a first to @a last onto the shared stack in one step */
+static void SAL_ThreadPool_Inject(SAL_ThreadPool* pool, SAL_ThreadPool_Task* first, SAL_ThreadPool_Task* last) {
+	SAL_ThreadPool_Task* head;
+
+	do {
+		head = (SAL_ThreadPool_Task*)SAL_Atomic_LoadPointer(&pool->Injected);
+		last->Next = head;
+	} while (!SAL_Atomic_CompareExchangePointer(&pool->Injected, head, first));
+}
+
+/* unparks one worker if any announced they were parking. The fence orders the task just queued before the read of Idle, pairing with the one a parking worker makes between announcing and its last search. */
+static void SAL_ThreadPool_Wake(SAL_ThreadPool* pool) {
+	uint32 idle;
+
+	SAL_Atomic_Fence();
+
+	do {
+		idle = SAL_Atomic_Load32(&pool->Idle);
+		if (idle == 0)
+			return;
+	} while (!SAL_Atomic_CompareExchange32(&pool->Idle, idle, idle - 1));
+
+	SAL_Semaphore_Increment(pool->Parked);
+}
+
+/* takes everything submitted from outside, oldest first: the first task is returned, the rest go into @a worker's deque for others to steal */
+static SAL_ThreadPool_Task* SAL_ThreadPool_TakeInjected(SAL_ThreadPool_Worker* worker) {
+	SAL_ThreadPool* pool = worker->Pool;
+	SAL_ThreadPool_Task* tasks;
+	SAL_ThreadPool_Task* ordered = NULL;
+	SAL_ThreadPool_Task* task;
+	SAL_ThreadPool_Task* last;
+	boolean pushed = false;
+
+	if (SAL_Atomic_LoadPointer(&pool->Injected) == NULL)
+		return NULL;
+
+	tasks = (SAL_ThreadPool_Task*)SAL_Atomic_ExchangePointer(&pool->Injected, NULL);
+
+	while (tasks != NULL) {
+		task = tasks;
+		tasks = task->Next;
+		task->Next = ordered;
+		ordered = task;
+	}
+
+	if (ordered == NULL)
+		return NULL;
+
+	task = ordered;
+	ordered = ordered->Next;
+
+	while (ordered != NULL && SAL_ThreadPool_Push(worker, ordered)) {
+		ordered = ordered->Next;
+		pushed = true;
+	}
+
+	/* whatever did not fit goes back for the next worker to look */
+	if (ordered != NULL) {
+		for (last = ordered; last->Next != NULL; last = last->Next)
+			;
+
+		SAL_ThreadPool_Inject(pool, ordered, last);
+	}
+
+	if (pushed)
+		SAL_ThreadPool_Wake(pool);
+
+	return task;
+}
+
+/* one pass over every place work can be: the worker's own deque, the shared stack, then the other workers starting from a random one */
+static SAL_ThreadPool_Task* SAL_ThreadPool_Find(SAL_ThreadPool_Worker* worker) {
+	SAL_ThreadPool* pool = worker->Pool;
+	SAL_ThreadPool_Worker* victim;
+	SAL_ThreadPool_Task* task;
+	uint32 start;
+	uint32 i;
+
+	task = SAL_ThreadPool_Take(worker);
+	if (task != NULL)
+		return task;
+
+	task = SAL_ThreadPool_TakeInjected(worker);
+	if (task != NULL)
+		return task;
+
+	/* xorshift, so thieves do not all line up behind the same victim */
+	worker->Seed ^= worker->Seed << 13;
+	worker->Seed ^= worker->Seed >> 17;
+	worker->Seed ^= worker->Seed << 5;
+	start = worker->Seed % pool->WorkerCount;
+
+	for (i = 0; i < pool->WorkerCount; i++) {
+		victim = pool->Workers[(start + i) % pool->WorkerCount];
+		if (victim == worker)
+			continue;
+
+		task = SAL_ThreadPool_Steal(victim);
+		if (task != NULL)
+			return task;
+	}
+
+	return NULL;
+}
+
+static SAL_Thread_Start(SAL_ThreadPool_Run) {
+	SAL_ThreadPool_Worker* worker = (SAL_ThreadPool_Worker*)startupArgument;
+	SAL_ThreadPool* pool = worker->Pool;
+	SAL_ThreadPool_Task* task;
+	uint32 round;
+	uint32 idle;
+
+	currentWorker = worker;
+
+	while (true) {
+		task = SAL_ThreadPool_Find(worker);
+
+		for (round = 0; task == NULL && round < SAL_ThreadPool_SpinRounds && SAL_Atomic_Load32(&pool->Running); round++) {
+			SAL_Thread_Yield();
+			task = SAL_ThreadPool_Find(worker);
+		}
+
+		if (task == NULL) {
+			/* announce the park before the last search so a submitter either sees Idle or its task is found here */
+			SAL_Atomic_Increment32(&pool->Idle);
+			SAL_Atomic_Fence();
+
+			task = SAL_ThreadPool_Find(worker);
+
+			if (task != NULL) {
+				/* if a submitter already took the announcement, its extra wake-up only costs some parked worker one more search */
+				do {
+					idle = SAL_Atomic_Load32(&pool->Idle);
+				} while (idle > 0 && !SAL_Atomic_CompareExchange32(&pool->Idle, idle, idle - 1));
+			}
+			else if (!SAL_Atomic_Load32(&pool->Running)) {
+				break;
+			}
+			else {
+				SAL_Semaphore_Decrement(pool->Parked);
+				continue;
+			}
+		}
+
+		task->Callback(task);
+	}
+
+	return 0;
+}
+
+/* whether @a thread was created, the thread functions return a zeroed id when they fail */
+static boolean SAL_ThreadPool_Started(SAL_Thread thread) {
+	SAL_Thread none;
+
+	memset(&none, 0, sizeof(SAL_Thread));
+
+	return memcmp(&thread, &none, sizeof(SAL_Thread)) != 0;
+}
+
+/* stops the first @a started workers of @a pool, then frees the pool and every worker in it */
+static void SAL_ThreadPool_Stop(SAL_ThreadPool* pool, uint32 started) {
+	uint32 i;
+
+	SAL_Atomic_Store32(&pool->Running, 0);
+
+	/* more wake-ups than parked workers is harmless, each one searches once more and sees the pool stopping */
+	for (i = 0; i < started; i++)
+		SAL_Semaphore_Increment(pool->Parked);
+
+	for (i = 0; i < started; i++)
+		SAL_Thread_Join(pool->Workers[i]->Thread);
+
+	for (i = 0; i < pool->WorkerCount; i++)
+		SAL_Allocator_Free(pool->Workers[i]);
+
+	SAL_Semaphore_Free(pool->Parked);
+	SAL_Allocator_Free(pool->Workers);
+	SAL_Allocator_Free(pool);
+}
+
+/**
+ * Create a pool of worker threads.
+ *
+ * @param workers Number of worker threads, 0 for one per processor
+ * @returns the new pool, or NULL if the workers could not be created.
+ */
+SAL_ThreadPool* SAL_ThreadPool_Create(uint32 workers) {
+	return SAL_ThreadPool_CreateWithAttributes(workers, NULL, false);
+}
+
+/**
+ * Create a pool of worker threads set up by @a attributes. With @a spread
+ * and default attributes this is one worker pinned to each processor; with a
+ * NUMA node set in @a attributes, one per processor of that node.
+ *
+ * @param workers Number of worker threads, 0 for one per processor
+ * @param attributes How to create every worker, or NULL for plain threads
+ * @param spread Whether to pin worker i alone to the i th processor
+ * @a attributes allows (see @ref SAL_Thread_Attributes_Spread)
+ * @returns the new pool, or NULL if the workers could not be created.
+ */
+SAL_ThreadPool* SAL_ThreadPool_CreateWithAttributes(uint32 workers, const SAL_Thread_Attributes* attributes, boolean spread) {
+	SAL_ThreadPool* pool;
+	SAL_ThreadPool_Worker* worker;
+	SAL_Thread_Attributes workerAttributes;
+	uint32 i;
+
+	if (workers == 0)
+		workers = SAL_Thread_ProcessorCount();
+
+	if (workers > SAL_ThreadPool_MaxWorkers)
+		workers = SAL_ThreadPool_MaxWorkers;
+
+	pool = SAL_Allocator_New(SAL_ThreadPool);
+	pool->Parked = SAL_Semaphore_Create();
+	if (pool->Parked == NULL) {
+		SAL_Allocator_Free(pool);
+		return NULL;
+	}
+
+	pool->Workers = SAL_Allocator_NewArray(SAL_ThreadPool_Worker*, workers);
+	pool->WorkerCount = workers;
+	pool->Injected = NULL;
+	pool->Idle = 0;
+	pool->Running = 1;
+
+	/* every worker exists before any runs, thieves index the whole array */
+	for (i = 0; i < workers; i++) {
+		worker = SAL_Allocator_New(SAL_ThreadPool_Worker);
+		worker->Top = 0;
+		worker->Bottom = 0;
+		worker->Seed = 2654435761U * (i + 1);
+		worker->Pool = pool;
+		pool->Workers[i] = worker;
+	}
+
+	for (i = 0; i < workers; i++) {
+		if (attributes == NULL) {
+			pool->Workers[i]->Thread = SAL_Thread_Create(SAL_ThreadPool_Run, pool->Workers[i]);
+		}
+		else {
+			if (spread)
+				SAL_Thread_Attributes_Spread(attributes, i, &workerAttributes);
+			else
+				workerAttributes = *attributes;
+
+			pool->Workers[i]->Thread = SAL_Thread_CreateWithAttributes(SAL_ThreadPool_Run, pool->Workers[i], &workerAttributes);
+		}
+
+		/* a pool short of workers would leave the work meant for them to the rest, so it is all or nothing */
+		if (!SAL_ThreadPool_Started(pool->Workers[i]->Thread)) {
+			SAL_ThreadPool_Stop(pool, i);
+			return NULL;
+		}
+	}
+
+	return pool;
+}
+
+/**
+ * Stop and free @a pool. Tasks already submitted are run first, including
+ * tasks they submit in turn.
+ *
+ * @param pool Pool to free
+ *
+ * @warning Must not be called from one of the pool's own tasks, and nothing
+ * may be submitted from other threads once this is called.
+ */
+void SAL_ThreadPool_Free(SAL_ThreadPool* pool) {
+	assert(pool != NULL);
+	assert(currentWorker == NULL || currentWorker->Pool != pool);
+
+	SAL_ThreadPool_Stop(pool, pool->WorkerCount);
+}
+
+/**
+ * Run @a callback with @a task on one of the pool's workers.
+ *
+ * @a task is usually a member of a larger structure holding the work's state,
+ * which the callback recovers from the task's address, so submitting never
+ * allocates. A task submitted by one of the pool's own workers goes to the
+ * bottom of that worker's deque and runs there unless an idle worker steals
+ * it first.
+ *
+ * @param pool Pool to run the task on
+ * @param task Task to run, untouched by the caller until its callback starts
+ * @param callback Function to run, passed @a task
+ */
+void SAL_ThreadPool_Submit(SAL_ThreadPool* pool, SAL_ThreadPool_Task* task, SAL_ThreadPool_Callback callback) {
+	SAL_ThreadPool_Worker* worker = currentWorker;
+
+	assert(pool != NULL);
+	assert(task != NULL);
+	assert(callback != NULL);
+
+	task->Callback = callback;
+
+	if (worker == NULL || worker->Pool != pool || !SAL_ThreadPool_Push(worker, task))
+		SAL_ThreadPool_Inject(pool, task, task);
+
+	SAL_ThreadPool_Wake(pool);
+}
+
+/**
+ * @returns the number of worker threads in @a pool.
+ */
+uint32 SAL_ThreadPool_GetWorkerCount(SAL_ThreadPool* pool) {
+	assert(pool != NULL);
+
+	return pool->WorkerCount;
+}
@@ -0,0 +1,24 @@
+#ifndef INCLUDE_SAL_THREADPOOL
+#define INCLUDE_SAL_THREADPOOL
+
+#include "Common.h"
+#include "Thread.h"
+
+typedef struct SAL_ThreadPool SAL_ThreadPool;
+typedef struct SAL_ThreadPool_Task SAL_ThreadPool_Task;
+
+typedef void (*SAL_ThreadPool_Callback)(SAL_ThreadPool_Task* task);
+
+/* a unit of work, embedded in the caller's own structure so submitting it allocates nothing */
+struct SAL_ThreadPool_Task {
+	SAL_ThreadPool_Callback Callback;
+	SAL_ThreadPool_Task* Next; /* owned by the pool while the task is queued */
+};
+
+public SAL_ThreadPool* SAL_ThreadPool_Create(uint32 workers);
+public SAL_ThreadPool* SAL_ThreadPool_CreateWithAttributes(uint32 workers, const SAL_Thread_Attributes* attributes, boolean spread);
+public void SAL_ThreadPool_Free(SAL_ThreadPool* pool);
+public void SAL_ThreadPool_Submit(SAL_ThreadPool* pool, SAL_ThreadPool_Task* task, SAL_ThreadPool_Callback callback);
+public uint32 SAL_ThreadPool_GetWorkerCount(SAL_ThreadPool* pool);
+
+#endif
@@ -5,13 +5,44 @@
 
 #include "Time.h"
 
+/* the exported version of what Time.h inlines */
+#undef SAL_Time_MonotonicCoarse
+
+#include <string.h>
+#include "Atomic.h"
+#include "Thread.h"
+
 #ifdef WINDOWS
 	#define WIN32_LEAN_AND_MEAN
 	#include <Windows.h>
+	#include <intrin.h>
 #elif defined POSIX
 	#include <sys/time.h>
+	#include <time.h>
+
+	#if defined __x86_64__ || defined __i386__
+		#include <cpuid.h>
+	#endif
 #endif
 
+/* how often the coarse clock's tick thread advances it, in ms */
+#define SAL_Time_CoarseInterval 1
+
+/* how long the cycle counter is timed against the monotonic clock to find its rate, in ns */
+#define SAL_Time_CalibrationPeriod 2000000
+
+/* guards for the one-time setups below: not started, in progress, done */
+#define SAL_Time_Unstarted 0
+#define SAL_Time_Starting 1
+#define SAL_Time_Started 2
+
+int64 SAL_Time_CoarseNow = 0;
+static uint32 coarseState = SAL_Time_Unstarted;
+
+static uint32 cyclesState = SAL_Time_Unstarted;
+static boolean cyclesHardware = false; /* false until calibrated, and where there is no usable counter */
+static uint64 cyclesScale = (uint64)1 << 32; /* ns per cycle, as a 32.32 fixed point number */
+
 /**
  * @returns the current time in ms since Jan 1, 1970.
  *
@@ -45,3 +76,228 @@ int64 SAL_Time_Now(void) {
 	return result;
 #endif
 }
+
+/**
+ * @returns a time in ms that only ever moves forward, unaffected by changes to
+ * the wall clock. Only differences between two results are meaningful.
+ */
+int64 SAL_Time_Monotonic(void) {
+#ifdef WINDOWS
+	return (int64)GetTickCount64();
+#elif defined POSIX
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (int64)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+#endif
+}
+
+/**
+ * @returns a time in ns that only ever moves forward, for timing intervals too
+ * short to see with @ref SAL_Time_Monotonic. Only differences between two
+ * results are meaningful.
+ */
+int64 SAL_Time_MonotonicNanoseconds(void) {
+#ifdef WINDOWS
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER now;
+
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+
+	QueryPerformanceCounter(&now);
+
+	/* split to keep the multiplication from overflowing after a few days of uptime */
+	return (now.QuadPart / frequency.QuadPart) * 1000000000 + (now.QuadPart % frequency.QuadPart) * 1000000000 / frequency.QuadPart;
+#elif defined POSIX
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (int64)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+/* advances SAL_Time_CoarseNow for as long as the process runs */
+static SAL_Thread_Start(SAL_Time_CoarseTick) {
+	(void)startupArgument;
+
+	while (true) {
+		SAL_Atomic_Store64(&SAL_Time_CoarseNow, SAL_Time_Monotonic());
+		SAL_Thread_Sleep(SAL_Time_CoarseInterval);
+	}
+
+	return 0;
+}
+
+/**
+ * @returns the same time as @ref SAL_Time_Monotonic, read from a copy a
+ * background thread refreshes every millisecond. Each call is a single load,
+ * for code that takes timestamps millions of times a second and can live
+ * with them lagging by up to a tick.
+ *
+ * @warning The first call starts the background thread, which then runs
+ * until the process exits. On Windows the system timer resolution can make
+ * the tick as coarse as 16 ms.
+ */
+int64 SAL_Time_MonotonicCoarse(void) {
+	SAL_Thread_Attributes attributes;
+	uint32 state = SAL_Atomic_Load32(&coarseState);
+
+	if (state == SAL_Time_Started)
+		return (int64)SAL_Atomic_Load64(&SAL_Time_CoarseNow);
+
+	if (state == SAL_Time_Unstarted && SAL_Atomic_CompareExchange32(&coarseState, SAL_Time_Unstarted, SAL_Time_Starting)) {
+		SAL_Atomic_Store64(&SAL_Time_CoarseNow, SAL_Time_Monotonic());
+
+		SAL_Thread_Attributes_Initialize(&attributes);
+		strcpy(attributes.Name, "sal-clock");
+		SAL_Thread_CreateWithAttributes(SAL_Time_CoarseTick, NULL, &attributes);
+
+		SAL_Atomic_Store32(&coarseState, SAL_Time_Started);
+	}
+
+	/* the clock is being started on another thread */
+	return SAL_Time_Monotonic();
+}
+
+/* the raw hardware counter, 0 where there is none */
+static uint64 SAL_Time_ReadCounter(void) {
+#if defined _MSC_VER && (defined _M_X64 || defined _M_IX86)
+	return __rdtsc();
+#elif defined __x86_64__ || defined __i386__
+	return __builtin_ia32_rdtsc();
+#elif defined __aarch64__
+	uint64 value;
+
+	__asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(value));
+
+	return value;
+#else
+	return 0;
+#endif
+}
+
+/* whether the counter runs at one rate on every core and through power states, so it can be read like a clock */
+static boolean SAL_Time_CounterIsStable(void) {
+#if defined _MSC_VER && (defined _M_X64 || defined _M_IX86)
+	int registers[4];
+
+	__cpuid(registers, 0x80000000);
+	if ((uint32)registers[0] < 0x80000007)
+		return false;
+
+	__cpuid(registers, 0x80000007);
+
+	return (registers[3] & (1 << 8)) != 0;
+#elif defined __x86_64__ || defined __i386__
+	unsigned int eax, ebx, ecx, edx;
+
+	/* the invariant TSC flag */
+	if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0)
+		return false;
+
+	return (edx & (1 << 8)) != 0;
+#elif defined __aarch64__
+	/* the generic timer is architecturally constant-rate */
+	return true;
+#else
+	return false;
+#endif
+}
+
+/* times the counter against the monotonic clock, or leaves the nanosecond fallback in place */
+static void SAL_Time_Calibrate(void) {
+	uint64 startCycles;
+	uint64 endCycles;
+	int64 startTime;
+	int64 endTime;
+
+	if (!SAL_Time_CounterIsStable())
+		return;
+
+	startTime = SAL_Time_MonotonicNanoseconds();
+	startCycles = SAL_Time_ReadCounter();
+
+	do {
+		endTime = SAL_Time_MonotonicNanoseconds();
+		endCycles = SAL_Time_ReadCounter();
+	} while (endTime - startTime < SAL_Time_CalibrationPeriod);
+
+	if (endCycles <= startCycles)
+		return;
+
+	cyclesScale = ((uint64)(endTime - startTime) << 32) / (endCycles - startCycles);
+	cyclesHardware = cyclesScale != 0;
+
+	if (!cyclesHardware)
+		cyclesScale = (uint64)1 << 32;
+}
+
+/**
+ * @returns a timestamp in processor cycles, read straight from the cycle
+ * counter (rdtsc on x86, cntvct on ARM64) without entering the kernel. Only
+ * differences between two results are meaningful; turn them into ns with
+ * @ref SAL_Time_CyclesToNanoseconds.
+ *
+ * Where the counter is missing or its rate varies, the result is in ns from
+ * @ref SAL_Time_MonotonicNanoseconds instead, which the conversion also
+ * handles.
+ *
+ * @warning The first call spends about 2 ms measuring the counter's rate.
+ */
+int64 SAL_Time_Cycles(void) {
+	if (SAL_Atomic_Load32(&cyclesState) != SAL_Time_Started) {
+		if (SAL_Atomic_CompareExchange32(&cyclesState, SAL_Time_Unstarted, SAL_Time_Starting)) {
+			SAL_Time_Calibrate();
+			SAL_Atomic_Store32(&cyclesState, SAL_Time_Started);
+		}
+		else {
+			while (SAL_Atomic_Load32(&cyclesState) != SAL_Time_Started)
+				SAL_Thread_Yield();
+		}
+	}
+
+	return cyclesHardware ? (int64)SAL_Time_ReadCounter() : SAL_Time_MonotonicNanoseconds();
+}
+
+/* the full 128 bit product of @a a and @a b: the low half is returned, the high half stored in @a high */
+static uint64 SAL_Time_Multiply64(uint64 a, uint64 b, uint64* high) {
+#if defined __SIZEOF_INT128__
+	unsigned __int128 product = (unsigned __int128)a * b;
+
+	*high = (uint64)(product >> 64);
+
+	return (uint64)product;
+#elif defined _MSC_VER && defined _M_X64
+	return _umul128(a, b, high);
+#else
+	uint64 lowLow = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+	uint64 highLow = (a >> 32) * (b & 0xFFFFFFFF);
+	uint64 lowHigh = (a & 0xFFFFFFFF) * (b >> 32);
+	uint64 highHigh = (a >> 32) * (b >> 32);
+	uint64 middle = (lowLow >> 32) + (highLow & 0xFFFFFFFF) + lowHigh;
+
+	*high = highHigh + (highLow >> 32) + (middle >> 32);
+
+	return (middle << 32) | (lowLow & 0xFFFFFFFF);
+#endif
+}
+
+/**
+ * @param cycles A difference between two @ref SAL_Time_Cycles results
+ * @returns @a cycles in ns.
+ */
+int64 SAL_Time_CyclesToNanoseconds(int64 cycles) {
+	uint64 magnitude = (uint64)(cycles < 0 ? -cycles : cycles);
+	uint64 result;
+	uint64 high;
+	uint64 low;
+
+	/* the scale passes 2^32 on counters slower than 1 GHz, so the product needs all 128 bits before dropping the fraction */
+	low = SAL_Time_Multiply64(magnitude, cyclesScale, &high);
+	result = (high << 32) | (low >> 32);
+
+	return cycles < 0 ? -(int64)result : (int64)result;
+}
@@ -4,5 +4,26 @@
 #include "Common.h"
 
 public int64 SAL_Time_Now(void);
+public int64 SAL_Time_Monotonic(void);
+public int64 SAL_Time_MonotonicNanoseconds(void);
+public int64 SAL_Time_MonotonicCoarse(void);
+public int64 SAL_Time_Cycles(void);
+public int64 SAL_Time_CyclesToNanoseconds(int64 cycles);
+
+/* what SAL_Time_MonotonicCoarse returns once its clock runs, 0 before */
+public extern int64 SAL_Time_CoarseNow;
+
+/* a DLL's data cannot be read without importing it, so Windows reads the clock inline only from the static library */
+#if !defined SAL_NoInline && (!defined WINDOWS || defined SAL_Static)
+	#include "Atomic.h"
+
+	static __inline int64 SAL_Time_MonotonicCoarseInline(void) {
+		int64 now = (int64)SAL_Atomic_Load64(&SAL_Time_CoarseNow);
+
+		return now != 0 ? now : SAL_Time_MonotonicCoarse();
+	}
+
+	#define SAL_Time_MonotonicCoarse() SAL_Time_MonotonicCoarseInline()
+#endif
 
 #endif